@@ -0,0 +1,500 @@
+#include "http.h"
+
+#include <sqlite3.h>
+
+#include "bench.h"
+
+SQLITE_EXTENSION_INIT3
+
+int sqlite3_http_init(sqlite3*, char**, const sqlite3_api_routines*);
+
+// Microbenchmarks of header parsing and lookups. Every corpus is measured
+// through the C API and through SQL run with sqlite3_exec(), and a baseline
+// statement that only scans the corpus table, so that the cost of the parser
+// and of the SQLite calls around it can be told apart.
+//
+//   b_headers [--min-time-ms N] [--filter TEXT]
+//
+// A benchmark runs whole passes over the variants of a corpus until it has
+// taken at least the minimum time.
+
+// Variants of every corpus differ in a leading X-Variant header, so that
+// lookups cannot be answered from the index of the previous row.
+#define BENCH_VARIANTS 256
+
+// Chunk size of the incremental parser benchmark, about what a socket read
+// delivers to the curl header callback.
+#define BENCH_PARSER_CHUNK 512
+
+typedef struct bench_corpus bench_corpus;
+struct bench_corpus {
+    const char* zName;
+    // Name of a header in the corpus that http_headers_get looks up.
+    const char* zLookup;
+    const char* zHeaders;
+};
+
+static const bench_corpus aCorpora[] = {
+    {"cdn",
+     "x-cache",
+     "Content-Type: text/html; charset=utf-8\r\n"
+     "Content-Length: 48213\r\n"
+     "Connection: keep-alive\r\n"
+     "Date: Fri, 16 Oct 2026 09:12:44 GMT\r\n"
+     "Server: nginx\r\n"
+     "Cache-Control: public, max-age=300, s-maxage=86400, stale-while-revalidate=60\r\n"
+     "ETag: W/\"bc4d-18f2a3c1e7a\"\r\n"
+     "Last-Modified: Thu, 15 Oct 2026 22:01:09 GMT\r\n"
+     "Accept-Ranges: bytes\r\n"
+     "Vary: Accept-Encoding, Origin\r\n"
+     "Content-Encoding: br\r\n"
+     "Strict-Transport-Security: max-age=63072000; includeSubDomains; preload\r\n"
+     "X-Content-Type-Options: nosniff\r\n"
+     "X-Frame-Options: SAMEORIGIN\r\n"
+     "X-XSS-Protection: 0\r\n"
+     "Referrer-Policy: strict-origin-when-cross-origin\r\n"
+     "Content-Security-Policy: default-src 'self'; script-src 'self' 'unsafe-inline' "
+     "https://cdn.example.net https://www.googletagmanager.com; style-src 'self' "
+     "'unsafe-inline' https://fonts.googleapis.com; img-src 'self' data: https:; font-src "
+     "'self' https://fonts.gstatic.com; connect-src 'self' https://api.example.com "
+     "wss://realtime.example.com; frame-ancestors 'none'; upgrade-insecure-requests\r\n"
+     "Permissions-Policy: camera=(), microphone=(), geolocation=(), interest-cohort=()\r\n"
+     "Access-Control-Allow-Origin: *\r\n"
+     "Timing-Allow-Origin: *\r\n"
+     "Alt-Svc: h3=\":443\"; ma=86400, h3-29=\":443\"; ma=86400\r\n"
+     "Age: 1873\r\n"
+     "Via: 1.1 varnish, 1.1 b5a6c1d2e3f4a5b6c7d8e9f0a1b2c3d4.cloudfront.net (CloudFront)\r\n"
+     "X-Served-By: cache-fra-eddf8230047-FRA, cache-ams21052-AMS\r\n"
+     "X-Cache: HIT, HIT\r\n"
+     "X-Cache-Hits: 3, 41\r\n"
+     "X-Timer: S1760605964.382113,VS0,VE0\r\n"
+     "X-Amz-Cf-Pop: FRA56-P4\r\n"
+     "X-Amz-Cf-Id: 2rTq9cW3Zb4lB0x8m1QhYfS6aN7dJ5kUoPvE-Gg3iHsR2tLyMzCwXA==\r\n"
+     "CF-Cache-Status: HIT\r\n"
+     "CF-Ray: 8c1f2e3d4a5b6c7d-FRA\r\n"
+     "NEL: {\"success_fraction\":0,\"report_to\":\"cf-nel\",\"max_age\":604800}\r\n"
+     "Report-To: {\"endpoints\":[{\"url\":\"https:\\/\\/a.nel.cloudflare.com\\/report\\/v4?s="
+     "Xk2bq8TzW1%2FpQ9vN3mLr7YcH5sJd0aE4fGiU6oK%2BtB8wZ1xC3vN5mQ7rT9yU2iO4pA6sD8fG0hJ\"}],"
+     "\"group\":\"cf-nel\",\"max_age\":604800}\r\n"
+     "Server-Timing: cdn-cache; desc=HIT, edge; dur=1, origin; dur=0\r\n"
+     "Expires: Fri, 16 Oct 2026 09:17:44 GMT\r\n"
+     "X-Request-Id: 7f3c2a91-5e4b-4d8a-9c6f-0b1e2d3c4a5f\r\n"
+     "\r\n"},
+    {"set-cookie",
+     "x-ratelimit-remaining",
+     "Content-Type: application/json\r\n"
+     "Content-Length: 512\r\n"
+     "Date: Fri, 16 Oct 2026 09:12:44 GMT\r\n"
+     "Cache-Control: no-store, no-cache, must-revalidate\r\n"
+     "Pragma: no-cache\r\n"
+     "Set-Cookie: session=eyJhbGciOiJIUzI1NiIsInR5cCI6IkpXVCJ9.eyJzdWIiOiIxMjM0NTY3ODkwIiwibm"
+     "FtZSI6IkpvaG4gRG9lIiwiaWF0IjoxNTE2MjM5MDIyLCJyb2xlcyI6WyJhZG1pbiIsImVkaXRvciIsInZpZXdlc"
+     "iJdLCJvcmciOiJleGFtcGxlLW9yZyIsImV4cCI6MTc2MDYwOTU2NH0.SflKxwRJSMeKKF2QT4fwpMeJf36POk6y"
+     "JV_adQssw5c; Path=/; Domain=.example.com; Expires=Sat, 17 Oct 2026 09:12:44 GMT; "
+     "Max-Age=86400; Secure; HttpOnly; SameSite=Lax\r\n"
+     "Set-Cookie: csrftoken=Qm9vUzN4cGFUZ3J1a2FtcTJ6dGhQb2w5YnN4ZGVyZ3Y0cXdlcnR5dWlvcGFzZGZn"
+     "aGprbHp4Y3Zibm0xMjM0NTY3ODkw; Path=/; Expires=Fri, 15 Oct 2027 09:12:44 GMT; "
+     "Max-Age=31449600; Secure; SameSite=Strict\r\n"
+     "Set-Cookie: _ga=GA1.2.1234567890.1760605964; Path=/; Domain=.example.com; "
+     "Expires=Sun, 16 Oct 2028 09:12:44 GMT; Max-Age=63072000\r\n"
+     "Set-Cookie: __cf_bm=a1B2c3D4e5F6g7H8i9J0k1L2m3N4o5P6q7R8s9T0u1V2w3X4y5Z6-1760605964-1.0."
+     "1.1-AbCdEfGhIjKlMnOpQrStUvWxYz0123456789AbCdEfGhIjKlMnOpQrStUvWxYz0123456789AbCdEfGhIj"
+     "KlMnOpQrStUv; path=/; expires=Fri, 16-Oct-26 09:42:44 GMT; domain=.example.com; "
+     "HttpOnly; Secure; SameSite=None\r\n"
+     "Set-Cookie: preferences=%7B%22theme%22%3A%22dark%22%2C%22lang%22%3A%22en-GB%22%2C%22tz"
+     "%22%3A%22Europe%2FBerlin%22%2C%22density%22%3A%22compact%22%2C%22beta%22%3Atrue%7D; "
+     "Path=/; Expires=Sat, 16 Oct 2027 09:12:44 GMT; SameSite=Lax\r\n"
+     "Set-Cookie: AWSALB=Zm9vYmFyYmF6cXV4cXV1eGNvcmdlZ3JhdWx0Z2FycGx5d2FsZG9mcmVkcGx1Z2g=; "
+     "Expires=Fri, 23 Oct 2026 09:12:44 GMT; Path=/\r\n"
+     "Set-Cookie: AWSALBCORS=Zm9vYmFyYmF6cXV4cXV1eGNvcmdlZ3JhdWx0Z2FycGx5d2FsZG9mcmVkcGx1Z2g="
+     "; Expires=Fri, 23 Oct 2026 09:12:44 GMT; Path=/; SameSite=None; Secure\r\n"
+     "X-RateLimit-Limit: 5000\r\n"
+     "X-RateLimit-Remaining: 4987\r\n"
+     "X-RateLimit-Reset: 1760609564\r\n"
+     "\r\n"},
+    {"folded",
+     "x-debug",
+     "Content-Type: multipart/related;\r\n"
+     "\tboundary=\"----=_Part_19_1137249512.1760605964382\";\r\n"
+     "\ttype=\"application/xop+xml\";\r\n"
+     "\tstart=\"<root.message@cxf.apache.org>\";\r\n"
+     "\tstart-info=\"application/soap+xml\"\r\n"
+     "Date: Fri, 16 Oct 2026 09:12:44 GMT\r\n"
+     "Server: Apache-Coyote/1.1\r\n"
+     "X-Powered-By: Servlet/3.0 JSP/2.2\r\n"
+     "Warning: 199 legacy-gateway \"Response contains obsolete\r\n"
+     " line folding, which RFC 9110 deprecates\"\r\n"
+     "X-Debug: node=app-03;\r\n"
+     " thread=http-nio-8080-exec-17;\r\n"
+     " elapsed=41ms;\r\n"
+     " trace=4bf92f3577b34da6a3ce929d0e0e4736\r\n"
+     "Content-Length: 2048\r\n"
+     "\r\n"},
+    {"malformed",
+     "x-forwarded-for",
+     "Content-Type : text/plain\r\n"
+     "X-Empty:\r\n"
+     "X-Forwarded-For: 203.0.113.7, 198.51.100.23, 192.0.2.1\r\n"
+     "X-Unicode: caf\xc3\xa9 na\xc3\xafve r\xc3\xa9sum\xc3\xa9\r\n"
+     "X-Trailing-Space: value   \r\n"
+     "Bare-LF: continues\n"
+     "X-Swallowed: into the previous value\r\n"
+     "X-Control: tab\tinside\r\n"
+     "Missing colon here\r\n"
+     "X-After-Error: unreachable\r\n"
+     "\r\n"},
+};
+
+// A corpus expanded into its variants, with the number of headers a full
+// parse of them returns, and the number of headers and bytes a lookup of
+// zLookup parses before it stops at the match.
+typedef struct bench_variants bench_variants;
+struct bench_variants {
+    char* azHeaders[BENCH_VARIANTS];
+    int anHeaders[BENCH_VARIANTS];
+    sqlite3_int64 nHeaders;
+    sqlite3_int64 nBytes;
+    sqlite3_int64 nLookupHeaders;
+    sqlite3_int64 nLookupBytes;
+    // The http_headers_get statement, with the lookup name as a literal so
+    // that sqlite3_exec() can run it without bindings.
+    char* zGetSql;
+};
+
+static int count_headers(const char* zHeaders, int nHeaders) {
+    const char* zName;
+    const char* zValue;
+    int nName;
+    int nValue;
+    int nParsed;
+    int n = 0;
+    while (http_next_header(zHeaders, nHeaders, &nParsed, &zName, &nName, &zValue, &nValue) ==
+           SQLITE_ROW) {
+        zHeaders += nParsed;
+        nHeaders -= nParsed;
+        n++;
+    }
+    return n;
+}
+
+// What a lookup without an index costs: parse until the name matches. Returns
+// the number of headers parsed, and their size in *pnBytes.
+static int lookup_headers(const char* zHeaders, int nHeaders, const char* zLookup, int* pnBytes) {
+    int nLookup = (int)strlen(zLookup);
+    const char* zName;
+    const char* zValue;
+    int nName;
+    int nValue;
+    int nParsed;
+    int n = 0;
+    *pnBytes = 0;
+    while (http_next_header(zHeaders, nHeaders, &nParsed, &zName, &nName, &zValue, &nValue) ==
+           SQLITE_ROW) {
+        zHeaders += nParsed;
+        nHeaders -= nParsed;
+        *pnBytes += nParsed;
+        n++;
+        if (http_header_name_eq(zName, nName, zLookup, nLookup)) {
+            break;
+        }
+    }
+    return n;
+}
+
+static void make_variants(const bench_corpus* pCorpus, bench_variants* pVariants) {
+    int i;
+    memset(pVariants, 0, sizeof(*pVariants));
+    for (i = 0; i < BENCH_VARIANTS; ++i) {
+        char* z = sqlite3_mprintf("X-Variant: %d\r\n%s", i, pCorpus->zHeaders);
+        int n = (int)strlen(z);
+        int nBytes;
+        pVariants->azHeaders[i] = z;
+        pVariants->anHeaders[i] = n;
+        pVariants->nHeaders += count_headers(z, n);
+        pVariants->nBytes += n;
+        pVariants->nLookupHeaders += lookup_headers(z, n, pCorpus->zLookup, &nBytes);
+        pVariants->nLookupBytes += nBytes;
+    }
+    pVariants->zGetSql = sqlite3_mprintf(
+        "select count(http_headers_get(headers, %Q)) from corpus", pCorpus->zLookup);
+}
+
+static void free_variants(bench_variants* pVariants) {
+    int i;
+    for (i = 0; i < BENCH_VARIANTS; ++i) {
+        sqlite3_free(pVariants->azHeaders[i]);
+    }
+    sqlite3_free(pVariants->zGetSql);
+}
+
+// A benchmark makes one pass over the variants per call and returns the
+// number of headers it saw, or -1 on an unexpected error. Lookups stop at
+// the match, so they count the headers up to and including it.
+typedef sqlite3_int64 (*bench_pass_fn)(const bench_corpus*, bench_variants*, sqlite3*);
+
+static sqlite3_int64 pass_next_header(const bench_corpus* pCorpus,
+                                      bench_variants* pVariants,
+                                      sqlite3* db) {
+    sqlite3_int64 n = 0;
+    int i;
+    for (i = 0; i < BENCH_VARIANTS; ++i) {
+        n += count_headers(pVariants->azHeaders[i], pVariants->anHeaders[i]);
+    }
+    return n;
+}
+
+static sqlite3_int64 pass_header_parser(const bench_corpus* pCorpus,
+                                        bench_variants* pVariants,
+                                        sqlite3* db) {
+    sqlite3_int64 n = 0;
+    int i;
+    for (i = 0; i < BENCH_VARIANTS; ++i) {
+        const char* zHeaders = pVariants->azHeaders[i];
+        int nLeft = pVariants->anHeaders[i];
+        http_header_parser parser;
+        const char* zName;
+        const char* zValue;
+        int nName;
+        int nValue;
+        int rc = SQLITE_OK;
+
+        http_header_parser_init(&parser);
+        while (rc == SQLITE_OK || rc == SQLITE_ROW) {
+            rc = http_header_parser_next(&parser, &zName, &nName, &zValue, &nValue);
+            if (rc == SQLITE_ROW) {
+                n++;
+            } else if (rc == SQLITE_OK) {
+                if (nLeft == 0) {
+                    http_header_parser_finish(&parser);
+                } else {
+                    int nChunk = nLeft < BENCH_PARSER_CHUNK ? nLeft : BENCH_PARSER_CHUNK;
+                    http_header_parser_feed(&parser, zHeaders, nChunk);
+                    zHeaders += nChunk;
+                    nLeft -= nChunk;
+                }
+            }
+        }
+        http_header_parser_clear(&parser);
+    }
+    return n;
+}
+
+static sqlite3_int64 pass_lookup(const bench_corpus* pCorpus,
+                                 bench_variants* pVariants,
+                                 sqlite3* db) {
+    sqlite3_int64 n = 0;
+    int nBytes;
+    int i;
+    for (i = 0; i < BENCH_VARIANTS; ++i) {
+        n += lookup_headers(
+            pVariants->azHeaders[i], pVariants->anHeaders[i], pCorpus->zLookup, &nBytes);
+    }
+    return n;
+}
+
+static int exec_callback(void* pArg, int nCol, char** azVal, char** azCol) {
+    return 0;
+}
+
+// Run a statement on every variant with sqlite3_exec().
+static sqlite3_int64 exec_pass(sqlite3* db, const char* zSql, const bench_variants* pVariants) {
+    if (sqlite3_exec(db, zSql, exec_callback, NULL, NULL) != SQLITE_OK) {
+        return -1;
+    }
+    return pVariants->nHeaders;
+}
+
+static sqlite3_int64 pass_sql_baseline(const bench_corpus* pCorpus,
+                                       bench_variants* pVariants,
+                                       sqlite3* db) {
+    return exec_pass(db, "select count(headers) from corpus", pVariants);
+}
+
+// http_headers_get indexes the headers as far as the first match.
+static sqlite3_int64 pass_sql_get(const bench_corpus* pCorpus,
+                                  bench_variants* pVariants,
+                                  sqlite3* db) {
+    if (exec_pass(db, pVariants->zGetSql, pVariants) < 0) {
+        return -1;
+    }
+    return pVariants->nLookupHeaders;
+}
+
+static sqlite3_int64 pass_sql_has(const bench_corpus* pCorpus,
+                                  bench_variants* pVariants,
+                                  sqlite3* db) {
+    return exec_pass(
+        db, "select count(http_headers_has(headers, 'x-missing')) from corpus", pVariants);
+}
+
+static sqlite3_int64 pass_sql_each(const bench_corpus* pCorpus,
+                                   bench_variants* pVariants,
+                                   sqlite3* db) {
+    return exec_pass(
+        db, "select count(*) from corpus, http_headers_each(corpus.headers)", pVariants);
+}
+
+typedef struct bench_function bench_function;
+struct bench_function {
+    const char* zName;
+    bench_pass_fn xPass;
+    // Set if the function gets through the malformed corpus. The C API stops
+    // at the error and http_headers_get finds its header before it, while the
+    // other SQL functions fail the statement.
+    int bMalformed;
+    // Set if the function stops at the lookup, the bytes it parses are then
+    // those up to the match.
+    int bLookup;
+};
+
+static const bench_function aFunctions[] = {
+    {"c/http_next_header", pass_next_header, 1, 0},
+    {"c/http_header_parser", pass_header_parser, 1, 0},
+    {"c/lookup", pass_lookup, 1, 1},
+    {"sql/baseline", pass_sql_baseline, 1, 0},
+    {"sql/http_headers_get", pass_sql_get, 1, 1},
+    {"sql/http_headers_has", pass_sql_has, 0, 0},
+    {"sql/http_headers_each", pass_sql_each, 0, 0},
+};
+
+// Load the variants into the corpus table, which the SQL benchmarks scan.
+static int load_corpus(sqlite3* db, const bench_corpus* pCorpus, bench_variants* pVariants) {
+    sqlite3_stmt* pStmt;
+    int rc;
+    int i;
+    rc = sqlite3_exec(db,
+                      "drop table if exists corpus; create table corpus(headers text)",
+                      NULL,
+                      NULL,
+                      NULL);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    rc = sqlite3_prepare_v2(db, "insert into corpus values (?)", -1, &pStmt, NULL);
+    for (i = 0; i < BENCH_VARIANTS && rc == SQLITE_OK; ++i) {
+        sqlite3_bind_text(
+            pStmt, 1, pVariants->azHeaders[i], pVariants->anHeaders[i], SQLITE_STATIC);
+        sqlite3_step(pStmt);
+        rc = sqlite3_reset(pStmt);
+    }
+    sqlite3_finalize(pStmt);
+    return rc;
+}
+
+static void print_result(const char* zName,
+                         sqlite3_int64 nPasses,
+                         sqlite3_int64 nHeaders,
+                         sqlite3_int64 nBytes,
+                         sqlite3_int64 usElapsed,
+                         sqlite3_int64 nAllocations,
+                         int bFirst) {
+    double ns = usElapsed * 1e3;
+    printf("%s\n    {\"name\": \"%s\", \"iterations\": %lld, \"headers\": %lld, \"bytes\": %lld, "
+           "\"seconds\": %.6f, \"ns_per_header\": %.2f, \"gb_per_sec\": %.3f, "
+           "\"allocations_per_header\": %.3f, \"max_rss_kb\": %lld}",
+           bFirst ? "" : ",",
+           zName,
+           nPasses,
+           nHeaders,
+           nBytes,
+           usElapsed / 1e6,
+           nHeaders ? ns / nHeaders : 0.0,
+           ns > 0 ? nBytes / ns : 0.0,
+           nHeaders ? (double)nAllocations / nHeaders : 0.0,
+           bench_max_rss_kb());
+    fflush(stdout);
+}
+
+static void usage() {
+    fprintf(stderr, "usage: b_headers [--min-time-ms N] [--filter TEXT]\n");
+    exit(2);
+}
+
+int main(int argc, char const* argv[]) {
+    sqlite3_int64 usMinTime = 200000;
+    const char* zFilter = NULL;
+    bench_variants variants;
+    sqlite3* db;
+    int nRun = 0;
+    int ok = 1;
+    int i;
+    int j;
+
+    for (i = 1; i < argc; ++i) {
+        if (i + 1 == argc) {
+            usage();
+        } else if (strcmp(argv[i], "--min-time-ms") == 0) {
+            usMinTime = atoll(argv[++i]) * 1000;
+        } else if (strcmp(argv[i], "--filter") == 0) {
+            zFilter = argv[++i];
+        } else {
+            usage();
+        }
+    }
+
+    if (bench_mem_install() != SQLITE_OK || sqlite3_initialize() != SQLITE_OK ||
+        sqlite3_open(":memory:", &db) != SQLITE_OK ||
+        sqlite3_http_init(db, NULL, NULL) != SQLITE_OK) {
+        fprintf(stderr, "error: could not set up the database\n");
+        return 1;
+    }
+
+    bench_print_begin("headers");
+    for (i = 0; i < (int)(sizeof(aCorpora) / sizeof(aCorpora[0])) && ok; ++i) {
+        const bench_corpus* pCorpus = &aCorpora[i];
+
+        make_variants(pCorpus, &variants);
+        if (load_corpus(db, pCorpus, &variants) != SQLITE_OK) {
+            fprintf(stderr, "error: %s\n", sqlite3_errmsg(db));
+            ok = 0;
+        }
+
+        for (j = 0; j < (int)(sizeof(aFunctions) / sizeof(aFunctions[0])) && ok; ++j) {
+            const bench_function* pFunction = &aFunctions[j];
+            sqlite3_int64 nPasses = 0;
+            sqlite3_int64 nHeaders = 0;
+            sqlite3_int64 nAllocations;
+            sqlite3_int64 usStart;
+            sqlite3_int64 usElapsed;
+            char zName[128];
+
+            snprintf(zName, sizeof(zName), "%s/%s", pFunction->zName, pCorpus->zName);
+            if ((zFilter && !strstr(zName, zFilter)) ||
+                (!pFunction->bMalformed && strcmp(pCorpus->zName, "malformed") == 0)) {
+                continue;
+            }
+            fprintf(stderr, "%s\n", zName);
+
+            nAllocations = bench_mem_allocations();
+            usStart = bench_now();
+            do {
+                sqlite3_int64 n = pFunction->xPass(pCorpus, &variants, db);
+                if (n < 0) {
+                    fprintf(stderr, "error: %s\n", sqlite3_errmsg(db));
+                    ok = 0;
+                    break;
+                }
+                nHeaders += n;
+                nPasses++;
+                usElapsed = bench_now() - usStart;
+            } while (usElapsed < usMinTime);
+
+            if (ok) {
+                print_result(zName,
+                             nPasses,
+                             nHeaders,
+                             (pFunction->bLookup ? variants.nLookupBytes : variants.nBytes) *
+                                 nPasses,
+                             usElapsed,
+                             bench_mem_allocations() - nAllocations,
+                             nRun++ == 0);
+            }
+        }
+
+        free_variants(&variants);
+    }
+    bench_print_end();
+
+    sqlite3_close(db);
+    return ok ? 0 : 1;
+}
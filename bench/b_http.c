@@ -0,0 +1,223 @@
+#include "http.h"
+
+#include <signal.h>
+#include <sqlite3.h>
+
+#include "bench.h"
+#include "bench_server.h"
+
+SQLITE_EXTENSION_INIT3
+
+int sqlite3_http_init(sqlite3*, char**, const sqlite3_api_routines*);
+
+// End-to-end benchmarks: real SQL through the curl backend against a server
+// on the loopback interface. Every statement returns the status code and the
+// length of the response body, so that a broken setup fails loudly instead
+// of measuring errors.
+//
+//   b_http [--requests N] [--filter TEXT]
+//          [--latency-us N] [--body-size N] [--chunked] [--close]
+//
+// Without server options every statement runs against each server in
+// aServers. With them, against a single server configured accordingly.
+
+typedef struct bench_statement bench_statement;
+struct bench_statement {
+    const char* zName;
+    const char* zSql;
+};
+
+static const bench_statement aStatements[] = {
+    {"http_get", "select response_status_code, length(response_body) from http_get(?1)"},
+    {"http_post",
+     "select response_status_code, length(response_body) from http_post(?1, null, ?2)"},
+    {"http_do",
+     "select response_status_code, length(response_body) from http_do('PUT', ?1, null, ?2)"},
+    {"http_get_body", "select 200, length(http_get_body(?1))"},
+    {"http_post_body", "select 200, length(http_post_body(?1, null, ?2))"},
+    {"http_do_body", "select 200, length(http_do_body('PUT', ?1, null, ?2))"},
+};
+
+typedef struct bench_server_case bench_server_case;
+struct bench_server_case {
+    const char* zName;
+    bench_server_config config;
+};
+
+static const bench_server_case aServers[] = {
+    {"keepalive-1k", {0, 1024, 0, 0}},
+    {"keepalive-64k", {0, 65536, 0, 0}},
+    {"chunked-64k", {0, 65536, 1, 0}},
+    {"close-1k", {0, 1024, 0, 1}},
+    {"latency-1ms", {1000, 1024, 0, 0}},
+};
+
+// Size of the request bodies sent by http_post and http_do.
+#define BENCH_REQUEST_BODY 1024
+
+static char aRequestBody[BENCH_REQUEST_BODY];
+
+static int run_statement(sqlite3_stmt* pStmt, sqlite3_int64 szBody) {
+    int rc = sqlite3_step(pStmt);
+    if (rc != SQLITE_ROW) {
+        fprintf(stderr, "error: %s\n", sqlite3_errmsg(sqlite3_db_handle(pStmt)));
+        sqlite3_reset(pStmt);
+        return 0;
+    }
+    if (sqlite3_column_int(pStmt, 0) != 200 || sqlite3_column_int64(pStmt, 1) != szBody) {
+        fprintf(stderr,
+                "error: unexpected response %d with %lld bytes\n",
+                sqlite3_column_int(pStmt, 0),
+                sqlite3_column_int64(pStmt, 1));
+        sqlite3_reset(pStmt);
+        return 0;
+    }
+    sqlite3_reset(pStmt);
+    return 1;
+}
+
+// Run a statement nRequests times against a server, after a short warm-up
+// that fills the connection pool.
+static int run_benchmark(sqlite3* db,
+                         const bench_statement* pStatement,
+                         const char* zServer,
+                         const bench_server_config* pConfig,
+                         int nRequests,
+                         int bFirst) {
+    bench_server* pServer;
+    bench_result result;
+    sqlite3_stmt* pStmt = NULL;
+    sqlite3_int64* aLatency;
+    sqlite3_int64 nAllocations;
+    sqlite3_int64 szAllocated;
+    sqlite3_int64 usStart;
+    char zUrl[64];
+    char zName[128];
+    int nWarmup = nRequests / 10 > 10 ? nRequests / 10 : 10;
+    int ok = 1;
+    int i;
+
+    pServer = bench_server_start(pConfig);
+    if (!pServer) {
+        fprintf(stderr, "error: could not start the server\n");
+        return 0;
+    }
+    snprintf(zUrl, sizeof(zUrl), "http://127.0.0.1:%d/bench", bench_server_port(pServer));
+    snprintf(zName, sizeof(zName), "%s/%s", pStatement->zName, zServer);
+    fprintf(stderr, "%s\n", zName);
+
+    aLatency = malloc(sizeof(*aLatency) * nRequests);
+    if (!aLatency || sqlite3_prepare_v2(db, pStatement->zSql, -1, &pStmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "error: %s\n", sqlite3_errmsg(db));
+        ok = 0;
+        goto done;
+    }
+    sqlite3_bind_text(pStmt, 1, zUrl, -1, SQLITE_STATIC);
+    sqlite3_bind_blob(pStmt, 2, aRequestBody, sizeof(aRequestBody), SQLITE_STATIC);
+
+    for (i = 0; i < nWarmup && ok; ++i) {
+        ok = run_statement(pStmt, pConfig->szBody);
+    }
+
+    nAllocations = bench_mem_allocations();
+    szAllocated = bench_mem_allocated();
+    usStart = bench_now();
+    for (i = 0; i < nRequests && ok; ++i) {
+        sqlite3_int64 usRequest = bench_now();
+        ok = run_statement(pStmt, pConfig->szBody);
+        aLatency[i] = bench_now() - usRequest;
+    }
+
+    if (ok) {
+        result.zName = zName;
+        result.nIterations = nRequests;
+        result.usElapsed = bench_now() - usStart;
+        result.nAllocations = bench_mem_allocations() - nAllocations;
+        result.szAllocated = bench_mem_allocated() - szAllocated;
+        result.usP50 = bench_percentile(aLatency, nRequests, 0.50);
+        result.usP99 = bench_percentile(aLatency, nRequests, 0.99);
+        bench_print_result(&result, "requests", "request", bFirst);
+    }
+
+done:
+    sqlite3_finalize(pStmt);
+    free(aLatency);
+    bench_server_stop(pServer);
+    return ok;
+}
+
+static void usage() {
+    fprintf(stderr,
+            "usage: b_http [--requests N] [--filter TEXT]\n"
+            "              [--latency-us N] [--body-size N] [--chunked] [--close]\n");
+    exit(2);
+}
+
+int main(int argc, char const* argv[]) {
+    bench_server_config config = {0, 1024, 0, 0};
+    const char* zFilter = NULL;
+    int bCustomServer = 0;
+    int nRequests = 1000;
+    int nRun = 0;
+    sqlite3* db;
+    int ok = 1;
+    int i;
+    int j;
+
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--chunked") == 0) {
+            config.bChunked = 1;
+            bCustomServer = 1;
+        } else if (strcmp(argv[i], "--close") == 0) {
+            config.bClose = 1;
+            bCustomServer = 1;
+        } else if (i + 1 == argc) {
+            usage();
+        } else if (strcmp(argv[i], "--requests") == 0) {
+            nRequests = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0) {
+            zFilter = argv[++i];
+        } else if (strcmp(argv[i], "--latency-us") == 0) {
+            config.usLatency = atoi(argv[++i]);
+            bCustomServer = 1;
+        } else if (strcmp(argv[i], "--body-size") == 0) {
+            config.szBody = atoll(argv[++i]);
+            bCustomServer = 1;
+        } else {
+            usage();
+        }
+    }
+    if (nRequests <= 0) {
+        usage();
+    }
+
+    // Connections closed by the server must not kill the process.
+    signal(SIGPIPE, SIG_IGN);
+    memset(aRequestBody, 'y', sizeof(aRequestBody));
+
+    if (bench_mem_install() != SQLITE_OK || sqlite3_initialize() != SQLITE_OK ||
+        sqlite3_open(":memory:", &db) != SQLITE_OK ||
+        sqlite3_http_init(db, NULL, NULL) != SQLITE_OK) {
+        fprintf(stderr, "error: could not set up the database\n");
+        return 1;
+    }
+
+    bench_print_begin("http");
+    for (i = 0; i < (int)(sizeof(aStatements) / sizeof(aStatements[0])) && ok; ++i) {
+        if (zFilter && !strstr(aStatements[i].zName, zFilter)) {
+            continue;
+        }
+        if (bCustomServer) {
+            ok = run_benchmark(db, &aStatements[i], "custom", &config, nRequests, nRun++ == 0);
+            continue;
+        }
+        for (j = 0; j < (int)(sizeof(aServers) / sizeof(aServers[0])) && ok; ++j) {
+            ok = run_benchmark(
+                db, &aStatements[i], aServers[j].zName, &aServers[j].config, nRequests, nRun++ == 0);
+        }
+    }
+    bench_print_end();
+
+    sqlite3_close(db);
+    return ok ? 0 : 1;
+}
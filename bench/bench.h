@@ -0,0 +1,142 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+// Helpers shared by the benchmarks. Results are written to stdout as JSON,
+// progress to stderr, so that the output can be piped into a file and
+// compared between runs.
+
+static inline sqlite3_int64 bench_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (sqlite3_int64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Allocations made through SQLite, which include those of the extension. The
+// counters are updated atomically, since requests may run on worker threads.
+static sqlite3_mem_methods bench_mem_default;
+static sqlite3_int64 bench_mem_count;
+static sqlite3_int64 bench_mem_bytes;
+
+static inline void* bench_mem_malloc(int nBytes) {
+    __atomic_add_fetch(&bench_mem_count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&bench_mem_bytes, nBytes, __ATOMIC_RELAXED);
+    return bench_mem_default.xMalloc(nBytes);
+}
+
+static inline void* bench_mem_realloc(void* p, int nBytes) {
+    __atomic_add_fetch(&bench_mem_count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&bench_mem_bytes, nBytes, __ATOMIC_RELAXED);
+    return bench_mem_default.xRealloc(p, nBytes);
+}
+
+// Must be called before SQLite is initialized.
+static inline int bench_mem_install() {
+    sqlite3_mem_methods methods;
+    int rc = sqlite3_config(SQLITE_CONFIG_GETMALLOC, &bench_mem_default);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    methods = bench_mem_default;
+    methods.xMalloc = bench_mem_malloc;
+    methods.xRealloc = bench_mem_realloc;
+    return sqlite3_config(SQLITE_CONFIG_MALLOC, &methods);
+}
+
+static inline sqlite3_int64 bench_mem_allocations() {
+    return __atomic_load_n(&bench_mem_count, __ATOMIC_RELAXED);
+}
+
+static inline sqlite3_int64 bench_mem_allocated() {
+    return __atomic_load_n(&bench_mem_bytes, __ATOMIC_RELAXED);
+}
+
+// Peak resident set size of the process in kilobytes.
+static inline sqlite3_int64 bench_max_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+static inline int bench_compare_int64(const void* a, const void* b) {
+    sqlite3_int64 iA = *(const sqlite3_int64*)a;
+    sqlite3_int64 iB = *(const sqlite3_int64*)b;
+    return iA < iB ? -1 : iA > iB;
+}
+
+// Sorts the samples and returns the one below which the fraction q falls.
+static inline sqlite3_int64 bench_percentile(sqlite3_int64* aSample, int nSample, double q) {
+    int i;
+    if (nSample == 0) {
+        return 0;
+    }
+    qsort(aSample, nSample, sizeof(*aSample), bench_compare_int64);
+    i = (int)(q * nSample + 0.5) - 1;
+    if (i < 0) {
+        i = 0;
+    } else if (i >= nSample) {
+        i = nSample - 1;
+    }
+    return aSample[i];
+}
+
+// Report of a single benchmark, written as one element of the "benchmarks"
+// array.
+typedef struct bench_result bench_result;
+struct bench_result {
+    const char* zName;
+    int nIterations;
+    sqlite3_int64 usElapsed;
+    sqlite3_int64 usP50;
+    sqlite3_int64 usP99;
+    sqlite3_int64 nAllocations;
+    sqlite3_int64 szAllocated;
+};
+
+static inline void bench_print_begin(const char* zSuite) {
+    printf("{\n  \"suite\": \"%s\",\n  \"sqlite_version\": \"%s\",\n  \"benchmarks\": [",
+           zSuite,
+           sqlite3_libversion());
+}
+
+// The rate is reported per second as zUnits, the allocations per zUnit.
+static inline void bench_print_result(const bench_result* pResult,
+                               const char* zUnits,
+                               const char* zUnit,
+                               int bFirst) {
+    double seconds = pResult->usElapsed / 1e6;
+    printf("%s\n    {\"name\": \"%s\", \"iterations\": %d, \"seconds\": %.6f, "
+           "\"%s_per_sec\": %.1f, \"p50_us\": %lld, \"p99_us\": %lld, "
+           "\"allocations_per_%s\": %.2f, \"bytes_allocated_per_%s\": %.1f, "
+           "\"max_rss_kb\": %lld}",
+           bFirst ? "" : ",",
+           pResult->zName,
+           pResult->nIterations,
+           seconds,
+           zUnits,
+           seconds > 0 ? pResult->nIterations / seconds : 0.0,
+           pResult->usP50,
+           pResult->usP99,
+           zUnit,
+           (double)pResult->nAllocations / pResult->nIterations,
+           zUnit,
+           (double)pResult->szAllocated / pResult->nIterations,
+           bench_max_rss_kb());
+    fflush(stdout);
+}
+
+static inline void bench_print_end() {
+    printf("\n  ],\n  \"max_rss_kb\": %lld\n}\n", bench_max_rss_kb());
+}
+
+#endif
@@ -0,0 +1,284 @@
+#define _GNU_SOURCE // memmem
+
+#include "bench_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+// Bodies are sent from a static buffer, in chunks of this size when chunked.
+#define BENCH_SERVER_CHUNK 16384
+
+struct bench_server {
+    bench_server_config config;
+    int fd;
+    int iPort;
+    pthread_t thread;
+};
+
+typedef struct bench_connection bench_connection;
+struct bench_connection {
+    bench_server_config config;
+    int fd;
+    char* aBuf;
+    int nBuf;
+    int nAlloc;
+};
+
+static char aBody[BENCH_SERVER_CHUNK];
+
+static int send_all(int fd, const char* p, size_t n) {
+    while (n > 0) {
+        ssize_t nSent = send(fd, p, n, 0);
+        if (nSent <= 0) {
+            return 0;
+        }
+        p += nSent;
+        n -= nSent;
+    }
+    return 1;
+}
+
+// Read until the buffer holds at least nWant bytes. Returns 0 on EOF or error.
+static int read_at_least(bench_connection* pConn, int nWant) {
+    while (pConn->nBuf < nWant) {
+        ssize_t nRead;
+        if (pConn->nAlloc - pConn->nBuf < 4096) {
+            int nAlloc = pConn->nAlloc * 2 > nWant ? pConn->nAlloc * 2 : nWant + 4096;
+            char* aBuf = realloc(pConn->aBuf, nAlloc);
+            if (!aBuf) {
+                return 0;
+            }
+            pConn->aBuf = aBuf;
+            pConn->nAlloc = nAlloc;
+        }
+        nRead = recv(pConn->fd, pConn->aBuf + pConn->nBuf, pConn->nAlloc - pConn->nBuf, 0);
+        if (nRead <= 0) {
+            return 0;
+        }
+        pConn->nBuf += (int)nRead;
+    }
+    return 1;
+}
+
+static void consume(bench_connection* pConn, int n) {
+    memmove(pConn->aBuf, pConn->aBuf + n, pConn->nBuf - n);
+    pConn->nBuf -= n;
+}
+
+// Find a header in the request head and return its value, or NULL.
+static const char* find_header(const char* zHead, int nHead, const char* zName) {
+    size_t nName = strlen(zName);
+    const char* z = zHead;
+    const char* zEnd = zHead + nHead;
+    while (z < zEnd) {
+        const char* zEol = memchr(z, '\n', zEnd - z);
+        if (!zEol) {
+            break;
+        }
+        if ((size_t)(zEol - z) > nName && strncasecmp(z, zName, nName) == 0 &&
+            z[nName] == ':') {
+            z += nName + 1;
+            while (*z == ' ' || *z == '\t') {
+                z++;
+            }
+            return z;
+        }
+        z = zEol + 1;
+    }
+    return NULL;
+}
+
+// Read a request and discard its body. Returns 0 when the connection ends.
+static int read_request(bench_connection* pConn) {
+    const char* zEnd = NULL;
+    const char* zValue;
+    int nHead;
+    sqlite3_int64 szBody = 0;
+
+    while (!zEnd) {
+        if (pConn->nBuf >= 4) {
+            zEnd = memmem(pConn->aBuf, pConn->nBuf, "\r\n\r\n", 4);
+        }
+        if (!zEnd && !read_at_least(pConn, pConn->nBuf + 1)) {
+            return 0;
+        }
+    }
+    nHead = (int)(zEnd - pConn->aBuf) + 4;
+
+    zValue = find_header(pConn->aBuf, nHead, "Content-Length");
+    if (zValue) {
+        szBody = strtoll(zValue, NULL, 10);
+    }
+    zValue = find_header(pConn->aBuf, nHead, "Expect");
+    if (zValue && strncasecmp(zValue, "100-continue", 12) == 0) {
+        static const char zContinue[] = "HTTP/1.1 100 Continue\r\n\r\n";
+        if (!send_all(pConn->fd, zContinue, sizeof(zContinue) - 1)) {
+            return 0;
+        }
+    }
+    consume(pConn, nHead);
+
+    while (szBody > 0) {
+        int n;
+        if (pConn->nBuf == 0 && !read_at_least(pConn, 1)) {
+            return 0;
+        }
+        n = pConn->nBuf < szBody ? pConn->nBuf : (int)szBody;
+        consume(pConn, n);
+        szBody -= n;
+    }
+    return 1;
+}
+
+static int write_response(bench_connection* pConn) {
+    const bench_server_config* pConfig = &pConn->config;
+    sqlite3_int64 szLeft = pConfig->szBody;
+    char zHead[256];
+    int nHead;
+
+    if (pConfig->usLatency > 0) {
+        struct timespec ts;
+        ts.tv_sec = pConfig->usLatency / 1000000;
+        ts.tv_nsec = (long)(pConfig->usLatency % 1000000) * 1000;
+        nanosleep(&ts, NULL);
+    }
+
+    if (pConfig->bChunked) {
+        nHead = snprintf(zHead,
+                         sizeof(zHead),
+                         "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n"
+                         "Transfer-Encoding: chunked\r\n%s\r\n",
+                         pConfig->bClose ? "Connection: close\r\n" : "");
+    } else {
+        nHead = snprintf(zHead,
+                         sizeof(zHead),
+                         "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n"
+                         "Content-Length: %lld\r\n%s\r\n",
+                         pConfig->szBody,
+                         pConfig->bClose ? "Connection: close\r\n" : "");
+    }
+    if (!send_all(pConn->fd, zHead, nHead)) {
+        return 0;
+    }
+
+    while (szLeft > 0) {
+        int n = szLeft < BENCH_SERVER_CHUNK ? (int)szLeft : BENCH_SERVER_CHUNK;
+        if (pConfig->bChunked) {
+            nHead = snprintf(zHead, sizeof(zHead), "%x\r\n", n);
+            if (!send_all(pConn->fd, zHead, nHead)) {
+                return 0;
+            }
+        }
+        if (!send_all(pConn->fd, aBody, n)) {
+            return 0;
+        }
+        if (pConfig->bChunked && !send_all(pConn->fd, "\r\n", 2)) {
+            return 0;
+        }
+        szLeft -= n;
+    }
+    if (pConfig->bChunked && !send_all(pConn->fd, "0\r\n\r\n", 5)) {
+        return 0;
+    }
+    return 1;
+}
+
+static void* connection_main(void* pArg) {
+    bench_connection* pConn = pArg;
+    while (read_request(pConn) && write_response(pConn) && !pConn->config.bClose) {
+    }
+    close(pConn->fd);
+    free(pConn->aBuf);
+    free(pConn);
+    return NULL;
+}
+
+static void* accept_main(void* pArg) {
+    bench_server* pServer = pArg;
+    for (;;) {
+        bench_connection* pConn;
+        pthread_t thread;
+        int one = 1;
+        int fd = accept(pServer->fd, NULL, NULL);
+        if (fd < 0) {
+            break;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        pConn = calloc(1, sizeof(*pConn));
+        if (!pConn) {
+            close(fd);
+            continue;
+        }
+        pConn->config = pServer->config;
+        pConn->fd = fd;
+        if (pthread_create(&thread, NULL, connection_main, pConn) != 0) {
+            close(fd);
+            free(pConn);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+bench_server* bench_server_start(const bench_server_config* pConfig) {
+    bench_server* pServer;
+    struct sockaddr_in addr;
+    socklen_t nAddr = sizeof(addr);
+    int one = 1;
+
+    memset(aBody, 'x', sizeof(aBody));
+
+    pServer = calloc(1, sizeof(*pServer));
+    if (!pServer) {
+        return NULL;
+    }
+    pServer->config = *pConfig;
+    pServer->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (pServer->fd < 0) {
+        free(pServer);
+        return NULL;
+    }
+    setsockopt(pServer->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (bind(pServer->fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(pServer->fd, 128) != 0 ||
+        getsockname(pServer->fd, (struct sockaddr*)&addr, &nAddr) != 0) {
+        close(pServer->fd);
+        free(pServer);
+        return NULL;
+    }
+    pServer->iPort = ntohs(addr.sin_port);
+
+    if (pthread_create(&pServer->thread, NULL, accept_main, pServer) != 0) {
+        close(pServer->fd);
+        free(pServer);
+        return NULL;
+    }
+    return pServer;
+}
+
+int bench_server_port(const bench_server* pServer) {
+    return pServer->iPort;
+}
+
+void bench_server_stop(bench_server* pServer) {
+    // Shutting the socket down wakes the thread blocked in accept().
+    shutdown(pServer->fd, SHUT_RDWR);
+    pthread_join(pServer->thread, NULL);
+    close(pServer->fd);
+    free(pServer);
+}
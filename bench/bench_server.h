@@ -0,0 +1,31 @@
+#ifndef BENCH_SERVER_H
+#define BENCH_SERVER_H
+
+#include <sqlite3.h>
+
+// A minimal HTTP/1.1 server on 127.0.0.1 that stands in for a real service.
+// Every request gets a 200 response with a body of szBody bytes, after
+// waiting usLatency microseconds. Request bodies are read and discarded.
+typedef struct bench_server_config bench_server_config;
+struct bench_server_config {
+    int usLatency;
+    sqlite3_int64 szBody;
+    // Send the body in chunks instead of with a Content-Length.
+    int bChunked;
+    // Close the connection after every response instead of keeping it alive.
+    int bClose;
+};
+
+typedef struct bench_server bench_server;
+
+// Start serving on an ephemeral port, one thread per connection. Returns NULL
+// if the server could not be started.
+bench_server* bench_server_start(const bench_server_config* pConfig);
+
+int bench_server_port(const bench_server* pServer);
+
+// Stop accepting connections. Open connections are served until the client
+// closes them.
+void bench_server_stop(bench_server* pServer);
+
+#endif
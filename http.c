@@ -34,6 +34,11 @@
 
 #include "sqlite3ext.h"
 
+// Parts of the response the caller is not going to read. Backends may skip
+// collecting them, in which case the corresponding fields stay NULL.
+#define HTTP_REQUEST_NO_BODY 1
+#define HTTP_REQUEST_NO_HEADERS 2
+
 typedef struct http_request http_request;
 struct http_request {
     char* zMethod;
@@ -41,19 +46,306 @@ struct http_request {
     const void* pBody;
     sqlite3_int64 szBody;
     const char* zHeaders;
+    int flags;
+    // Fail the request if the body is larger than this, zero means no limit.
+    sqlite3_int64 szMaxBody;
+    // Text of the statement that made the request, for http_trace. Only set
+    // while tracing is enabled.
+    const char* zSql;
+    // The backend gives up on the request once this is set, NULL if the
+    // request can't be cancelled. Read with http_request_cancelled().
+    const int* pbCancel;
 };
 
+int http_request_cancelled(const http_request* req);
+
+// Headers whose values are located while the headers are captured, so that
+// they can be returned without scanning the headers again.
+#define HTTP_META_CONTENT_TYPE 0
+#define HTTP_META_CONTENT_LENGTH 1
+#define HTTP_META_ETAG 2
+#define HTTP_META_LAST_MODIFIED 3
+#define HTTP_META_CONTENT_ENCODING 4
+#define HTTP_META_COUNT 5
+
 typedef struct http_response http_response;
 struct http_response {
+    // Allocated with http_body_realloc() and released with http_body_unref().
     void* pBody;
     sqlite3_int64 szBody;
+    sqlite3_int64 szBodyAlloc;
     char* zHeaders;
     int szHeaders;
     int iStatusCode;
     char* zStatus;
+    // 1 + offset of the value of each HTTP_META_* header in zHeaders and the
+    // size of the value, or 0 if there is no such header.
+    int aMetaOffset[HTTP_META_COUNT];
+    int aMetaSize[HTTP_META_COUNT];
+    // Set if the backend reports the transfer details below. Details that are
+    // not known are -1.
+    int bTransfer;
+    // Microseconds from the start of the request until the name was resolved,
+    // the connection was made, the TLS handshake was done and the first byte
+    // of the response arrived, and until the transfer was complete.
+    sqlite3_int64 usDns;
+    sqlite3_int64 usConnect;
+    sqlite3_int64 usTls;
+    sqlite3_int64 usFirstByte;
+    sqlite3_int64 usTotal;
+    // Bytes of body sent and received.
+    sqlite3_int64 szUpload;
+    sqlite3_int64 szDownload;
+    // Connections opened for the request, zero if an existing one was reused.
+    int nNewConnections;
+    int nRedirects;
+    // 10, 11, 20 or 30 for HTTP/1.0, HTTP/1.1, HTTP/2 and HTTP/3.
+    int iHttpVersion;
+    // The URL of the last request if redirects were followed, otherwise NULL.
+    char* zEffectiveUrl;
+};
+
+// Response bodies are reference counted, so that the same buffer can be handed
+// to SQLite any number of times without copying. http_body_unref() can be used
+// as the destructor of sqlite3_result_blob(). The buffer can only be resized
+// while there is a single reference to it.
+void* http_body_realloc(void* pBody, sqlite3_int64 nBytes);
+void* http_body_ref(void* pBody);
+void http_body_unref(void* pBody);
+
+// Make room for nBytes more bytes of body. The buffer grows geometrically, so
+// appending chunk by chunk copies the body only a constant number of times.
+int http_response_reserve(http_response* resp, sqlite3_int64 nBytes);
+
+// Locate the HTTP_META_* headers among the nBytes of resp->zHeaders starting
+// at iOffset. Backends that get all of the headers at once call this once.
+// The first header with each name is kept.
+void http_response_capture_meta(http_response* resp, int iOffset, int nBytes);
+
+// Record a single header whose value is at offset iValue of resp->zHeaders,
+// for backends that parse the headers as they arrive.
+void http_response_capture_header(
+    http_response* resp, const char* zName, int nName, int iValue, int nValue);
+
+// Return the value of a Content-Length header, or -1 if it is not a number.
+sqlite3_int64 http_parse_content_length(const char* zValue, int nValue);
+
+// Load the backend and probe its capabilities. Safe to call from any thread,
+// the work is done only once.
+int http_backend_init(char** ppErrMsg);
+
+typedef struct http_backend_info http_backend_info;
+struct http_backend_info {
+    const char* zName;
+    const char* zVersion;
+    const char* zSslVersion;
+    // Comma separated list of supported content encodings
+    const char* zCompression;
+    int bHttp2;
+    int bHttp3;
+    int bShare;
+};
+
+int http_backend_get_info(http_backend_info* pInfo, char** ppErrMsg);
+
+// A pool of reusable backend connections. Each database connection owns one
+// pool so that consecutive requests to the same host can reuse warm
+// connections instead of paying for a new TCP connect and TLS handshake.
+typedef struct http_pool http_pool;
+
+int http_pool_open(http_pool** ppPool);
+void http_pool_close(http_pool* pPool);
+
+// Enable or disable the process-wide cache of resolved names, TLS sessions and
+// connections shared by all pools. nMaxConnections limits the size of the
+// shared connection cache, zero means backend default.
+int http_share_configure(int bEnable, int nMaxConnections, char** ppErrMsg);
+
+int http_do_request(http_pool* pPool, http_request* req, http_response* resp, char** ppErrMsg);
+
+// A batch runs many requests concurrently. The request and response passed to
+// http_batch_add() must stay valid until they are returned by
+// http_batch_next() or the batch is closed.
+typedef struct http_batch http_batch;
+
+int http_batch_open(http_pool* pPool, int nConcurrency, http_batch** ppBatch, char** ppErrMsg);
+int http_batch_add(http_batch* pBatch, http_request* req, http_response* resp, void* pArg);
+
+// Wait for the next request to complete. Returns SQLITE_ROW with the pArg of
+// the completed request, its result code in *pRc and error message in
+// *ppErrMsg. Returns SQLITE_DONE when all requests have completed.
+int http_batch_next(http_batch* pBatch, void** ppArg, int* pRc, char** ppErrMsg);
+
+// Close the batch, cancelling any requests still in flight.
+void http_batch_close(http_batch* pBatch);
+
+// Asynchronous requests are queued and run by a process-wide pool of worker
+// threads. Results are kept by id until they are removed, or until too many
+// newer requests have finished. Running requests are cancelled when the
+// workers are stopped.
+#define HTTP_ASYNC_QUEUED 0
+#define HTTP_ASYNC_RUNNING 1
+#define HTTP_ASYNC_DONE 2
+#define HTTP_ASYNC_ERROR 3
+
+typedef struct http_async_entry http_async_entry;
+struct http_async_entry {
+    sqlite3_int64 iId;
+    int eState;
+    int rc;
+    char* zErrMsg;
+    http_request req;
+    http_response resp;
+};
+
+// Every database connection holds a reference. The workers are stopped when
+// the last reference is released.
+void http_async_ref();
+void http_async_unref();
+
+// Queue a copy of the request and return its id in *piId.
+int http_async_enqueue(const http_request* req, sqlite3_int64* piId);
+
+// Wait up to msTimeout milliseconds (forever if negative) for the request to
+// complete and return its state in *peState. Returns SQLITE_NOTFOUND if there
+// is no such request.
+int http_async_wait(sqlite3_int64 iId, int msTimeout, int* peState);
+
+// Copy the request with the given id, or the first one after it if bNext is
+// set, into *pCopy. Returns SQLITE_ROW or SQLITE_DONE if there is none. The
+// copy must be released with http_async_entry_clear().
+int http_async_get(sqlite3_int64 iId, int bNext, http_async_entry* pCopy);
+void http_async_entry_clear(http_async_entry* pEntry);
+
+// Remove a queued or completed request. Returns SQLITE_BUSY if it is running.
+int http_async_remove(sqlite3_int64 iId);
+
+// Process-wide statistics of the requests made by all connections, kept per
+// host. The counters are sharded by thread, so recording a request only waits
+// for threads that happen to share the shard.
+#define HTTP_STATS_BUCKETS 24
+
+typedef struct http_stats_host http_stats_host;
+struct http_stats_host {
+    char* zHost;
+    sqlite3_int64 nRequests;
+    // Requests that failed without a response, and responses with a 4xx or
+    // 5xx status.
+    sqlite3_int64 nFailed;
+    sqlite3_int64 n4xx;
+    sqlite3_int64 n5xx;
+    sqlite3_int64 szSent;
+    sqlite3_int64 szReceived;
+    sqlite3_int64 nNewConnections;
+    sqlite3_int64 nReusedConnections;
+    // Sum of the latencies in microseconds, and the number of requests by
+    // latency. Bucket i counts requests that took less than
+    // http_stats_bucket_limit(i), the last bucket all slower requests.
+    sqlite3_int64 usLatency;
+    sqlite3_int64 aLatency[HTTP_STATS_BUCKETS];
+};
+
+// Must be called before requests are recorded. Safe to call any number of
+// times from any thread.
+int http_stats_init();
+
+// Microseconds from an arbitrary point in time, for measuring latencies.
+sqlite3_int64 http_stats_now();
+
+// Record a finished request. The total time reported by the backend in the
+// response is used if there is one, usElapsed otherwise.
+void http_stats_record(const http_request* req,
+                       const http_response* resp,
+                       int rc,
+                       sqlite3_int64 usElapsed);
+
+// Merge the statistics of all shards into an array sorted by host. The array
+// must be released with http_stats_free().
+int http_stats_snapshot(http_stats_host** paHost, int* pnHost);
+void http_stats_free(http_stats_host* aHost, int nHost);
+
+sqlite3_int64 http_stats_bucket_limit(int iBucket);
+
+// Returned by http_stats_percentile() when the percentile falls in the last
+// bucket, which has no upper limit.
+#define HTTP_STATS_UNBOUNDED ((sqlite3_int64)(~(sqlite3_uint64)0 >> 1))
+
+// Estimate the latency within which the fraction q of the requests completed.
+// Returns the limit of the histogram bucket the percentile falls in,
+// HTTP_STATS_UNBOUNDED if it is slower than every limit, or -1 if there are no
+// requests.
+sqlite3_int64 http_stats_percentile(const http_stats_host* pHost, double q);
+
+// Process-wide trace of the most recent requests. Finished requests are
+// written to a ring buffer of fixed-size entries without taking locks, and
+// requests slower than a threshold are also kept in a smaller ring, so that
+// outliers survive bursts of fast requests.
+#define HTTP_TRACE_METHOD 0
+#define HTTP_TRACE_URL 1
+#define HTTP_TRACE_ERROR 2
+#define HTTP_TRACE_SQL 3
+
+// Room for the method, URL, error message and statement text of an entry,
+// not counting their terminators. Longer texts are truncated.
+#define HTTP_TRACE_TEXT 188
+
+typedef struct http_trace_entry http_trace_entry;
+struct http_trace_entry {
+    // Twice the id of the request while it is written, one more once it is
+    // complete. Zero for an unused entry.
+    sqlite3_int64 iSeq;
+    // Wall-clock time the request started, in microseconds since the epoch.
+    sqlite3_int64 iStarted;
+    sqlite3_int64 usTotal;
+    sqlite3_int64 szSent;
+    sqlite3_int64 szReceived;
+    // Phase timings from the backend, -1 if unknown.
+    int usDns;
+    int usConnect;
+    int usTls;
+    int usFirstByte;
+    int iStatusCode;
+    char bSlow;
+    char aText[HTTP_TRACE_TEXT + 4];
 };
 
-int http_do_request(http_request* req, http_response* resp, char** ppErrMsg);
+// Enable or disable tracing. Requests that take at least usSlow microseconds
+// are kept in the ring of slow requests, zero disables it and a negative value
+// keeps the current threshold.
+void http_trace_configure(int bEnable, sqlite3_int64 usSlow);
+int http_trace_enabled();
+
+// Record a finished request if tracing is enabled. zErrMsg is only looked at
+// if the request failed.
+void http_trace_record(const http_request* req,
+                       const http_response* resp,
+                       int rc,
+                       const char* zErrMsg,
+                       sqlite3_int64 usElapsed);
+
+// Copy the complete entries of both rings into an array ordered by request
+// id. The array must be released with sqlite3_free().
+int http_trace_snapshot(http_trace_entry** paEntry, int* pnEntry);
+
+// One of the texts of an entry, NULL if it is empty.
+const char* http_trace_text(const http_trace_entry* pEntry, int iText);
+
+// Character classes used when parsing, looking up and building headers. The
+// table does not depend on the locale, bytes 0x80-0xff belong to no class.
+#define HTTP_CHAR_TOKEN 1 // tchar of RFC 9110, the characters of a header name
+#define HTTP_CHAR_WS 2    // space and horizontal tab
+#define HTTP_CHAR_VCHAR 4 // visible ASCII characters
+#define HTTP_CHAR_DIGIT 8
+#define HTTP_CHAR_UPPER 16
+
+extern const unsigned char http_char_class[256];
+
+#define http_char_is(c, mask) ((http_char_class[(unsigned char)(c)] & (mask)) != 0)
+#define http_char_lower(c) \
+    (http_char_is(c, HTTP_CHAR_UPPER) ? (unsigned char)(c) | 0x20 : (unsigned char)(c))
+
+// Compare two header names case-insensitively. Returns non-zero if equal.
+int http_header_name_eq(const char* zA, int nA, const char* zB, int nB);
 
 int http_next_header(const char* headers,
                      int size,
@@ -63,6 +355,50 @@ int http_next_header(const char* headers,
                      const char** ppValue,
                      int* pValueSize);
 
+// An incremental version of http_next_header() for headers that arrive in
+// pieces. Chunks of any size are passed to http_header_parser_feed() and
+// headers are taken out with http_header_parser_next(), which returns
+//
+// - SQLITE_ROW with the next header,
+// - SQLITE_DONE at the empty line ending the headers,
+// - SQLITE_OK when it needs more input,
+// - SQLITE_ERROR on malformed input or SQLITE_NOMEM.
+//
+// A header cannot be returned before the first byte of the next line has been
+// seen, since that line may continue the value. Only the bytes of a header
+// that is split between chunks are copied, everything else is parsed in place.
+// Returned names and values are valid until the next call to the parser and
+// as long as the chunk they were fed in.
+typedef struct http_header_parser http_header_parser;
+struct http_header_parser {
+    const char* zIn;
+    int nIn;
+    int iScan;
+    int bLineEnd;
+    int bCR;
+    int bEof;
+    int rc;
+    char* zCarry;
+    int nCarry;
+    int nCarryAlloc;
+    // Offset of zIn in the whole input, and of the last header returned,
+    // which is where its name starts.
+    int iIn;
+    int iHeader;
+};
+
+void http_header_parser_init(http_header_parser* p);
+void http_header_parser_clear(http_header_parser* p);
+// The parser must have returned SQLITE_OK (or not been used) before feeding.
+void http_header_parser_feed(http_header_parser* p, const char* zData, int nData);
+// Signal that there is no more input, the last header may now be returned.
+void http_header_parser_finish(http_header_parser* p);
+int http_header_parser_next(http_header_parser* p,
+                            const char** ppName,
+                            int* pNameSize,
+                            const char** ppValue,
+                            int* pValueSize);
+
 void remove_all_but_last_headers(char* zHeaders);
 void separate_status_and_headers(char** ppStatus, char* zHeaders);
 
@@ -74,13 +410,123 @@ void separate_status_and_headers(char** ppStatus, char* zHeaders);
 SQLITE_EXTENSION_INIT1
 
 #include <assert.h>
-#include <ctype.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// An index of text headers. The index is built as the headers are scanned by
+// lookups, so a single lookup costs no more than scanning the text and every
+// further lookup on the same text is a hash probe that resumes the scan only
+// if the name has not been seen yet. The index owns a copy of the text, so it
+// can be shared between the connection, auxiliary data and cursors.
+typedef struct http_headers_index http_headers_index;
+struct http_headers_index {
+    int nRef;
+    // Set once the index has been attached to a function argument.
+    int bAuxData;
+    char* zText;
+    int nText;
+    int nTextAlloc;
+    // How much of the text has been indexed, and SQLITE_ROW while there is
+    // more to index, SQLITE_DONE at the end or SQLITE_ERROR if malformed.
+    int nParsed;
+    int eState;
+    // Name offset, name size, value offset and value size of each header. The
+    // value offset is -1 if the value is empty.
+    int* aHeader;
+    int nHeaders;
+    int nHeadersAlloc;
+    // Hash slots, 1 + index of the first header with the name or 0 if empty.
+    // Only the first nHashed headers are in the table, the rest are added
+    // when the index is used for another lookup.
+    int* aSlot;
+    int nSlots;
+    int nHashed;
+};
+
+static void httpHeadersIndexUnref(void* p) {
+    http_headers_index* pIndex = (http_headers_index*)p;
+    if (pIndex && --pIndex->nRef == 0) {
+        sqlite3_free(pIndex->zText);
+        sqlite3_free(pIndex->aHeader);
+        sqlite3_free(pIndex->aSlot);
+        sqlite3_free(pIndex);
+    }
+}
+
+// State shared by all the functions and modules registered on a single
+// database connection. Every registration holds a reference and the state is
+// freed when the last function or module is destroyed.
+typedef struct http_ext http_ext;
+struct http_ext {
+    int nRef;
+    sqlite3* db;
+    http_pool* pPool;
+    // Set by http_max_body_size(), zero means SQLITE_LIMIT_LENGTH.
+    sqlite3_int64 szMaxBody;
+    // Index of the headers last looked up on this connection, see
+    // httpHeadersCached().
+    http_headers_index* pLastIndex;
+};
+
+// Bodies larger than the maximum length of a blob could not be returned
+// anyway, so never download more than that.
+static sqlite3_int64 httpMaxBodySize(http_ext* pExt) {
+    sqlite3_int64 szLimit = sqlite3_limit(pExt->db, SQLITE_LIMIT_LENGTH, -1);
+    if (pExt->szMaxBody > 0 && pExt->szMaxBody < szLimit) {
+        return pExt->szMaxBody;
+    }
+    return szLimit;
+}
+
+// The text of the statement making a request, for http_trace. SQLite does not
+// tell a function or a virtual table which statement calls it, so this is the
+// most recently prepared statement of the calling connection that is running.
+// Statements are listed most recently prepared first, so a nested statement
+// is found before the one running it. When several unrelated statements are
+// stepped at once, the request may be attributed to the wrong one.
+static const char* httpRunningSql(sqlite3* db) {
+    sqlite3_stmt* pStmt = NULL;
+    if (!http_trace_enabled()) {
+        return NULL;
+    }
+    while ((pStmt = sqlite3_next_stmt(db, pStmt)) != NULL) {
+        if (sqlite3_stmt_busy(pStmt)) {
+            return sqlite3_sql(pStmt);
+        }
+    }
+    return NULL;
+}
+
+static void httpExtUnref(void* p) {
+    http_ext* pExt = (http_ext*)p;
+    if (--pExt->nRef == 0) {
+        http_pool_close(pExt->pPool);
+        http_async_unref();
+        httpHeadersIndexUnref(pExt->pLastIndex);
+        sqlite3_free(pExt);
+    }
+}
+
 typedef struct http_vtab http_vtab;
 struct http_vtab {
     sqlite3_vtab base;
     char* zMethod;
+    http_ext* pExt;
+};
+
+// A cursor returns one row per distinct URL. Usually there is just one, but
+// a request_url IN (...) constraint is handled by fetching the whole list
+// concurrently.
+typedef struct http_cursor_item http_cursor_item;
+struct http_cursor_item {
+    http_request req;
+    http_response resp;
 };
 
 typedef struct http_cursor http_cursor;
@@ -88,9 +534,138 @@ struct http_cursor {
     sqlite3_vtab_cursor base;
     sqlite3_int64 iRowid;
     http_request req;
-    http_response resp;
+    http_batch* pBatch;
+    http_cursor_item* aItem;
+    int nItem;
+    http_cursor_item* pCurrent;
+};
+
+void* http_body_realloc(void* pBody, sqlite3_int64 nBytes) {
+    sqlite3_int64* p = pBody ? (sqlite3_int64*)pBody - 1 : NULL;
+    assert(!p || *p == 1);
+    p = sqlite3_realloc64(p, sizeof(*p) + nBytes);
+    if (!p) {
+        return NULL;
+    }
+    if (!pBody) {
+        *p = 1;
+    }
+    return p + 1;
+}
+
+// Bodies are shared with the threads of http_async, so their reference count
+// is updated atomically. Releasing a reference must make the writes to the
+// body visible to the thread that frees it.
+#ifdef _MSC_VER
+#define body_ref_increment(p) _InterlockedIncrement64(p)
+#define body_ref_decrement(p) _InterlockedDecrement64(p)
+#else
+#define body_ref_increment(p) __atomic_add_fetch((p), 1, __ATOMIC_RELAXED)
+#define body_ref_decrement(p) __atomic_sub_fetch((p), 1, __ATOMIC_ACQ_REL)
+#endif
+
+void* http_body_ref(void* pBody) {
+    if (pBody) {
+        body_ref_increment((sqlite3_int64*)pBody - 1);
+    }
+    return pBody;
+}
+
+void http_body_unref(void* pBody) {
+    sqlite3_int64* p;
+    if (!pBody) {
+        return;
+    }
+    p = (sqlite3_int64*)pBody - 1;
+    if (body_ref_decrement(p) == 0) {
+        sqlite3_free(p);
+    }
+}
+
+int http_response_reserve(http_response* resp, sqlite3_int64 nBytes) {
+    sqlite3_int64 szNeeded = resp->szBody + nBytes;
+    sqlite3_int64 szAlloc;
+    void* p;
+    if (szNeeded <= resp->szBodyAlloc) {
+        return SQLITE_OK;
+    }
+    szAlloc = resp->szBodyAlloc * 2;
+    if (szAlloc < szNeeded) {
+        szAlloc = szNeeded;
+    }
+    p = http_body_realloc(resp->pBody, szAlloc);
+    if (!p) {
+        return SQLITE_NOMEM;
+    }
+    resp->pBody = p;
+    resp->szBodyAlloc = szAlloc;
+    return SQLITE_OK;
+}
+
+static const struct {
+    const char* zName;
+    int nName;
+} aHttpMeta[HTTP_META_COUNT] = {
+    {"content-type", 12},
+    {"content-length", 14},
+    {"etag", 4},
+    {"last-modified", 13},
+    {"content-encoding", 16},
 };
 
+void http_response_capture_meta(http_response* resp, int iOffset, int nBytes) {
+    const char* zHeaders = resp->zHeaders + iOffset;
+    const char* pName;
+    int iNameSize;
+    const char* pValue;
+    int iValueSize;
+    int nParsed;
+
+    while (nBytes > 0 && http_next_header(zHeaders,
+                                          nBytes,
+                                          &nParsed,
+                                          &pName,
+                                          &iNameSize,
+                                          &pValue,
+                                          &iValueSize) == SQLITE_ROW) {
+        http_response_capture_header(resp,
+                                     pName,
+                                     iNameSize,
+                                     (int)((pValue ? pValue : pName) - resp->zHeaders),
+                                     iValueSize);
+        zHeaders += nParsed;
+        nBytes -= nParsed;
+    }
+}
+
+void http_response_capture_header(
+    http_response* resp, const char* zName, int nName, int iValue, int nValue) {
+    int i;
+    for (i = 0; i < HTTP_META_COUNT; ++i) {
+        if (resp->aMetaOffset[i] == 0 &&
+            http_header_name_eq(aHttpMeta[i].zName, aHttpMeta[i].nName, zName, nName)) {
+            resp->aMetaOffset[i] = 1 + iValue;
+            resp->aMetaSize[i] = nValue;
+            break;
+        }
+    }
+}
+
+sqlite3_int64 http_parse_content_length(const char* zValue, int nValue) {
+    sqlite3_int64 iValue = 0;
+    int i;
+    if (nValue == 0) {
+        return -1;
+    }
+    for (i = 0; i < nValue; i++) {
+        if (!http_char_is(zValue[i], HTTP_CHAR_DIGIT) || iValue > ((sqlite3_int64)1 << 56)) {
+            return -1;
+        }
+        iValue = iValue * 10 + (zValue[i] - '0');
+    }
+    return iValue;
+}
+
 // If zHeaders contains headers for multiple responses, then this will strip
 // headers from all but the last response.
 void remove_all_but_last_headers(char* zHeaders) {
@@ -125,6 +700,18 @@ void separate_status_and_headers(char** ppStatus, char* zHeaders) {
     memmove(zHeaders, cr + 2, strlen(cr + 2) + 1);
 }
 
+#define HTTP_META_COLUMNS                                                                          \
+    "response_content_type TEXT HIDDEN, response_content_length INT HIDDEN, "                      \
+    "response_etag TEXT HIDDEN, response_last_modified TEXT HIDDEN, "                              \
+    "response_content_encoding TEXT HIDDEN"
+
+#define HTTP_TRANSFER_COLUMNS                                                                      \
+    "transfer_dns_us INT HIDDEN, transfer_connect_us INT HIDDEN, transfer_tls_us INT HIDDEN, "     \
+    "transfer_first_byte_us INT HIDDEN, transfer_total_us INT HIDDEN, "                            \
+    "transfer_bytes_sent INT HIDDEN, transfer_bytes_received INT HIDDEN, "                         \
+    "transfer_new_connections INT HIDDEN, transfer_redirects INT HIDDEN, "                         \
+    "transfer_effective_url TEXT HIDDEN, transfer_http_version TEXT HIDDEN"
+
 static int httpConnect(sqlite3* db,
                        void* pAux,
                        int argc,
@@ -132,16 +719,34 @@ static int httpConnect(sqlite3* db,
                        sqlite3_vtab** ppVtab,
                        char** pzErr) {
     http_vtab* pNew;
+    int bIsDo = sqlite3_stricmp(argv[0], "http_do") == 0;
     int rc;
 
-    rc = sqlite3_declare_vtab(db,
-                              "CREATE TABLE x(response_status TEXT, "
-                              "response_status_code INT, response_headers TEXT, "
-                              "response_body BLOB, request_method TEXT HIDDEN, "
-                              "request_url TEXT HIDDEN, "
-                              "request_headers TEXT HIDDEN, "
-                              "request_body BLOB HIDDEN)");
+    // Table-valued function arguments map to the hidden columns in order. For
+    // http_get and http_post the method is implied, so it comes last. Values
+    // of common response headers follow the arguments, in the order of the
+    // HTTP_META_* constants, and then the details of the transfer.
+    if (bIsDo) {
+        rc = sqlite3_declare_vtab(db,
+                                  "CREATE TABLE x(response_status TEXT, "
+                                  "response_status_code INT, response_headers TEXT, "
+                                  "response_body BLOB, request_method TEXT HIDDEN, "
+                                  "request_url TEXT HIDDEN, "
+                                  "request_headers TEXT HIDDEN, "
+                                  "request_body BLOB HIDDEN, " HTTP_META_COLUMNS
+                                  ", " HTTP_TRANSFER_COLUMNS ")");
+    } else {
+        rc = sqlite3_declare_vtab(db,
+                                  "CREATE TABLE x(response_status TEXT, "
+                                  "response_status_code INT, response_headers TEXT, "
+                                  "response_body BLOB, request_url TEXT HIDDEN, "
+                                  "request_headers TEXT HIDDEN, "
+                                  "request_body BLOB HIDDEN, "
+                                  "request_method TEXT HIDDEN, " HTTP_META_COLUMNS
+                                  ", " HTTP_TRANSFER_COLUMNS ")");
+    }
 
+// Column numbers of http_do. See httpColumnIndex().
 #define HTTP_COL_RESPONSE_STATUS 0
 #define HTTP_COL_RESPONSE_STATUS_CODE 1
 #define HTTP_COL_RESPONSE_HEADERS 2
@@ -150,6 +755,22 @@ static int httpConnect(sqlite3* db,
 #define HTTP_COL_REQUEST_URL 5
 #define HTTP_COL_REQUEST_HEADERS 6
 #define HTTP_COL_REQUEST_BODY 7
+#define HTTP_COL_RESPONSE_CONTENT_TYPE 8
+#define HTTP_COL_RESPONSE_CONTENT_LENGTH 9
+#define HTTP_COL_RESPONSE_ETAG 10
+#define HTTP_COL_RESPONSE_LAST_MODIFIED 11
+#define HTTP_COL_RESPONSE_CONTENT_ENCODING 12
+#define HTTP_COL_TRANSFER_DNS 13
+#define HTTP_COL_TRANSFER_CONNECT 14
+#define HTTP_COL_TRANSFER_TLS 15
+#define HTTP_COL_TRANSFER_FIRST_BYTE 16
+#define HTTP_COL_TRANSFER_TOTAL 17
+#define HTTP_COL_TRANSFER_BYTES_SENT 18
+#define HTTP_COL_TRANSFER_BYTES_RECEIVED 19
+#define HTTP_COL_TRANSFER_NEW_CONNECTIONS 20
+#define HTTP_COL_TRANSFER_REDIRECTS 21
+#define HTTP_COL_TRANSFER_EFFECTIVE_URL 22
+#define HTTP_COL_TRANSFER_HTTP_VERSION 23
 
     if (rc == SQLITE_OK) {
         pNew = sqlite3_malloc(sizeof(*pNew));
@@ -157,6 +778,7 @@ static int httpConnect(sqlite3* db,
         if (pNew == 0)
             return SQLITE_NOMEM;
         memset(pNew, 0, sizeof(*pNew));
+        pNew->pExt = (http_ext*)pAux;
         if (sqlite3_stricmp(argv[0], "http_get") == 0) {
             pNew->zMethod = sqlite3_mprintf("GET");
         } else if (sqlite3_stricmp(argv[0], "http_post") == 0) {
@@ -166,6 +788,15 @@ static int httpConnect(sqlite3* db,
     return rc;
 }
 
+// Map a column number of the table to the http_do column numbering.
+static int httpColumnIndex(const http_vtab* pVtab, int iColumn) {
+    if (pVtab->zMethod == NULL || iColumn < HTTP_COL_REQUEST_METHOD ||
+        iColumn > HTTP_COL_REQUEST_BODY) {
+        return iColumn;
+    }
+    return iColumn == HTTP_COL_REQUEST_BODY ? HTTP_COL_REQUEST_METHOD : iColumn + 1;
+}
+
 static int httpDisconnect(sqlite3_vtab* pVtab) {
     http_vtab* p = (http_vtab*)pVtab;
     sqlite3_free(p->zMethod);
@@ -175,76 +806,208 @@ static int httpDisconnect(sqlite3_vtab* pVtab) {
 
 static int httpOpen(sqlite3_vtab* p, sqlite3_vtab_cursor** ppCursor) {
     http_cursor* pCur;
-    http_vtab* pVtab = (http_vtab*)p;
     pCur = sqlite3_malloc(sizeof(*pCur));
     if (pCur == 0)
         return SQLITE_NOMEM;
     memset(pCur, 0, sizeof(*pCur));
-    if (pVtab->zMethod) {
-        pCur->req.zMethod = sqlite3_mprintf("%s", pVtab->zMethod);
-    }
     *ppCursor = &pCur->base;
     return SQLITE_OK;
 }
 
+static void httpReset(http_cursor* pCur) {
+    int i;
+    http_batch_close(pCur->pBatch);
+    for (i = 0; i < pCur->nItem; ++i) {
+        sqlite3_free(pCur->aItem[i].req.zUrl);
+        http_body_unref(pCur->aItem[i].resp.pBody);
+        sqlite3_free(pCur->aItem[i].resp.zHeaders);
+        sqlite3_free(pCur->aItem[i].resp.zStatus);
+        sqlite3_free(pCur->aItem[i].resp.zEffectiveUrl);
+    }
+    sqlite3_free(pCur->aItem);
+    sqlite3_free(pCur->req.zMethod);
+    sqlite3_free((void*)pCur->req.zHeaders);
+    sqlite3_free((void*)pCur->req.pBody);
+    memset(&pCur->req, 0, sizeof(pCur->req));
+    pCur->pBatch = NULL;
+    pCur->aItem = NULL;
+    pCur->nItem = 0;
+    pCur->pCurrent = NULL;
+    pCur->iRowid = 0;
+}
+
 static int httpClose(sqlite3_vtab_cursor* cur) {
     http_cursor* pCur = (http_cursor*)cur;
-    sqlite3_free(pCur->resp.pBody);
-    sqlite3_free(pCur->req.zUrl);
-    sqlite3_free(pCur->req.zMethod);
+    httpReset(pCur);
     sqlite3_free(pCur);
     return SQLITE_OK;
 }
 
 static int httpNext(sqlite3_vtab_cursor* cur) {
     http_cursor* pCur = (http_cursor*)cur;
+    void* pArg = NULL;
+    int rcItem = SQLITE_OK;
+    char* zErrMsg = NULL;
+    int rc;
+
+    pCur->pCurrent = NULL;
+
+    if (!pCur->pBatch) {
+        return SQLITE_OK;
+    }
+
+    rc = http_batch_next(pCur->pBatch, &pArg, &rcItem, &zErrMsg);
+    if (rc == SQLITE_DONE) {
+        return SQLITE_OK;
+    }
+    if (rc == SQLITE_ROW) {
+        rc = rcItem;
+    }
+    if (rc != SQLITE_OK) {
+        sqlite3_free(cur->pVtab->zErrMsg);
+        cur->pVtab->zErrMsg = zErrMsg;
+        return rc;
+    }
+
+    pCur->pCurrent = (http_cursor_item*)pArg;
     pCur->iRowid++;
+
     return SQLITE_OK;
 }
 
+// Return a transfer detail, or NULL if the backend does not report it.
+static void httpResultTransfer(sqlite3_context* ctx, http_response* resp, sqlite3_int64 iValue) {
+    if (resp->bTransfer && iValue >= 0) {
+        sqlite3_result_int64(ctx, iValue);
+    }
+}
+
 static int httpColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
     http_cursor* pCur = (http_cursor*)cur;
+    http_request* req = &pCur->pCurrent->req;
+    http_response* resp = &pCur->pCurrent->resp;
+    int iColumn = httpColumnIndex((http_vtab*)cur->pVtab, i);
+    int iMeta;
 
-    switch (i) {
+    switch (iColumn) {
     case HTTP_COL_RESPONSE_STATUS:
-        sqlite3_result_text(ctx, pCur->resp.zStatus, -1, SQLITE_TRANSIENT);
+        sqlite3_result_text(ctx, resp->zStatus, -1, SQLITE_TRANSIENT);
         break;
 
     case HTTP_COL_RESPONSE_STATUS_CODE:
-        sqlite3_result_int(ctx, pCur->resp.iStatusCode);
+        sqlite3_result_int(ctx, resp->iStatusCode);
         break;
 
     case HTTP_COL_RESPONSE_HEADERS:
-        sqlite3_result_text(ctx, pCur->resp.zHeaders, -1, SQLITE_TRANSIENT);
+        sqlite3_result_text(ctx, resp->zHeaders, -1, SQLITE_TRANSIENT);
         break;
 
     case HTTP_COL_RESPONSE_BODY:
-        sqlite3_result_blob(ctx, pCur->resp.pBody, pCur->resp.szBody, SQLITE_TRANSIENT);
+        sqlite3_result_blob64(ctx, http_body_ref(resp->pBody), resp->szBody, http_body_unref);
         break;
 
     case HTTP_COL_REQUEST_METHOD:
-        sqlite3_result_text(ctx, pCur->req.zMethod, -1, SQLITE_TRANSIENT);
+        sqlite3_result_text(ctx, req->zMethod, -1, SQLITE_TRANSIENT);
         break;
 
     case HTTP_COL_REQUEST_URL:
-        sqlite3_result_text(ctx, pCur->req.zUrl, -1, SQLITE_TRANSIENT);
+        sqlite3_result_text(ctx, req->zUrl, -1, SQLITE_TRANSIENT);
         break;
 
     case HTTP_COL_REQUEST_HEADERS:
-        if (pCur->req.zHeaders) {
-            sqlite3_result_text(ctx, pCur->req.zHeaders, -1, SQLITE_TRANSIENT);
+        if (req->zHeaders) {
+            sqlite3_result_text(ctx, req->zHeaders, -1, SQLITE_TRANSIENT);
         } else {
             sqlite3_result_null(ctx);
         }
         break;
 
     case HTTP_COL_REQUEST_BODY:
-        if (pCur->req.pBody) {
-            sqlite3_result_blob(ctx, pCur->req.pBody, pCur->req.szBody, SQLITE_TRANSIENT);
+        if (req->pBody) {
+            sqlite3_result_blob(ctx, req->pBody, req->szBody, SQLITE_TRANSIENT);
         } else {
             sqlite3_result_null(ctx);
         }
         break;
+
+    case HTTP_COL_RESPONSE_CONTENT_LENGTH:
+        iMeta = HTTP_META_CONTENT_LENGTH;
+        if (resp->aMetaOffset[iMeta] != 0) {
+            sqlite3_int64 szContent = http_parse_content_length(
+                resp->zHeaders + resp->aMetaOffset[iMeta] - 1, resp->aMetaSize[iMeta]);
+            if (szContent >= 0) {
+                sqlite3_result_int64(ctx, szContent);
+            }
+        }
+        break;
+
+    case HTTP_COL_RESPONSE_CONTENT_TYPE:
+    case HTTP_COL_RESPONSE_ETAG:
+    case HTTP_COL_RESPONSE_LAST_MODIFIED:
+    case HTTP_COL_RESPONSE_CONTENT_ENCODING:
+        iMeta = HTTP_META_CONTENT_TYPE + iColumn - HTTP_COL_RESPONSE_CONTENT_TYPE;
+        if (resp->aMetaOffset[iMeta] != 0) {
+            sqlite3_result_text(ctx,
+                                resp->zHeaders + resp->aMetaOffset[iMeta] - 1,
+                                resp->aMetaSize[iMeta],
+                                SQLITE_TRANSIENT);
+        }
+        break;
+
+    case HTTP_COL_TRANSFER_DNS:
+        httpResultTransfer(ctx, resp, resp->usDns);
+        break;
+
+    case HTTP_COL_TRANSFER_CONNECT:
+        httpResultTransfer(ctx, resp, resp->usConnect);
+        break;
+
+    case HTTP_COL_TRANSFER_TLS:
+        httpResultTransfer(ctx, resp, resp->usTls);
+        break;
+
+    case HTTP_COL_TRANSFER_FIRST_BYTE:
+        httpResultTransfer(ctx, resp, resp->usFirstByte);
+        break;
+
+    case HTTP_COL_TRANSFER_TOTAL:
+        httpResultTransfer(ctx, resp, resp->usTotal);
+        break;
+
+    case HTTP_COL_TRANSFER_BYTES_SENT:
+        httpResultTransfer(ctx, resp, resp->szUpload);
+        break;
+
+    case HTTP_COL_TRANSFER_BYTES_RECEIVED:
+        httpResultTransfer(ctx, resp, resp->szDownload);
+        break;
+
+    case HTTP_COL_TRANSFER_NEW_CONNECTIONS:
+        httpResultTransfer(ctx, resp, resp->nNewConnections);
+        break;
+
+    case HTTP_COL_TRANSFER_REDIRECTS:
+        httpResultTransfer(ctx, resp, resp->nRedirects);
+        break;
+
+    case HTTP_COL_TRANSFER_EFFECTIVE_URL:
+        if (resp->bTransfer) {
+            sqlite3_result_text(
+                ctx, resp->zEffectiveUrl ? resp->zEffectiveUrl : req->zUrl, -1, SQLITE_TRANSIENT);
+        }
+        break;
+
+    case HTTP_COL_TRANSFER_HTTP_VERSION:
+        if (resp->bTransfer && resp->iHttpVersion > 0) {
+            sqlite3_result_text(ctx,
+                                resp->iHttpVersion == 10   ? "1.0"
+                                : resp->iHttpVersion == 11 ? "1.1"
+                                : resp->iHttpVersion == 20 ? "2"
+                                                           : "3",
+                                -1,
+                                SQLITE_STATIC);
+        }
+        break;
     }
 
     return SQLITE_OK;
@@ -258,13 +1021,88 @@ static int httpRowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
 
 static int httpEof(sqlite3_vtab_cursor* cur) {
     http_cursor* pCur = (http_cursor*)cur;
-    return pCur->iRowid >= 1;
+    return pCur->pCurrent == NULL;
 }
 
 #define HTTP_FLAG_METHOD 1
 #define HTTP_FLAG_URL 2
 #define HTTP_FLAG_HEADERS 4
 #define HTTP_FLAG_BODY 8
+#define HTTP_FLAG_URL_IN 16
+#define HTTP_FLAG_NO_BODY 32
+#define HTTP_FLAG_NO_HEADERS 64
+
+// Maximum number of concurrent requests for a request_url IN (...) list.
+#define HTTP_IN_CONCURRENCY 16
+
+static int compare_strings(const void* a, const void* b) {
+    return strcmp(*(const char**)a, *(const char**)b);
+}
+
+// Collect the distinct URLs of an IN (...) list into the cursor.
+static int httpLoadUrlList(http_cursor* pCur, sqlite3_value* pList) {
+    char** azUrl = NULL;
+    int nUrl = 0;
+    int nAlloc = 0;
+    sqlite3_value* pValue;
+    int rc;
+    int i;
+
+    for (rc = sqlite3_vtab_in_first(pList, &pValue); rc == SQLITE_OK && pValue;
+         rc = sqlite3_vtab_in_next(pList, &pValue)) {
+        if (sqlite3_value_type(pValue) == SQLITE_NULL) {
+            continue;
+        }
+        if (nUrl == nAlloc) {
+            char** azNew;
+            nAlloc = nAlloc ? nAlloc * 2 : 16;
+            azNew = sqlite3_realloc(azUrl, sizeof(*azNew) * nAlloc);
+            if (!azNew) {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            azUrl = azNew;
+        }
+        azUrl[nUrl] = sqlite3_mprintf("%s", sqlite3_value_text(pValue));
+        if (!azUrl[nUrl]) {
+            rc = SQLITE_NOMEM;
+            break;
+        }
+        nUrl++;
+    }
+
+    if (rc == SQLITE_DONE) {
+        rc = SQLITE_OK;
+    }
+
+    if (rc == SQLITE_OK && nUrl > 0) {
+        pCur->aItem = sqlite3_malloc(sizeof(*pCur->aItem) * nUrl);
+        if (!pCur->aItem) {
+            rc = SQLITE_NOMEM;
+        }
+    }
+
+    if (rc == SQLITE_OK) {
+        qsort(azUrl, nUrl, sizeof(*azUrl), compare_strings);
+        for (i = 0; i < nUrl; ++i) {
+            if (pCur->nItem > 0 && strcmp(pCur->aItem[pCur->nItem - 1].req.zUrl, azUrl[i]) == 0) {
+                sqlite3_free(azUrl[i]);
+                continue;
+            }
+            memset(&pCur->aItem[pCur->nItem], 0, sizeof(pCur->aItem[0]));
+            pCur->aItem[pCur->nItem].req.zUrl = azUrl[i];
+            pCur->nItem++;
+        }
+    } else {
+        for (i = 0; i < nUrl; ++i) {
+            sqlite3_free(azUrl[i]);
+        }
+    }
+
+    sqlite3_free(azUrl);
+
+    return rc;
+}
 
 static int httpFilter(sqlite3_vtab_cursor* pVtabCursor,
                       int idxNum,
@@ -273,35 +1111,107 @@ static int httpFilter(sqlite3_vtab_cursor* pVtabCursor,
                       sqlite3_value** argv) {
     http_cursor* pCur = (http_cursor*)pVtabCursor;
     http_vtab* pVtab = (http_vtab*)pVtabCursor->pVtab;
-    int bIsDo = pVtab->zMethod == NULL;
+    sqlite3_value* pUrl;
     char* zErrMsg = NULL;
-    int rc;
-    if (bIsDo) {
-        pCur->req.zMethod = sqlite3_mprintf("%s", sqlite3_value_text(argv[0]));
-        pCur->req.zUrl = sqlite3_mprintf("%s", sqlite3_value_text(argv[1]));
-        if (idxNum & HTTP_FLAG_HEADERS) {
-            pCur->req.zHeaders = sqlite3_mprintf("%s", sqlite3_value_text(argv[2]));
+    int iArg = 0;
+    int rc = SQLITE_OK;
+    int i;
+
+    httpReset(pCur);
+
+    if (idxNum & HTTP_FLAG_METHOD) {
+        pCur->req.zMethod = sqlite3_mprintf("%s", sqlite3_value_text(argv[iArg++]));
+    } else {
+        pCur->req.zMethod = sqlite3_mprintf("%s", pVtab->zMethod);
+    }
+    pUrl = argv[iArg++];
+    if (idxNum & HTTP_FLAG_HEADERS) {
+        pCur->req.zHeaders = sqlite3_mprintf("%s", sqlite3_value_text(argv[iArg++]));
+    }
+    if (idxNum & HTTP_FLAG_BODY) {
+        // The body must outlive this call when requests run in a batch.
+        pCur->req.szBody = sqlite3_value_bytes(argv[iArg]);
+        pCur->req.pBody = sqlite3_malloc64(pCur->req.szBody + 1);
+        if (pCur->req.pBody) {
+            memcpy((void*)pCur->req.pBody, sqlite3_value_blob(argv[iArg]), pCur->req.szBody);
         }
-        if (idxNum & HTTP_FLAG_BODY) {
-            pCur->req.szBody = sqlite3_value_bytes(argv[3]);
-            pCur->req.pBody = sqlite3_value_blob(argv[3]);
+        iArg++;
+    }
+
+    if (!pCur->req.zMethod || ((idxNum & HTTP_FLAG_BODY) && !pCur->req.pBody)) {
+        return SQLITE_NOMEM;
+    }
+
+    if (idxNum & HTTP_FLAG_NO_BODY) {
+        pCur->req.flags |= HTTP_REQUEST_NO_BODY;
+    }
+    if (idxNum & HTTP_FLAG_NO_HEADERS) {
+        pCur->req.flags |= HTTP_REQUEST_NO_HEADERS;
+    }
+    pCur->req.szMaxBody = httpMaxBodySize(pVtab->pExt);
+    pCur->req.zSql = httpRunningSql(pVtab->pExt->db);
+
+    if (idxNum & HTTP_FLAG_URL_IN) {
+        rc = httpLoadUrlList(pCur, pUrl);
+        if (rc != SQLITE_OK) {
+            return rc;
         }
     } else {
-        pCur->req.zUrl = sqlite3_mprintf("%s", sqlite3_value_text(argv[0]));
-        if (idxNum & HTTP_FLAG_HEADERS) {
-            pCur->req.zHeaders = sqlite3_mprintf("%s", sqlite3_value_text(argv[1]));
+        pCur->aItem = sqlite3_malloc(sizeof(*pCur->aItem));
+        if (!pCur->aItem) {
+            return SQLITE_NOMEM;
         }
-        if (idxNum & HTTP_FLAG_BODY) {
-            pCur->req.szBody = sqlite3_value_bytes(argv[2]);
-            pCur->req.pBody = sqlite3_value_blob(argv[2]);
+        memset(pCur->aItem, 0, sizeof(*pCur->aItem));
+        pCur->aItem->req.zUrl = sqlite3_mprintf("%s", sqlite3_value_text(pUrl));
+        pCur->nItem = 1;
+    }
+
+    for (i = 0; i < pCur->nItem; ++i) {
+        http_request* req = &pCur->aItem[i].req;
+        req->zMethod = pCur->req.zMethod;
+        req->zHeaders = pCur->req.zHeaders;
+        req->pBody = pCur->req.pBody;
+        req->szBody = pCur->req.szBody;
+        req->flags = pCur->req.flags;
+        req->szMaxBody = pCur->req.szMaxBody;
+        req->zSql = pCur->req.zSql;
+    }
+
+    if (!(idxNum & HTTP_FLAG_URL_IN)) {
+        rc = http_do_request(pVtab->pExt->pPool, &pCur->aItem->req, &pCur->aItem->resp, &zErrMsg);
+        if (rc != SQLITE_OK) {
+            sqlite3_free(pCur->base.pVtab->zErrMsg);
+            pCur->base.pVtab->zErrMsg = zErrMsg;
+            return rc;
         }
+        pCur->pCurrent = pCur->aItem;
+        pCur->iRowid = 1;
+        return SQLITE_OK;
+    }
+
+    rc = http_batch_open(pVtab->pExt->pPool, HTTP_IN_CONCURRENCY, &pCur->pBatch, &zErrMsg);
+    for (i = 0; i < pCur->nItem && rc == SQLITE_OK; ++i) {
+        http_cursor_item* pItem = &pCur->aItem[i];
+        rc = http_batch_add(pCur->pBatch, &pItem->req, &pItem->resp, pItem);
     }
-    rc = http_do_request(&pCur->req, &pCur->resp, &zErrMsg);
     if (rc != SQLITE_OK) {
         sqlite3_free(pCur->base.pVtab->zErrMsg);
         pCur->base.pVtab->zErrMsg = zErrMsg;
+        return rc;
     }
-    return rc;
+
+    return httpNext(pVtabCursor);
+}
+
+// Ask SQLite to pass the whole right-hand side of an IN constraint at once.
+// sqlite3_vtab_in() only exists since 3.38.0, older versions pass one value
+// at a time as an equality constraint.
+static int httpVtabInAll(sqlite3_index_info* pIdxInfo, int iConstraint) {
+    if (sqlite3_libversion_number() < 3038000 || !sqlite3_vtab_in(pIdxInfo, iConstraint, -1)) {
+        return 0;
+    }
+    sqlite3_vtab_in(pIdxInfo, iConstraint, 1);
+    return 1;
 }
 
 static int httpBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
@@ -309,60 +1219,55 @@ static int httpBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
     int bIsDo = pTab->zMethod == NULL;
     int i;
     int idxNum = 0;
+    int aConstraint[HTTP_COL_REQUEST_BODY + 1];
+    int nArg = 0;
     const struct sqlite3_index_constraint* pConstraint;
 
+    for (i = 0; i <= HTTP_COL_REQUEST_BODY; ++i) {
+        aConstraint[i] = -1;
+    }
+
     pConstraint = pIdxInfo->aConstraint;
 
     for (i = 0; i < pIdxInfo->nConstraint; ++i, ++pConstraint) {
-        if (!pIdxInfo->aConstraint[i].usable) {
+        int iColumn = httpColumnIndex(pTab, pConstraint->iColumn);
+        // Constraints on the response are checked by SQLite.
+        if (iColumn < HTTP_COL_REQUEST_METHOD || iColumn > HTTP_COL_REQUEST_BODY) {
+            continue;
+        }
+        if (!pConstraint->usable) {
             return SQLITE_CONSTRAINT;
         }
         if (pConstraint->op != SQLITE_INDEX_CONSTRAINT_EQ) {
             return SQLITE_CONSTRAINT;
         };
-        switch (pConstraint->iColumn) {
+        switch (iColumn) {
         case HTTP_COL_REQUEST_METHOD:
-            if (bIsDo) {
-                idxNum |= HTTP_FLAG_METHOD;
-            } else {
-                idxNum |= HTTP_FLAG_URL;
+            if (!bIsDo) {
+                sqlite3_free(tab->zErrMsg);
+                tab->zErrMsg = sqlite3_mprintf("too many arguments");
+                return SQLITE_ERROR;
             }
-            pIdxInfo->aConstraintUsage[i].argvIndex = 1;
-            pIdxInfo->aConstraintUsage[i].omit = 1;
+            idxNum |= HTTP_FLAG_METHOD;
             break;
 
         case HTTP_COL_REQUEST_URL:
-            if (bIsDo) {
-                idxNum |= HTTP_FLAG_URL;
-            } else {
-                idxNum |= HTTP_FLAG_HEADERS;
+            idxNum |= HTTP_FLAG_URL;
+            // Fetch the whole list at once instead of one request per value.
+            if (httpVtabInAll(pIdxInfo, i)) {
+                idxNum |= HTTP_FLAG_URL_IN;
             }
-            pIdxInfo->aConstraintUsage[i].argvIndex = 2;
-            pIdxInfo->aConstraintUsage[i].omit = 1;
             break;
 
         case HTTP_COL_REQUEST_HEADERS:
-            if (bIsDo) {
-                idxNum |= HTTP_FLAG_HEADERS;
-            } else {
-                idxNum |= HTTP_FLAG_BODY;
-            }
-            pIdxInfo->aConstraintUsage[i].argvIndex = 3;
-            pIdxInfo->aConstraintUsage[i].omit = 1;
+            idxNum |= HTTP_FLAG_HEADERS;
             break;
 
         case HTTP_COL_REQUEST_BODY:
-            if (bIsDo) {
-                idxNum |= HTTP_FLAG_BODY;
-            } else {
-                sqlite3_free(tab->zErrMsg);
-                tab->zErrMsg = sqlite3_mprintf("too many arguments");
-                return SQLITE_ERROR;
-            }
-            pIdxInfo->aConstraintUsage[i].argvIndex = 4;
-            pIdxInfo->aConstraintUsage[i].omit = 1;
+            idxNum |= HTTP_FLAG_BODY;
             break;
         }
+        aConstraint[iColumn] = i;
     }
 
     if (bIsDo && !(idxNum & HTTP_FLAG_METHOD)) {
@@ -377,8 +1282,32 @@ static int httpBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
         return SQLITE_ERROR;
     }
 
-    pIdxInfo->estimatedCost = (double)1;
-    pIdxInfo->estimatedRows = 1;
+    // Arguments are passed to xFilter in column order.
+    for (i = HTTP_COL_REQUEST_METHOD; i <= HTTP_COL_REQUEST_BODY; ++i) {
+        if (aConstraint[i] >= 0) {
+            pIdxInfo->aConstraintUsage[aConstraint[i]].argvIndex = ++nArg;
+            pIdxInfo->aConstraintUsage[aConstraint[i]].omit = 1;
+        }
+    }
+
+    // The status line and the values of common headers come with the
+    // headers, so they are skipped only when none of them is read.
+    if (!(pIdxInfo->colUsed & ((sqlite3_uint64)1 << HTTP_COL_RESPONSE_BODY))) {
+        idxNum |= HTTP_FLAG_NO_BODY;
+    }
+    if (!(pIdxInfo->colUsed & (((sqlite3_uint64)1 << HTTP_COL_RESPONSE_STATUS) |
+                               ((sqlite3_uint64)1 << HTTP_COL_RESPONSE_HEADERS) |
+                               ((sqlite3_uint64)0x1f << HTTP_COL_RESPONSE_CONTENT_TYPE)))) {
+        idxNum |= HTTP_FLAG_NO_HEADERS;
+    }
+
+    if (idxNum & HTTP_FLAG_URL_IN) {
+        pIdxInfo->estimatedCost = (double)10;
+        pIdxInfo->estimatedRows = 10;
+    } else {
+        pIdxInfo->estimatedCost = (double)1;
+        pIdxInfo->estimatedRows = 1;
+    }
     pIdxInfo->idxNum = idxNum;
 
     return SQLITE_OK;
@@ -411,259 +1340,97 @@ static sqlite3_module httpModule = {
     /* xShadowName */ 0,
 };
 
-static void httpSimpleFunc(sqlite3_context* ctx,
-                           int argc,
-                           sqlite3_value** argv,
-                           const char* zTable,
-                           const char* zColumn,
-                           int bText) {
-    char* zSql;
-    int rc;
-    sqlite3_stmt* pStmt;
-
-    if (argc == 0) {
-        sqlite3_result_error(ctx, "not enough arguments", -1);
-        return;
-    }
-
-    if (argc == 1) {
-        zSql = sqlite3_mprintf(
-            "select \"%w\" from \"%w\"(%Q)", zColumn, zTable, sqlite3_value_text(argv[0]));
-    }
-
-    if (argc == 2) {
-        zSql = sqlite3_mprintf("select \"%w\" from \"%w\"(%Q, %Q)",
-                               zColumn,
-                               zTable,
-                               sqlite3_value_text(argv[0]),
-                               sqlite3_value_text(argv[1]));
-    }
-
-    if (argc == 3) {
-        zSql = sqlite3_mprintf("select \"%w\" from \"%w\"(%Q, %Q, %Q)",
-                               zColumn,
-                               zTable,
-                               sqlite3_value_text(argv[0]),
-                               sqlite3_value_text(argv[1]),
-                               sqlite3_value_text(argv[2]));
-    }
-
-    if (argc >= 4) {
-        zSql = sqlite3_mprintf("select \"%w\" from \"%w\"(%Q, %Q, %Q, %Q)",
-                               zColumn,
-                               zTable,
-                               sqlite3_value_text(argv[0]),
-                               sqlite3_value_text(argv[1]),
-                               sqlite3_value_text(argv[2]),
-                               sqlite3_value_text(argv[2]));
-    }
-
-    if (zSql == 0) {
-        sqlite3_result_error_code(ctx, SQLITE_NOMEM);
-        return;
-    }
-
-    rc = sqlite3_prepare_v2(sqlite3_context_db_handle(ctx), zSql, -1, &pStmt, 0);
-
-    sqlite3_free(zSql);
-
-    if (rc != SQLITE_OK) {
-        sqlite3_result_error_code(ctx, rc);
-        return;
-    }
-
-    rc = sqlite3_step(pStmt);
-
-    if (rc == SQLITE_ROW) {
-        int size = sqlite3_column_bytes(pStmt, 0);
-        if (bText) {
-            sqlite3_result_text(ctx, sqlite3_column_text(pStmt, 0), size, SQLITE_TRANSIENT);
-        } else {
-            sqlite3_result_blob(ctx, sqlite3_column_blob(pStmt, 0), size, SQLITE_TRANSIENT);
-        }
-        sqlite3_finalize(pStmt);
-        return;
-    }
-
-    rc = sqlite3_finalize(pStmt);
-    if (rc != SQLITE_OK) {
-        sqlite3_result_error_code(ctx, rc);
-    }
-}
-
-static void httpGetBodyFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    httpSimpleFunc(ctx, argc, argv, "http_get", "response_body", 0);
-}
-
-static void httpPostBodyFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    httpSimpleFunc(ctx, argc, argv, "http_post", "response_body", 0);
-}
-
-static void httpDoBodyFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    httpSimpleFunc(ctx, argc, argv, "http_do", "response_body", 0);
-}
-
-static void httpGetHeadersFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    httpSimpleFunc(ctx, argc, argv, "http_get", "response_headers", 1);
-}
-
-static void httpPostHeadersFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    httpSimpleFunc(ctx, argc, argv, "http_post", "response_headers", 1);
-}
-
-static void httpDoHeadersFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    httpSimpleFunc(ctx, argc, argv, "http_do", "response_headers", 1);
-}
-
-static void httpHeadersFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    char* zHeaders = NULL;
-    int i;
-    int size = 0;
-    int offset = 0;
-    if (argc < 2) {
-        sqlite3_result_error(ctx, "http_headers: expected at least 2 arguments", -1);
-        return;
-    }
-    if (argc % 2 != 0) {
-        sqlite3_result_error(ctx, "http_headers: even number of arguments expected", -1);
-        return;
-    }
-    for (i = 0; i < argc; i += 2) {
-        size += sqlite3_value_bytes(argv[i]) + 2;
-        size += sqlite3_value_bytes(argv[i + 1]) + 2;
-    }
-    zHeaders = sqlite3_malloc(size);
-    if (!zHeaders) {
-        sqlite3_result_error_code(ctx, SQLITE_NOMEM);
-        return;
-    }
-    for (i = 0; i < argc; i += 2) {
-        memcpy(zHeaders + offset, sqlite3_value_text(argv[i]), sqlite3_value_bytes(argv[i]));
-        offset += sqlite3_value_bytes(argv[i]);
-
-        memcpy(zHeaders + offset, ": ", 2);
-        offset += 2;
-
-        memcpy(
-            zHeaders + offset, sqlite3_value_text(argv[i + 1]), sqlite3_value_bytes(argv[i + 1]));
-        offset += sqlite3_value_bytes(argv[i + 1]);
-
-        memcpy(zHeaders + offset, "\r\n", 2);
-        offset += 2;
-    }
-    assert(offset == size);
-    sqlite3_result_text(ctx, zHeaders, size, sqlite3_free);
-}
-
-static void httpHeadersHasFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    int zHeadersSize = sqlite3_value_bytes(argv[0]);
-    const char* zHeaders = sqlite3_value_text(argv[0]);
-    int zHeaderSize = sqlite3_value_bytes(argv[1]);
-    const char* zHeader = sqlite3_value_text(argv[1]);
-    while (zHeadersSize > 0) {
-        int iParsed = 0;
-        const char* pName;
-        int iNameSize;
-        int rc = http_next_header(zHeaders, zHeadersSize, &iParsed, &pName, &iNameSize, NULL, NULL);
-        if (rc == SQLITE_ERROR) {
-            sqlite3_result_error(ctx, "http_headers_has: malformed headers", -1);
-            return;
-        }
-        if (rc == SQLITE_DONE) {
-            sqlite3_result_int(ctx, 0);
-            return;
-        }
-        zHeaders += iParsed;
-        zHeadersSize -= iParsed;
-        if (iNameSize == zHeaderSize && sqlite3_strnicmp(zHeader, pName, zHeaderSize) == 0) {
-            sqlite3_result_int(ctx, 1);
-            return;
-        }
-    }
-    sqlite3_result_int(ctx, 0);
-}
-
-static void httpHeadersGetFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    int zHeadersSize = sqlite3_value_bytes(argv[0]);
-    const char* zHeaders = sqlite3_value_text(argv[0]);
-    int zHeaderSize = sqlite3_value_bytes(argv[1]);
-    const char* zHeader = sqlite3_value_text(argv[1]);
-    while (zHeadersSize > 0) {
-        int iParsed = 0;
-        const char* pName;
-        int iNameSize;
-        const char* pValue;
-        int iValueSize;
-        int rc = http_next_header(
-            zHeaders, zHeadersSize, &iParsed, &pName, &iNameSize, &pValue, &iValueSize);
-        if (rc == SQLITE_ERROR) {
-            sqlite3_result_error(ctx, "http_headers_get: malformed headers", -1);
-            return;
-        }
-        if (rc == SQLITE_DONE) {
-            sqlite3_result_int(ctx, 0);
-            return;
-        }
-        zHeaders += iParsed;
-        zHeadersSize -= iParsed;
-        if (iNameSize == zHeaderSize && sqlite3_strnicmp(zHeader, pName, zHeaderSize) == 0) {
-            sqlite3_result_text(ctx, pValue, iValueSize, SQLITE_TRANSIENT);
-            return;
-        }
-    }
-}
-
-#define HTTP_HEADERS_EACH_COL_NAME 0
-#define HTTP_HEADERS_EACH_COL_VALUE 1
-#define HTTP_HEADERS_EACH_COL_HEADERS 2
-
-typedef struct http_headers_each_vtab http_headers_each_vtab;
-struct http_headers_each_vtab {
+// Default number of concurrent requests for http_get_many.
+#define HTTP_MANY_DEFAULT_CONCURRENCY 16
+
+#define HTTP_MANY_COL_REQUEST_INDEX 0
+#define HTTP_MANY_COL_RESPONSE_STATUS 1
+#define HTTP_MANY_COL_RESPONSE_STATUS_CODE 2
+#define HTTP_MANY_COL_RESPONSE_HEADERS 3
+#define HTTP_MANY_COL_RESPONSE_BODY 4
+#define HTTP_MANY_COL_REQUESTS 5
+#define HTTP_MANY_COL_MAX_CONCURRENCY 6
+#define HTTP_MANY_COL_REQUEST_METHOD 7
+#define HTTP_MANY_COL_REQUEST_URL 8
+#define HTTP_MANY_COL_REQUEST_HEADERS 9
+#define HTTP_MANY_COL_REQUEST_BODY 10
+#define HTTP_MANY_COL_RESPONSE_ERROR 11
+
+typedef struct http_many_vtab http_many_vtab;
+struct http_many_vtab {
     sqlite3_vtab base;
+    sqlite3* db;
+    http_ext* pExt;
 };
 
-typedef struct http_headers_each_cursor http_headers_each_cursor;
-struct http_headers_each_cursor {
+typedef struct http_many_item http_many_item;
+struct http_many_item {
+    int iIndex;
+    int rc;
+    char* zErrMsg;
+    http_request req;
+    http_response resp;
+};
+
+typedef struct http_many_cursor http_many_cursor;
+struct http_many_cursor {
     sqlite3_vtab_cursor base;
     sqlite3_int64 iRowid;
-    const char* zHeaders;
-    int zHeadersSize;
-    const char* p;
-    const char* name;
-    int nameSize;
-    const char* value;
-    int valueSize;
-    int available;
-    int done;
+    http_batch* pBatch;
+    http_many_item* aItem;
+    int nItem;
+    http_many_item* pCurrent;
 };
 
-static int httpHeadersEachConnect(sqlite3* db,
-                                  void* pAux,
-                                  int argc,
-                                  const char* const* argv,
-                                  sqlite3_vtab** ppVtab,
-                                  char** pzErr) {
-    http_headers_each_vtab* pNew;
+static void http_many_item_clear(http_many_item* pItem) {
+    sqlite3_free(pItem->zErrMsg);
+    sqlite3_free(pItem->req.zMethod);
+    sqlite3_free(pItem->req.zUrl);
+    sqlite3_free((void*)pItem->req.zHeaders);
+    sqlite3_free((void*)pItem->req.pBody);
+    http_body_unref(pItem->resp.pBody);
+    sqlite3_free(pItem->resp.zHeaders);
+    sqlite3_free(pItem->resp.zStatus);
+    sqlite3_free(pItem->resp.zEffectiveUrl);
+    memset(pItem, 0, sizeof(*pItem));
+}
+
+static int httpManyConnect(sqlite3* db,
+                           void* pAux,
+                           int argc,
+                           const char* const* argv,
+                           sqlite3_vtab** ppVtab,
+                           char** pzErr) {
+    http_many_vtab* pNew;
     int rc;
-    rc = sqlite3_declare_vtab(db, "CREATE TABLE x(name TEXT, value TEXT, headers TEXT HIDDEN)");
+
+    rc = sqlite3_declare_vtab(db,
+                              "CREATE TABLE x(request_index INT, response_status TEXT, "
+                              "response_status_code INT, response_headers TEXT, "
+                              "response_body BLOB, requests TEXT HIDDEN, "
+                              "max_concurrency INT HIDDEN, request_method TEXT HIDDEN, "
+                              "request_url TEXT HIDDEN, request_headers TEXT HIDDEN, "
+                              "request_body BLOB HIDDEN, response_error TEXT HIDDEN)");
+
     if (rc == SQLITE_OK) {
         pNew = sqlite3_malloc(sizeof(*pNew));
         *ppVtab = (sqlite3_vtab*)pNew;
         if (pNew == 0)
             return SQLITE_NOMEM;
         memset(pNew, 0, sizeof(*pNew));
+        pNew->db = db;
+        pNew->pExt = (http_ext*)pAux;
     }
     return rc;
 }
 
-static int httpHeadersEachDisconnect(sqlite3_vtab* pVtab) {
-    http_headers_each_vtab* p = (http_headers_each_vtab*)pVtab;
-    sqlite3_free(p);
+static int httpManyDisconnect(sqlite3_vtab* pVtab) {
+    sqlite3_free(pVtab);
     return SQLITE_OK;
 }
 
-static int httpHeadersEachOpen(sqlite3_vtab* p, sqlite3_vtab_cursor** ppCursor) {
-    http_headers_each_cursor* pCur;
+static int httpManyOpen(sqlite3_vtab* p, sqlite3_vtab_cursor** ppCursor) {
+    http_many_cursor* pCur;
     pCur = sqlite3_malloc(sizeof(*pCur));
     if (pCur == 0)
         return SQLITE_NOMEM;
@@ -672,138 +1439,311 @@ static int httpHeadersEachOpen(sqlite3_vtab* p, sqlite3_vtab_cursor** ppCursor)
     return SQLITE_OK;
 }
 
-static int httpHeadersEachClose(sqlite3_vtab_cursor* cur) {
-    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
+static void httpManyReset(http_many_cursor* pCur) {
+    int i;
+    // Closing the batch cancels whatever is still in flight.
+    http_batch_close(pCur->pBatch);
+    for (i = 0; i < pCur->nItem; ++i) {
+        http_many_item_clear(&pCur->aItem[i]);
+    }
+    sqlite3_free(pCur->aItem);
+    pCur->pBatch = NULL;
+    pCur->aItem = NULL;
+    pCur->nItem = 0;
+    pCur->pCurrent = NULL;
+    pCur->iRowid = 0;
+}
+
+static int httpManyClose(sqlite3_vtab_cursor* cur) {
+    http_many_cursor* pCur = (http_many_cursor*)cur;
+    httpManyReset(pCur);
     sqlite3_free(pCur);
     return SQLITE_OK;
 }
 
-static int httpHeadersEachNext(sqlite3_vtab_cursor* cur) {
-    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
-    pCur->iRowid++;
-    int nparsed = 0;
-    int rc = http_next_header(pCur->p,
-                              pCur->available,
-                              &nparsed,
-                              &pCur->name,
-                              &pCur->nameSize,
-                              &pCur->value,
-                              &pCur->valueSize);
-    pCur->p += nparsed;
-    pCur->available -= nparsed;
-    if (rc == SQLITE_ERROR) {
+// Advance to the next completed request.
+static int httpManyNext(sqlite3_vtab_cursor* cur) {
+    http_many_cursor* pCur = (http_many_cursor*)cur;
+    void* pArg = NULL;
+    int rcItem = SQLITE_OK;
+    char* zErrMsg = NULL;
+    int rc;
+
+    // Responses are released as soon as the row has been consumed.
+    if (pCur->pCurrent) {
+        http_many_item_clear(pCur->pCurrent);
+        pCur->pCurrent = NULL;
+    }
+
+    rc = http_batch_next(pCur->pBatch, &pArg, &rcItem, &zErrMsg);
+    if (rc == SQLITE_DONE) {
+        return SQLITE_OK;
+    }
+    if (rc != SQLITE_ROW) {
         sqlite3_free(cur->pVtab->zErrMsg);
-        cur->pVtab->zErrMsg = sqlite3_mprintf("http_headers_each: malformed headers");
-        return SQLITE_ERROR;
+        cur->pVtab->zErrMsg = zErrMsg;
+        return rc;
     }
-    pCur->done = rc == SQLITE_DONE;
+
+    pCur->pCurrent = (http_many_item*)pArg;
+    pCur->pCurrent->rc = rcItem;
+    pCur->pCurrent->zErrMsg = zErrMsg;
+    if (rcItem != SQLITE_OK && !zErrMsg) {
+        pCur->pCurrent->zErrMsg = sqlite3_mprintf("%s", sqlite3_errstr(rcItem));
+    }
+    pCur->iRowid++;
+
     return SQLITE_OK;
 }
 
-static int httpHeadersEachColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
-    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
+static int httpManyColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
+    http_many_cursor* pCur = (http_many_cursor*)cur;
+    http_many_item* pItem = pCur->pCurrent;
+    int bOk = pItem->rc == SQLITE_OK;
+
     switch (i) {
-    case HTTP_HEADERS_EACH_COL_NAME:
-        sqlite3_result_text(ctx, pCur->name, pCur->nameSize, SQLITE_TRANSIENT);
+    case HTTP_MANY_COL_REQUEST_INDEX:
+        sqlite3_result_int(ctx, pItem->iIndex);
         break;
 
-    case HTTP_HEADERS_EACH_COL_VALUE:
-        sqlite3_result_text(ctx, pCur->value, pCur->valueSize, SQLITE_TRANSIENT);
+    case HTTP_MANY_COL_RESPONSE_STATUS:
+        if (bOk) {
+            sqlite3_result_text(ctx, pItem->resp.zStatus, -1, SQLITE_TRANSIENT);
+        }
         break;
 
-    case HTTP_HEADERS_EACH_COL_HEADERS:
-        sqlite3_result_text(ctx, pCur->zHeaders, pCur->zHeadersSize, SQLITE_TRANSIENT);
+    case HTTP_MANY_COL_RESPONSE_STATUS_CODE:
+        if (bOk) {
+            sqlite3_result_int(ctx, pItem->resp.iStatusCode);
+        }
         break;
 
-    default:
-        sqlite3_result_error(ctx, "unknown column", -1);
+    case HTTP_MANY_COL_RESPONSE_HEADERS:
+        if (bOk) {
+            sqlite3_result_text(ctx, pItem->resp.zHeaders, -1, SQLITE_TRANSIENT);
+        }
+        break;
+
+    case HTTP_MANY_COL_RESPONSE_BODY:
+        if (bOk) {
+            sqlite3_result_blob64(
+                ctx, http_body_ref(pItem->resp.pBody), pItem->resp.szBody, http_body_unref);
+        }
+        break;
+
+    case HTTP_MANY_COL_REQUEST_METHOD:
+        sqlite3_result_text(ctx, pItem->req.zMethod, -1, SQLITE_TRANSIENT);
+        break;
+
+    case HTTP_MANY_COL_REQUEST_URL:
+        sqlite3_result_text(ctx, pItem->req.zUrl, -1, SQLITE_TRANSIENT);
+        break;
+
+    case HTTP_MANY_COL_REQUEST_HEADERS:
+        if (pItem->req.zHeaders) {
+            sqlite3_result_text(ctx, pItem->req.zHeaders, -1, SQLITE_TRANSIENT);
+        }
+        break;
+
+    case HTTP_MANY_COL_REQUEST_BODY:
+        if (pItem->req.pBody) {
+            sqlite3_result_blob(ctx, pItem->req.pBody, pItem->req.szBody, SQLITE_TRANSIENT);
+        }
+        break;
+
+    case HTTP_MANY_COL_RESPONSE_ERROR:
+        if (pItem->zErrMsg) {
+            sqlite3_result_text(ctx, pItem->zErrMsg, -1, SQLITE_TRANSIENT);
+        }
         break;
     }
+
     return SQLITE_OK;
 }
 
-static int httpHeadersEachRowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
-    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
+static int httpManyRowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
+    http_many_cursor* pCur = (http_many_cursor*)cur;
     *pRowid = pCur->iRowid;
     return SQLITE_OK;
 }
 
-static int httpHeadersEachEof(sqlite3_vtab_cursor* cur) {
-    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
-    return pCur->done;
+static int httpManyEof(sqlite3_vtab_cursor* cur) {
+    http_many_cursor* pCur = (http_many_cursor*)cur;
+    return pCur->pCurrent == NULL;
 }
 
-static int httpHeadersEachFilter(sqlite3_vtab_cursor* pVtabCursor,
-                                 int idxNum,
-                                 const char* idxStr,
-                                 int argc,
-                                 sqlite3_value** argv) {
-    http_headers_each_cursor* pCur = (http_headers_each_cursor*)pVtabCursor;
-    pCur->zHeadersSize = sqlite3_value_bytes(argv[0]);
-    pCur->available = pCur->zHeadersSize;
-    pCur->zHeaders = sqlite3_value_text(argv[0]);
-    pCur->p = pCur->zHeaders;
-    int nparsed = 0;
-    int rc = http_next_header(pCur->p,
-                              pCur->available,
-                              &nparsed,
-                              &pCur->name,
-                              &pCur->nameSize,
-                              &pCur->value,
-                              &pCur->valueSize);
-    pCur->p += nparsed;
-    pCur->available -= nparsed;
-    pCur->iRowid = 1;
-    if (rc == SQLITE_ERROR) {
-        sqlite3_free(pVtabCursor->pVtab->zErrMsg);
-        pVtabCursor->pVtab->zErrMsg = sqlite3_mprintf("http_headers_each: malformed headers");
-        return SQLITE_ERROR;
+static char* dup_value_text(sqlite3_value* pValue) {
+    if (sqlite3_value_type(pValue) == SQLITE_NULL) {
+        return NULL;
     }
-    pCur->done = rc == SQLITE_DONE;
-    return SQLITE_OK;
+    return sqlite3_mprintf("%s", sqlite3_value_text(pValue));
 }
 
-static int httpHeadersEachBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
-    http_vtab* pTab = (http_vtab*)tab;
-    int bHeadersSeen = 0;
+// Each element of the requests array is either a URL or an object with url,
+// method, headers and body fields.
+static int httpManyLoadRequests(http_many_cursor* pCur, sqlite3* db, sqlite3_value* pRequests) {
+    static const char zSql[] =
+        "SELECT key, CASE type WHEN 'object' THEN json_extract(value, '$.url') ELSE value END, "
+        "CASE type WHEN 'object' THEN json_extract(value, '$.method') END, "
+        "CASE type WHEN 'object' THEN json_extract(value, '$.headers') END, "
+        "CASE type WHEN 'object' THEN json_extract(value, '$.body') END "
+        "FROM json_each(?)";
+    sqlite3_stmt* pStmt;
+    int nAlloc = 0;
+    int rc;
 
-    for (int i = 0; i < pIdxInfo->nConstraint; ++i) {
-        if (pIdxInfo->aConstraint[i].iColumn == HTTP_HEADERS_EACH_COL_HEADERS) {
-            if (!pIdxInfo->aConstraint[i].usable) {
-                return SQLITE_CONSTRAINT;
+    rc = sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+
+    sqlite3_bind_value(pStmt, 1, pRequests);
+
+    while ((rc = sqlite3_step(pStmt)) == SQLITE_ROW) {
+        http_many_item* pItem;
+        if (pCur->nItem == nAlloc) {
+            http_many_item* aItem;
+            nAlloc = nAlloc ? nAlloc * 2 : 16;
+            aItem = sqlite3_realloc(pCur->aItem, sizeof(*aItem) * nAlloc);
+            if (!aItem) {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            pCur->aItem = aItem;
+        }
+        pItem = &pCur->aItem[pCur->nItem++];
+        memset(pItem, 0, sizeof(*pItem));
+        pItem->iIndex = sqlite3_column_int(pStmt, 0);
+        pItem->req.zUrl = dup_value_text(sqlite3_column_value(pStmt, 1));
+        pItem->req.zMethod = dup_value_text(sqlite3_column_value(pStmt, 2));
+        if (!pItem->req.zMethod) {
+            pItem->req.zMethod = sqlite3_mprintf("GET");
+        }
+        pItem->req.zHeaders = dup_value_text(sqlite3_column_value(pStmt, 3));
+        if (sqlite3_column_type(pStmt, 4) != SQLITE_NULL) {
+            pItem->req.szBody = sqlite3_column_bytes(pStmt, 4);
+            pItem->req.pBody = sqlite3_malloc64(pItem->req.szBody + 1);
+            if (pItem->req.pBody) {
+                memcpy((void*)pItem->req.pBody, sqlite3_column_blob(pStmt, 4), pItem->req.szBody);
             }
+        }
+        if (!pItem->req.zUrl) {
+            rc = SQLITE_ERROR;
+            break;
+        }
+    }
+
+    sqlite3_finalize(pStmt);
+
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
+
+static int httpManyFilter(sqlite3_vtab_cursor* pVtabCursor,
+                          int idxNum,
+                          const char* idxStr,
+                          int argc,
+                          sqlite3_value** argv) {
+    http_many_cursor* pCur = (http_many_cursor*)pVtabCursor;
+    http_many_vtab* pVtab = (http_many_vtab*)pVtabCursor->pVtab;
+    int nConcurrency = HTTP_MANY_DEFAULT_CONCURRENCY;
+    const char* zSql;
+    char* zErrMsg = NULL;
+    int rc;
+    int i;
+
+    httpManyReset(pCur);
+
+    if (argc > 1 && sqlite3_value_type(argv[1]) != SQLITE_NULL) {
+        nConcurrency = sqlite3_value_int(argv[1]);
+    }
+
+    rc = httpManyLoadRequests(pCur, pVtab->db, argv[0]);
+    if (rc == SQLITE_NOMEM) {
+        return rc;
+    }
+    if (rc != SQLITE_OK) {
+        sqlite3_free(pVtab->base.zErrMsg);
+        pVtab->base.zErrMsg = sqlite3_mprintf("http_get_many: invalid requests");
+        return rc;
+    }
+
+    zSql = httpRunningSql(pVtab->db);
+    rc = http_batch_open(pVtab->pExt->pPool, nConcurrency, &pCur->pBatch, &zErrMsg);
+    for (i = 0; i < pCur->nItem && rc == SQLITE_OK; ++i) {
+        http_many_item* pItem = &pCur->aItem[i];
+        pItem->req.flags = idxNum;
+        pItem->req.szMaxBody = httpMaxBodySize(pVtab->pExt);
+        pItem->req.zSql = zSql;
+        rc = http_batch_add(pCur->pBatch, &pItem->req, &pItem->resp, pItem);
+    }
+    if (rc != SQLITE_OK) {
+        sqlite3_free(pVtab->base.zErrMsg);
+        pVtab->base.zErrMsg = zErrMsg;
+        return rc;
+    }
+
+    return httpManyNext(pVtabCursor);
+}
+
+static int httpManyBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
+    int bRequestsSeen = 0;
+    int i;
+
+    for (i = 0; i < pIdxInfo->nConstraint; ++i) {
+        int iColumn = pIdxInfo->aConstraint[i].iColumn;
+        if (iColumn != HTTP_MANY_COL_REQUESTS && iColumn != HTTP_MANY_COL_MAX_CONCURRENCY) {
+            continue;
+        }
+        if (!pIdxInfo->aConstraint[i].usable) {
+            return SQLITE_CONSTRAINT;
+        }
+        if (pIdxInfo->aConstraint[i].op != SQLITE_INDEX_CONSTRAINT_EQ) {
+            return SQLITE_CONSTRAINT;
+        }
+        if (iColumn == HTTP_MANY_COL_REQUESTS) {
             pIdxInfo->aConstraintUsage[i].argvIndex = 1;
-            pIdxInfo->aConstraintUsage[i].omit = 1;
-            bHeadersSeen = 1;
+            bRequestsSeen = 1;
+        } else {
+            pIdxInfo->aConstraintUsage[i].argvIndex = 2;
         }
+        pIdxInfo->aConstraintUsage[i].omit = 1;
     }
 
-    if (!bHeadersSeen) {
+    if (!bRequestsSeen) {
         sqlite3_free(tab->zErrMsg);
-        tab->zErrMsg = sqlite3_mprintf("headers missing");
+        tab->zErrMsg = sqlite3_mprintf("requests missing");
         return SQLITE_ERROR;
     }
 
-    pIdxInfo->estimatedCost = (double)1;
-    // pIdxInfo->estimatedRows = 1;
+    // idxNum holds the HTTP_REQUEST_* flags for the parts the query doesn't read.
+    if (!(pIdxInfo->colUsed & ((sqlite3_uint64)1 << HTTP_MANY_COL_RESPONSE_BODY))) {
+        pIdxInfo->idxNum |= HTTP_REQUEST_NO_BODY;
+    }
+    if (!(pIdxInfo->colUsed & (((sqlite3_uint64)1 << HTTP_MANY_COL_RESPONSE_STATUS) |
+                               ((sqlite3_uint64)1 << HTTP_MANY_COL_RESPONSE_HEADERS)))) {
+        pIdxInfo->idxNum |= HTTP_REQUEST_NO_HEADERS;
+    }
+
+    pIdxInfo->estimatedCost = (double)100;
+    pIdxInfo->estimatedRows = 100;
 
     return SQLITE_OK;
 }
 
-static sqlite3_module httpHeadersEachModule = {
+static sqlite3_module httpManyModule = {
     /* iVersion    */ 0,
     /* xCreate     */ 0,
-    /* xConnect    */ httpHeadersEachConnect,
-    /* xBestIndex  */ httpHeadersEachBestIndex,
-    /* xDisconnect */ httpHeadersEachDisconnect,
+    /* xConnect    */ httpManyConnect,
+    /* xBestIndex  */ httpManyBestIndex,
+    /* xDisconnect */ httpManyDisconnect,
     /* xDestroy    */ 0,
-    /* xOpen       */ httpHeadersEachOpen,
-    /* xClose      */ httpHeadersEachClose,
-    /* xFilter     */ httpHeadersEachFilter,
-    /* xNext       */ httpHeadersEachNext,
-    /* xEof        */ httpHeadersEachEof,
-    /* xColumn     */ httpHeadersEachColumn,
-    /* xRowid      */ httpHeadersEachRowid,
+    /* xOpen       */ httpManyOpen,
+    /* xClose      */ httpManyClose,
+    /* xFilter     */ httpManyFilter,
+    /* xNext       */ httpManyNext,
+    /* xEof        */ httpManyEof,
+    /* xColumn     */ httpManyColumn,
+    /* xRowid      */ httpManyRowid,
     /* xUpdate     */ 0,
     /* xBegin      */ 0,
     /* xSync       */ 0,
@@ -817,47 +1757,3469 @@ static sqlite3_module httpHeadersEachModule = {
     /* xShadowName */ 0,
 };
 
-static const struct Func {
-    const char* name;
-    void (*xFunc)(sqlite3_context*, int, sqlite3_value**);
-} funcs[] = {
-    {"http_get_body", httpGetBodyFunc},
-    {"http_post_body", httpPostBodyFunc},
-    {"http_do_body", httpDoBodyFunc},
-    {"http_get_headers", httpGetHeadersFunc},
-    {"http_post_headers", httpPostHeadersFunc},
-    {"http_do_headers", httpDoHeadersFunc},
-    {"http_headers", httpHeadersFunc},
-    {"http_headers_has", httpHeadersHasFunc},
-    {"http_headers_get", httpHeadersGetFunc},
-    {NULL, NULL},
-};
+// Responses returned by the http_*_response functions are packed into a single
+// blob: a fixed size header followed by the status line, headers and body. All
+// integers are stored big-endian.
+//
+//   0  magic "HRSP"
+//   4  status code
+//   8  status line size
+//  12  headers size
+//  16  body size
+//  20  status line, headers, body
+#define HTTP_RESPONSE_MAGIC "HRSP"
+#define HTTP_RESPONSE_HEADER_SIZE 20
+
+typedef struct http_response_view http_response_view;
+struct http_response_view {
+    int iStatusCode;
+    const char* zStatus;
+    int szStatus;
+    const char* zHeaders;
+    int szHeaders;
+    const unsigned char* pBody;
+    int szBody;
+};
+
+static void put_u32(unsigned char* p, unsigned int v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static unsigned int get_u32(const unsigned char* p) {
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) |
+           (unsigned int)p[3];
+}
+
+static unsigned char* httpResponsePack(const http_response* resp, sqlite3_int64* pnBlob) {
+    unsigned int szStatus = resp->zStatus ? strlen(resp->zStatus) : 0;
+    unsigned int szHeaders = resp->zHeaders ? strlen(resp->zHeaders) : 0;
+    unsigned int szBody = resp->pBody ? (unsigned int)resp->szBody : 0;
+    sqlite3_int64 nBlob = HTTP_RESPONSE_HEADER_SIZE + (sqlite3_int64)szStatus + szHeaders + szBody;
+    unsigned char* pBlob;
+    unsigned char* p;
+
+    pBlob = sqlite3_malloc64(nBlob);
+    if (!pBlob) {
+        return NULL;
+    }
+
+    memcpy(pBlob, HTTP_RESPONSE_MAGIC, 4);
+    put_u32(pBlob + 4, (unsigned int)resp->iStatusCode);
+    put_u32(pBlob + 8, szStatus);
+    put_u32(pBlob + 12, szHeaders);
+    put_u32(pBlob + 16, szBody);
+    p = pBlob + HTTP_RESPONSE_HEADER_SIZE;
+    if (szStatus) {
+        memcpy(p, resp->zStatus, szStatus);
+        p += szStatus;
+    }
+    if (szHeaders) {
+        memcpy(p, resp->zHeaders, szHeaders);
+        p += szHeaders;
+    }
+    if (szBody) {
+        memcpy(p, resp->pBody, szBody);
+    }
+
+    *pnBlob = nBlob;
+    return pBlob;
+}
+
+// Point pView into a response blob. Returns SQLITE_ERROR if the value is not
+// a response.
+static int httpResponseUnpack(sqlite3_value* pValue, http_response_view* pView) {
+    const unsigned char* pBlob;
+    sqlite3_int64 nBlob;
+
+    if (sqlite3_value_type(pValue) != SQLITE_BLOB) {
+        return SQLITE_ERROR;
+    }
+    pBlob = sqlite3_value_blob(pValue);
+    nBlob = sqlite3_value_bytes(pValue);
+    if (nBlob < HTTP_RESPONSE_HEADER_SIZE || memcmp(pBlob, HTTP_RESPONSE_MAGIC, 4) != 0) {
+        return SQLITE_ERROR;
+    }
+
+    pView->iStatusCode = (int)get_u32(pBlob + 4);
+    pView->szStatus = (int)get_u32(pBlob + 8);
+    pView->szHeaders = (int)get_u32(pBlob + 12);
+    pView->szBody = (int)get_u32(pBlob + 16);
+    if (pView->szStatus < 0 || pView->szHeaders < 0 || pView->szBody < 0 ||
+        nBlob != HTTP_RESPONSE_HEADER_SIZE + (sqlite3_int64)pView->szStatus + pView->szHeaders +
+                     pView->szBody) {
+        return SQLITE_ERROR;
+    }
+    pView->zStatus = (const char*)pBlob + HTTP_RESPONSE_HEADER_SIZE;
+    pView->zHeaders = pView->zStatus + pView->szStatus;
+    pView->pBody = (const unsigned char*)pView->zHeaders + pView->szHeaders;
+
+    return SQLITE_OK;
+}
+
+#define HTTP_RESULT_BODY 0
+#define HTTP_RESULT_HEADERS 1
+#define HTTP_RESULT_RESPONSE 2
+
+// Run the request directly, without going through the http_get/http_post/
+// http_do tables. The arguments are the same as for the tables: url, headers
+// and body for http_get and http_post, method first for http_do.
+static void httpSimpleFunc(sqlite3_context* ctx,
+                           int argc,
+                           sqlite3_value** argv,
+                           const char* zMethod,
+                           int eResult) {
+    http_ext* pExt = (http_ext*)sqlite3_user_data(ctx);
+    http_request req;
+    http_response resp;
+    char* zErrMsg = NULL;
+    int nMaxArgs = zMethod ? 3 : 4;
+    int iArg = 0;
+    int rc;
+
+    if (argc == 0) {
+        sqlite3_result_error(ctx, "not enough arguments", -1);
+        return;
+    }
+
+    if (argc > nMaxArgs) {
+        sqlite3_result_error(ctx, "too many arguments", -1);
+        return;
+    }
+
+    memset(&req, 0, sizeof(req));
+    memset(&resp, 0, sizeof(resp));
+
+    req.zMethod = zMethod ? (char*)zMethod : (char*)sqlite3_value_text(argv[iArg++]);
+    if (!req.zMethod) {
+        sqlite3_result_error(ctx, "method missing", -1);
+        return;
+    }
+
+    req.zUrl = iArg < argc ? (char*)sqlite3_value_text(argv[iArg]) : NULL;
+    iArg++;
+    if (!req.zUrl) {
+        sqlite3_result_error(ctx, "url missing", -1);
+        return;
+    }
+
+    if (iArg < argc) {
+        req.zHeaders = (const char*)sqlite3_value_text(argv[iArg]);
+    }
+    iArg++;
+
+    // Bodies are passed as is, so binary data survives the round trip.
+    if (iArg < argc && sqlite3_value_type(argv[iArg]) != SQLITE_NULL) {
+        req.pBody = sqlite3_value_blob(argv[iArg]);
+        req.szBody = sqlite3_value_bytes(argv[iArg]);
+        if (!req.pBody) {
+            req.pBody = "";
+        }
+    }
+
+    req.szMaxBody = httpMaxBodySize(pExt);
+    req.zSql = httpRunningSql(sqlite3_context_db_handle(ctx));
+    if (eResult == HTTP_RESULT_BODY) {
+        req.flags |= HTTP_REQUEST_NO_HEADERS;
+    } else if (eResult == HTTP_RESULT_HEADERS) {
+        req.flags |= HTTP_REQUEST_NO_BODY;
+    }
+
+    rc = http_do_request(pExt->pPool, &req, &resp, &zErrMsg);
+    if (rc != SQLITE_OK) {
+        if (zErrMsg) {
+            sqlite3_result_error(ctx, zErrMsg, -1);
+            sqlite3_free(zErrMsg);
+        } else {
+            sqlite3_result_error_code(ctx, rc);
+        }
+        goto done;
+    }
+
+    // Hand the response buffers over to SQLite instead of copying them.
+    switch (eResult) {
+    case HTTP_RESULT_BODY:
+        sqlite3_result_blob64(ctx, resp.pBody, resp.szBody, http_body_unref);
+        resp.pBody = NULL;
+        break;
+
+    case HTTP_RESULT_HEADERS:
+        sqlite3_result_text(ctx, resp.zHeaders, -1, sqlite3_free);
+        resp.zHeaders = NULL;
+        break;
+
+    case HTTP_RESULT_RESPONSE: {
+        sqlite3_int64 nBlob;
+        unsigned char* pBlob = httpResponsePack(&resp, &nBlob);
+        if (pBlob) {
+            sqlite3_result_blob64(ctx, pBlob, nBlob, sqlite3_free);
+        } else {
+            sqlite3_result_error_nomem(ctx);
+        }
+        break;
+    }
+    }
+
+done:
+
+    http_body_unref(resp.pBody);
+    sqlite3_free(resp.zHeaders);
+    sqlite3_free(resp.zStatus);
+    sqlite3_free(resp.zEffectiveUrl);
+}
+
+static void httpGetBodyFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpSimpleFunc(ctx, argc, argv, "GET", HTTP_RESULT_BODY);
+}
+
+static void httpPostBodyFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpSimpleFunc(ctx, argc, argv, "POST", HTTP_RESULT_BODY);
+}
+
+static void httpDoBodyFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpSimpleFunc(ctx, argc, argv, NULL, HTTP_RESULT_BODY);
+}
+
+static void httpGetHeadersFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpSimpleFunc(ctx, argc, argv, "GET", HTTP_RESULT_HEADERS);
+}
+
+static void httpPostHeadersFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpSimpleFunc(ctx, argc, argv, "POST", HTTP_RESULT_HEADERS);
+}
+
+static void httpDoHeadersFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpSimpleFunc(ctx, argc, argv, NULL, HTTP_RESULT_HEADERS);
+}
+
+static void httpGetResponseFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpSimpleFunc(ctx, argc, argv, "GET", HTTP_RESULT_RESPONSE);
+}
+
+static void httpPostResponseFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpSimpleFunc(ctx, argc, argv, "POST", HTTP_RESULT_RESPONSE);
+}
+
+static void httpDoResponseFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpSimpleFunc(ctx, argc, argv, NULL, HTTP_RESULT_RESPONSE);
+}
+
+#define HTTP_RESPONSE_FIELD_STATUS 0
+#define HTTP_RESPONSE_FIELD_STATUS_CODE 1
+#define HTTP_RESPONSE_FIELD_HEADERS 2
+#define HTTP_RESPONSE_FIELD_BODY 3
+
+static void httpResponseFieldFunc(sqlite3_context* ctx,
+                                  int argc,
+                                  sqlite3_value** argv,
+                                  const char* zFunc,
+                                  int eField) {
+    http_response_view view;
+    char* zErrMsg;
+
+    if (argc != 1) {
+        zErrMsg = sqlite3_mprintf("%s: expected 1 argument", zFunc);
+        sqlite3_result_error(ctx, zErrMsg, -1);
+        sqlite3_free(zErrMsg);
+        return;
+    }
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        return;
+    }
+
+    if (httpResponseUnpack(argv[0], &view) != SQLITE_OK) {
+        zErrMsg = sqlite3_mprintf("%s: not a response", zFunc);
+        sqlite3_result_error(ctx, zErrMsg, -1);
+        sqlite3_free(zErrMsg);
+        return;
+    }
+
+    switch (eField) {
+    case HTTP_RESPONSE_FIELD_STATUS:
+        sqlite3_result_text(ctx, view.zStatus, view.szStatus, SQLITE_TRANSIENT);
+        break;
+
+    case HTTP_RESPONSE_FIELD_STATUS_CODE:
+        sqlite3_result_int(ctx, view.iStatusCode);
+        break;
+
+    case HTTP_RESPONSE_FIELD_HEADERS:
+        sqlite3_result_text(ctx, view.zHeaders, view.szHeaders, SQLITE_TRANSIENT);
+        break;
+
+    case HTTP_RESPONSE_FIELD_BODY:
+        sqlite3_result_blob(ctx, view.pBody, view.szBody, SQLITE_TRANSIENT);
+        break;
+    }
+}
+
+static void httpResponseStatusFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpResponseFieldFunc(ctx, argc, argv, "http_response_status", HTTP_RESPONSE_FIELD_STATUS);
+}
+
+static void httpResponseStatusCodeFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpResponseFieldFunc(
+        ctx, argc, argv, "http_response_status_code", HTTP_RESPONSE_FIELD_STATUS_CODE);
+}
+
+static void httpResponseHeadersFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpResponseFieldFunc(ctx, argc, argv, "http_response_headers", HTTP_RESPONSE_FIELD_HEADERS);
+}
+
+static void httpResponseBodyFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpResponseFieldFunc(ctx, argc, argv, "http_response_body", HTTP_RESPONSE_FIELD_BODY);
+}
+
+// Return the value of the first header with the given name, or NULL if there
+// is no such header.
+static void httpResponseHeaderFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    http_response_view view;
+    const char* zHeaders;
+    int zHeadersSize;
+    const char* zHeader;
+    int zHeaderSize;
+
+    if (argc != 2) {
+        sqlite3_result_error(ctx, "http_response_header: expected 2 arguments", -1);
+        return;
+    }
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        return;
+    }
+
+    if (httpResponseUnpack(argv[0], &view) != SQLITE_OK) {
+        sqlite3_result_error(ctx, "http_response_header: not a response", -1);
+        return;
+    }
+
+    zHeaders = view.zHeaders;
+    zHeadersSize = view.szHeaders;
+    zHeader = (const char*)sqlite3_value_text(argv[1]);
+    zHeaderSize = sqlite3_value_bytes(argv[1]);
+    while (zHeadersSize > 0) {
+        int iParsed = 0;
+        const char* pName;
+        int iNameSize;
+        const char* pValue;
+        int iValueSize;
+        int rc = http_next_header(
+            zHeaders, zHeadersSize, &iParsed, &pName, &iNameSize, &pValue, &iValueSize);
+        if (rc == SQLITE_ERROR) {
+            sqlite3_result_error(ctx, "http_response_header: malformed headers", -1);
+            return;
+        }
+        if (rc == SQLITE_DONE) {
+            return;
+        }
+        zHeaders += iParsed;
+        zHeadersSize -= iParsed;
+        if (http_header_name_eq(pName, iNameSize, zHeader, zHeaderSize)) {
+            sqlite3_result_text(ctx, pValue, iValueSize, SQLITE_TRANSIENT);
+            return;
+        }
+    }
+}
+
+static void httpHeadersFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    char* zHeaders = NULL;
+    int i;
+    int size = 0;
+    int offset = 0;
+    if (argc < 2) {
+        sqlite3_result_error(ctx, "http_headers: expected at least 2 arguments", -1);
+        return;
+    }
+    if (argc % 2 != 0) {
+        sqlite3_result_error(ctx, "http_headers: even number of arguments expected", -1);
+        return;
+    }
+    for (i = 0; i < argc; i += 2) {
+        size += sqlite3_value_bytes(argv[i]) + 2;
+        size += sqlite3_value_bytes(argv[i + 1]) + 2;
+    }
+    zHeaders = sqlite3_malloc(size);
+    if (!zHeaders) {
+        sqlite3_result_error_code(ctx, SQLITE_NOMEM);
+        return;
+    }
+    for (i = 0; i < argc; i += 2) {
+        memcpy(zHeaders + offset, sqlite3_value_text(argv[i]), sqlite3_value_bytes(argv[i]));
+        offset += sqlite3_value_bytes(argv[i]);
+
+        memcpy(zHeaders + offset, ": ", 2);
+        offset += 2;
+
+        memcpy(
+            zHeaders + offset, sqlite3_value_text(argv[i + 1]), sqlite3_value_bytes(argv[i + 1]));
+        offset += sqlite3_value_bytes(argv[i + 1]);
+
+        memcpy(zHeaders + offset, "\r\n", 2);
+        offset += 2;
+    }
+    assert(offset == size);
+    sqlite3_result_text(ctx, zHeaders, size, sqlite3_free);
+}
+
+// Headers parsed by http_headers_parse() are packed into a blob that can be
+// searched without parsing the text again. The fixed size header is followed
+// by a table of headers, a hash table and the string data. The integers in the
+// tables are 2 bytes wide when the headers are small enough, which they nearly
+// always are, and 4 bytes otherwise. All integers are stored big-endian.
+//
+//   0  magic "HHDR"
+//   4  number of headers
+//   8  number of hash slots, a power of two
+//  12  size of the string data
+//  16  width of the integers in the tables, 2 or 4
+//  20  headers: name offset, name size, value offset, value size
+//      hash slots: 1 + index of the first header with the name, 0 if empty
+//      string data: lowercase names, each stored once, and values
+#define HTTP_HEADERS_MAGIC "HHDR"
+#define HTTP_HEADERS_HEADER_SIZE 20
+
+typedef struct http_headers_view http_headers_view;
+struct http_headers_view {
+    int nHeaders;
+    int nSlots;
+    int nWidth;
+    const unsigned char* aHeader;
+    const unsigned char* aSlot;
+    const char* zData;
+    int szData;
+};
+
+static void put_uw(unsigned char* p, int nWidth, unsigned int v) {
+    if (nWidth == 2) {
+        p[0] = (unsigned char)(v >> 8);
+        p[1] = (unsigned char)v;
+    } else {
+        put_u32(p, v);
+    }
+}
+
+static unsigned int get_uw(const unsigned char* p, int nWidth) {
+    return nWidth == 2 ? ((unsigned int)p[0] << 8) | (unsigned int)p[1] : get_u32(p);
+}
+
+// FNV-1a over the lowercased name.
+static unsigned int httpHeaderHash(const char* zName, int nName) {
+    unsigned int h = 2166136261u;
+    int i;
+    for (i = 0; i < nName; ++i) {
+        h = (h ^ http_char_lower(zName[i])) * 16777619u;
+    }
+    return h;
+}
+
+// Returns NULL and sets *pnBlob to -1 if the headers are malformed, or to 0 if
+// out of memory.
+static unsigned char* httpHeadersPack(const char* zHeaders, int szHeaders, sqlite3_int64* pnBlob) {
+    const char* p;
+    int n;
+    int nHeaders = 0;
+    int nSlots = 1;
+    int nWidth;
+    sqlite3_int64 szData = 0;
+    sqlite3_int64 nBlob;
+    unsigned char* pBlob;
+    unsigned char* aHeader;
+    unsigned char* aSlot;
+    char* zData;
+    int iHeader = 0;
+    int iData = 0;
+
+    // Count the headers first to size the blob.
+    for (p = zHeaders, n = szHeaders; n > 0;) {
+        int iParsed = 0;
+        const char* pName;
+        int iNameSize;
+        const char* pValue;
+        int iValueSize;
+        int rc = http_next_header(p, n, &iParsed, &pName, &iNameSize, &pValue, &iValueSize);
+        if (rc == SQLITE_ERROR) {
+            *pnBlob = -1;
+            return NULL;
+        }
+        if (rc == SQLITE_DONE) {
+            break;
+        }
+        nHeaders++;
+        szData += iNameSize + iValueSize;
+        p += iParsed;
+        n -= iParsed;
+    }
+    while (nSlots < nHeaders * 2) {
+        nSlots *= 2;
+    }
+    nWidth = szData <= 0xffff && nHeaders < 0xffff ? 2 : 4;
+
+    nBlob = HTTP_HEADERS_HEADER_SIZE + (sqlite3_int64)nHeaders * 4 * nWidth +
+            (sqlite3_int64)nSlots * nWidth + szData;
+    pBlob = sqlite3_malloc64(nBlob);
+    if (!pBlob) {
+        *pnBlob = 0;
+        return NULL;
+    }
+    aHeader = pBlob + HTTP_HEADERS_HEADER_SIZE;
+    aSlot = aHeader + nHeaders * 4 * nWidth;
+    zData = (char*)aSlot + nSlots * nWidth;
+    memset(aSlot, 0, nSlots * nWidth);
+
+    for (p = zHeaders, n = szHeaders; iHeader < nHeaders; ++iHeader) {
+        int iParsed = 0;
+        const char* pName;
+        int iNameSize;
+        const char* pValue;
+        int iValueSize;
+        unsigned char* pHeader = aHeader + iHeader * 4 * nWidth;
+        unsigned int iSlot;
+        int iName = -1;
+        int i;
+        http_next_header(p, n, &iParsed, &pName, &iNameSize, &pValue, &iValueSize);
+        p += iParsed;
+        n -= iParsed;
+
+        // Find the slot of the name, reusing the name if it was seen before.
+        iSlot = httpHeaderHash(pName, iNameSize) & (nSlots - 1);
+        while (get_uw(aSlot + iSlot * nWidth, nWidth) != 0) {
+            const unsigned char* pOther =
+                aHeader + (get_uw(aSlot + iSlot * nWidth, nWidth) - 1) * 4 * nWidth;
+            int iOtherName = get_uw(pOther, nWidth);
+            if (http_header_name_eq(
+                    zData + iOtherName, get_uw(pOther + nWidth, nWidth), pName, iNameSize)) {
+                iName = iOtherName;
+                break;
+            }
+            iSlot = (iSlot + 1) & (nSlots - 1);
+        }
+        if (iName < 0) {
+            iName = iData;
+            for (i = 0; i < iNameSize; ++i) {
+                zData[iData++] = http_char_lower(pName[i]);
+            }
+            put_uw(aSlot + iSlot * nWidth, nWidth, iHeader + 1);
+        }
+
+        put_uw(pHeader, nWidth, iName);
+        put_uw(pHeader + nWidth, nWidth, iNameSize);
+        put_uw(pHeader + 2 * nWidth, nWidth, iData);
+        put_uw(pHeader + 3 * nWidth, nWidth, iValueSize);
+        if (iValueSize > 0) {
+            memcpy(zData + iData, pValue, iValueSize);
+        }
+        iData += iValueSize;
+    }
+
+    memcpy(pBlob, HTTP_HEADERS_MAGIC, 4);
+    put_u32(pBlob + 4, nHeaders);
+    put_u32(pBlob + 8, nSlots);
+    put_u32(pBlob + 12, iData);
+    put_u32(pBlob + 16, nWidth);
+
+    *pnBlob = nBlob - szData + iData;
+    return pBlob;
+}
+
+// Point pView into a parsed headers blob. Returns SQLITE_ERROR if the value is
+// not one.
+static int httpHeadersUnpack(sqlite3_value* pValue, http_headers_view* pView) {
+    const unsigned char* pBlob;
+    sqlite3_int64 nBlob;
+
+    if (sqlite3_value_type(pValue) != SQLITE_BLOB) {
+        return SQLITE_ERROR;
+    }
+    pBlob = sqlite3_value_blob(pValue);
+    nBlob = sqlite3_value_bytes(pValue);
+    if (nBlob < HTTP_HEADERS_HEADER_SIZE || memcmp(pBlob, HTTP_HEADERS_MAGIC, 4) != 0) {
+        return SQLITE_ERROR;
+    }
+
+    pView->nHeaders = (int)get_u32(pBlob + 4);
+    pView->nSlots = (int)get_u32(pBlob + 8);
+    pView->szData = (int)get_u32(pBlob + 12);
+    pView->nWidth = (int)get_u32(pBlob + 16);
+    if (pView->nHeaders < 0 || pView->nSlots <= 0 || (pView->nSlots & (pView->nSlots - 1)) ||
+        pView->szData < 0 || (pView->nWidth != 2 && pView->nWidth != 4) ||
+        nBlob != HTTP_HEADERS_HEADER_SIZE + (sqlite3_int64)pView->nHeaders * 4 * pView->nWidth +
+                     (sqlite3_int64)pView->nSlots * pView->nWidth + pView->szData) {
+        return SQLITE_ERROR;
+    }
+    pView->aHeader = pBlob + HTTP_HEADERS_HEADER_SIZE;
+    pView->aSlot = pView->aHeader + pView->nHeaders * 4 * pView->nWidth;
+    pView->zData = (const char*)pView->aSlot + pView->nSlots * pView->nWidth;
+
+    return SQLITE_OK;
+}
+
+// Get the name and value of the iHeader'th header. Returns SQLITE_ERROR if the
+// blob is corrupt.
+static int httpHeadersViewGet(const http_headers_view* pView,
+                              int iHeader,
+                              const char** ppName,
+                              int* pNameSize,
+                              const char** ppValue,
+                              int* pValueSize) {
+    int nWidth = pView->nWidth;
+    const unsigned char* pHeader = pView->aHeader + iHeader * 4 * nWidth;
+    unsigned int iName = get_uw(pHeader, nWidth);
+    unsigned int nName = get_uw(pHeader + nWidth, nWidth);
+    unsigned int iValue = get_uw(pHeader + 2 * nWidth, nWidth);
+    unsigned int nValue = get_uw(pHeader + 3 * nWidth, nWidth);
+    if (iName > (unsigned int)pView->szData || nName > pView->szData - iName ||
+        iValue > (unsigned int)pView->szData || nValue > pView->szData - iValue) {
+        return SQLITE_ERROR;
+    }
+    *ppName = pView->zData + iName;
+    *pNameSize = (int)nName;
+    // Empty values are NULL, as with http_next_header().
+    *ppValue = nValue > 0 ? pView->zData + iValue : NULL;
+    *pValueSize = (int)nValue;
+    return SQLITE_OK;
+}
+
+// Find the first header with the given name. Returns SQLITE_ROW with its value,
+// SQLITE_DONE if there is none or SQLITE_ERROR if the blob is corrupt.
+static int httpHeadersViewFind(const http_headers_view* pView,
+                               const char* zName,
+                               int nName,
+                               const char** ppValue,
+                               int* pValueSize) {
+    unsigned int iSlot = httpHeaderHash(zName, nName) & (pView->nSlots - 1);
+    int nProbe;
+    for (nProbe = 0; nProbe < pView->nSlots; ++nProbe) {
+        unsigned int iHeader = get_uw(pView->aSlot + iSlot * pView->nWidth, pView->nWidth);
+        const char* pName;
+        int iNameSize;
+        if (iHeader == 0) {
+            return SQLITE_DONE;
+        }
+        if (iHeader > (unsigned int)pView->nHeaders ||
+            httpHeadersViewGet(pView, iHeader - 1, &pName, &iNameSize, ppValue, pValueSize) !=
+                SQLITE_OK) {
+            return SQLITE_ERROR;
+        }
+        if (http_header_name_eq(pName, iNameSize, zName, nName)) {
+            return SQLITE_ROW;
+        }
+        iSlot = (iSlot + 1) & (pView->nSlots - 1);
+    }
+    return SQLITE_DONE;
+}
+
+// Parse headers into the blob form understood by http_headers_has,
+// http_headers_get and http_headers_each.
+static void httpHeadersParseFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    const char* zHeaders;
+    int szHeaders;
+    unsigned char* pBlob;
+    sqlite3_int64 nBlob;
+
+    if (argc != 1) {
+        sqlite3_result_error(ctx, "http_headers_parse: expected 1 argument", -1);
+        return;
+    }
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        return;
+    }
+
+    zHeaders = (const char*)sqlite3_value_text(argv[0]);
+    szHeaders = sqlite3_value_bytes(argv[0]);
+    pBlob = httpHeadersPack(zHeaders, szHeaders, &nBlob);
+    if (!pBlob && nBlob < 0) {
+        sqlite3_result_error(ctx, "http_headers_parse: malformed headers", -1);
+        return;
+    }
+    if (!pBlob) {
+        sqlite3_result_error_nomem(ctx);
+        return;
+    }
+    sqlite3_result_blob64(ctx, pBlob, nBlob, sqlite3_free);
+}
+
+// Start indexing a new text. The text is copied into the index. Buffers grown
+// past HTTP_HEADERS_INDEX_KEEP bytes for a large text are released when a
+// smaller text comes along, so that the index on the connection does not hold
+// on to the largest headers it has ever seen.
+#define HTTP_HEADERS_INDEX_KEEP 16384
+
+static int httpHeadersIndexReset(http_headers_index* pIndex, const char* zText, int nText) {
+    if (pIndex->nTextAlloc > HTTP_HEADERS_INDEX_KEEP && nText <= HTTP_HEADERS_INDEX_KEEP) {
+        sqlite3_free(pIndex->zText);
+        sqlite3_free(pIndex->aHeader);
+        sqlite3_free(pIndex->aSlot);
+        pIndex->zText = NULL;
+        pIndex->nTextAlloc = 0;
+        pIndex->aHeader = NULL;
+        pIndex->nHeadersAlloc = 0;
+        pIndex->aSlot = NULL;
+        pIndex->nSlots = 0;
+    }
+    if (nText > pIndex->nTextAlloc) {
+        char* z = sqlite3_realloc(pIndex->zText, nText);
+        if (!z) {
+            return SQLITE_NOMEM;
+        }
+        pIndex->zText = z;
+        pIndex->nTextAlloc = nText;
+    }
+    if (nText > 0) {
+        memcpy(pIndex->zText, zText, nText);
+    }
+    pIndex->nText = nText;
+    pIndex->nParsed = 0;
+    pIndex->eState = SQLITE_ROW;
+    pIndex->nHeaders = 0;
+    pIndex->nHashed = 0;
+    pIndex->bAuxData = 0;
+    return SQLITE_OK;
+}
+
+// Insert the iHeader'th header into the hash table unless there already is a
+// header with the same name.
+// The index is rebuilt for every new text, so its hash only looks at the
+// length and a few characters of the name. Collisions are resolved by
+// comparing the names.
+static unsigned int httpHeadersIndexHash(const char* zName, int nName) {
+    unsigned int h = (unsigned int)nName;
+    if (nName > 0) {
+        h = h * 31 + http_char_lower(zName[0]);
+        h = h * 31 + http_char_lower(zName[nName / 2]);
+        h = h * 31 + http_char_lower(zName[nName - 1]);
+    }
+    return h * 2654435761u >> 8;
+}
+
+static void httpHeadersIndexInsert(http_headers_index* pIndex, int iHeader) {
+    const int* aHeader = pIndex->aHeader + iHeader * 4;
+    const char* zName = pIndex->zText + aHeader[0];
+    unsigned int iSlot = httpHeadersIndexHash(zName, aHeader[1]) & (pIndex->nSlots - 1);
+    while (pIndex->aSlot[iSlot] != 0) {
+        const int* aOther = pIndex->aHeader + (pIndex->aSlot[iSlot] - 1) * 4;
+        if (http_header_name_eq(pIndex->zText + aOther[0], aOther[1], zName, aHeader[1])) {
+            return;
+        }
+        iSlot = (iSlot + 1) & (pIndex->nSlots - 1);
+    }
+    pIndex->aSlot[iSlot] = iHeader + 1;
+}
+
+// Index the next header. Returns SQLITE_ROW, SQLITE_DONE if all headers have
+// been indexed, SQLITE_ERROR if the headers are malformed or SQLITE_NOMEM.
+static int httpHeadersIndexNext(http_headers_index* pIndex) {
+    int iParsed = 0;
+    const char* pName;
+    int iNameSize;
+    const char* pValue;
+    int iValueSize;
+    int* aHeader;
+    int rc;
+
+    if (pIndex->eState != SQLITE_ROW || pIndex->nParsed == pIndex->nText) {
+        pIndex->eState = pIndex->eState == SQLITE_ROW ? SQLITE_DONE : pIndex->eState;
+        return pIndex->eState;
+    }
+
+    if (pIndex->nHeaders == pIndex->nHeadersAlloc) {
+        int nAlloc = pIndex->nHeadersAlloc ? pIndex->nHeadersAlloc * 2 : 16;
+        int* a = sqlite3_realloc64(pIndex->aHeader, sizeof(int) * 4 * (sqlite3_int64)nAlloc);
+        if (!a) {
+            return SQLITE_NOMEM;
+        }
+        pIndex->aHeader = a;
+        pIndex->nHeadersAlloc = nAlloc;
+    }
+    rc = http_next_header(pIndex->zText + pIndex->nParsed,
+                          pIndex->nText - pIndex->nParsed,
+                          &iParsed,
+                          &pName,
+                          &iNameSize,
+                          &pValue,
+                          &iValueSize);
+    if (rc != SQLITE_ROW) {
+        pIndex->eState = rc;
+        return rc;
+    }
+    pIndex->nParsed += iParsed;
+
+    aHeader = pIndex->aHeader + pIndex->nHeaders * 4;
+    aHeader[0] = (int)(pName - pIndex->zText);
+    aHeader[1] = iNameSize;
+    aHeader[2] = pValue ? (int)(pValue - pIndex->zText) : -1;
+    aHeader[3] = iValueSize;
+    pIndex->nHeaders++;
+    return SQLITE_ROW;
+}
+
+// Add the headers indexed so far to the hash table, keeping it at most half
+// full.
+static int httpHeadersIndexHashAll(http_headers_index* pIndex) {
+    if (pIndex->nHeaders * 2 > pIndex->nSlots) {
+        int nSlots = pIndex->nSlots ? pIndex->nSlots : 32;
+        int* a;
+        while (pIndex->nHeaders * 2 > nSlots) {
+            nSlots *= 2;
+        }
+        a = sqlite3_realloc64(pIndex->aSlot, sizeof(int) * (sqlite3_int64)nSlots);
+        if (!a) {
+            return SQLITE_NOMEM;
+        }
+        pIndex->aSlot = a;
+        pIndex->nSlots = nSlots;
+        pIndex->nHashed = 0;
+    }
+    if (pIndex->nHashed == 0) {
+        memset(pIndex->aSlot, 0, sizeof(int) * pIndex->nSlots);
+    }
+    for (; pIndex->nHashed < pIndex->nHeaders; ++pIndex->nHashed) {
+        httpHeadersIndexInsert(pIndex, pIndex->nHashed);
+    }
+    return SQLITE_OK;
+}
+
+// Get the name and value of the iHeader'th header. The value is NULL if it is
+// empty, as with http_next_header().
+static void httpHeadersIndexGet(const http_headers_index* pIndex,
+                                int iHeader,
+                                const char** ppName,
+                                int* pNameSize,
+                                const char** ppValue,
+                                int* pValueSize) {
+    const int* aHeader = pIndex->aHeader + iHeader * 4;
+    *ppName = pIndex->zText + aHeader[0];
+    *pNameSize = aHeader[1];
+    *ppValue = aHeader[2] < 0 ? NULL : pIndex->zText + aHeader[2];
+    *pValueSize = aHeader[3];
+}
+
+// Find the first header with the given name, indexing more of the headers if
+// needed. Returns SQLITE_ROW with its value, SQLITE_DONE if there is none,
+// SQLITE_ERROR if the headers are malformed or SQLITE_NOMEM.
+static int httpHeadersIndexFind(http_headers_index* pIndex,
+                                const char* zName,
+                                int nName,
+                                const char** ppValue,
+                                int* pValueSize) {
+    const char* pName;
+    int iNameSize;
+    int rc;
+    if (pIndex->nHeaders > 0) {
+        unsigned int iSlot;
+        rc = httpHeadersIndexHashAll(pIndex);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        iSlot = httpHeadersIndexHash(zName, nName) & (pIndex->nSlots - 1);
+        while (pIndex->aSlot[iSlot] != 0) {
+            httpHeadersIndexGet(
+                pIndex, pIndex->aSlot[iSlot] - 1, &pName, &iNameSize, ppValue, pValueSize);
+            if (http_header_name_eq(pName, iNameSize, zName, nName)) {
+                return SQLITE_ROW;
+            }
+            iSlot = (iSlot + 1) & (pIndex->nSlots - 1);
+        }
+    }
+    // Any match from here on is the first one, earlier ones would have been
+    // found in the hash table.
+    while ((rc = httpHeadersIndexNext(pIndex)) == SQLITE_ROW) {
+        httpHeadersIndexGet(
+            pIndex, pIndex->nHeaders - 1, &pName, &iNameSize, ppValue, pValueSize);
+        if (http_header_name_eq(pName, iNameSize, zName, nName)) {
+            return SQLITE_ROW;
+        }
+    }
+    return rc;
+}
+
+// Queries often look up several headers from the same text, for example
+// http_headers_get(h, 'a'), http_headers_get(h, 'b') on each row. The index of
+// the last headers is kept on the connection and reused if the text is the
+// same. *pbHit is set if it was.
+static int httpHeadersCached(http_ext* pExt,
+                             const char* zHeaders,
+                             int szHeaders,
+                             http_headers_index** ppIndex,
+                             int* pbHit) {
+    http_headers_index* pIndex = pExt->pLastIndex;
+    int rc;
+
+    if (pIndex && szHeaders == pIndex->nText &&
+        (szHeaders == 0 || memcmp(zHeaders, pIndex->zText, szHeaders) == 0)) {
+        *ppIndex = pIndex;
+        *pbHit = 1;
+        return SQLITE_OK;
+    }
+
+    // The index can be reused unless something else still refers to it.
+    if (!pIndex || pIndex->nRef > 1) {
+        httpHeadersIndexUnref(pIndex);
+        pIndex = pExt->pLastIndex = sqlite3_malloc(sizeof(*pIndex));
+        if (!pIndex) {
+            return SQLITE_NOMEM;
+        }
+        memset(pIndex, 0, sizeof(*pIndex));
+        pIndex->nRef = 1;
+    }
+    rc = httpHeadersIndexReset(pIndex, zHeaders, szHeaders);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    *ppIndex = pIndex;
+    *pbHit = 0;
+    return SQLITE_OK;
+}
+
+// Get the index of the text headers in the first argument of the function.
+// The index is also attached to the argument when the headers are looked up
+// again, so that constant headers are not even compared on later calls.
+static int httpHeadersIndexFor(sqlite3_context* ctx,
+                               sqlite3_value* pHeaders,
+                               http_headers_index** ppIndex) {
+    http_headers_index* pIndex = sqlite3_get_auxdata(ctx, 0);
+    const char* zHeaders;
+    int zHeadersSize;
+    int bHit;
+    int rc;
+
+    if (pIndex) {
+        *ppIndex = pIndex;
+        return SQLITE_OK;
+    }
+
+    zHeaders = (const char*)sqlite3_value_text(pHeaders);
+    zHeadersSize = sqlite3_value_bytes(pHeaders);
+    rc = httpHeadersCached(sqlite3_user_data(ctx), zHeaders, zHeadersSize, &pIndex, &bHit);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    if (bHit && !pIndex->bAuxData) {
+        pIndex->bAuxData = 1;
+        pIndex->nRef++;
+        sqlite3_set_auxdata(ctx, 0, pIndex, httpHeadersIndexUnref);
+    }
+    *ppIndex = pIndex;
+    return SQLITE_OK;
+}
+
+// Look up the first header with the given name in either text or parsed
+// headers. Returns SQLITE_ROW, SQLITE_DONE if there is no such header,
+// SQLITE_ERROR if the headers are malformed or SQLITE_NOMEM.
+static int httpHeadersFind(sqlite3_context* ctx,
+                           sqlite3_value* pHeaders,
+                           const char* zName,
+                           int nName,
+                           const char** ppValue,
+                           int* pValueSize) {
+    http_headers_view view;
+    http_headers_index* pIndex;
+    int rc;
+
+    if (httpHeadersUnpack(pHeaders, &view) == SQLITE_OK) {
+        return httpHeadersViewFind(&view, zName, nName, ppValue, pValueSize);
+    }
+
+    rc = httpHeadersIndexFor(ctx, pHeaders, &pIndex);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    return httpHeadersIndexFind(pIndex, zName, nName, ppValue, pValueSize);
+}
+
+static void httpHeadersHasFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    int zHeaderSize = sqlite3_value_bytes(argv[1]);
+    const char* zHeader = sqlite3_value_text(argv[1]);
+    const char* pValue;
+    int iValueSize;
+    int rc = httpHeadersFind(ctx, argv[0], zHeader, zHeaderSize, &pValue, &iValueSize);
+    if (rc == SQLITE_NOMEM) {
+        sqlite3_result_error_nomem(ctx);
+        return;
+    }
+    if (rc == SQLITE_ERROR) {
+        sqlite3_result_error(ctx, "http_headers_has: malformed headers", -1);
+        return;
+    }
+    sqlite3_result_int(ctx, rc == SQLITE_ROW);
+}
+
+static void httpHeadersGetFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    int zHeaderSize = sqlite3_value_bytes(argv[1]);
+    const char* zHeader = sqlite3_value_text(argv[1]);
+    const char* pValue;
+    int iValueSize;
+    int rc = httpHeadersFind(ctx, argv[0], zHeader, zHeaderSize, &pValue, &iValueSize);
+    if (rc == SQLITE_NOMEM) {
+        sqlite3_result_error_nomem(ctx);
+        return;
+    }
+    if (rc == SQLITE_ERROR) {
+        sqlite3_result_error(ctx, "http_headers_get: malformed headers", -1);
+        return;
+    }
+    if (rc == SQLITE_ROW) {
+        sqlite3_result_text(ctx, pValue, iValueSize, SQLITE_TRANSIENT);
+    }
+}
+
+// Size of a string encoded as a JSON string, including the quotes.
+static sqlite3_int64 httpJsonStringSize(const char* z, int n) {
+    sqlite3_int64 nJson = n + 2;
+    int i;
+    for (i = 0; i < n; ++i) {
+        unsigned char c = (unsigned char)z[i];
+        if (c < 0x20) {
+            nJson += 5;
+        } else if (c == '"' || c == '\\') {
+            nJson += 1;
+        }
+    }
+    return nJson;
+}
+
+// Write a string encoded as a JSON string and return the end of the output.
+static char* httpJsonWriteString(char* zOut, const char* z, int n) {
+    static const char aHex[] = "0123456789abcdef";
+    int i;
+    *zOut++ = '"';
+    for (i = 0; i < n; ++i) {
+        unsigned char c = (unsigned char)z[i];
+        if (c < 0x20) {
+            memcpy(zOut, "\\u00", 4);
+            zOut[4] = aHex[c >> 4];
+            zOut[5] = aHex[c & 15];
+            zOut += 6;
+        } else if (c == '"' || c == '\\') {
+            *zOut++ = '\\';
+            *zOut++ = (char)c;
+        } else {
+            *zOut++ = (char)c;
+        }
+    }
+    *zOut++ = '"';
+    return zOut;
+}
+
+// http_headers_extract(headers, name, ...) returns a JSON object with a key
+// for each name. The value is null if there is no such header, a string if
+// there is one and an array of strings if the header is repeated. The headers
+// are scanned once no matter how many names are extracted.
+static void httpHeadersExtractFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    http_headers_view view;
+    http_headers_index* pIndex = NULL;
+    const char** azName = NULL;
+    int* anName;
+    int* aCount;
+    int* aFirst;
+    int* aMatch;
+    int nHeaders;
+    sqlite3_int64 nJson = 2;
+    char* zJson;
+    char* zOut;
+    const char* pName;
+    int iNameSize;
+    const char* pValue;
+    int iValueSize;
+    int rc = SQLITE_OK;
+    int i;
+    int j;
+
+    if (argc < 1) {
+        sqlite3_result_error(ctx, "http_headers_extract: expected at least 1 argument", -1);
+        return;
+    }
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        return;
+    }
+
+    if (httpHeadersUnpack(argv[0], &view) == SQLITE_OK) {
+        nHeaders = view.nHeaders;
+    } else {
+        rc = httpHeadersIndexFor(ctx, argv[0], &pIndex);
+        while (rc == SQLITE_OK && (rc = httpHeadersIndexNext(pIndex)) == SQLITE_ROW) {
+            rc = SQLITE_OK;
+        }
+        if (rc != SQLITE_DONE) {
+            goto done;
+        }
+        rc = SQLITE_OK;
+        nHeaders = pIndex->nHeaders;
+    }
+
+    azName = sqlite3_malloc64(sizeof(*azName) * argc + sizeof(int) * (4 * argc + nHeaders));
+    if (!azName) {
+        rc = SQLITE_NOMEM;
+        goto done;
+    }
+    anName = (int*)(azName + argc);
+    aCount = anName + argc;
+    aFirst = aCount + argc;
+    aMatch = aFirst + argc;
+
+    // Names that are NULL or repeat an earlier name are skipped.
+    for (j = 1; j < argc; ++j) {
+        azName[j] = (const char*)sqlite3_value_text(argv[j]);
+        anName[j] = sqlite3_value_bytes(argv[j]);
+        aCount[j] = 0;
+        aFirst[j] = -1;
+        if (!azName[j] && sqlite3_value_type(argv[j]) != SQLITE_NULL) {
+            rc = SQLITE_NOMEM;
+            goto done;
+        }
+        for (i = 1; azName[j] && i < j; ++i) {
+            if (azName[i] && anName[i] == anName[j] &&
+                http_header_name_eq(azName[i], anName[i], azName[j], anName[j])) {
+                azName[j] = NULL;
+            }
+        }
+    }
+
+    // Match every header against the names and size the result on the way.
+    for (i = 0; i < nHeaders; ++i) {
+        if (pIndex) {
+            httpHeadersIndexGet(pIndex, i, &pName, &iNameSize, &pValue, &iValueSize);
+        } else if (httpHeadersViewGet(&view, i, &pName, &iNameSize, &pValue, &iValueSize) !=
+                   SQLITE_OK) {
+            rc = SQLITE_ERROR;
+            goto done;
+        }
+        aMatch[i] = 0;
+        for (j = 1; j < argc; ++j) {
+            if (azName[j] && anName[j] == iNameSize &&
+                http_header_name_eq(azName[j], anName[j], pName, iNameSize)) {
+                aMatch[i] = j;
+                if (aCount[j]++ == 0) {
+                    aFirst[j] = i;
+                }
+                nJson += httpJsonStringSize(pValue, iValueSize);
+                break;
+            }
+        }
+    }
+    for (j = 1; j < argc; ++j) {
+        if (azName[j]) {
+            // The key, colon, comma and either null, the commas of an array
+            // and its brackets or nothing more for a single value.
+            nJson += httpJsonStringSize(azName[j], anName[j]) + 2;
+            nJson += aCount[j] == 0 ? 4 : aCount[j] == 1 ? 0 : aCount[j] + 1;
+        }
+    }
+
+    zJson = zOut = sqlite3_malloc64(nJson);
+    if (!zJson) {
+        rc = SQLITE_NOMEM;
+        goto done;
+    }
+    *zOut++ = '{';
+    for (j = 1; j < argc; ++j) {
+        if (!azName[j]) {
+            continue;
+        }
+        if (zOut > zJson + 1) {
+            *zOut++ = ',';
+        }
+        zOut = httpJsonWriteString(zOut, azName[j], anName[j]);
+        *zOut++ = ':';
+        if (aCount[j] == 0) {
+            memcpy(zOut, "null", 4);
+            zOut += 4;
+            continue;
+        }
+        if (aCount[j] > 1) {
+            *zOut++ = '[';
+        }
+        for (i = aFirst[j]; i < nHeaders; ++i) {
+            if (aMatch[i] != j) {
+                continue;
+            }
+            if (i != aFirst[j]) {
+                *zOut++ = ',';
+            }
+            if (pIndex) {
+                httpHeadersIndexGet(pIndex, i, &pName, &iNameSize, &pValue, &iValueSize);
+            } else {
+                httpHeadersViewGet(&view, i, &pName, &iNameSize, &pValue, &iValueSize);
+            }
+            zOut = httpJsonWriteString(zOut, pValue, iValueSize);
+        }
+        if (aCount[j] > 1) {
+            *zOut++ = ']';
+        }
+    }
+    *zOut++ = '}';
+    assert(zOut <= zJson + nJson);
+    sqlite3_result_text64(ctx, zJson, zOut - zJson, sqlite3_free, SQLITE_UTF8);
+    sqlite3_result_subtype(ctx, 'J');
+
+done:
+
+    sqlite3_free(azName);
+
+    if (rc == SQLITE_NOMEM) {
+        sqlite3_result_error_nomem(ctx);
+    } else if (rc == SQLITE_ERROR) {
+        sqlite3_result_error(ctx, "http_headers_extract: malformed headers", -1);
+    } else if (rc != SQLITE_OK) {
+        sqlite3_result_error_code(ctx, rc);
+    }
+}
+
+static void httpShareFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    int bEnable;
+    int nMaxConnections = 0;
+    char* zErrMsg = NULL;
+    int rc;
+    if (argc < 1 || argc > 2) {
+        sqlite3_result_error(ctx, "http_share: expected 1 or 2 arguments", -1);
+        return;
+    }
+    bEnable = sqlite3_value_int(argv[0]);
+    if (argc == 2) {
+        nMaxConnections = sqlite3_value_int(argv[1]);
+    }
+    rc = http_share_configure(bEnable, nMaxConnections, &zErrMsg);
+    if (rc != SQLITE_OK) {
+        if (zErrMsg) {
+            sqlite3_result_error(ctx, zErrMsg, -1);
+            sqlite3_free(zErrMsg);
+        } else {
+            sqlite3_result_error_code(ctx, rc);
+        }
+        return;
+    }
+    sqlite3_result_int(ctx, bEnable != 0);
+}
+
+// Get or set the maximum size of response bodies on this connection. Zero
+// restores the default, which is the maximum length of a blob.
+static void httpMaxBodySizeFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    http_ext* pExt = (http_ext*)sqlite3_user_data(ctx);
+    if (argc > 1) {
+        sqlite3_result_error(ctx, "http_max_body_size: expected 0 or 1 arguments", -1);
+        return;
+    }
+    if (argc == 1) {
+        sqlite3_int64 szMaxBody = sqlite3_value_int64(argv[0]);
+        pExt->szMaxBody = szMaxBody > 0 ? szMaxBody : 0;
+    }
+    sqlite3_result_int64(ctx, httpMaxBodySize(pExt));
+}
+
+static void httpEnqueueFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    http_request req;
+    sqlite3_int64 iId;
+    int rc;
+
+    if (argc < 2 || argc > 4) {
+        sqlite3_result_error(ctx, "http_enqueue: expected 2 to 4 arguments", -1);
+        return;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.zMethod = (char*)sqlite3_value_text(argv[0]);
+    req.zUrl = (char*)sqlite3_value_text(argv[1]);
+    if (!req.zMethod || !req.zUrl) {
+        sqlite3_result_error(ctx, "http_enqueue: method and url must not be NULL", -1);
+        return;
+    }
+    if (argc > 2) {
+        req.zHeaders = (const char*)sqlite3_value_text(argv[2]);
+    }
+    if (argc > 3 && sqlite3_value_type(argv[3]) != SQLITE_NULL) {
+        req.pBody = sqlite3_value_blob(argv[3]);
+        req.szBody = sqlite3_value_bytes(argv[3]);
+        if (!req.pBody) {
+            req.pBody = "";
+        }
+    }
+
+    req.szMaxBody = httpMaxBodySize((http_ext*)sqlite3_user_data(ctx));
+    req.zSql = httpRunningSql(sqlite3_context_db_handle(ctx));
+
+    rc = http_async_enqueue(&req, &iId);
+    if (rc != SQLITE_OK) {
+        if (rc == SQLITE_NOMEM) {
+            sqlite3_result_error_nomem(ctx);
+        } else {
+            sqlite3_result_error(ctx, "http_enqueue: failed to start worker threads", -1);
+        }
+        return;
+    }
+
+    sqlite3_result_int64(ctx, iId);
+}
+
+static void httpWaitFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    int msTimeout = -1;
+    int eState;
+    int rc;
+
+    if (argc < 1 || argc > 2) {
+        sqlite3_result_error(ctx, "http_wait: expected 1 or 2 arguments", -1);
+        return;
+    }
+    if (argc == 2 && sqlite3_value_type(argv[1]) != SQLITE_NULL) {
+        msTimeout = sqlite3_value_int(argv[1]);
+        if (msTimeout < 0) {
+            msTimeout = -1;
+        }
+    }
+
+    rc = http_async_wait(sqlite3_value_int64(argv[0]), msTimeout, &eState);
+    if (rc == SQLITE_NOTFOUND) {
+        sqlite3_result_error(ctx, "http_wait: no such request", -1);
+        return;
+    }
+
+    sqlite3_result_int(ctx, eState == HTTP_ASYNC_DONE || eState == HTTP_ASYNC_ERROR);
+}
+
+#define HTTP_RESULTS_COL_ID 0
+#define HTTP_RESULTS_COL_STATE 1
+#define HTTP_RESULTS_COL_RESPONSE_STATUS 2
+#define HTTP_RESULTS_COL_RESPONSE_STATUS_CODE 3
+#define HTTP_RESULTS_COL_RESPONSE_HEADERS 4
+#define HTTP_RESULTS_COL_RESPONSE_BODY 5
+#define HTTP_RESULTS_COL_RESPONSE_ERROR 6
+#define HTTP_RESULTS_COL_REQUEST_METHOD 7
+#define HTTP_RESULTS_COL_REQUEST_URL 8
+#define HTTP_RESULTS_COL_REQUEST_HEADERS 9
+#define HTTP_RESULTS_COL_REQUEST_BODY 10
+
+#define HTTP_RESULTS_FLAG_ID 1
+
+typedef struct http_results_cursor http_results_cursor;
+struct http_results_cursor {
+    sqlite3_vtab_cursor base;
+    http_async_entry entry;
+    int bSingle;
+    int bEof;
+};
+
+static int httpResultsConnect(sqlite3* db,
+                              void* pAux,
+                              int argc,
+                              const char* const* argv,
+                              sqlite3_vtab** ppVtab,
+                              char** pzErr) {
+    sqlite3_vtab* pNew;
+    int rc;
+
+    rc = sqlite3_declare_vtab(db,
+                              "CREATE TABLE x(id INT, state TEXT, response_status TEXT, "
+                              "response_status_code INT, response_headers TEXT, "
+                              "response_body BLOB, response_error TEXT, request_method TEXT, "
+                              "request_url TEXT, request_headers TEXT, request_body BLOB)");
+
+    if (rc == SQLITE_OK) {
+        pNew = sqlite3_malloc(sizeof(*pNew));
+        *ppVtab = pNew;
+        if (pNew == 0)
+            return SQLITE_NOMEM;
+        memset(pNew, 0, sizeof(*pNew));
+    }
+    return rc;
+}
+
+static int httpResultsDisconnect(sqlite3_vtab* pVtab) {
+    sqlite3_free(pVtab);
+    return SQLITE_OK;
+}
+
+static int httpResultsOpen(sqlite3_vtab* p, sqlite3_vtab_cursor** ppCursor) {
+    http_results_cursor* pCur;
+    pCur = sqlite3_malloc(sizeof(*pCur));
+    if (pCur == 0)
+        return SQLITE_NOMEM;
+    memset(pCur, 0, sizeof(*pCur));
+    *ppCursor = &pCur->base;
+    return SQLITE_OK;
+}
+
+static int httpResultsClose(sqlite3_vtab_cursor* cur) {
+    http_results_cursor* pCur = (http_results_cursor*)cur;
+    http_async_entry_clear(&pCur->entry);
+    sqlite3_free(pCur);
+    return SQLITE_OK;
+}
+
+// Each row is a snapshot of the request taken when the cursor moves onto it.
+static int httpResultsLoad(http_results_cursor* pCur, sqlite3_int64 iId, int bNext) {
+    int rc;
+    http_async_entry_clear(&pCur->entry);
+    rc = http_async_get(iId, bNext, &pCur->entry);
+    if (rc == SQLITE_DONE) {
+        pCur->bEof = 1;
+        return SQLITE_OK;
+    }
+    if (rc != SQLITE_ROW) {
+        return rc;
+    }
+    pCur->bEof = 0;
+    return SQLITE_OK;
+}
+
+static int httpResultsNext(sqlite3_vtab_cursor* cur) {
+    http_results_cursor* pCur = (http_results_cursor*)cur;
+    if (pCur->bSingle) {
+        pCur->bEof = 1;
+        return SQLITE_OK;
+    }
+    return httpResultsLoad(pCur, pCur->entry.iId, 1);
+}
+
+static int httpResultsColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
+    static const char* aStates[] = {"queued", "running", "done", "error"};
+    http_results_cursor* pCur = (http_results_cursor*)cur;
+    http_async_entry* pEntry = &pCur->entry;
+    int bOk = pEntry->eState == HTTP_ASYNC_DONE;
+
+    switch (i) {
+    case HTTP_RESULTS_COL_ID:
+        sqlite3_result_int64(ctx, pEntry->iId);
+        break;
+
+    case HTTP_RESULTS_COL_STATE:
+        sqlite3_result_text(ctx, aStates[pEntry->eState], -1, SQLITE_STATIC);
+        break;
+
+    case HTTP_RESULTS_COL_RESPONSE_STATUS:
+        if (bOk) {
+            sqlite3_result_text(ctx, pEntry->resp.zStatus, -1, SQLITE_TRANSIENT);
+        }
+        break;
+
+    case HTTP_RESULTS_COL_RESPONSE_STATUS_CODE:
+        if (bOk) {
+            sqlite3_result_int(ctx, pEntry->resp.iStatusCode);
+        }
+        break;
+
+    case HTTP_RESULTS_COL_RESPONSE_HEADERS:
+        if (bOk) {
+            sqlite3_result_text(ctx, pEntry->resp.zHeaders, -1, SQLITE_TRANSIENT);
+        }
+        break;
+
+    case HTTP_RESULTS_COL_RESPONSE_BODY:
+        if (bOk) {
+            sqlite3_result_blob64(
+                ctx, http_body_ref(pEntry->resp.pBody), pEntry->resp.szBody, http_body_unref);
+        }
+        break;
+
+    case HTTP_RESULTS_COL_RESPONSE_ERROR:
+        if (pEntry->zErrMsg) {
+            sqlite3_result_text(ctx, pEntry->zErrMsg, -1, SQLITE_TRANSIENT);
+        }
+        break;
+
+    case HTTP_RESULTS_COL_REQUEST_METHOD:
+        sqlite3_result_text(ctx, pEntry->req.zMethod, -1, SQLITE_TRANSIENT);
+        break;
+
+    case HTTP_RESULTS_COL_REQUEST_URL:
+        sqlite3_result_text(ctx, pEntry->req.zUrl, -1, SQLITE_TRANSIENT);
+        break;
+
+    case HTTP_RESULTS_COL_REQUEST_HEADERS:
+        if (pEntry->req.zHeaders) {
+            sqlite3_result_text(ctx, pEntry->req.zHeaders, -1, SQLITE_TRANSIENT);
+        }
+        break;
+
+    case HTTP_RESULTS_COL_REQUEST_BODY:
+        if (pEntry->req.pBody) {
+            sqlite3_result_blob(ctx, pEntry->req.pBody, pEntry->req.szBody, SQLITE_TRANSIENT);
+        }
+        break;
+    }
+
+    return SQLITE_OK;
+}
+
+static int httpResultsRowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
+    http_results_cursor* pCur = (http_results_cursor*)cur;
+    *pRowid = pCur->entry.iId;
+    return SQLITE_OK;
+}
+
+static int httpResultsEof(sqlite3_vtab_cursor* cur) {
+    http_results_cursor* pCur = (http_results_cursor*)cur;
+    return pCur->bEof;
+}
+
+static int httpResultsFilter(sqlite3_vtab_cursor* pVtabCursor,
+                             int idxNum,
+                             const char* idxStr,
+                             int argc,
+                             sqlite3_value** argv) {
+    http_results_cursor* pCur = (http_results_cursor*)pVtabCursor;
+    if (idxNum & HTTP_RESULTS_FLAG_ID) {
+        pCur->bSingle = 1;
+        return httpResultsLoad(pCur, sqlite3_value_int64(argv[0]), 0);
+    }
+    pCur->bSingle = 0;
+    return httpResultsLoad(pCur, 0, 1);
+}
+
+static int httpResultsBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
+    int i;
+
+    for (i = 0; i < pIdxInfo->nConstraint; ++i) {
+        int iColumn = pIdxInfo->aConstraint[i].iColumn;
+        if (iColumn != HTTP_RESULTS_COL_ID && iColumn != -1) {
+            continue;
+        }
+        if (!pIdxInfo->aConstraint[i].usable ||
+            pIdxInfo->aConstraint[i].op != SQLITE_INDEX_CONSTRAINT_EQ) {
+            continue;
+        }
+        pIdxInfo->aConstraintUsage[i].argvIndex = 1;
+        pIdxInfo->aConstraintUsage[i].omit = 1;
+        pIdxInfo->idxNum = HTTP_RESULTS_FLAG_ID;
+        pIdxInfo->idxFlags = SQLITE_INDEX_SCAN_UNIQUE;
+        pIdxInfo->estimatedCost = (double)1;
+        pIdxInfo->estimatedRows = 1;
+        return SQLITE_OK;
+    }
+
+    pIdxInfo->estimatedCost = (double)1000;
+    pIdxInfo->estimatedRows = 1000;
+
+    return SQLITE_OK;
+}
+
+// Only DELETE is supported. Deleting a queued request cancels it.
+static int httpResultsUpdate(sqlite3_vtab* pVtab,
+                             int argc,
+                             sqlite3_value** argv,
+                             sqlite_int64* pRowid) {
+    int rc;
+
+    if (argc != 1) {
+        sqlite3_free(pVtab->zErrMsg);
+        pVtab->zErrMsg = sqlite3_mprintf("http_results: only DELETE is supported");
+        return SQLITE_ERROR;
+    }
+
+    rc = http_async_remove(sqlite3_value_int64(argv[0]));
+    if (rc == SQLITE_BUSY) {
+        sqlite3_free(pVtab->zErrMsg);
+        pVtab->zErrMsg = sqlite3_mprintf("http_results: request is running");
+        return SQLITE_ERROR;
+    }
+
+    return rc;
+}
+
+static sqlite3_module httpResultsModule = {
+    /* iVersion    */ 0,
+    /* xCreate     */ 0,
+    /* xConnect    */ httpResultsConnect,
+    /* xBestIndex  */ httpResultsBestIndex,
+    /* xDisconnect */ httpResultsDisconnect,
+    /* xDestroy    */ 0,
+    /* xOpen       */ httpResultsOpen,
+    /* xClose      */ httpResultsClose,
+    /* xFilter     */ httpResultsFilter,
+    /* xNext       */ httpResultsNext,
+    /* xEof        */ httpResultsEof,
+    /* xColumn     */ httpResultsColumn,
+    /* xRowid      */ httpResultsRowid,
+    /* xUpdate     */ httpResultsUpdate,
+    /* xBegin      */ 0,
+    /* xSync       */ 0,
+    /* xCommit     */ 0,
+    /* xRollback   */ 0,
+    /* xFindMethod */ 0,
+    /* xRename     */ 0,
+    /* xSavepoint  */ 0,
+    /* xRelease    */ 0,
+    /* xRollbackTo */ 0,
+    /* xShadowName */ 0,
+};
+
+#define HTTP_HEADERS_EACH_COL_NAME 0
+#define HTTP_HEADERS_EACH_COL_VALUE 1
+#define HTTP_HEADERS_EACH_COL_HEADERS 2
+
+// How the name constraint passed to xFilter after the headers is matched.
+#define HTTP_HEADERS_EACH_NAME_EQ 1
+#define HTTP_HEADERS_EACH_NAME_IN 2
+#define HTTP_HEADERS_EACH_NAME_LIKE 3
+#define HTTP_HEADERS_EACH_NAME_GLOB 4
+
+typedef struct http_headers_each_vtab http_headers_each_vtab;
+struct http_headers_each_vtab {
+    sqlite3_vtab base;
+    http_ext* pExt;
+};
+
+typedef struct http_headers_each_cursor http_headers_each_cursor;
+struct http_headers_each_cursor {
+    sqlite3_vtab_cursor base;
+    sqlite3_int64 iRowid;
+    const char* zHeaders;
+    int zHeadersSize;
+    const char* name;
+    int nameSize;
+    const char* value;
+    int valueSize;
+    int done;
+    // Set when iterating over headers returned by http_headers_parse().
+    // Otherwise the text headers are iterated through their index.
+    int bParsed;
+    http_headers_view view;
+    http_headers_index* pIndex;
+    // Set to HTTP_HEADERS_EACH_NAME_* when the headers are filtered by name.
+    // Only headers with one of the names, or starting with the prefix for LIKE
+    // and GLOB, are returned.
+    int eName;
+    int nName;
+    struct http_headers_each_name {
+        char* zName;
+        int nName;
+    } * aName;
+};
+
+static void httpHeadersEachClearNames(http_headers_each_cursor* pCur) {
+    int i;
+    for (i = 0; i < pCur->nName; ++i) {
+        sqlite3_free(pCur->aName[i].zName);
+    }
+    sqlite3_free(pCur->aName);
+    pCur->aName = NULL;
+    pCur->eName = 0;
+    pCur->nName = 0;
+}
+
+// Add the first nName bytes of a name to filter by.
+static int httpHeadersEachAddName(http_headers_each_cursor* pCur,
+                                  const char* zName,
+                                  int nName) {
+    struct http_headers_each_name* aName;
+    struct http_headers_each_name* pName;
+    aName = sqlite3_realloc64(pCur->aName, sizeof(*aName) * (pCur->nName + 1));
+    if (!aName) {
+        return SQLITE_NOMEM;
+    }
+    pCur->aName = aName;
+    pName = &aName[pCur->nName];
+    pName->zName = sqlite3_malloc(nName + 1);
+    if (!pName->zName) {
+        return SQLITE_NOMEM;
+    }
+    memcpy(pName->zName, zName, nName);
+    pName->zName[nName] = '\0';
+    pName->nName = nName;
+    pCur->nName++;
+    return SQLITE_OK;
+}
+
+// Load the names to filter by. NULL names match nothing. LIKE and GLOB
+// patterns are reduced to the literal prefix before the first wildcard, SQLite
+// checks the rest of the pattern.
+static int httpHeadersEachLoadNames(http_headers_each_cursor* pCur,
+                                    int eName,
+                                    sqlite3_value* pValue) {
+    sqlite3_value* pItem;
+    const char* zName;
+    int nPrefix;
+    int rc = SQLITE_OK;
+
+    pCur->eName = eName;
+    switch (eName) {
+    case HTTP_HEADERS_EACH_NAME_EQ:
+        zName = (const char*)sqlite3_value_text(pValue);
+        if (zName) {
+            rc = httpHeadersEachAddName(pCur, zName, sqlite3_value_bytes(pValue));
+        } else if (sqlite3_value_type(pValue) != SQLITE_NULL) {
+            rc = SQLITE_NOMEM;
+        }
+        break;
+
+    case HTTP_HEADERS_EACH_NAME_IN:
+        for (rc = sqlite3_vtab_in_first(pValue, &pItem); rc == SQLITE_OK && pItem;
+             rc = sqlite3_vtab_in_next(pValue, &pItem)) {
+            zName = (const char*)sqlite3_value_text(pItem);
+            if (zName) {
+                rc = httpHeadersEachAddName(pCur, zName, sqlite3_value_bytes(pItem));
+            } else if (sqlite3_value_type(pItem) != SQLITE_NULL) {
+                rc = SQLITE_NOMEM;
+            }
+            if (rc != SQLITE_OK) {
+                return rc;
+            }
+        }
+        if (rc == SQLITE_DONE) {
+            rc = SQLITE_OK;
+        }
+        break;
+
+    case HTTP_HEADERS_EACH_NAME_LIKE:
+    case HTTP_HEADERS_EACH_NAME_GLOB:
+        zName = (const char*)sqlite3_value_text(pValue);
+        if (!zName) {
+            rc = sqlite3_value_type(pValue) == SQLITE_NULL ? SQLITE_OK : SQLITE_NOMEM;
+            break;
+        }
+        nPrefix = (int)strcspn(zName, eName == HTTP_HEADERS_EACH_NAME_LIKE ? "%_" : "*?[");
+        if (nPrefix == 0 && zName[0] != '\0') {
+            // Any name may match a pattern starting with a wildcard.
+            pCur->eName = 0;
+            break;
+        }
+        rc = httpHeadersEachAddName(pCur, zName, nPrefix);
+        break;
+    }
+    return rc;
+}
+
+// Check the current header against the names.
+static int httpHeadersEachMatch(http_headers_each_cursor* pCur) {
+    int bPrefix = pCur->eName >= HTTP_HEADERS_EACH_NAME_LIKE;
+    int i;
+    for (i = 0; i < pCur->nName; ++i) {
+        struct http_headers_each_name* pName = &pCur->aName[i];
+        int nName = bPrefix ? pName->nName : pCur->nameSize;
+        if (pCur->nameSize < nName ||
+            !http_header_name_eq(pName->zName, pName->nName, pCur->name, nName)) {
+            continue;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+static int httpHeadersEachConnect(sqlite3* db,
+                                  void* pAux,
+                                  int argc,
+                                  const char* const* argv,
+                                  sqlite3_vtab** ppVtab,
+                                  char** pzErr) {
+    http_headers_each_vtab* pNew;
+    int rc;
+    // Header names are case-insensitive, and so are comparisons on the name
+    // column whether or not they are pushed down into xFilter.
+    rc = sqlite3_declare_vtab(
+        db, "CREATE TABLE x(name TEXT COLLATE NOCASE, value TEXT, headers TEXT HIDDEN)");
+    if (rc == SQLITE_OK) {
+        pNew = sqlite3_malloc(sizeof(*pNew));
+        *ppVtab = (sqlite3_vtab*)pNew;
+        if (pNew == 0)
+            return SQLITE_NOMEM;
+        memset(pNew, 0, sizeof(*pNew));
+        pNew->pExt = (http_ext*)pAux;
+    }
+    return rc;
+}
+
+static int httpHeadersEachDisconnect(sqlite3_vtab* pVtab) {
+    http_headers_each_vtab* p = (http_headers_each_vtab*)pVtab;
+    sqlite3_free(p);
+    return SQLITE_OK;
+}
+
+static int httpHeadersEachOpen(sqlite3_vtab* p, sqlite3_vtab_cursor** ppCursor) {
+    http_headers_each_cursor* pCur;
+    pCur = sqlite3_malloc(sizeof(*pCur));
+    if (pCur == 0)
+        return SQLITE_NOMEM;
+    memset(pCur, 0, sizeof(*pCur));
+    *ppCursor = &pCur->base;
+    return SQLITE_OK;
+}
+
+static int httpHeadersEachClose(sqlite3_vtab_cursor* cur) {
+    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
+    httpHeadersIndexUnref(pCur->pIndex);
+    httpHeadersEachClearNames(pCur);
+    sqlite3_free(pCur);
+    return SQLITE_OK;
+}
+
+// Move to the header at pCur->iRowid.
+static int httpHeadersEachStep(http_headers_each_cursor* pCur) {
+    int rc;
+    if (pCur->bParsed) {
+        if (pCur->iRowid > pCur->view.nHeaders) {
+            pCur->done = 1;
+            return SQLITE_OK;
+        }
+        rc = httpHeadersViewGet(&pCur->view,
+                                (int)pCur->iRowid - 1,
+                                &pCur->name,
+                                &pCur->nameSize,
+                                &pCur->value,
+                                &pCur->valueSize);
+    } else {
+        rc = SQLITE_ROW;
+        if (pCur->iRowid > pCur->pIndex->nHeaders) {
+            rc = httpHeadersIndexNext(pCur->pIndex);
+        }
+        if (rc == SQLITE_ROW) {
+            httpHeadersIndexGet(pCur->pIndex,
+                                (int)pCur->iRowid - 1,
+                                &pCur->name,
+                                &pCur->nameSize,
+                                &pCur->value,
+                                &pCur->valueSize);
+        }
+    }
+    if (rc == SQLITE_NOMEM) {
+        return rc;
+    }
+    if (rc == SQLITE_ERROR) {
+        sqlite3_free(pCur->base.pVtab->zErrMsg);
+        pCur->base.pVtab->zErrMsg = sqlite3_mprintf("http_headers_each: malformed headers");
+        return SQLITE_ERROR;
+    }
+    pCur->done = rc == SQLITE_DONE;
+    if (pCur->done) {
+        // Let the next lookup reuse the index.
+        httpHeadersIndexUnref(pCur->pIndex);
+        pCur->pIndex = NULL;
+    }
+    return SQLITE_OK;
+}
+
+// Move to the first header at or after pCur->iRowid that passes the name
+// filter. A filtered scan must return the same rows as SQLite filtering an
+// unfiltered one, so it always runs to the end of the headers: any name may
+// be repeated, even those a sender should not repeat.
+static int httpHeadersEachSeek(http_headers_each_cursor* pCur) {
+    int rc;
+    for (;;) {
+        rc = httpHeadersEachStep(pCur);
+        if (rc != SQLITE_OK || pCur->done || !pCur->eName || httpHeadersEachMatch(pCur)) {
+            return rc;
+        }
+        pCur->iRowid++;
+    }
+}
+
+static int httpHeadersEachNext(sqlite3_vtab_cursor* cur) {
+    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
+    pCur->iRowid++;
+    return httpHeadersEachSeek(pCur);
+}
+
+static int httpHeadersEachColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
+    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
+    switch (i) {
+    case HTTP_HEADERS_EACH_COL_NAME:
+        sqlite3_result_text(ctx, pCur->name, pCur->nameSize, SQLITE_TRANSIENT);
+        break;
+
+    case HTTP_HEADERS_EACH_COL_VALUE:
+        sqlite3_result_text(ctx, pCur->value, pCur->valueSize, SQLITE_TRANSIENT);
+        break;
+
+    case HTTP_HEADERS_EACH_COL_HEADERS:
+        if (pCur->bParsed) {
+            sqlite3_result_blob(ctx, pCur->zHeaders, pCur->zHeadersSize, SQLITE_TRANSIENT);
+        } else {
+            sqlite3_result_text(ctx, pCur->zHeaders, pCur->zHeadersSize, SQLITE_TRANSIENT);
+        }
+        break;
+
+    default:
+        sqlite3_result_error(ctx, "unknown column", -1);
+        break;
+    }
+    return SQLITE_OK;
+}
+
+static int httpHeadersEachRowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
+    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
+    *pRowid = pCur->iRowid;
+    return SQLITE_OK;
+}
+
+static int httpHeadersEachEof(sqlite3_vtab_cursor* cur) {
+    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
+    return pCur->done;
+}
+
+static int httpHeadersEachFilter(sqlite3_vtab_cursor* pVtabCursor,
+                                 int idxNum,
+                                 const char* idxStr,
+                                 int argc,
+                                 sqlite3_value** argv) {
+    http_headers_each_cursor* pCur = (http_headers_each_cursor*)pVtabCursor;
+    http_headers_each_vtab* pTab = (http_headers_each_vtab*)pVtabCursor->pVtab;
+    int rc;
+    httpHeadersIndexUnref(pCur->pIndex);
+    pCur->pIndex = NULL;
+    pCur->done = 0;
+    httpHeadersEachClearNames(pCur);
+    if (idxNum) {
+        rc = httpHeadersEachLoadNames(pCur, idxNum, argv[1]);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+    }
+    pCur->bParsed = httpHeadersUnpack(argv[0], &pCur->view) == SQLITE_OK;
+    if (pCur->bParsed) {
+        pCur->zHeaders = sqlite3_value_blob(argv[0]);
+        pCur->zHeadersSize = sqlite3_value_bytes(argv[0]);
+    } else {
+        int bHit;
+        rc = httpHeadersCached(pTab->pExt,
+                               (const char*)sqlite3_value_text(argv[0]),
+                               sqlite3_value_bytes(argv[0]),
+                               &pCur->pIndex,
+                               &bHit);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        pCur->pIndex->nRef++;
+        pCur->zHeaders = pCur->pIndex->zText;
+        pCur->zHeadersSize = pCur->pIndex->nText;
+    }
+    pCur->iRowid = 1;
+    return httpHeadersEachSeek(pCur);
+}
+
+// The cursor compares names case-insensitively, which skips no header that
+// could be equal under BINARY or NOCASE. Other collations are left to SQLite.
+// Older versions cannot report it, so the column's NOCASE is assumed.
+static int httpHeadersEachCanMatch(sqlite3_index_info* pIdxInfo, int iConstraint) {
+    const char* zColl;
+    if (sqlite3_libversion_number() < 3022000) {
+        return 1;
+    }
+    zColl = sqlite3_vtab_collation(pIdxInfo, iConstraint);
+    return !zColl || sqlite3_stricmp(zColl, "BINARY") == 0 || sqlite3_stricmp(zColl, "NOCASE") == 0;
+}
+
+static int httpHeadersEachBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
+    int bHeadersSeen = 0;
+    int iName = -1;
+    int eName = 0;
+
+    for (int i = 0; i < pIdxInfo->nConstraint; ++i) {
+        const struct sqlite3_index_constraint* pConstraint = &pIdxInfo->aConstraint[i];
+        if (pConstraint->iColumn == HTTP_HEADERS_EACH_COL_HEADERS) {
+            if (!pConstraint->usable) {
+                return SQLITE_CONSTRAINT;
+            }
+            pIdxInfo->aConstraintUsage[i].argvIndex = 1;
+            pIdxInfo->aConstraintUsage[i].omit = 1;
+            bHeadersSeen = 1;
+        } else if (pConstraint->iColumn == HTTP_HEADERS_EACH_COL_NAME && pConstraint->usable) {
+            // Use one name constraint, preferring equality.
+            if (pConstraint->op == SQLITE_INDEX_CONSTRAINT_EQ &&
+                eName != HTTP_HEADERS_EACH_NAME_EQ && httpHeadersEachCanMatch(pIdxInfo, i)) {
+                iName = i;
+                eName = HTTP_HEADERS_EACH_NAME_EQ;
+            } else if (pConstraint->op == SQLITE_INDEX_CONSTRAINT_LIKE && !eName) {
+                iName = i;
+                eName = HTTP_HEADERS_EACH_NAME_LIKE;
+            } else if (pConstraint->op == SQLITE_INDEX_CONSTRAINT_GLOB && !eName) {
+                iName = i;
+                eName = HTTP_HEADERS_EACH_NAME_GLOB;
+            }
+        }
+    }
+
+    if (!bHeadersSeen) {
+        sqlite3_free(tab->zErrMsg);
+        tab->zErrMsg = sqlite3_mprintf("headers missing");
+        return SQLITE_ERROR;
+    }
+
+    // The cursor only skips headers that cannot match, SQLite still checks
+    // every constraint with the collation of the query.
+    if (eName) {
+        pIdxInfo->aConstraintUsage[iName].argvIndex = 2;
+        if (eName == HTTP_HEADERS_EACH_NAME_EQ && httpVtabInAll(pIdxInfo, iName)) {
+            eName = HTTP_HEADERS_EACH_NAME_IN;
+        }
+    }
+    pIdxInfo->idxNum = eName;
+
+    // All headers are scanned in any case, but a filtered scan returns fewer
+    // rows and copies less.
+    switch (eName) {
+    case HTTP_HEADERS_EACH_NAME_EQ:
+        pIdxInfo->estimatedCost = (double)5;
+        pIdxInfo->estimatedRows = 1;
+        break;
+    case HTTP_HEADERS_EACH_NAME_IN:
+        pIdxInfo->estimatedCost = (double)6;
+        pIdxInfo->estimatedRows = 3;
+        break;
+    case HTTP_HEADERS_EACH_NAME_LIKE:
+    case HTTP_HEADERS_EACH_NAME_GLOB:
+        pIdxInfo->estimatedCost = (double)8;
+        pIdxInfo->estimatedRows = 5;
+        break;
+    default:
+        pIdxInfo->estimatedCost = (double)10;
+        pIdxInfo->estimatedRows = 20;
+        break;
+    }
+
+    return SQLITE_OK;
+}
+
+static sqlite3_module httpHeadersEachModule = {
+    /* iVersion    */ 0,
+    /* xCreate     */ 0,
+    /* xConnect    */ httpHeadersEachConnect,
+    /* xBestIndex  */ httpHeadersEachBestIndex,
+    /* xDisconnect */ httpHeadersEachDisconnect,
+    /* xDestroy    */ 0,
+    /* xOpen       */ httpHeadersEachOpen,
+    /* xClose      */ httpHeadersEachClose,
+    /* xFilter     */ httpHeadersEachFilter,
+    /* xNext       */ httpHeadersEachNext,
+    /* xEof        */ httpHeadersEachEof,
+    /* xColumn     */ httpHeadersEachColumn,
+    /* xRowid      */ httpHeadersEachRowid,
+    /* xUpdate     */ 0,
+    /* xBegin      */ 0,
+    /* xSync       */ 0,
+    /* xCommit     */ 0,
+    /* xRollback   */ 0,
+    /* xFindMethod */ 0,
+    /* xRename     */ 0,
+    /* xSavepoint  */ 0,
+    /* xRelease    */ 0,
+    /* xRollbackTo */ 0,
+    /* xShadowName */ 0,
+};
+
+#define HTTP_BACKEND_INFO_COL_NAME 0
+#define HTTP_BACKEND_INFO_COL_VALUE 1
+
+#define HTTP_BACKEND_INFO_ROWS 7
+
+typedef struct http_backend_info_cursor http_backend_info_cursor;
+struct http_backend_info_cursor {
+    sqlite3_vtab_cursor base;
+    sqlite3_int64 iRowid;
+    http_backend_info info;
+};
+
+static int httpBackendInfoConnect(sqlite3* db,
+                                  void* pAux,
+                                  int argc,
+                                  const char* const* argv,
+                                  sqlite3_vtab** ppVtab,
+                                  char** pzErr) {
+    sqlite3_vtab* pNew;
+    int rc;
+    rc = sqlite3_declare_vtab(db, "CREATE TABLE x(name TEXT, value)");
+    if (rc == SQLITE_OK) {
+        pNew = sqlite3_malloc(sizeof(*pNew));
+        *ppVtab = pNew;
+        if (pNew == 0)
+            return SQLITE_NOMEM;
+        memset(pNew, 0, sizeof(*pNew));
+    }
+    return rc;
+}
+
+static int httpBackendInfoDisconnect(sqlite3_vtab* pVtab) {
+    sqlite3_free(pVtab);
+    return SQLITE_OK;
+}
+
+static int httpBackendInfoOpen(sqlite3_vtab* p, sqlite3_vtab_cursor** ppCursor) {
+    http_backend_info_cursor* pCur;
+    pCur = sqlite3_malloc(sizeof(*pCur));
+    if (pCur == 0)
+        return SQLITE_NOMEM;
+    memset(pCur, 0, sizeof(*pCur));
+    *ppCursor = &pCur->base;
+    return SQLITE_OK;
+}
+
+static int httpBackendInfoClose(sqlite3_vtab_cursor* cur) {
+    sqlite3_free(cur);
+    return SQLITE_OK;
+}
+
+static int httpBackendInfoNext(sqlite3_vtab_cursor* cur) {
+    http_backend_info_cursor* pCur = (http_backend_info_cursor*)cur;
+    pCur->iRowid++;
+    return SQLITE_OK;
+}
+
+static void result_text_or_null(sqlite3_context* ctx, const char* zText) {
+    if (zText) {
+        sqlite3_result_text(ctx, zText, -1, SQLITE_STATIC);
+    } else {
+        sqlite3_result_null(ctx);
+    }
+}
+
+static int httpBackendInfoColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
+    static const char* aNames[HTTP_BACKEND_INFO_ROWS] = {
+        "backend",
+        "version",
+        "ssl_version",
+        "http2",
+        "http3",
+        "compression",
+        "share",
+    };
+    http_backend_info_cursor* pCur = (http_backend_info_cursor*)cur;
+    const http_backend_info* pInfo = &pCur->info;
+    int iRow = (int)pCur->iRowid - 1;
+
+    if (i == HTTP_BACKEND_INFO_COL_NAME) {
+        sqlite3_result_text(ctx, aNames[iRow], -1, SQLITE_STATIC);
+        return SQLITE_OK;
+    }
+
+    switch (iRow) {
+    case 0:
+        result_text_or_null(ctx, pInfo->zName);
+        break;
+    case 1:
+        result_text_or_null(ctx, pInfo->zVersion);
+        break;
+    case 2:
+        result_text_or_null(ctx, pInfo->zSslVersion);
+        break;
+    case 3:
+        sqlite3_result_int(ctx, pInfo->bHttp2);
+        break;
+    case 4:
+        sqlite3_result_int(ctx, pInfo->bHttp3);
+        break;
+    case 5:
+        result_text_or_null(ctx, pInfo->zCompression);
+        break;
+    case 6:
+        sqlite3_result_int(ctx, pInfo->bShare);
+        break;
+    }
+
+    return SQLITE_OK;
+}
+
+static int httpBackendInfoRowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
+    http_backend_info_cursor* pCur = (http_backend_info_cursor*)cur;
+    *pRowid = pCur->iRowid;
+    return SQLITE_OK;
+}
+
+static int httpBackendInfoEof(sqlite3_vtab_cursor* cur) {
+    http_backend_info_cursor* pCur = (http_backend_info_cursor*)cur;
+    return pCur->iRowid > HTTP_BACKEND_INFO_ROWS;
+}
+
+static int httpBackendInfoFilter(sqlite3_vtab_cursor* pVtabCursor,
+                                 int idxNum,
+                                 const char* idxStr,
+                                 int argc,
+                                 sqlite3_value** argv) {
+    http_backend_info_cursor* pCur = (http_backend_info_cursor*)pVtabCursor;
+    char* zErrMsg = NULL;
+    int rc = http_backend_get_info(&pCur->info, &zErrMsg);
+    if (rc != SQLITE_OK) {
+        sqlite3_free(pVtabCursor->pVtab->zErrMsg);
+        pVtabCursor->pVtab->zErrMsg = zErrMsg;
+        return rc;
+    }
+    pCur->iRowid = 1;
+    return SQLITE_OK;
+}
+
+static int httpBackendInfoBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
+    pIdxInfo->estimatedCost = (double)HTTP_BACKEND_INFO_ROWS;
+    pIdxInfo->estimatedRows = HTTP_BACKEND_INFO_ROWS;
+    return SQLITE_OK;
+}
+
+static sqlite3_module httpBackendInfoModule = {
+    /* iVersion    */ 0,
+    /* xCreate     */ 0,
+    /* xConnect    */ httpBackendInfoConnect,
+    /* xBestIndex  */ httpBackendInfoBestIndex,
+    /* xDisconnect */ httpBackendInfoDisconnect,
+    /* xDestroy    */ 0,
+    /* xOpen       */ httpBackendInfoOpen,
+    /* xClose      */ httpBackendInfoClose,
+    /* xFilter     */ httpBackendInfoFilter,
+    /* xNext       */ httpBackendInfoNext,
+    /* xEof        */ httpBackendInfoEof,
+    /* xColumn     */ httpBackendInfoColumn,
+    /* xRowid      */ httpBackendInfoRowid,
+    /* xUpdate     */ 0,
+    /* xBegin      */ 0,
+    /* xSync       */ 0,
+    /* xCommit     */ 0,
+    /* xRollback   */ 0,
+    /* xFindMethod */ 0,
+    /* xRename     */ 0,
+    /* xSavepoint  */ 0,
+    /* xRelease    */ 0,
+    /* xRollbackTo */ 0,
+    /* xShadowName */ 0,
+};
+
+#define HTTP_STATS_COL_HOST 0
+#define HTTP_STATS_COL_REQUESTS 1
+#define HTTP_STATS_COL_FAILED 2
+#define HTTP_STATS_COL_STATUS_4XX 3
+#define HTTP_STATS_COL_STATUS_5XX 4
+#define HTTP_STATS_COL_BYTES_SENT 5
+#define HTTP_STATS_COL_BYTES_RECEIVED 6
+#define HTTP_STATS_COL_CONNECTIONS_NEW 7
+#define HTTP_STATS_COL_CONNECTIONS_REUSED 8
+#define HTTP_STATS_COL_LATENCY_TOTAL 9
+#define HTTP_STATS_COL_LATENCY_P50 10
+#define HTTP_STATS_COL_LATENCY_P95 11
+#define HTTP_STATS_COL_LATENCY_P99 12
+
+typedef struct http_stats_cursor http_stats_cursor;
+struct http_stats_cursor {
+    sqlite3_vtab_cursor base;
+    sqlite3_int64 iRowid;
+    http_stats_host* aHost;
+    int nHost;
+};
+
+static int httpStatsConnect(sqlite3* db,
+                            void* pAux,
+                            int argc,
+                            const char* const* argv,
+                            sqlite3_vtab** ppVtab,
+                            char** pzErr) {
+    sqlite3_vtab* pNew;
+    int rc;
+    rc = sqlite3_declare_vtab(db,
+                              "CREATE TABLE x(host TEXT, requests INT, failed INT, "
+                              "status_4xx INT, status_5xx INT, bytes_sent INT, "
+                              "bytes_received INT, connections_new INT, "
+                              "connections_reused INT, latency_total_us INT, "
+                              "latency_p50_us INT, latency_p95_us INT, latency_p99_us INT)");
+    if (rc == SQLITE_OK) {
+        pNew = sqlite3_malloc(sizeof(*pNew));
+        *ppVtab = pNew;
+        if (pNew == 0)
+            return SQLITE_NOMEM;
+        memset(pNew, 0, sizeof(*pNew));
+    }
+    return rc;
+}
+
+static int httpStatsDisconnect(sqlite3_vtab* pVtab) {
+    sqlite3_free(pVtab);
+    return SQLITE_OK;
+}
+
+static int httpStatsOpen(sqlite3_vtab* p, sqlite3_vtab_cursor** ppCursor) {
+    http_stats_cursor* pCur;
+    pCur = sqlite3_malloc(sizeof(*pCur));
+    if (pCur == 0)
+        return SQLITE_NOMEM;
+    memset(pCur, 0, sizeof(*pCur));
+    *ppCursor = &pCur->base;
+    return SQLITE_OK;
+}
+
+static int httpStatsClose(sqlite3_vtab_cursor* cur) {
+    http_stats_cursor* pCur = (http_stats_cursor*)cur;
+    http_stats_free(pCur->aHost, pCur->nHost);
+    sqlite3_free(pCur);
+    return SQLITE_OK;
+}
+
+static int httpStatsNext(sqlite3_vtab_cursor* cur) {
+    http_stats_cursor* pCur = (http_stats_cursor*)cur;
+    pCur->iRowid++;
+    return SQLITE_OK;
+}
+
+static int httpStatsColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
+    http_stats_cursor* pCur = (http_stats_cursor*)cur;
+    const http_stats_host* pHost = &pCur->aHost[pCur->iRowid - 1];
+    sqlite3_int64 usPercentile;
+
+    switch (i) {
+    case HTTP_STATS_COL_HOST:
+        sqlite3_result_text(ctx, pHost->zHost, -1, SQLITE_TRANSIENT);
+        break;
+    case HTTP_STATS_COL_REQUESTS:
+        sqlite3_result_int64(ctx, pHost->nRequests);
+        break;
+    case HTTP_STATS_COL_FAILED:
+        sqlite3_result_int64(ctx, pHost->nFailed);
+        break;
+    case HTTP_STATS_COL_STATUS_4XX:
+        sqlite3_result_int64(ctx, pHost->n4xx);
+        break;
+    case HTTP_STATS_COL_STATUS_5XX:
+        sqlite3_result_int64(ctx, pHost->n5xx);
+        break;
+    case HTTP_STATS_COL_BYTES_SENT:
+        sqlite3_result_int64(ctx, pHost->szSent);
+        break;
+    case HTTP_STATS_COL_BYTES_RECEIVED:
+        sqlite3_result_int64(ctx, pHost->szReceived);
+        break;
+    case HTTP_STATS_COL_CONNECTIONS_NEW:
+        sqlite3_result_int64(ctx, pHost->nNewConnections);
+        break;
+    case HTTP_STATS_COL_CONNECTIONS_REUSED:
+        sqlite3_result_int64(ctx, pHost->nReusedConnections);
+        break;
+    case HTTP_STATS_COL_LATENCY_TOTAL:
+        sqlite3_result_int64(ctx, pHost->usLatency);
+        break;
+    case HTTP_STATS_COL_LATENCY_P50:
+    case HTTP_STATS_COL_LATENCY_P95:
+    case HTTP_STATS_COL_LATENCY_P99:
+        usPercentile = http_stats_percentile(pHost,
+                                             i == HTTP_STATS_COL_LATENCY_P50   ? 0.50
+                                             : i == HTTP_STATS_COL_LATENCY_P95 ? 0.95
+                                                                               : 0.99);
+        // Requests slower than the histogram are reported as +Inf, not as the
+        // limit of the last bounded bucket.
+        if (usPercentile == HTTP_STATS_UNBOUNDED) {
+            sqlite3_result_double(ctx, HUGE_VAL);
+        } else if (usPercentile >= 0) {
+            sqlite3_result_int64(ctx, usPercentile);
+        }
+        break;
+    }
+    return SQLITE_OK;
+}
+
+static int httpStatsRowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
+    http_stats_cursor* pCur = (http_stats_cursor*)cur;
+    *pRowid = pCur->iRowid;
+    return SQLITE_OK;
+}
+
+static int httpStatsEof(sqlite3_vtab_cursor* cur) {
+    http_stats_cursor* pCur = (http_stats_cursor*)cur;
+    return pCur->iRowid > pCur->nHost;
+}
+
+// The statistics are copied when the scan starts, so that the shards are not
+// locked while the query runs.
+static int httpStatsFilter(sqlite3_vtab_cursor* pVtabCursor,
+                           int idxNum,
+                           const char* idxStr,
+                           int argc,
+                           sqlite3_value** argv) {
+    http_stats_cursor* pCur = (http_stats_cursor*)pVtabCursor;
+    http_stats_free(pCur->aHost, pCur->nHost);
+    pCur->aHost = NULL;
+    pCur->nHost = 0;
+    pCur->iRowid = 1;
+    return http_stats_snapshot(&pCur->aHost, &pCur->nHost);
+}
+
+static int httpStatsBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
+    pIdxInfo->estimatedCost = (double)10;
+    pIdxInfo->estimatedRows = 10;
+    return SQLITE_OK;
+}
+
+static sqlite3_module httpStatsModule = {
+    /* iVersion    */ 0,
+    /* xCreate     */ 0,
+    /* xConnect    */ httpStatsConnect,
+    /* xBestIndex  */ httpStatsBestIndex,
+    /* xDisconnect */ httpStatsDisconnect,
+    /* xDestroy    */ 0,
+    /* xOpen       */ httpStatsOpen,
+    /* xClose      */ httpStatsClose,
+    /* xFilter     */ httpStatsFilter,
+    /* xNext       */ httpStatsNext,
+    /* xEof        */ httpStatsEof,
+    /* xColumn     */ httpStatsColumn,
+    /* xRowid      */ httpStatsRowid,
+    /* xUpdate     */ 0,
+    /* xBegin      */ 0,
+    /* xSync       */ 0,
+    /* xCommit     */ 0,
+    /* xRollback   */ 0,
+    /* xFindMethod */ 0,
+    /* xRename     */ 0,
+    /* xSavepoint  */ 0,
+    /* xRelease    */ 0,
+    /* xRollbackTo */ 0,
+    /* xShadowName */ 0,
+};
+
+#define HTTP_TRACE_COL_ID 0
+#define HTTP_TRACE_COL_STARTED_AT 1
+#define HTTP_TRACE_COL_REQUEST_METHOD 2
+#define HTTP_TRACE_COL_REQUEST_URL 3
+#define HTTP_TRACE_COL_REQUEST_SQL 4
+#define HTTP_TRACE_COL_RESPONSE_STATUS_CODE 5
+#define HTTP_TRACE_COL_RESPONSE_ERROR 6
+#define HTTP_TRACE_COL_TRANSFER_DNS_US 7
+#define HTTP_TRACE_COL_TRANSFER_CONNECT_US 8
+#define HTTP_TRACE_COL_TRANSFER_TLS_US 9
+#define HTTP_TRACE_COL_TRANSFER_FIRST_BYTE_US 10
+#define HTTP_TRACE_COL_TRANSFER_TOTAL_US 11
+#define HTTP_TRACE_COL_TRANSFER_BYTES_SENT 12
+#define HTTP_TRACE_COL_TRANSFER_BYTES_RECEIVED 13
+#define HTTP_TRACE_COL_SLOW 14
+
+typedef struct http_trace_cursor http_trace_cursor;
+struct http_trace_cursor {
+    sqlite3_vtab_cursor base;
+    sqlite3_int64 iRowid;
+    http_trace_entry* aEntry;
+    int nEntry;
+};
+
+static int httpTraceConnect(sqlite3* db,
+                            void* pAux,
+                            int argc,
+                            const char* const* argv,
+                            sqlite3_vtab** ppVtab,
+                            char** pzErr) {
+    sqlite3_vtab* pNew;
+    int rc;
+    rc = sqlite3_declare_vtab(db,
+                              "CREATE TABLE x(id INT, started_at REAL, request_method TEXT, "
+                              "request_url TEXT, request_sql TEXT, response_status_code INT, "
+                              "response_error TEXT, transfer_dns_us INT, transfer_connect_us INT, "
+                              "transfer_tls_us INT, transfer_first_byte_us INT, "
+                              "transfer_total_us INT, transfer_bytes_sent INT, "
+                              "transfer_bytes_received INT, slow INT)");
+    if (rc == SQLITE_OK) {
+        pNew = sqlite3_malloc(sizeof(*pNew));
+        *ppVtab = pNew;
+        if (pNew == 0)
+            return SQLITE_NOMEM;
+        memset(pNew, 0, sizeof(*pNew));
+    }
+    return rc;
+}
+
+static int httpTraceDisconnect(sqlite3_vtab* pVtab) {
+    sqlite3_free(pVtab);
+    return SQLITE_OK;
+}
+
+static int httpTraceOpen(sqlite3_vtab* p, sqlite3_vtab_cursor** ppCursor) {
+    http_trace_cursor* pCur;
+    pCur = sqlite3_malloc(sizeof(*pCur));
+    if (pCur == 0)
+        return SQLITE_NOMEM;
+    memset(pCur, 0, sizeof(*pCur));
+    *ppCursor = &pCur->base;
+    return SQLITE_OK;
+}
+
+static int httpTraceClose(sqlite3_vtab_cursor* cur) {
+    http_trace_cursor* pCur = (http_trace_cursor*)cur;
+    sqlite3_free(pCur->aEntry);
+    sqlite3_free(pCur);
+    return SQLITE_OK;
+}
+
+static int httpTraceNext(sqlite3_vtab_cursor* cur) {
+    http_trace_cursor* pCur = (http_trace_cursor*)cur;
+    pCur->iRowid++;
+    return SQLITE_OK;
+}
+
+static void httpResultTraceTiming(sqlite3_context* ctx, int usTiming) {
+    if (usTiming >= 0) {
+        sqlite3_result_int(ctx, usTiming);
+    }
+}
+
+static void httpResultTraceText(sqlite3_context* ctx, const http_trace_entry* pEntry, int iText) {
+    const char* zText = http_trace_text(pEntry, iText);
+    if (zText) {
+        sqlite3_result_text(ctx, zText, -1, SQLITE_TRANSIENT);
+    }
+}
+
+static int httpTraceColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
+    http_trace_cursor* pCur = (http_trace_cursor*)cur;
+    const http_trace_entry* pEntry = &pCur->aEntry[pCur->iRowid - 1];
+
+    switch (i) {
+    case HTTP_TRACE_COL_ID:
+        sqlite3_result_int64(ctx, pEntry->iSeq / 2);
+        break;
+    case HTTP_TRACE_COL_STARTED_AT:
+        sqlite3_result_double(ctx, pEntry->iStarted / 1e6);
+        break;
+    case HTTP_TRACE_COL_REQUEST_METHOD:
+        httpResultTraceText(ctx, pEntry, HTTP_TRACE_METHOD);
+        break;
+    case HTTP_TRACE_COL_REQUEST_URL:
+        httpResultTraceText(ctx, pEntry, HTTP_TRACE_URL);
+        break;
+    case HTTP_TRACE_COL_REQUEST_SQL:
+        httpResultTraceText(ctx, pEntry, HTTP_TRACE_SQL);
+        break;
+    case HTTP_TRACE_COL_RESPONSE_STATUS_CODE:
+        if (pEntry->iStatusCode) {
+            sqlite3_result_int(ctx, pEntry->iStatusCode);
+        }
+        break;
+    case HTTP_TRACE_COL_RESPONSE_ERROR:
+        httpResultTraceText(ctx, pEntry, HTTP_TRACE_ERROR);
+        break;
+    case HTTP_TRACE_COL_TRANSFER_DNS_US:
+        httpResultTraceTiming(ctx, pEntry->usDns);
+        break;
+    case HTTP_TRACE_COL_TRANSFER_CONNECT_US:
+        httpResultTraceTiming(ctx, pEntry->usConnect);
+        break;
+    case HTTP_TRACE_COL_TRANSFER_TLS_US:
+        httpResultTraceTiming(ctx, pEntry->usTls);
+        break;
+    case HTTP_TRACE_COL_TRANSFER_FIRST_BYTE_US:
+        httpResultTraceTiming(ctx, pEntry->usFirstByte);
+        break;
+    case HTTP_TRACE_COL_TRANSFER_TOTAL_US:
+        sqlite3_result_int64(ctx, pEntry->usTotal);
+        break;
+    case HTTP_TRACE_COL_TRANSFER_BYTES_SENT:
+        sqlite3_result_int64(ctx, pEntry->szSent);
+        break;
+    case HTTP_TRACE_COL_TRANSFER_BYTES_RECEIVED:
+        sqlite3_result_int64(ctx, pEntry->szReceived);
+        break;
+    case HTTP_TRACE_COL_SLOW:
+        sqlite3_result_int(ctx, pEntry->bSlow);
+        break;
+    }
+    return SQLITE_OK;
+}
+
+static int httpTraceRowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
+    http_trace_cursor* pCur = (http_trace_cursor*)cur;
+    *pRowid = pCur->iRowid;
+    return SQLITE_OK;
+}
+
+static int httpTraceEof(sqlite3_vtab_cursor* cur) {
+    http_trace_cursor* pCur = (http_trace_cursor*)cur;
+    return pCur->iRowid > pCur->nEntry;
+}
+
+static int httpTraceFilter(sqlite3_vtab_cursor* pVtabCursor,
+                           int idxNum,
+                           const char* idxStr,
+                           int argc,
+                           sqlite3_value** argv) {
+    http_trace_cursor* pCur = (http_trace_cursor*)pVtabCursor;
+    sqlite3_free(pCur->aEntry);
+    pCur->aEntry = NULL;
+    pCur->nEntry = 0;
+    pCur->iRowid = 1;
+    return http_trace_snapshot(&pCur->aEntry, &pCur->nEntry);
+}
+
+static int httpTraceBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
+    pIdxInfo->estimatedCost = (double)1000;
+    pIdxInfo->estimatedRows = 1000;
+    return SQLITE_OK;
+}
+
+static sqlite3_module httpTraceModule = {
+    /* iVersion    */ 0,
+    /* xCreate     */ 0,
+    /* xConnect    */ httpTraceConnect,
+    /* xBestIndex  */ httpTraceBestIndex,
+    /* xDisconnect */ httpTraceDisconnect,
+    /* xDestroy    */ 0,
+    /* xOpen       */ httpTraceOpen,
+    /* xClose      */ httpTraceClose,
+    /* xFilter     */ httpTraceFilter,
+    /* xNext       */ httpTraceNext,
+    /* xEof        */ httpTraceEof,
+    /* xColumn     */ httpTraceColumn,
+    /* xRowid      */ httpTraceRowid,
+    /* xUpdate     */ 0,
+    /* xBegin      */ 0,
+    /* xSync       */ 0,
+    /* xCommit     */ 0,
+    /* xRollback   */ 0,
+    /* xFindMethod */ 0,
+    /* xRename     */ 0,
+    /* xSavepoint  */ 0,
+    /* xRelease    */ 0,
+    /* xRollbackTo */ 0,
+    /* xShadowName */ 0,
+};
+
+// http_trace_enable(enable [, slow_ms]) turns the trace of all connections on
+// or off. Requests taking at least slow_ms milliseconds are kept apart, so
+// they are not pushed out by many fast requests. Zero keeps none apart.
+static void httpTraceEnableFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    int bEnable;
+    sqlite3_int64 usSlow = -1;
+    if (argc < 1 || argc > 2) {
+        sqlite3_result_error(ctx, "http_trace_enable: expected 1 or 2 arguments", -1);
+        return;
+    }
+    bEnable = sqlite3_value_int(argv[0]);
+    if (argc == 2) {
+        double msSlow = sqlite3_value_double(argv[1]);
+        usSlow = msSlow > 0 ? (sqlite3_int64)(msSlow * 1000) : 0;
+    }
+    http_trace_configure(bEnable, usSlow);
+    sqlite3_result_int(ctx, bEnable != 0);
+}
+
+// Append a counter of every host in the Prometheus text format.
+static void httpMetricsCounter(sqlite3_str* pStr,
+                               const http_stats_host* aHost,
+                               int nHost,
+                               const char* zName,
+                               const char* zHelp,
+                               const char* zLabel,
+                               size_t iOffset) {
+    int i;
+    sqlite3_str_appendf(pStr, "# HELP %s %s\n# TYPE %s counter\n", zName, zHelp, zName);
+    for (i = 0; i < nHost; ++i) {
+        sqlite3_str_appendf(pStr,
+                            "%s{host=\"%s\"%s} %lld\n",
+                            zName,
+                            aHost[i].zHost,
+                            zLabel,
+                            *(const sqlite3_int64*)((const char*)&aHost[i] + iOffset));
+    }
+}
+
+// Escape a label value as Prometheus requires: backslash, double quote and
+// newline are written as \\, \" and \n.
+static int httpMetricsEscape(char** pzValue) {
+    const char* zValue = *pzValue;
+    sqlite3_str* pStr;
+    char* zEscaped;
+
+    if (zValue[strcspn(zValue, "\\\"\n")] == '\0') {
+        return SQLITE_OK;
+    }
+    pStr = sqlite3_str_new(NULL);
+    for (; *zValue; ++zValue) {
+        switch (*zValue) {
+        case '\\':
+            sqlite3_str_append(pStr, "\\\\", 2);
+            break;
+        case '"':
+            sqlite3_str_append(pStr, "\\\"", 2);
+            break;
+        case '\n':
+            sqlite3_str_append(pStr, "\\n", 2);
+            break;
+        default:
+            sqlite3_str_appendchar(pStr, 1, *zValue);
+        }
+    }
+    zEscaped = sqlite3_str_finish(pStr);
+    if (!zEscaped) {
+        return SQLITE_NOMEM;
+    }
+    sqlite3_free(*pzValue);
+    *pzValue = zEscaped;
+    return SQLITE_OK;
+}
+
+// http_metrics() returns the statistics of http_stats in the Prometheus text
+// exposition format.
+static void httpMetricsFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    http_stats_host* aHost = NULL;
+    int nHost = 0;
+    sqlite3_str* pStr;
+    sqlite3_int64 nCount;
+    int rc;
+    int i;
+    int j;
+
+    if (argc != 0) {
+        sqlite3_result_error(ctx, "http_metrics: expected no arguments", -1);
+        return;
+    }
+
+    rc = http_stats_snapshot(&aHost, &nHost);
+    if (rc != SQLITE_OK) {
+        sqlite3_result_error_code(ctx, rc);
+        return;
+    }
+
+    // The snapshot is ours, so the host names are escaped in place.
+    for (i = 0; i < nHost; ++i) {
+        if (httpMetricsEscape(&aHost[i].zHost) != SQLITE_OK) {
+            http_stats_free(aHost, nHost);
+            sqlite3_result_error_nomem(ctx);
+            return;
+        }
+    }
+
+    pStr = sqlite3_str_new(sqlite3_context_db_handle(ctx));
+    httpMetricsCounter(pStr,
+                       aHost,
+                       nHost,
+                       "http_requests_total",
+                       "Requests made.",
+                       "",
+                       offsetof(http_stats_host, nRequests));
+    sqlite3_str_appendf(pStr,
+                        "# HELP http_request_errors_total Failed requests and error "
+                        "responses.\n# TYPE http_request_errors_total counter\n");
+    for (i = 0; i < nHost; ++i) {
+        sqlite3_str_appendf(pStr,
+                            "http_request_errors_total{host=\"%s\",class=\"failed\"} %lld\n"
+                            "http_request_errors_total{host=\"%s\",class=\"4xx\"} %lld\n"
+                            "http_request_errors_total{host=\"%s\",class=\"5xx\"} %lld\n",
+                            aHost[i].zHost,
+                            aHost[i].nFailed,
+                            aHost[i].zHost,
+                            aHost[i].n4xx,
+                            aHost[i].zHost,
+                            aHost[i].n5xx);
+    }
+    httpMetricsCounter(pStr,
+                       aHost,
+                       nHost,
+                       "http_sent_bytes_total",
+                       "Bytes of request bodies sent.",
+                       "",
+                       offsetof(http_stats_host, szSent));
+    httpMetricsCounter(pStr,
+                       aHost,
+                       nHost,
+                       "http_received_bytes_total",
+                       "Bytes of response bodies received.",
+                       "",
+                       offsetof(http_stats_host, szReceived));
+    sqlite3_str_appendf(pStr,
+                        "# HELP http_connections_total Connections opened and reused.\n"
+                        "# TYPE http_connections_total counter\n");
+    for (i = 0; i < nHost; ++i) {
+        sqlite3_str_appendf(pStr,
+                            "http_connections_total{host=\"%s\",reused=\"false\"} %lld\n"
+                            "http_connections_total{host=\"%s\",reused=\"true\"} %lld\n",
+                            aHost[i].zHost,
+                            aHost[i].nNewConnections,
+                            aHost[i].zHost,
+                            aHost[i].nReusedConnections);
+    }
+    sqlite3_str_appendf(pStr,
+                        "# HELP http_request_duration_seconds Request latency.\n"
+                        "# TYPE http_request_duration_seconds histogram\n");
+    for (i = 0; i < nHost; ++i) {
+        nCount = 0;
+        for (j = 0; j < HTTP_STATS_BUCKETS - 1; ++j) {
+            nCount += aHost[i].aLatency[j];
+            sqlite3_str_appendf(pStr,
+                                "http_request_duration_seconds_bucket{host=\"%s\",le=\"%.6f\"} %lld\n",
+                                aHost[i].zHost,
+                                http_stats_bucket_limit(j) / 1e6,
+                                nCount);
+        }
+        sqlite3_str_appendf(pStr,
+                            "http_request_duration_seconds_bucket{host=\"%s\",le=\"+Inf\"} %lld\n"
+                            "http_request_duration_seconds_sum{host=\"%s\"} %.6f\n"
+                            "http_request_duration_seconds_count{host=\"%s\"} %lld\n",
+                            aHost[i].zHost,
+                            aHost[i].nRequests,
+                            aHost[i].zHost,
+                            aHost[i].usLatency / 1e6,
+                            aHost[i].zHost,
+                            aHost[i].nRequests);
+    }
+
+    http_stats_free(aHost, nHost);
+
+    rc = sqlite3_str_errcode(pStr);
+    if (rc != SQLITE_OK) {
+        sqlite3_free(sqlite3_str_finish(pStr));
+        sqlite3_result_error_code(ctx, rc);
+        return;
+    }
+    i = sqlite3_str_length(pStr);
+    sqlite3_result_text(ctx, sqlite3_str_finish(pStr), i, sqlite3_free);
+}
+
+// Functions returning JSON must declare that they set a subtype on newer
+// versions of SQLite.
+#ifdef SQLITE_RESULT_SUBTYPE
+#define HTTP_RESULT_SUBTYPE SQLITE_RESULT_SUBTYPE
+#else
+#define HTTP_RESULT_SUBTYPE 0
+#endif
+
+static const struct Func {
+    const char* name;
+    void (*xFunc)(sqlite3_context*, int, sqlite3_value**);
+    int flags;
+} funcs[] = {
+    {"http_get_body", httpGetBodyFunc},
+    {"http_post_body", httpPostBodyFunc},
+    {"http_do_body", httpDoBodyFunc},
+    {"http_get_headers", httpGetHeadersFunc},
+    {"http_post_headers", httpPostHeadersFunc},
+    {"http_do_headers", httpDoHeadersFunc},
+    {"http_get_response", httpGetResponseFunc},
+    {"http_post_response", httpPostResponseFunc},
+    {"http_do_response", httpDoResponseFunc},
+    {"http_response_status", httpResponseStatusFunc},
+    {"http_response_status_code", httpResponseStatusCodeFunc},
+    {"http_response_headers", httpResponseHeadersFunc},
+    {"http_response_body", httpResponseBodyFunc},
+    {"http_response_header", httpResponseHeaderFunc},
+    {"http_headers", httpHeadersFunc},
+    {"http_headers_has", httpHeadersHasFunc},
+    {"http_headers_get", httpHeadersGetFunc},
+    {"http_headers_parse", httpHeadersParseFunc},
+    {"http_headers_extract", httpHeadersExtractFunc, HTTP_RESULT_SUBTYPE},
+    {"http_share", httpShareFunc},
+    {"http_max_body_size", httpMaxBodySizeFunc},
+    {"http_enqueue", httpEnqueueFunc},
+    {"http_wait", httpWaitFunc},
+    {"http_metrics", httpMetricsFunc},
+    {"http_trace_enable", httpTraceEnableFunc},
+    {NULL, NULL},
+};
+
+static const struct Module {
+    const char* name;
+    const sqlite3_module* module;
+} modules[] = {
+    {"http_get", &httpModule},
+    {"http_post", &httpModule},
+    {"http_do", &httpModule},
+    {"http_get_many", &httpManyModule},
+    {"http_headers_each", &httpHeadersEachModule},
+    {"http_backend_info", &httpBackendInfoModule},
+    {"http_results", &httpResultsModule},
+    {"http_stats", &httpStatsModule},
+    {"http_trace", &httpTraceModule},
+    {NULL, NULL},
+};
+
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+    int sqlite3_http_init(sqlite3* db, char** pzErrMsg, const sqlite3_api_routines* pApi) {
+    int rc = SQLITE_OK;
+    SQLITE_EXTENSION_INIT2(pApi);
+    int i;
+    http_ext* pExt;
+    char* zErrMsg = NULL;
+    pExt = sqlite3_malloc(sizeof(*pExt));
+    if (!pExt) {
+        return SQLITE_NOMEM;
+    }
+    memset(pExt, 0, sizeof(*pExt));
+    pExt->nRef = 1;
+    pExt->db = db;
+    http_async_ref();
+    // Load the backend eagerly so that the first request doesn't pay for it.
+    // Failures are reported again when a request is made.
+    http_backend_init(&zErrMsg);
+    sqlite3_free(zErrMsg);
+    rc = http_stats_init();
+    if (rc == SQLITE_OK) {
+        rc = http_pool_open(&pExt->pPool);
+    }
+    // The destructor is invoked also when registration fails, so take the
+    // reference before each call.
+    for (i = 0; funcs[i].name && rc == SQLITE_OK; ++i) {
+        pExt->nRef++;
+        rc = sqlite3_create_function_v2(db,
+                                        funcs[i].name,
+                                        -1,
+                                        SQLITE_UTF8 | funcs[i].flags,
+                                        pExt,
+                                        funcs[i].xFunc,
+                                        NULL,
+                                        NULL,
+                                        httpExtUnref);
+    }
+    for (i = 0; modules[i].name && rc == SQLITE_OK; ++i) {
+        pExt->nRef++;
+        rc = sqlite3_create_module_v2(db, modules[i].name, modules[i].module, pExt, httpExtUnref);
+    }
+    httpExtUnref(pExt);
+    return rc;
+}
+
+/********** src/http_async.c **********/
+
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+SQLITE_EXTENSION_INIT3
+
+// Number of background threads running queued requests.
+#define HTTP_ASYNC_WORKERS 4
+
+// Number of finished requests kept for http_results. Past this the oldest
+// results are dropped, so that requests nobody collects don't pile up.
+#define HTTP_ASYNC_MAX_FINISHED 1000
+
+#ifdef _WIN32
+typedef SRWLOCK http_async_mutex;
+typedef CONDITION_VARIABLE http_async_cond;
+typedef HANDLE http_async_thread;
+#define HTTP_ASYNC_MUTEX_INIT SRWLOCK_INIT
+#define HTTP_ASYNC_COND_INIT CONDITION_VARIABLE_INIT
+#else
+typedef pthread_mutex_t http_async_mutex;
+typedef pthread_cond_t http_async_cond;
+typedef pthread_t http_async_thread;
+#define HTTP_ASYNC_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define HTTP_ASYNC_COND_INIT PTHREAD_COND_INITIALIZER
+#endif
+
+// bStop is also read by the backends, without the mutex, to cancel running
+// requests.
+#ifdef _MSC_VER
+#define load_acquire(p) InterlockedCompareExchange((volatile LONG*)(p), 0, 0)
+#define store_release(p, v) InterlockedExchange((volatile LONG*)(p), (v))
+#else
+#define load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#endif
+
+typedef struct http_async_node http_async_node;
+struct http_async_node {
+    http_async_entry entry;
+    http_async_node* pNextQueued;
+};
+
+// All asynchronous requests of the process. Entries are kept in id order until
+// they are removed. Queued entries are additionally linked in FIFO order.
+// nFinished counts the entries that are done or failed.
+static struct {
+    http_async_mutex mutex;
+    http_async_cond workCond;
+    http_async_cond doneCond;
+    http_async_node** aNode;
+    int nNode;
+    int nAlloc;
+    int nFinished;
+    http_async_node* pQueueHead;
+    http_async_node* pQueueTail;
+    sqlite3_int64 iNextId;
+    int nRef;
+    int bStop;
+    int nWorker;
+    http_async_thread aWorker[HTTP_ASYNC_WORKERS];
+} async = {
+    HTTP_ASYNC_MUTEX_INIT,
+    HTTP_ASYNC_COND_INIT,
+    HTTP_ASYNC_COND_INIT,
+};
+
+#ifdef _WIN32
+static void async_lock() {
+    AcquireSRWLockExclusive(&async.mutex);
+}
+
+static void async_unlock() {
+    ReleaseSRWLockExclusive(&async.mutex);
+}
+
+static void async_wait(http_async_cond* cond) {
+    SleepConditionVariableSRW(cond, &async.mutex, INFINITE, 0);
+}
+
+// Returns zero if the wait timed out.
+static int async_timedwait(http_async_cond* cond, int msTimeout) {
+    return SleepConditionVariableSRW(cond, &async.mutex, msTimeout, 0);
+}
+
+static sqlite3_int64 async_now_ms() {
+    return (sqlite3_int64)GetTickCount64();
+}
+
+static void async_broadcast(http_async_cond* cond) {
+    WakeAllConditionVariable(cond);
+}
+
+static void async_signal(http_async_cond* cond) {
+    WakeConditionVariable(cond);
+}
+#else
+static void async_lock() {
+    pthread_mutex_lock(&async.mutex);
+}
+
+static void async_unlock() {
+    pthread_mutex_unlock(&async.mutex);
+}
+
+static void async_wait(http_async_cond* cond) {
+    pthread_cond_wait(cond, &async.mutex);
+}
+
+// Returns zero if the wait timed out.
+static int async_timedwait(http_async_cond* cond, int msTimeout) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += msTimeout / 1000;
+    ts.tv_nsec += (long)(msTimeout % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return pthread_cond_timedwait(cond, &async.mutex, &ts) == 0;
+}
+
+static sqlite3_int64 async_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (sqlite3_int64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void async_broadcast(http_async_cond* cond) {
+    pthread_cond_broadcast(cond);
+}
+
+static void async_signal(http_async_cond* cond) {
+    pthread_cond_signal(cond);
+}
+#endif
+
+void http_async_entry_clear(http_async_entry* pEntry) {
+    sqlite3_free(pEntry->zErrMsg);
+    sqlite3_free(pEntry->req.zMethod);
+    sqlite3_free(pEntry->req.zUrl);
+    sqlite3_free((void*)pEntry->req.zHeaders);
+    sqlite3_free((void*)pEntry->req.pBody);
+    sqlite3_free((void*)pEntry->req.zSql);
+    http_body_unref(pEntry->resp.pBody);
+    sqlite3_free(pEntry->resp.zHeaders);
+    sqlite3_free(pEntry->resp.zStatus);
+    sqlite3_free(pEntry->resp.zEffectiveUrl);
+    memset(pEntry, 0, sizeof(*pEntry));
+}
+
+int http_request_cancelled(const http_request* req) {
+    return req->pbCancel && load_acquire(req->pbCancel);
+}
+
+// Return the index of the first node with id >= iId.
+static int async_find(sqlite3_int64 iId) {
+    int lo = 0;
+    int hi = async.nNode;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (async.aNode[mid]->entry.iId < iId) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static http_async_node* async_lookup(sqlite3_int64 iId) {
+    int i = async_find(iId);
+    if (i < async.nNode && async.aNode[i]->entry.iId == iId) {
+        return async.aNode[i];
+    }
+    return NULL;
+}
+
+// Delete the node at index i, which must not be queued or running.
+static void async_delete(int i) {
+    http_async_node* pNode = async.aNode[i];
+    if (pNode->entry.eState == HTTP_ASYNC_DONE || pNode->entry.eState == HTTP_ASYNC_ERROR) {
+        async.nFinished--;
+    }
+    memmove(&async.aNode[i], &async.aNode[i + 1], sizeof(async.aNode[0]) * (async.nNode - i - 1));
+    async.nNode--;
+    http_async_entry_clear(&pNode->entry);
+    sqlite3_free(pNode);
+}
+
+// Drop the oldest finished requests past the limit. Ids only grow, so those
+// are the first finished ones in aNode.
+static void async_trim() {
+    int i = 0;
+    while (async.nFinished > HTTP_ASYNC_MAX_FINISHED) {
+        while (async.aNode[i]->entry.eState != HTTP_ASYNC_DONE &&
+               async.aNode[i]->entry.eState != HTTP_ASYNC_ERROR) {
+            i++;
+        }
+        async_delete(i);
+    }
+}
+
+static void async_run(http_pool* pPool, http_async_node* pNode) {
+    http_async_entry* pEntry = &pNode->entry;
+    char* zErrMsg = NULL;
+    int rc = http_do_request(pPool, &pEntry->req, &pEntry->resp, &zErrMsg);
+    async_lock();
+    pEntry->rc = rc;
+    pEntry->zErrMsg = zErrMsg;
+    if (rc != SQLITE_OK && !zErrMsg) {
+        pEntry->zErrMsg = sqlite3_mprintf("%s", sqlite3_errstr(rc));
+    }
+    pEntry->eState = rc == SQLITE_OK ? HTTP_ASYNC_DONE : HTTP_ASYNC_ERROR;
+    async.nFinished++;
+    async_trim();
+    async_broadcast(&async.doneCond);
+    async_unlock();
+}
+
+static void async_worker() {
+    http_pool* pPool = NULL;
+    http_async_node* pNode;
+
+    http_pool_open(&pPool);
+
+    async_lock();
+    for (;;) {
+        while (!async.bStop && !async.pQueueHead) {
+            async_wait(&async.workCond);
+        }
+        if (async.bStop) {
+            break;
+        }
+        pNode = async.pQueueHead;
+        async.pQueueHead = pNode->pNextQueued;
+        if (!async.pQueueHead) {
+            async.pQueueTail = NULL;
+        }
+        pNode->pNextQueued = NULL;
+        pNode->entry.eState = HTTP_ASYNC_RUNNING;
+        async_unlock();
+        // The node stays in aNode and can't be removed while it is running.
+        async_run(pPool, pNode);
+        async_lock();
+    }
+    async_unlock();
+
+    http_pool_close(pPool);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI async_thread_main(LPVOID arg) {
+    async_worker();
+    return 0;
+}
+
+static int async_thread_start(http_async_thread* pThread) {
+    *pThread = CreateThread(NULL, 0, async_thread_main, NULL, 0, NULL);
+    return *pThread != NULL;
+}
+
+static void async_thread_join(http_async_thread thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+#else
+static void* async_thread_main(void* arg) {
+    async_worker();
+    return NULL;
+}
+
+static int async_thread_start(http_async_thread* pThread) {
+    return pthread_create(pThread, NULL, async_thread_main, NULL) == 0;
+}
+
+static void async_thread_join(http_async_thread thread) {
+    pthread_join(thread, NULL);
+}
+#endif
+
+void http_async_ref() {
+    async_lock();
+    async.nRef++;
+    async_unlock();
+}
+
+// Wait until the workers stopped by http_async_unref() are gone and the
+// requests dropped. Must be called with the mutex held.
+static void async_wait_stopped() {
+    while (async.bStop) {
+        async_wait(&async.doneCond);
+    }
+}
+
+// When the last database connection using the extension goes away the workers
+// are stopped, so that the library can be unloaded safely. Requests that are
+// still queued are dropped and running requests are cancelled, so that a
+// stalled server doesn't keep the connection from closing. Requests queued by
+// a new connection in the meantime wait for the stop to complete.
+void http_async_unref() {
+    int nWorker;
+    int i;
+
+    async_lock();
+    async_wait_stopped();
+    if (--async.nRef > 0) {
+        async_unlock();
+        return;
+    }
+    store_release(&async.bStop, 1);
+    nWorker = async.nWorker;
+    async_broadcast(&async.workCond);
+    async_unlock();
+
+    for (i = 0; i < nWorker; ++i) {
+        async_thread_join(async.aWorker[i]);
+    }
+
+    async_lock();
+    for (i = 0; i < async.nNode; ++i) {
+        http_async_entry_clear(&async.aNode[i]->entry);
+        sqlite3_free(async.aNode[i]);
+    }
+    sqlite3_free(async.aNode);
+    async.aNode = NULL;
+    async.nNode = 0;
+    async.nAlloc = 0;
+    async.nFinished = 0;
+    async.pQueueHead = NULL;
+    async.pQueueTail = NULL;
+    async.nWorker = 0;
+    store_release(&async.bStop, 0);
+    async_broadcast(&async.doneCond);
+    async_unlock();
+}
+
+static char* dup_text(const char* zText) {
+    return zText ? sqlite3_mprintf("%s", zText) : NULL;
+}
+
+int http_async_enqueue(const http_request* req, sqlite3_int64* piId) {
+    http_async_node* pNode;
+    http_request* pReq;
+    int rc = SQLITE_OK;
+
+    pNode = sqlite3_malloc(sizeof(*pNode));
+    if (!pNode) {
+        return SQLITE_NOMEM;
+    }
+    memset(pNode, 0, sizeof(*pNode));
+
+    pReq = &pNode->entry.req;
+    pReq->zMethod = dup_text(req->zMethod);
+    pReq->zUrl = dup_text(req->zUrl);
+    pReq->zHeaders = dup_text(req->zHeaders);
+    pReq->flags = req->flags;
+    pReq->szMaxBody = req->szMaxBody;
+    pReq->zSql = dup_text(req->zSql);
+    pReq->pbCancel = &async.bStop;
+    if (req->pBody) {
+        pReq->szBody = req->szBody;
+        pReq->pBody = sqlite3_malloc64(req->szBody + 1);
+        if (pReq->pBody) {
+            memcpy((void*)pReq->pBody, req->pBody, req->szBody);
+        }
+    }
+    if (!pReq->zMethod || !pReq->zUrl || (req->zHeaders && !pReq->zHeaders) ||
+        (req->zSql && !pReq->zSql) || (req->pBody && !pReq->pBody)) {
+        http_async_entry_clear(&pNode->entry);
+        sqlite3_free(pNode);
+        return SQLITE_NOMEM;
+    }
+
+    async_lock();
+    async_wait_stopped();
+
+    if (async.nNode == async.nAlloc) {
+        int nAlloc = async.nAlloc ? async.nAlloc * 2 : 64;
+        http_async_node** aNode = sqlite3_realloc(async.aNode, sizeof(*aNode) * nAlloc);
+        if (!aNode) {
+            rc = SQLITE_NOMEM;
+            goto done;
+        }
+        async.aNode = aNode;
+        async.nAlloc = nAlloc;
+    }
+
+    // Workers are started lazily when the first request is queued.
+    while (async.nWorker < HTTP_ASYNC_WORKERS) {
+        if (!async_thread_start(&async.aWorker[async.nWorker])) {
+            break;
+        }
+        async.nWorker++;
+    }
+    if (async.nWorker == 0) {
+        rc = SQLITE_ERROR;
+        goto done;
+    }
+
+    pNode->entry.iId = ++async.iNextId;
+    pNode->entry.eState = HTTP_ASYNC_QUEUED;
+    async.aNode[async.nNode++] = pNode;
+    if (async.pQueueTail) {
+        async.pQueueTail->pNextQueued = pNode;
+    } else {
+        async.pQueueHead = pNode;
+    }
+    async.pQueueTail = pNode;
+    *piId = pNode->entry.iId;
+    pNode = NULL;
+    async_signal(&async.workCond);
+
+done:
+
+    async_unlock();
+
+    if (pNode) {
+        http_async_entry_clear(&pNode->entry);
+        sqlite3_free(pNode);
+    }
+
+    return rc;
+}
+
+int http_async_wait(sqlite3_int64 iId, int msTimeout, int* peState) {
+    http_async_node* pNode;
+    // Every completion wakes all waiters, so the timeout is counted from here.
+    sqlite3_int64 msDeadline = msTimeout > 0 ? async_now_ms() + msTimeout : 0;
+    int rc = SQLITE_OK;
+
+    async_lock();
+    for (;;) {
+        pNode = async_lookup(iId);
+        if (!pNode) {
+            rc = SQLITE_NOTFOUND;
+            break;
+        }
+        if (pNode->entry.eState == HTTP_ASYNC_DONE || pNode->entry.eState == HTTP_ASYNC_ERROR ||
+            msTimeout == 0) {
+            break;
+        }
+        if (msTimeout < 0) {
+            async_wait(&async.doneCond);
+        } else {
+            sqlite3_int64 msLeft = msDeadline - async_now_ms();
+            if (msLeft <= 0 || !async_timedwait(&async.doneCond, (int)msLeft)) {
+                // Timed out. Report whatever the state is now.
+                msTimeout = 0;
+            }
+        }
+    }
+    if (pNode) {
+        *peState = pNode->entry.eState;
+    }
+    async_unlock();
+
+    return rc;
+}
+
+int http_async_get(sqlite3_int64 iId, int bNext, http_async_entry* pCopy) {
+    http_async_entry* pEntry;
+    int rc = SQLITE_ROW;
+    int i;
+
+    memset(pCopy, 0, sizeof(*pCopy));
+
+    async_lock();
 
-static const struct Module {
-    const char* name;
-    const sqlite3_module* module;
-} modules[] = {
-    {"http_get", &httpModule},
-    {"http_post", &httpModule},
-    {"http_do", &httpModule},
-    {"http_headers_each", &httpHeadersEachModule},
-    {NULL, NULL},
-};
+    i = async_find(bNext ? iId + 1 : iId);
+    if (i == async.nNode || (!bNext && async.aNode[i]->entry.iId != iId)) {
+        rc = SQLITE_DONE;
+        goto done;
+    }
 
-#ifdef _WIN32
-__declspec(dllexport)
-#endif
-    int sqlite3_http_init(sqlite3* db, char** pzErrMsg, const sqlite3_api_routines* pApi) {
+    pEntry = &async.aNode[i]->entry;
+    pCopy->iId = pEntry->iId;
+    pCopy->eState = pEntry->eState;
+    pCopy->rc = pEntry->rc;
+    pCopy->req.zMethod = dup_text(pEntry->req.zMethod);
+    pCopy->req.zUrl = dup_text(pEntry->req.zUrl);
+    pCopy->req.zHeaders = dup_text(pEntry->req.zHeaders);
+    if (pEntry->req.pBody) {
+        pCopy->req.pBody = sqlite3_malloc64(pEntry->req.szBody + 1);
+        if (!pCopy->req.pBody) {
+            rc = SQLITE_NOMEM;
+            goto done;
+        }
+        memcpy((void*)pCopy->req.pBody, pEntry->req.pBody, pEntry->req.szBody);
+        pCopy->req.szBody = pEntry->req.szBody;
+    }
+    // The response is only touched by the worker while the request runs.
+    if (pEntry->eState == HTTP_ASYNC_DONE || pEntry->eState == HTTP_ASYNC_ERROR) {
+        pCopy->zErrMsg = dup_text(pEntry->zErrMsg);
+        pCopy->resp.zStatus = dup_text(pEntry->resp.zStatus);
+        pCopy->resp.zHeaders = dup_text(pEntry->resp.zHeaders);
+        pCopy->resp.szHeaders = pEntry->resp.szHeaders;
+        pCopy->resp.iStatusCode = pEntry->resp.iStatusCode;
+        memcpy(pCopy->resp.aMetaOffset, pEntry->resp.aMetaOffset, sizeof(pCopy->resp.aMetaOffset));
+        memcpy(pCopy->resp.aMetaSize, pEntry->resp.aMetaSize, sizeof(pCopy->resp.aMetaSize));
+        if (pEntry->resp.pBody) {
+            pCopy->resp.pBody = http_body_realloc(NULL, pEntry->resp.szBody);
+            if (!pCopy->resp.pBody) {
+                rc = SQLITE_NOMEM;
+                goto done;
+            }
+            memcpy(pCopy->resp.pBody, pEntry->resp.pBody, pEntry->resp.szBody);
+            pCopy->resp.szBody = pEntry->resp.szBody;
+            pCopy->resp.szBodyAlloc = pEntry->resp.szBody;
+        }
+    }
+
+done:
+
+    async_unlock();
+
+    if (rc == SQLITE_NOMEM) {
+        http_async_entry_clear(pCopy);
+    }
+
+    return rc;
+}
+
+int http_async_remove(sqlite3_int64 iId) {
+    http_async_node* pNode;
+    http_async_node** ppPrev;
+    http_async_node* pPrev = NULL;
     int rc = SQLITE_OK;
-    SQLITE_EXTENSION_INIT2(pApi);
     int i;
-    for (i = 0; funcs[i].name && rc == SQLITE_OK; ++i) {
-        rc = sqlite3_create_function(
-            db, funcs[i].name, -1, SQLITE_UTF8, NULL, funcs[i].xFunc, NULL, NULL);
+
+    async_lock();
+
+    i = async_find(iId);
+    if (i == async.nNode || async.aNode[i]->entry.iId != iId) {
+        goto done;
     }
-    for (i = 0; modules[i].name && rc == SQLITE_OK; ++i) {
-        rc = sqlite3_create_module(db, modules[i].name, modules[i].module, 0);
+    pNode = async.aNode[i];
+
+    if (pNode->entry.eState == HTTP_ASYNC_RUNNING) {
+        rc = SQLITE_BUSY;
+        goto done;
+    }
+
+    if (pNode->entry.eState == HTTP_ASYNC_QUEUED) {
+        for (ppPrev = &async.pQueueHead; *ppPrev != pNode; ppPrev = &(*ppPrev)->pNextQueued) {
+            pPrev = *ppPrev;
+        }
+        *ppPrev = pNode->pNextQueued;
+        if (async.pQueueTail == pNode) {
+            async.pQueueTail = pPrev;
+        }
     }
+
+    async_delete(i);
+
+done:
+
+    async_unlock();
+
     return rc;
 }
 
@@ -868,6 +5230,7 @@ __declspec(dllexport)
 
 #include <assert.h>
 #include <string.h>
+#include <time.h>
 
 SQLITE_EXTENSION_INIT3
 
@@ -906,7 +5269,12 @@ void* http_dlsym(void* library, const char* zName) {
 #endif
 
 typedef struct CURL CURL;
+typedef struct CURLSH CURLSH;
+typedef struct CURLM CURLM;
 typedef int CURLcode;
+typedef int CURLMcode;
+typedef int CURLSHcode;
+typedef int CURLSHoption;
 typedef int CURLoption;
 typedef int CURLINFO;
 typedef int CURLversion;
@@ -934,18 +5302,82 @@ typedef int CURLversion;
 #define CURLOPT_NOBODY (44)
 #define CURLOPT_CUSTOMREQUEST (10000 + 36)
 #define CURLOPT_PUT (54)
+#define CURLOPT_SHARE (10000 + 100)
+#define CURLOPT_MAXCONNECTS (71)
+#define CURLOPT_NOPROGRESS (43)
+#define CURLOPT_XFERINFOFUNCTION (20000 + 219)
+#define CURLOPT_XFERINFODATA (10000 + 57)
+
+#define CURLOPT_PRIVATE (10000 + 103)
+
+#define CURLM_OK 0
+
+#define CURLMSG_DONE 1
+
+#define CURLSHE_OK 0
+
+#define CURLSHOPT_SHARE 1
+#define CURLSHOPT_LOCKFUNC 3
+#define CURLSHOPT_UNLOCKFUNC 4
+
+#define CURL_LOCK_DATA_DNS 3
+#define CURL_LOCK_DATA_SSL_SESSION 4
+#define CURL_LOCK_DATA_CONNECT 5
+#define CURL_LOCK_DATA_LAST 8
 
 #define CURLSSLOPT_NATIVE_CA (1 << 4)
 
 #define CURLVERSION_NOW 9
 
+#define CURLINFO_EFFECTIVE_URL (0x100000 + 1)
 #define CURLINFO_RESPONSE_CODE (0x200000 + 2)
+#define CURLINFO_SIZE_UPLOAD_T (0x600000 + 7)
+#define CURLINFO_SIZE_DOWNLOAD_T (0x600000 + 8)
+#define CURLINFO_REDIRECT_COUNT (0x200000 + 20)
+#define CURLINFO_PRIVATE (0x100000 + 21)
+#define CURLINFO_NUM_CONNECTS (0x200000 + 26)
+#define CURLINFO_HTTP_VERSION (0x200000 + 46)
+#define CURLINFO_TOTAL_TIME_T (0x600000 + 50)
+#define CURLINFO_NAMELOOKUP_TIME_T (0x600000 + 51)
+#define CURLINFO_CONNECT_TIME_T (0x600000 + 52)
+#define CURLINFO_STARTTRANSFER_TIME_T (0x600000 + 54)
+#define CURLINFO_APPCONNECT_TIME_T (0x600000 + 56)
+
+#define CURL_HTTP_VERSION_1_0 1
+#define CURL_HTTP_VERSION_1_1 2
+#define CURL_HTTP_VERSION_2_0 3
+#define CURL_HTTP_VERSION_3 30
+
+typedef sqlite3_int64 curl_off_t;
+
+struct CURLMsg {
+    int msg;
+    CURL* easy_handle;
+    union {
+        void* whatever;
+        CURLcode result;
+    } data;
+};
+typedef struct CURLMsg CURLMsg;
+
+#define CURL_VERSION_SSL (1 << 2)
+#define CURL_VERSION_LIBZ (1 << 3)
+#define CURL_VERSION_HTTP2 (1 << 16)
+#define CURL_VERSION_BROTLI (1 << 23)
+#define CURL_VERSION_HTTP3 (1 << 25)
+#define CURL_VERSION_ZSTD (1 << 26)
 
 // The struct is bigger but I don't need more information for now...
 struct curl_version_info_data {
     CURLversion age;
     const char* version;
     unsigned int version_num;
+    const char* host;
+    int features;
+    const char* ssl_version;
+    long ssl_version_num;
+    const char* libz_version;
+    const char* const* protocols;
 };
 typedef struct curl_version_info_data curl_version_info_data;
 
@@ -953,6 +5385,7 @@ struct curl_slist;
 
 typedef CURL* (*curl_easy_init_t)();
 typedef void (*curl_easy_cleanup_t)(CURL*);
+typedef void (*curl_easy_reset_t)(CURL*);
 typedef CURLcode (*curl_easy_setopt_t)(CURL*, CURLoption, ...);
 typedef CURLcode (*curl_easy_perform_t)(CURL*);
 typedef CURLcode (*curl_easy_getinfo_t)(CURL*, CURLINFO, ...);
@@ -961,11 +5394,25 @@ typedef curl_version_info_data* (*curl_version_info_t)(CURLversion);
 typedef struct curl_slist* (*curl_slist_append_t)(struct curl_slist*, const char*);
 typedef void (*curl_slist_free_all_t)(struct curl_slist*);
 typedef const char* (*curl_easy_strerror_t)(CURLcode);
+typedef CURLM* (*curl_multi_init_t)();
+typedef CURLMcode (*curl_multi_cleanup_t)(CURLM*);
+typedef CURLMcode (*curl_multi_add_handle_t)(CURLM*, CURL*);
+typedef CURLMcode (*curl_multi_remove_handle_t)(CURLM*, CURL*);
+typedef CURLMcode (*curl_multi_perform_t)(CURLM*, int*);
+typedef CURLMcode (*curl_multi_wait_t)(CURLM*, void*, unsigned int, int, int*);
+typedef CURLMsg* (*curl_multi_info_read_t)(CURLM*, int*);
+typedef const char* (*curl_multi_strerror_t)(CURLMcode);
+typedef CURLSH* (*curl_share_init_t)();
+typedef CURLSHcode (*curl_share_setopt_t)(CURLSH*, CURLSHoption, ...);
+typedef CURLSHcode (*curl_share_cleanup_t)(CURLSH*);
+typedef void (*curl_lock_function)(CURL*, int, int, void*);
+typedef void (*curl_unlock_function)(CURL*, int, void*);
 
 struct curl_api_routines {
     void* pLibrary;
     curl_easy_init_t easy_init;
     curl_easy_cleanup_t easy_cleanup;
+    curl_easy_reset_t easy_reset;
     curl_easy_setopt_t easy_setopt;
     curl_easy_perform_t easy_perform;
     curl_easy_getinfo_t easy_getinfo;
@@ -974,12 +5421,24 @@ struct curl_api_routines {
     curl_slist_append_t slist_append;
     curl_slist_free_all_t slist_free_all;
     curl_easy_strerror_t easy_strerror;
+    curl_multi_init_t multi_init;
+    curl_multi_cleanup_t multi_cleanup;
+    curl_multi_add_handle_t multi_add_handle;
+    curl_multi_remove_handle_t multi_remove_handle;
+    curl_multi_perform_t multi_perform;
+    curl_multi_wait_t multi_wait;
+    curl_multi_info_read_t multi_info_read;
+    curl_multi_strerror_t multi_strerror;
+    curl_share_init_t share_init;
+    curl_share_setopt_t share_setopt;
+    curl_share_cleanup_t share_cleanup;
 };
 
 static struct curl_api_routines curl_api;
 
 #define curl_easy_init curl_api.easy_init
 #define curl_easy_cleanup curl_api.easy_cleanup
+#define curl_easy_reset curl_api.easy_reset
 #define curl_easy_setopt curl_api.easy_setopt
 #define curl_easy_perform curl_api.easy_perform
 #define curl_easy_getinfo curl_api.easy_getinfo
@@ -988,6 +5447,17 @@ static struct curl_api_routines curl_api;
 #define curl_slist_append curl_api.slist_append
 #define curl_slist_free_all curl_api.slist_free_all
 #define curl_easy_strerror curl_api.easy_strerror
+#define curl_multi_init curl_api.multi_init
+#define curl_multi_cleanup curl_api.multi_cleanup
+#define curl_multi_add_handle curl_api.multi_add_handle
+#define curl_multi_remove_handle curl_api.multi_remove_handle
+#define curl_multi_perform curl_api.multi_perform
+#define curl_multi_wait curl_api.multi_wait
+#define curl_multi_info_read curl_api.multi_info_read
+#define curl_multi_strerror curl_api.multi_strerror
+#define curl_share_init curl_api.share_init
+#define curl_share_setopt curl_api.share_setopt
+#define curl_share_cleanup curl_api.share_cleanup
 
 static const char* aCurlLibNames[] = {
 #ifdef _WIN32
@@ -999,113 +5469,484 @@ static const char* aCurlLibNames[] = {
 #endif
 };
 
-static const int szCurlLibNames = sizeof(aCurlLibNames) / sizeof(aCurlLibNames[0]);
+static const int szCurlLibNames = sizeof(aCurlLibNames) / sizeof(aCurlLibNames[0]);
+
+static int http_backend_curl_load(char** zErrMsg) {
+    assert(zErrMsg != NULL);
+
+    *zErrMsg = NULL;
+
+    if (!curl_api.pLibrary) {
+        for (int i = 0; i < szCurlLibNames && !curl_api.pLibrary; ++i) {
+            curl_api.pLibrary = http_dlopen(aCurlLibNames[i]);
+        }
+    }
+
+    if (!curl_api.pLibrary) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl");
+        goto error;
+    }
+
+    curl_easy_init = (curl_easy_init_t)http_dlsym(curl_api.pLibrary, "curl_easy_init");
+    if (!curl_easy_init) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_easy_init");
+        goto error;
+    }
+    curl_easy_cleanup = (curl_easy_cleanup_t)http_dlsym(curl_api.pLibrary, "curl_easy_cleanup");
+    if (!curl_easy_cleanup) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_easy_cleanup");
+        goto error;
+    }
+    curl_easy_reset = (curl_easy_reset_t)http_dlsym(curl_api.pLibrary, "curl_easy_reset");
+    if (!curl_easy_reset) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_easy_reset");
+        goto error;
+    }
+    curl_easy_setopt = (curl_easy_setopt_t)http_dlsym(curl_api.pLibrary, "curl_easy_setopt");
+    if (!curl_easy_setopt) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_easy_setopt");
+        goto error;
+    }
+    curl_easy_perform = (curl_easy_perform_t)http_dlsym(curl_api.pLibrary, "curl_easy_perform");
+    if (!curl_easy_perform) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_easy_perform");
+        goto error;
+    }
+    curl_easy_getinfo = (curl_easy_getinfo_t)http_dlsym(curl_api.pLibrary, "curl_easy_getinfo");
+    if (!curl_easy_getinfo) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_easy_getinfo");
+        goto error;
+    }
+    curl_version = (curl_version_t)http_dlsym(curl_api.pLibrary, "curl_version");
+    if (!curl_version) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_version");
+        goto error;
+    }
+    curl_version_info = (curl_version_info_t)http_dlsym(curl_api.pLibrary, "curl_version_info");
+    if (!curl_version_info) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_version_info");
+        goto error;
+    }
+    curl_slist_append = (curl_slist_append_t)http_dlsym(curl_api.pLibrary, "curl_slist_append");
+    if (!curl_slist_append) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_slist_append");
+        goto error;
+    }
+    curl_slist_free_all =
+        (curl_slist_free_all_t)http_dlsym(curl_api.pLibrary, "curl_slist_free_all");
+    if (!curl_slist_free_all) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_slist_free_all");
+        goto error;
+    }
+    curl_easy_strerror = (curl_easy_strerror_t)http_dlsym(curl_api.pLibrary, "curl_easy_strerror");
+    if (!curl_easy_strerror) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_easy_strerror");
+        goto error;
+    }
+    curl_multi_init = (curl_multi_init_t)http_dlsym(curl_api.pLibrary, "curl_multi_init");
+    if (!curl_multi_init) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_multi_init");
+        goto error;
+    }
+    curl_multi_cleanup = (curl_multi_cleanup_t)http_dlsym(curl_api.pLibrary, "curl_multi_cleanup");
+    if (!curl_multi_cleanup) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_multi_cleanup");
+        goto error;
+    }
+    curl_multi_add_handle =
+        (curl_multi_add_handle_t)http_dlsym(curl_api.pLibrary, "curl_multi_add_handle");
+    if (!curl_multi_add_handle) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_multi_add_handle");
+        goto error;
+    }
+    curl_multi_remove_handle =
+        (curl_multi_remove_handle_t)http_dlsym(curl_api.pLibrary, "curl_multi_remove_handle");
+    if (!curl_multi_remove_handle) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_multi_remove_handle");
+        goto error;
+    }
+    curl_multi_perform = (curl_multi_perform_t)http_dlsym(curl_api.pLibrary, "curl_multi_perform");
+    if (!curl_multi_perform) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_multi_perform");
+        goto error;
+    }
+    curl_multi_wait = (curl_multi_wait_t)http_dlsym(curl_api.pLibrary, "curl_multi_wait");
+    if (!curl_multi_wait) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_multi_wait");
+        goto error;
+    }
+    curl_multi_info_read =
+        (curl_multi_info_read_t)http_dlsym(curl_api.pLibrary, "curl_multi_info_read");
+    if (!curl_multi_info_read) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_multi_info_read");
+        goto error;
+    }
+    curl_multi_strerror =
+        (curl_multi_strerror_t)http_dlsym(curl_api.pLibrary, "curl_multi_strerror");
+    if (!curl_multi_strerror) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_multi_strerror");
+        goto error;
+    }
+    curl_share_init = (curl_share_init_t)http_dlsym(curl_api.pLibrary, "curl_share_init");
+    if (!curl_share_init) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_share_init");
+        goto error;
+    }
+    curl_share_setopt = (curl_share_setopt_t)http_dlsym(curl_api.pLibrary, "curl_share_setopt");
+    if (!curl_share_setopt) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_share_setopt");
+        goto error;
+    }
+    curl_share_cleanup = (curl_share_cleanup_t)http_dlsym(curl_api.pLibrary, "curl_share_cleanup");
+    if (!curl_share_cleanup) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_share_cleanup");
+        goto error;
+    }
+
+    return SQLITE_OK;
+
+error:
+
+    if (curl_api.pLibrary) {
+        http_dlclose(curl_api.pLibrary);
+        memset(&curl_api, 0, sizeof(curl_api));
+    }
+
+    return SQLITE_ERROR;
+}
+
+// Flags read on every request without taking the global mutex. They are only
+// set under the mutex, after everything they guard has been written.
+#ifdef _MSC_VER
+#define load_acquire(p) InterlockedCompareExchange((volatile LONG*)(p), 0, 0)
+#define store_release(p, v) InterlockedExchange((volatile LONG*)(p), (v))
+#else
+#define load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#endif
+
+// Capabilities of the loaded library, probed once by http_backend_init().
+static struct {
+    int bInitialized;
+    int bNativeCa;
+    int bHttp2;
+    int bHttp3;
+    const char* zVersion;
+    const char* zSslVersion;
+    char zCompression[32];
+} curl_caps;
+
+static void probe_capabilities() {
+    curl_version_info_data* pInfo = curl_version_info(CURLVERSION_NOW);
+    char* z = curl_caps.zCompression;
+
+    curl_caps.zVersion = pInfo->version;
+    curl_caps.zSslVersion = (pInfo->features & CURL_VERSION_SSL) ? pInfo->ssl_version : NULL;
+    curl_caps.bHttp2 = (pInfo->features & CURL_VERSION_HTTP2) != 0;
+    curl_caps.bHttp3 = (pInfo->features & CURL_VERSION_HTTP3) != 0;
+    // Since 7.71.0 (Jun 24 2020). Makes life easier on Windows at least.
+    curl_caps.bNativeCa = pInfo->version_num >= ((7 << 16) | (71 << 8));
+
+    // The buffer is large enough for all of the encodings.
+    z[0] = '\0';
+    if (pInfo->features & CURL_VERSION_LIBZ) {
+        strcat(z, "deflate,gzip");
+    }
+    if (pInfo->features & CURL_VERSION_BROTLI) {
+        strcat(z, z[0] ? ",br" : "br");
+    }
+    if (pInfo->features & CURL_VERSION_ZSTD) {
+        strcat(z, z[0] ? ",zstd" : "zstd");
+    }
+}
+
+int http_backend_init(char** ppErrMsg) {
+    sqlite3_mutex* mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+    int rc = SQLITE_OK;
+
+    *ppErrMsg = NULL;
+
+    if (load_acquire(&curl_caps.bInitialized)) {
+        return SQLITE_OK;
+    }
+
+    sqlite3_mutex_enter(mutex);
+    if (!curl_caps.bInitialized) {
+        rc = http_backend_curl_load(ppErrMsg);
+        if (rc == SQLITE_OK) {
+            probe_capabilities();
+            store_release(&curl_caps.bInitialized, 1);
+        }
+    }
+    sqlite3_mutex_leave(mutex);
+
+    return rc;
+}
+
+int http_backend_get_info(http_backend_info* pInfo, char** ppErrMsg) {
+    int rc = http_backend_init(ppErrMsg);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    memset(pInfo, 0, sizeof(*pInfo));
+    pInfo->zName = "curl";
+    pInfo->zVersion = curl_caps.zVersion;
+    pInfo->zSslVersion = curl_caps.zSslVersion;
+    pInfo->zCompression = curl_caps.zCompression[0] ? curl_caps.zCompression : NULL;
+    pInfo->bHttp2 = curl_caps.bHttp2;
+    pInfo->bHttp3 = curl_caps.bHttp3;
+    pInfo->bShare = 1;
+    return SQLITE_OK;
+}
+
+// Maximum number of idle handles kept in a pool.
+#define HTTP_POOL_MAX_IDLE 16
+
+// Maximum number of idle handles kept for a single origin.
+#define HTTP_POOL_MAX_IDLE_PER_HOST 4
+
+// Idle handles older than this (in seconds) are evicted from the pool.
+#define HTTP_POOL_IDLE_TIMEOUT 60
+
+typedef struct http_pool_entry http_pool_entry;
+struct http_pool_entry {
+    CURL* curl;
+    char* zOrigin;
+    time_t tLastUsed;
+};
+
+// Every curl easy handle keeps a cache of live connections, resolved names and
+// TLS sessions. Handles are kept around after a request and handed out again
+// for requests to the same origin so that the connection can be reused.
+struct http_pool {
+    http_pool_entry aIdle[HTTP_POOL_MAX_IDLE];
+    int nIdle;
+};
+
+int http_pool_open(http_pool** ppPool) {
+    http_pool* pPool = sqlite3_malloc(sizeof(*pPool));
+    if (!pPool) {
+        return SQLITE_NOMEM;
+    }
+    memset(pPool, 0, sizeof(*pPool));
+    *ppPool = pPool;
+    return SQLITE_OK;
+}
+
+static void http_pool_remove(http_pool* pPool, int i) {
+    assert(i >= 0 && i < pPool->nIdle);
+    memmove(&pPool->aIdle[i],
+            &pPool->aIdle[i + 1],
+            sizeof(pPool->aIdle[0]) * (pPool->nIdle - i - 1));
+    pPool->nIdle--;
+}
+
+static void http_pool_evict(http_pool* pPool, int i) {
+    curl_easy_cleanup(pPool->aIdle[i].curl);
+    sqlite3_free(pPool->aIdle[i].zOrigin);
+    http_pool_remove(pPool, i);
+}
+
+void http_pool_close(http_pool* pPool) {
+    if (!pPool) {
+        return;
+    }
+    while (pPool->nIdle > 0) {
+        http_pool_evict(pPool, pPool->nIdle - 1);
+    }
+    sqlite3_free(pPool);
+}
+
+// Return the length of the scheme://authority part of zUrl.
+static int url_origin_length(const char* zUrl) {
+    const char* p = strstr(zUrl, "://");
+    if (!p) {
+        return strlen(zUrl);
+    }
+    p += 3;
+    while (*p && *p != '/' && *p != '?' && *p != '#') {
+        ++p;
+    }
+    return p - zUrl;
+}
+
+static void http_pool_expire(http_pool* pPool, time_t now) {
+    int i = 0;
+    while (i < pPool->nIdle) {
+        if (now - pPool->aIdle[i].tLastUsed >= HTTP_POOL_IDLE_TIMEOUT) {
+            http_pool_evict(pPool, i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+// Take a handle from the pool, preferring the most recently used handle that
+// has talked to the same origin. Returns NULL if the pool has nothing to offer.
+static CURL* http_pool_acquire(http_pool* pPool, const char* zUrl, char** pzOrigin) {
+    int nOrigin = url_origin_length(zUrl);
+    CURL* curl;
+    int i;
+
+    *pzOrigin = NULL;
+
+    if (!pPool) {
+        return NULL;
+    }
+
+    http_pool_expire(pPool, time(NULL));
+
+    for (i = pPool->nIdle - 1; i >= 0; --i) {
+        const char* zOrigin = pPool->aIdle[i].zOrigin;
+        if (sqlite3_strnicmp(zOrigin, zUrl, nOrigin) == 0 && zOrigin[nOrigin] == '\0') {
+            curl = pPool->aIdle[i].curl;
+            *pzOrigin = pPool->aIdle[i].zOrigin;
+            http_pool_remove(pPool, i);
+            return curl;
+        }
+    }
+
+    *pzOrigin = sqlite3_mprintf("%.*s", nOrigin, zUrl);
+
+    return NULL;
+}
+
+// Return a handle to the pool. Options are reset but the connection cache of
+// the handle stays intact. Takes ownership of zOrigin.
+static void http_pool_release(http_pool* pPool, CURL* curl, char* zOrigin) {
+    int nSameOrigin = 0;
+    int iOldestSameOrigin = -1;
+    int i;
+
+    if (!pPool || !zOrigin) {
+        curl_easy_cleanup(curl);
+        sqlite3_free(zOrigin);
+        return;
+    }
+
+    curl_easy_reset(curl);
+
+    for (i = 0; i < pPool->nIdle; ++i) {
+        if (sqlite3_stricmp(pPool->aIdle[i].zOrigin, zOrigin) == 0) {
+            if (iOldestSameOrigin < 0) {
+                iOldestSameOrigin = i;
+            }
+            ++nSameOrigin;
+        }
+    }
+
+    if (nSameOrigin >= HTTP_POOL_MAX_IDLE_PER_HOST) {
+        http_pool_evict(pPool, iOldestSameOrigin);
+    } else if (pPool->nIdle == HTTP_POOL_MAX_IDLE) {
+        http_pool_evict(pPool, 0);
+    }
 
-int http_backend_curl_load(char** zErrMsg) {
-    assert(zErrMsg != NULL);
+    pPool->aIdle[pPool->nIdle].curl = curl;
+    pPool->aIdle[pPool->nIdle].zOrigin = zOrigin;
+    pPool->aIdle[pPool->nIdle].tLastUsed = time(NULL);
+    pPool->nIdle++;
+}
 
-    *zErrMsg = NULL;
+// Process-wide share object. When enabled, every easy handle in every pool is
+// attached to it so that the DNS cache, TLS sessions and live connections are
+// shared between database connections and threads. Once created the share is
+// never freed because handles in other connections may still refer to it.
+// The share is created before bEnabled is first set, so handles can be
+// attached without taking the global mutex.
+static struct {
+    CURLSH* share;
+    sqlite3_mutex* aLock[CURL_LOCK_DATA_LAST];
+    int bEnabled;
+    long nMaxConnects;
+} http_share_state;
+
+static void share_lock(CURL* curl, int data, int access, void* userptr) {
+    sqlite3_mutex_enter(http_share_state.aLock[data]);
+}
 
-    if (!curl_api.pLibrary) {
-        for (int i = 0; i < szCurlLibNames && !curl_api.pLibrary; ++i) {
-            curl_api.pLibrary = http_dlopen(aCurlLibNames[i]);
+static void share_unlock(CURL* curl, int data, void* userptr) {
+    sqlite3_mutex_leave(http_share_state.aLock[data]);
+}
+
+static int http_share_create(char** ppErrMsg) {
+    CURLSH* share;
+    int i;
+
+    for (i = 0; i < CURL_LOCK_DATA_LAST; ++i) {
+        if (!http_share_state.aLock[i]) {
+            http_share_state.aLock[i] = sqlite3_mutex_alloc(SQLITE_MUTEX_FAST);
+            if (!http_share_state.aLock[i]) {
+                return SQLITE_NOMEM;
+            }
         }
     }
 
-    if (!curl_api.pLibrary) {
-        *zErrMsg = sqlite3_mprintf("failed to load curl");
-        goto error;
+    share = curl_share_init();
+    if (!share) {
+        *ppErrMsg = sqlite3_mprintf("curl_share_init failed");
+        return SQLITE_ERROR;
     }
 
-    curl_easy_init = (curl_easy_init_t)http_dlsym(curl_api.pLibrary, "curl_easy_init");
-    if (!curl_easy_init) {
-        *zErrMsg = sqlite3_mprintf("failed to load curl_easy_init");
-        goto error;
-    }
-    curl_easy_cleanup = (curl_easy_cleanup_t)http_dlsym(curl_api.pLibrary, "curl_easy_cleanup");
-    if (!curl_easy_cleanup) {
-        *zErrMsg = sqlite3_mprintf("failed to load curl_easy_cleanup");
-        goto error;
-    }
-    curl_easy_setopt = (curl_easy_setopt_t)http_dlsym(curl_api.pLibrary, "curl_easy_setopt");
-    if (!curl_easy_setopt) {
-        *zErrMsg = sqlite3_mprintf("failed to load curl_easy_setopt");
-        goto error;
-    }
-    curl_easy_perform = (curl_easy_perform_t)http_dlsym(curl_api.pLibrary, "curl_easy_perform");
-    if (!curl_easy_perform) {
-        *zErrMsg = sqlite3_mprintf("failed to load curl_easy_perform");
-        goto error;
-    }
-    curl_easy_getinfo = (curl_easy_getinfo_t)http_dlsym(curl_api.pLibrary, "curl_easy_getinfo");
-    if (!curl_easy_getinfo) {
-        *zErrMsg = sqlite3_mprintf("failed to load curl_easy_getinfo");
-        goto error;
-    }
-    curl_version = (curl_version_t)http_dlsym(curl_api.pLibrary, "curl_version");
-    if (!curl_version) {
-        *zErrMsg = sqlite3_mprintf("failed to load curl_version");
-        goto error;
-    }
-    curl_version_info = (curl_version_info_t)http_dlsym(curl_api.pLibrary, "curl_version_info");
-    if (!curl_version_info) {
-        *zErrMsg = sqlite3_mprintf("failed to load curl_version_info");
-        goto error;
-    }
-    curl_slist_append = (curl_slist_append_t)http_dlsym(curl_api.pLibrary, "curl_slist_append");
-    if (!curl_slist_append) {
-        *zErrMsg = sqlite3_mprintf("failed to load curl_slist_append");
-        goto error;
-    }
-    curl_slist_free_all =
-        (curl_slist_free_all_t)http_dlsym(curl_api.pLibrary, "curl_slist_free_all");
-    if (!curl_slist_free_all) {
-        *zErrMsg = sqlite3_mprintf("failed to load curl_slist_free_all");
-        goto error;
-    }
-    curl_easy_strerror = (curl_easy_strerror_t)http_dlsym(curl_api.pLibrary, "curl_easy_strerror");
-    if (!curl_easy_strerror) {
-        *zErrMsg = sqlite3_mprintf("failed to load curl_easy_strerror");
-        goto error;
+    if (curl_share_setopt(share, CURLSHOPT_LOCKFUNC, (curl_lock_function)share_lock) !=
+            CURLSHE_OK ||
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, (curl_unlock_function)share_unlock) !=
+            CURLSHE_OK ||
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS) != CURLSHE_OK ||
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION) != CURLSHE_OK) {
+        curl_share_cleanup(share);
+        *ppErrMsg = sqlite3_mprintf("curl_share_setopt failed");
+        return SQLITE_ERROR;
     }
 
+    // Connection sharing is available since 7.57.0. Older versions still get
+    // the DNS and TLS session caches.
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+    http_share_state.share = share;
+
     return SQLITE_OK;
+}
 
-error:
+int http_share_configure(int bEnable, int nMaxConnections, char** ppErrMsg) {
+    sqlite3_mutex* mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+    int rc;
 
-    if (curl_api.pLibrary) {
-        http_dlclose(curl_api.pLibrary);
-        memset(&curl_api, 0, sizeof(curl_api));
+    rc = http_backend_init(ppErrMsg);
+    if (rc != SQLITE_OK) {
+        return rc;
     }
 
-    return SQLITE_ERROR;
+    sqlite3_mutex_enter(mutex);
+    if (bEnable && !http_share_state.share) {
+        rc = http_share_create(ppErrMsg);
+    }
+    if (rc == SQLITE_OK) {
+        store_release(&http_share_state.nMaxConnects, nMaxConnections > 0 ? nMaxConnections : 0);
+        store_release(&http_share_state.bEnabled, bEnable);
+    }
+    sqlite3_mutex_leave(mutex);
+
+    return rc;
 }
 
-static size_t write_callback(char* ptr, size_t size, size_t nmemb, void* userdata) {
-    http_response* pResp = (http_response*)userdata;
-    char* p;
-    p = sqlite3_realloc(pResp->pBody, pResp->szBody + size * nmemb);
-    if (!p) {
-        return 0;
+// Attach curl to the share if sharing is enabled, or detach it otherwise.
+// Pooled handles stay attached across curl_easy_reset().
+static CURLcode http_share_attach(CURL* curl) {
+    CURLSH* share = NULL;
+    long nMaxConnects = 0;
+    CURLcode curlrc;
+
+    if (load_acquire(&http_share_state.bEnabled)) {
+        share = http_share_state.share;
+        nMaxConnects = load_acquire(&http_share_state.nMaxConnects);
     }
-    pResp->pBody = p;
-    memcpy((char*)pResp->pBody + pResp->szBody, ptr, size * nmemb);
-    pResp->szBody += size * nmemb;
-    return size * nmemb;
-}
 
-static size_t header_callback(char* ptr, size_t size, size_t nmemb, void* userdata) {
-    http_response* pResp = (http_response*)userdata;
-    char* p;
-    p = sqlite3_realloc(pResp->zHeaders, pResp->szHeaders + size * nmemb + 1);
-    if (!p) {
-        return 0;
+    curlrc = curl_easy_setopt(curl, CURLOPT_SHARE, share);
+    if (curlrc == CURLE_OK && nMaxConnects > 0) {
+        curlrc = curl_easy_setopt(curl, CURLOPT_MAXCONNECTS, nMaxConnects);
     }
-    pResp->zHeaders = p;
-    memcpy(pResp->zHeaders + pResp->szHeaders, ptr, size * nmemb);
-    pResp->szHeaders += size * nmemb;
-    pResp->zHeaders[pResp->szHeaders] = '\0';
-    return size * nmemb;
+
+    return curlrc;
 }
 
 struct readdata {
@@ -1158,185 +5999,674 @@ static int set_curl_error_message(char** ppErrMsg, CURLcode rc, const char* mess
     return SQLITE_ERROR;
 }
 
-int http_do_request(http_request* req, http_response* resp, char** ppErrMsg) {
-    int rc;
+// State of a single transfer. Everything curl keeps a pointer to while the
+// transfer is running lives here.
+typedef struct http_transfer http_transfer;
+struct http_transfer {
     CURL* curl;
-    char aErrorBuf[CURL_ERROR_SIZE];
-    curl_version_info_data* pCurlVersionInfo;
-    long responseCode;
-    struct curl_slist* headers = NULL;
-    CURLcode curlrc;
+    char* zOrigin;
+    struct curl_slist* headers;
     struct readdata readdata;
+    http_request* req;
+    http_response* resp;
+    void* pArg;
+    int bNoBody;
+    int bTooLarge;
+    int bCancelled;
+    // Set while the headers are those of an interim response or a redirect,
+    // whose Content-Length is not the length of the body that is kept.
+    int bNotFinal;
+    http_header_parser headerParser;
+    char aErrorBuf[CURL_ERROR_SIZE];
+};
 
-    rc = http_backend_curl_load(ppErrMsg);
-    if (rc != SQLITE_OK) {
-        return rc;
+// Append a chunk of the body, failing the transfer if the body grows past
+// the limit set in the request.
+static size_t write_callback(char* ptr, size_t size, size_t nmemb, void* userdata) {
+    http_transfer* t = (http_transfer*)userdata;
+    http_response* pResp = t->resp;
+    sqlite3_int64 n = (sqlite3_int64)(size * nmemb);
+    if (t->req->szMaxBody > 0 && pResp->szBody + n > t->req->szMaxBody) {
+        t->bTooLarge = 1;
+        return 0;
+    }
+    if (http_response_reserve(pResp, n) != SQLITE_OK) {
+        return 0;
+    }
+    memcpy((char*)pResp->pBody + pResp->szBody, ptr, n);
+    pResp->szBody += n;
+    return size * nmemb;
+}
+
+// Called at least once a second while the transfer runs, stalled or not.
+static int xferinfo_callback(void* clientp,
+                             curl_off_t dltotal,
+                             curl_off_t dlnow,
+                             curl_off_t ultotal,
+                             curl_off_t ulnow) {
+    http_transfer* t = (http_transfer*)clientp;
+    t->bCancelled = http_request_cancelled(t->req);
+    return t->bCancelled;
+}
+
+// Used when the body is not needed. The data still has to be read off the
+// connection, but it is not buffered.
+static size_t discard_callback(char* ptr, size_t size, size_t nmemb, void* userdata) {
+    return size * nmemb;
+}
+
+// The headers are parsed as curl hands them over line by line. A header is
+// only complete once the next line has arrived, so every header is seen by the
+// time the empty line ending the headers is. The body buffer is sized up
+// front when the length is known, so that it is allocated once, and bodies
+// that are too large are rejected before any of it is downloaded. The values
+// of the HTTP_META_* headers are located in pResp->zHeaders, which holds the
+// same bytes as the parser's input.
+static int parse_header_callback(http_transfer* t, char* ptr, size_t n) {
+    http_response* pResp = t->resp;
+    const char* zName;
+    int nName;
+    const char* zValue;
+    int nValue;
+    sqlite3_int64 szContent;
+    int rc;
+
+    http_header_parser_feed(&t->headerParser, ptr, (int)n);
+    while ((rc = http_header_parser_next(
+                &t->headerParser, &zName, &nName, &zValue, &nValue)) == SQLITE_ROW) {
+        if (!(t->req->flags & HTTP_REQUEST_NO_HEADERS)) {
+            http_response_capture_header(
+                pResp,
+                zName,
+                nName,
+                t->headerParser.iHeader + (int)((zValue ? zValue : zName) - zName),
+                nValue);
+        }
+        if (t->bNoBody || t->bNotFinal ||
+            !http_header_name_eq(zName, nName, "content-length", 14)) {
+            continue;
+        }
+        if ((szContent = http_parse_content_length(zValue, nValue)) < 0) {
+            continue;
+        }
+        if (t->req->szMaxBody > 0 && szContent > t->req->szMaxBody) {
+            t->bTooLarge = 1;
+            return 0;
+        }
+        if (pResp->szBody == 0 && http_response_reserve(pResp, szContent) != SQLITE_OK) {
+            return 0;
+        }
+    }
+
+    // Malformed headers only mean that the body is not pre-sized.
+    return rc != SQLITE_NOMEM;
+}
+
+// Whether the status line is that of a 1xx response or of a redirect curl may
+// follow. Redirects without a Location header are final, but their body is
+// still not worth sizing up front, write_callback enforces the limit anyway.
+static int status_line_not_final(const char* zLine, size_t n) {
+    const char* zCode = memchr(zLine, ' ', n);
+    if (!zCode || zLine + n - zCode < 4) {
+        return 0;
+    }
+    switch (zCode[1]) {
+    case '1':
+        return 1;
+    case '3':
+        return zCode[2] == '0' && (zCode[3] == '1' || zCode[3] == '2' || zCode[3] == '3' ||
+                                   zCode[3] == '7' || zCode[3] == '8');
+    default:
+        return 0;
+    }
+}
+
+static size_t header_callback(char* ptr, size_t size, size_t nmemb, void* userdata) {
+    http_transfer* t = (http_transfer*)userdata;
+    http_response* pResp = t->resp;
+    size_t n = size * nmemb;
+    char* p;
+
+    // A status line starts a new response. Redirects and interim responses
+    // come before the final one, so throw away whatever was collected so far
+    // and keep only the headers of the last response.
+    if (n >= 5 && memcmp(ptr, "HTTP/", 5) == 0) {
+        http_header_parser_clear(&t->headerParser);
+        t->bNotFinal = status_line_not_final(ptr, n);
+        if (t->req->flags & HTTP_REQUEST_NO_HEADERS) {
+            return n;
+        }
+        while (n > 0 && (ptr[n - 1] == '\r' || ptr[n - 1] == '\n')) {
+            n--;
+        }
+        sqlite3_free(pResp->zStatus);
+        pResp->zStatus = sqlite3_mprintf("%.*s", (int)n, ptr);
+        if (!pResp->zStatus) {
+            return 0;
+        }
+        pResp->szHeaders = 0;
+        if (pResp->zHeaders) {
+            pResp->zHeaders[0] = '\0';
+        }
+        memset(pResp->aMetaOffset, 0, sizeof(pResp->aMetaOffset));
+        return size * nmemb;
+    }
+
+    if (!(t->req->flags & HTTP_REQUEST_NO_HEADERS)) {
+        if (!pResp->zHeaders || sqlite3_msize(pResp->zHeaders) < pResp->szHeaders + n + 1) {
+            p = sqlite3_realloc64(pResp->zHeaders, (pResp->szHeaders + n + 1) * 2);
+            if (!p) {
+                return 0;
+            }
+            pResp->zHeaders = p;
+        }
+        memcpy(pResp->zHeaders + pResp->szHeaders, ptr, n);
+        pResp->szHeaders += n;
+        pResp->zHeaders[pResp->szHeaders] = '\0';
+    } else if (t->bNoBody) {
+        return n;
+    }
+
+    if (!parse_header_callback(t, ptr, n)) {
+        return 0;
     }
+    return n;
+}
 
-    pCurlVersionInfo = curl_version_info(CURLVERSION_NOW);
+// Take a handle from the pool and configure it for t->req.
+static int transfer_setup(http_pool* pPool, http_transfer* t, char** ppErrMsg) {
+    int rc;
+    CURLcode curlrc;
 
-    curl = curl_easy_init();
-    if (!curl) {
+    t->curl = http_pool_acquire(pPool, t->req->zUrl, &t->zOrigin);
+    if (!t->curl) {
+        t->curl = curl_easy_init();
+    }
+    if (!t->curl) {
         *ppErrMsg = sqlite3_mprintf("curl_easy_init failed");
         rc = SQLITE_ERROR;
         goto error;
     }
 
-    memset(aErrorBuf, 0, sizeof(aErrorBuf));
-    if ((curlrc = curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, aErrorBuf)) != CURLE_OK) {
+    memset(t->aErrorBuf, 0, sizeof(t->aErrorBuf));
+    if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_ERRORBUFFER, t->aErrorBuf)) != CURLE_OK) {
         rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
         goto error;
     }
 
-    if ((curlrc = curl_easy_setopt(curl, CURLOPT_URL, req->zUrl)) != CURLE_OK) {
+    if ((curlrc = http_share_attach(t->curl)) != CURLE_OK) {
         rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
         goto error;
     }
 
-    if ((curlrc = curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L)) != CURLE_OK) {
+    if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_URL, t->req->zUrl)) != CURLE_OK) {
         rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
         goto error;
     }
 
-    if (sqlite3_stricmp(req->zMethod, "GET") == 0) {
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L)) != CURLE_OK) {
+    if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_FOLLOWLOCATION, 1L)) != CURLE_OK) {
+        rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+        goto error;
+    }
+
+    if (sqlite3_stricmp(t->req->zMethod, "GET") == 0) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_HTTPGET, 1L)) != CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
-    } else if (sqlite3_stricmp(req->zMethod, "POST") == 0) {
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_POST, 1L)) != CURLE_OK) {
+    } else if (sqlite3_stricmp(t->req->zMethod, "POST") == 0) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_POST, 1L)) != CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_POSTFIELDS, req->pBody)) != CURLE_OK) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_POSTFIELDS, t->req->pBody)) != CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, req->szBody)) !=
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_POSTFIELDSIZE_LARGE, t->req->szBody)) !=
             CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
-    } else if (sqlite3_stricmp(req->zMethod, "PUT") == 0) {
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_PUT, 1L)) != CURLE_OK) {
+    } else if (sqlite3_stricmp(t->req->zMethod, "PUT") == 0) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_PUT, 1L)) != CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
-    } else if (sqlite3_stricmp(req->zMethod, "HEAD") == 0) {
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_NOBODY, 1L)) != CURLE_OK) {
+    } else if (sqlite3_stricmp(t->req->zMethod, "HEAD") == 0) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_NOBODY, 1L)) != CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
     } else {
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L)) != CURLE_OK) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_HTTPGET, 1L)) != CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
 
-        if (req->pBody && req->szBody) {
-            if ((curlrc = curl_easy_setopt(curl, CURLOPT_PUT, 1L)) != CURLE_OK) {
+        if (t->req->pBody && t->req->szBody) {
+            if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_PUT, 1L)) != CURLE_OK) {
                 rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
                 goto error;
             }
         }
 
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, req->zMethod)) != CURLE_OK) {
-            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
-            goto error;
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_CUSTOMREQUEST, t->req->zMethod)) !=
+            CURLE_OK) {
+            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+            goto error;
+        }
+    }
+
+    if (t->req->pBody && t->req->szBody && sqlite3_stricmp(t->req->zMethod, "POST") != 0) {
+        t->readdata.pBody = (const char*)t->req->pBody;
+        t->readdata.szBody = (size_t)t->req->szBody;
+
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_INFILESIZE_LARGE, t->req->szBody)) !=
+            CURLE_OK) {
+            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+            goto error;
+        }
+
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_READFUNCTION, read_callback)) != CURLE_OK) {
+            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+            goto error;
+        }
+
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_READDATA, &t->readdata)) != CURLE_OK) {
+            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+            goto error;
+        }
+    }
+
+    if (curl_caps.bNativeCa) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_SSL_OPTIONS, CURLSSLOPT_NATIVE_CA)) !=
+            CURLE_OK) {
+            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+            goto error;
+        }
+    }
+
+    // HEAD responses announce the length of a body that never comes.
+    t->bNoBody = (t->req->flags & HTTP_REQUEST_NO_BODY) ||
+                 sqlite3_stricmp(t->req->zMethod, "HEAD") == 0;
+
+    if (t->bNoBody) {
+        curlrc = curl_easy_setopt(t->curl, CURLOPT_WRITEFUNCTION, discard_callback);
+    } else {
+        curlrc = curl_easy_setopt(t->curl, CURLOPT_WRITEFUNCTION, write_callback);
+    }
+    if (curlrc != CURLE_OK) {
+        rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+        goto error;
+    }
+
+    if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_WRITEDATA, t)) != CURLE_OK) {
+        rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+        goto error;
+    }
+
+    if (t->req->pbCancel) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_XFERINFOFUNCTION, xferinfo_callback)) !=
+            CURLE_OK) {
+            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+            goto error;
+        }
+
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_XFERINFODATA, t)) != CURLE_OK) {
+            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+            goto error;
+        }
+
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_NOPROGRESS, 0L)) != CURLE_OK) {
+            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+            goto error;
+        }
+    }
+
+    // Without a header function curl doesn't keep the headers anywhere. The
+    // headers are still looked at for Content-Length when the body is needed.
+    if (!(t->req->flags & HTTP_REQUEST_NO_HEADERS) || !t->bNoBody) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_HEADERFUNCTION, header_callback)) !=
+            CURLE_OK) {
+            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+            goto error;
+        }
+
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_HEADERDATA, t)) != CURLE_OK) {
+            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+            goto error;
+        }
+    }
+
+    // Remove content-type header by default...
+    t->headers = curl_slist_append(NULL, "content-type;");
+    if (!t->headers) {
+        *ppErrMsg = sqlite3_mprintf("curl_slist_append failed");
+        rc = SQLITE_ERROR;
+        goto error;
+    }
+
+    if (t->req->zHeaders) {
+        if (!headers_to_curl_headers(&t->headers, t->req->zHeaders, strlen(t->req->zHeaders))) {
+            *ppErrMsg = sqlite3_mprintf("failed to convert headers for curl");
+            rc = SQLITE_ERROR;
+            goto error;
+        }
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_HTTPHEADER, t->headers)) != CURLE_OK) {
+            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+            goto error;
+        }
+    }
+
+    rc = SQLITE_OK;
+
+error:
+
+    return rc;
+}
+
+// Get a time or size, or -1 if this version of curl does not know it.
+static sqlite3_int64 transfer_info_off_t(CURL* curl, CURLINFO info) {
+    curl_off_t value;
+    return curl_easy_getinfo(curl, info, &value) == CURLE_OK ? value : -1;
+}
+
+static long transfer_info_long(CURL* curl, CURLINFO info) {
+    long value;
+    return curl_easy_getinfo(curl, info, &value) == CURLE_OK ? value : -1;
+}
+
+// Collect the timings and connection details of a finished transfer.
+static int transfer_info(http_transfer* t) {
+    http_response* pResp = t->resp;
+    char* zUrl = NULL;
+
+    pResp->bTransfer = 1;
+    pResp->usDns = transfer_info_off_t(t->curl, CURLINFO_NAMELOOKUP_TIME_T);
+    pResp->usConnect = transfer_info_off_t(t->curl, CURLINFO_CONNECT_TIME_T);
+    pResp->usTls = transfer_info_off_t(t->curl, CURLINFO_APPCONNECT_TIME_T);
+    pResp->usFirstByte = transfer_info_off_t(t->curl, CURLINFO_STARTTRANSFER_TIME_T);
+    pResp->usTotal = transfer_info_off_t(t->curl, CURLINFO_TOTAL_TIME_T);
+    pResp->szUpload = transfer_info_off_t(t->curl, CURLINFO_SIZE_UPLOAD_T);
+    pResp->szDownload = transfer_info_off_t(t->curl, CURLINFO_SIZE_DOWNLOAD_T);
+    pResp->nNewConnections = transfer_info_long(t->curl, CURLINFO_NUM_CONNECTS);
+    pResp->nRedirects = transfer_info_long(t->curl, CURLINFO_REDIRECT_COUNT);
+
+    switch (transfer_info_long(t->curl, CURLINFO_HTTP_VERSION)) {
+    case CURL_HTTP_VERSION_1_0:
+        pResp->iHttpVersion = 10;
+        break;
+    case CURL_HTTP_VERSION_1_1:
+        pResp->iHttpVersion = 11;
+        break;
+    case CURL_HTTP_VERSION_2_0:
+        pResp->iHttpVersion = 20;
+        break;
+    case CURL_HTTP_VERSION_3:
+        pResp->iHttpVersion = 30;
+        break;
+    default:
+        pResp->iHttpVersion = -1;
+        break;
+    }
+
+    // The URL is only copied when a redirect changed it.
+    sqlite3_free(pResp->zEffectiveUrl);
+    pResp->zEffectiveUrl = NULL;
+    if (curl_easy_getinfo(t->curl, CURLINFO_EFFECTIVE_URL, &zUrl) == CURLE_OK && zUrl &&
+        strcmp(zUrl, t->req->zUrl) != 0) {
+        pResp->zEffectiveUrl = sqlite3_mprintf("%s", zUrl);
+        if (!pResp->zEffectiveUrl) {
+            return SQLITE_NOMEM;
         }
     }
 
-    if (req->pBody && req->szBody && sqlite3_stricmp(req->zMethod, "POST") != 0) {
-        readdata.pBody = (const char*)req->pBody;
-        readdata.szBody = (size_t)req->szBody;
+    return SQLITE_OK;
+}
 
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, req->szBody)) != CURLE_OK) {
-            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
-            goto error;
-        }
+// Collect the results of a finished transfer into t->resp.
+static int transfer_result(http_transfer* t, CURLcode result, char** ppErrMsg) {
+    long responseCode;
 
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_callback)) != CURLE_OK) {
-            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
-            goto error;
-        }
+    if (t->bTooLarge) {
+        *ppErrMsg = sqlite3_mprintf("response body exceeds the maximum size of %lld bytes",
+                                    t->req->szMaxBody);
+        return SQLITE_TOOBIG;
+    }
 
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_READDATA, &readdata)) != CURLE_OK) {
-            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
-            goto error;
-        }
+    if (t->bCancelled) {
+        *ppErrMsg = sqlite3_mprintf("request cancelled");
+        return SQLITE_INTERRUPT;
     }
 
-    // Since 7.71.0 (Jun 24 2020). Makes life easier on Windows at least.
-    if (pCurlVersionInfo->version_num >= ((7 << 16) | (71 << 8))) {
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_SSL_OPTIONS, CURLSSLOPT_NATIVE_CA)) !=
-            CURLE_OK) {
-            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
-            goto error;
-        }
+    if (result != CURLE_OK) {
+        *ppErrMsg = sqlite3_mprintf("curl_easy_perform failed: %s",
+                                    t->aErrorBuf[0] ? t->aErrorBuf : curl_easy_strerror(result));
+        return SQLITE_ERROR;
     }
 
-    if ((curlrc = curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback)) != CURLE_OK) {
-        rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
-        goto error;
+    curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &responseCode);
+    t->resp->iStatusCode = responseCode;
+
+    return transfer_info(t);
+}
+
+// Finish a single transfer or one in a batch, and record it in the statistics
+// and the trace.
+static int transfer_finish(http_transfer* t, CURLcode result, char** ppErrMsg) {
+    int rc = transfer_result(t, result, ppErrMsg);
+    sqlite3_int64 usElapsed = transfer_info_off_t(t->curl, CURLINFO_TOTAL_TIME_T);
+    http_stats_record(t->req, t->resp, rc, usElapsed);
+    http_trace_record(t->req, t->resp, rc, *ppErrMsg, usElapsed);
+    return rc;
+}
+
+// Return the handle of the transfer to the pool.
+static void transfer_cleanup(http_pool* pPool, http_transfer* t) {
+    if (t->curl) {
+        http_pool_release(pPool, t->curl, t->zOrigin);
+    } else {
+        sqlite3_free(t->zOrigin);
     }
+    curl_slist_free_all(t->headers);
+    http_header_parser_clear(&t->headerParser);
+    t->curl = NULL;
+    t->zOrigin = NULL;
+    t->headers = NULL;
+}
 
-    if ((curlrc = curl_easy_setopt(curl, CURLOPT_WRITEDATA, resp)) != CURLE_OK) {
-        rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
-        goto error;
+int http_do_request(http_pool* pPool, http_request* req, http_response* resp, char** ppErrMsg) {
+    http_transfer t;
+    int rc;
+
+    rc = http_backend_init(ppErrMsg);
+    if (rc != SQLITE_OK) {
+        return rc;
     }
 
-    if ((curlrc = curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback)) != CURLE_OK) {
-        rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
-        goto error;
+    memset(&t, 0, sizeof(t));
+    t.req = req;
+    t.resp = resp;
+
+    rc = transfer_setup(pPool, &t, ppErrMsg);
+    if (rc == SQLITE_OK) {
+        rc = transfer_finish(&t, curl_easy_perform(t.curl), ppErrMsg);
     }
 
-    if ((curlrc = curl_easy_setopt(curl, CURLOPT_HEADERDATA, resp)) != CURLE_OK) {
-        rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
-        goto error;
+    transfer_cleanup(pPool, &t);
+
+    return rc;
+}
+
+// Maximum time to block in curl_multi_wait() before checking the transfers
+// again.
+#define HTTP_BATCH_WAIT_MS 1000
+
+// Transfers of a batch are driven by a curl multi handle. At most nConcurrency
+// transfers are running at any time, the rest wait in aTransfer until a slot
+// frees up.
+struct http_batch {
+    http_pool* pPool;
+    CURLM* multi;
+    int nConcurrency;
+    http_transfer** aTransfer;
+    int nTransfer;
+    int nAlloc;
+    int iNextStart;
+    int nRunning;
+};
+
+int http_batch_open(http_pool* pPool, int nConcurrency, http_batch** ppBatch, char** ppErrMsg) {
+    http_batch* pBatch;
+    int rc;
+
+    rc = http_backend_init(ppErrMsg);
+    if (rc != SQLITE_OK) {
+        return rc;
     }
 
-    // Remove content-type header by default...
-    headers = curl_slist_append(NULL, "content-type;");
-    if (!headers) {
-        *ppErrMsg = sqlite3_mprintf("curl_slist_append failed");
-        rc = SQLITE_ERROR;
-        goto error;
+    pBatch = sqlite3_malloc(sizeof(*pBatch));
+    if (!pBatch) {
+        return SQLITE_NOMEM;
+    }
+    memset(pBatch, 0, sizeof(*pBatch));
+    pBatch->pPool = pPool;
+    pBatch->nConcurrency = nConcurrency > 0 ? nConcurrency : 1;
+    pBatch->multi = curl_multi_init();
+    if (!pBatch->multi) {
+        sqlite3_free(pBatch);
+        *ppErrMsg = sqlite3_mprintf("curl_multi_init failed");
+        return SQLITE_ERROR;
     }
 
-    if (req->zHeaders) {
-        if (!headers_to_curl_headers(&headers, req->zHeaders, strlen(req->zHeaders))) {
-            *ppErrMsg = sqlite3_mprintf("failed to convert headers for curl");
-            rc = SQLITE_ERROR;
-            goto error;
-        }
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers)) != CURLE_OK) {
-            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
-            goto error;
+    *ppBatch = pBatch;
+
+    return SQLITE_OK;
+}
+
+int http_batch_add(http_batch* pBatch, http_request* req, http_response* resp, void* pArg) {
+    http_transfer* t;
+
+    if (pBatch->nTransfer == pBatch->nAlloc) {
+        int nAlloc = pBatch->nAlloc ? pBatch->nAlloc * 2 : 16;
+        http_transfer** aTransfer =
+            sqlite3_realloc(pBatch->aTransfer, sizeof(*aTransfer) * nAlloc);
+        if (!aTransfer) {
+            return SQLITE_NOMEM;
         }
+        pBatch->aTransfer = aTransfer;
+        pBatch->nAlloc = nAlloc;
     }
 
-    if (curl_easy_perform(curl) != CURLE_OK) {
-        *ppErrMsg = sqlite3_mprintf("curl_easy_perform failed: %s", aErrorBuf);
-        rc = SQLITE_ERROR;
-        goto error;
+    t = sqlite3_malloc(sizeof(*t));
+    if (!t) {
+        return SQLITE_NOMEM;
     }
+    memset(t, 0, sizeof(*t));
+    t->req = req;
+    t->resp = resp;
+    t->pArg = pArg;
 
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
-    resp->iStatusCode = responseCode;
+    pBatch->aTransfer[pBatch->nTransfer++] = t;
 
-    remove_all_but_last_headers(resp->zHeaders);
-    separate_status_and_headers(&resp->zStatus, resp->zHeaders);
+    return SQLITE_OK;
+}
 
-    rc = SQLITE_OK;
+// Remove a transfer from the batch. The handle goes back to the pool.
+static void batch_remove(http_batch* pBatch, http_transfer* t) {
+    int i;
+    for (i = 0; i < pBatch->nTransfer; ++i) {
+        if (pBatch->aTransfer[i] == t) {
+            break;
+        }
+    }
+    assert(i < pBatch->nTransfer);
+    if (i < pBatch->iNextStart) {
+        pBatch->iNextStart--;
+    }
+    memmove(&pBatch->aTransfer[i],
+            &pBatch->aTransfer[i + 1],
+            sizeof(pBatch->aTransfer[0]) * (pBatch->nTransfer - i - 1));
+    pBatch->nTransfer--;
+    transfer_cleanup(pBatch->pPool, t);
+    sqlite3_free(t);
+}
 
-error:
+int http_batch_next(http_batch* pBatch, void** ppArg, int* pRc, char** ppErrMsg) {
+    CURLMcode mrc;
+    CURLMsg* msg;
+    http_transfer* t;
+    int nQueued;
+    int nRunning;
 
-done:
+    *ppErrMsg = NULL;
+
+    for (;;) {
+        // Fill the free slots. A transfer that can't be set up completes
+        // immediately with an error.
+        while (pBatch->nRunning < pBatch->nConcurrency &&
+               pBatch->iNextStart < pBatch->nTransfer) {
+            t = pBatch->aTransfer[pBatch->iNextStart++];
+            *pRc = transfer_setup(pBatch->pPool, t, ppErrMsg);
+            if (*pRc == SQLITE_OK &&
+                (curl_easy_setopt(t->curl, CURLOPT_PRIVATE, t) != CURLE_OK ||
+                 curl_multi_add_handle(pBatch->multi, t->curl) != CURLM_OK)) {
+                *ppErrMsg = sqlite3_mprintf("curl_multi_add_handle failed");
+                *pRc = SQLITE_ERROR;
+            }
+            if (*pRc != SQLITE_OK) {
+                *ppArg = t->pArg;
+                batch_remove(pBatch, t);
+                return SQLITE_ROW;
+            }
+            pBatch->nRunning++;
+        }
+
+        if ((msg = curl_multi_info_read(pBatch->multi, &nQueued)) != NULL) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&t);
+            *pRc = transfer_finish(t, msg->data.result, ppErrMsg);
+            *ppArg = t->pArg;
+            curl_multi_remove_handle(pBatch->multi, t->curl);
+            pBatch->nRunning--;
+            batch_remove(pBatch, t);
+            return SQLITE_ROW;
+        }
 
-    curl_easy_cleanup(curl);
-    curl_slist_free_all(headers);
+        if (pBatch->nRunning == 0) {
+            return SQLITE_DONE;
+        }
 
-    return rc;
+        mrc = curl_multi_perform(pBatch->multi, &nRunning);
+        if (mrc == CURLM_OK && nRunning == pBatch->nRunning) {
+            mrc = curl_multi_wait(pBatch->multi, NULL, 0, HTTP_BATCH_WAIT_MS, NULL);
+        }
+        if (mrc != CURLM_OK) {
+            *ppErrMsg = sqlite3_mprintf("curl_multi failed: %s", curl_multi_strerror(mrc));
+            return SQLITE_ERROR;
+        }
+    }
+}
+
+void http_batch_close(http_batch* pBatch) {
+    int i;
+    if (!pBatch) {
+        return;
+    }
+    // Anything still in flight is cancelled.
+    for (i = 0; i < pBatch->iNextStart; ++i) {
+        curl_multi_remove_handle(pBatch->multi, pBatch->aTransfer[i]->curl);
+    }
+    for (i = 0; i < pBatch->nTransfer; ++i) {
+        transfer_cleanup(pBatch->pPool, pBatch->aTransfer[i]);
+        sqlite3_free(pBatch->aTransfer[i]);
+    }
+    curl_multi_cleanup(pBatch->multi);
+    sqlite3_free(pBatch->aTransfer);
+    sqlite3_free(pBatch);
 }
 
 #endif // HTTP_BACKEND_CURL
@@ -1350,7 +6680,13 @@ done:
 
 SQLITE_EXTENSION_INIT3
 
+struct http_pool {
+    int nRequests;
+};
+
 static http_request sLastRequest;
+static int sShareEnabled;
+static int sShareMaxConnections;
 static http_response* sResponse;
 static char* sErrMsg;
 
@@ -1364,6 +6700,7 @@ void http_backend_dummy_set_errmsg(const char* zErrMsg) {
 
 void http_backend_dummy_reset_request() {
     sqlite3_free(sLastRequest.zMethod);
+    sqlite3_free(sLastRequest.zUrl);
     sqlite3_free((void*)sLastRequest.pBody);
     sqlite3_free((void*)sLastRequest.zHeaders);
     memset(&sLastRequest, 0, sizeof(sLastRequest));
@@ -1373,11 +6710,65 @@ const http_request* http_backend_dummy_get_last_request() {
     return &sLastRequest;
 }
 
-int http_do_request(http_request* req, http_response* resp, char** ppErrMsg) {
+int http_backend_init(char** ppErrMsg) {
+    *ppErrMsg = NULL;
+    return SQLITE_OK;
+}
+
+int http_backend_get_info(http_backend_info* pInfo, char** ppErrMsg) {
+    memset(pInfo, 0, sizeof(*pInfo));
+    pInfo->zName = "dummy";
+    pInfo->zVersion = "0";
+    pInfo->bShare = 1;
+    return SQLITE_OK;
+}
+
+int http_pool_open(http_pool** ppPool) {
+    http_pool* pPool = sqlite3_malloc(sizeof(*pPool));
+    if (!pPool) {
+        return SQLITE_NOMEM;
+    }
+    memset(pPool, 0, sizeof(*pPool));
+    *ppPool = pPool;
+    return SQLITE_OK;
+}
+
+void http_pool_close(http_pool* pPool) {
+    sqlite3_free(pPool);
+}
+
+int http_share_configure(int bEnable, int nMaxConnections, char** ppErrMsg) {
+    sShareEnabled = bEnable;
+    sShareMaxConnections = nMaxConnections;
+    return SQLITE_OK;
+}
+
+int http_backend_dummy_get_share(int* pMaxConnections) {
+    *pMaxConnections = sShareMaxConnections;
+    return sShareEnabled;
+}
+
+int http_do_request(http_pool* pPool, http_request* req, http_response* resp, char** ppErrMsg) {
     int rc = SQLITE_OK;
-    if (sResponse) {
+    if (pPool) {
+        pPool->nRequests++;
+    }
+    if (sResponse && req->szMaxBody > 0 && sResponse->szBody > req->szMaxBody) {
+        http_body_unref(sResponse->pBody);
+        sqlite3_free(sResponse->zHeaders);
+        sqlite3_free(sResponse->zStatus);
+        sqlite3_free(sResponse->zEffectiveUrl);
+        sResponse = NULL;
+        *ppErrMsg = sqlite3_mprintf("response body exceeds the maximum size of %lld bytes",
+                                    req->szMaxBody);
+        rc = SQLITE_TOOBIG;
+    } else if (sResponse) {
         *resp = *sResponse;
         sResponse = NULL;
+        if (resp->zHeaders) {
+            memset(resp->aMetaOffset, 0, sizeof(resp->aMetaOffset));
+            http_response_capture_meta(resp, 0, resp->szHeaders);
+        }
     } else if (sErrMsg) {
         *ppErrMsg = sErrMsg;
         sErrMsg = NULL;
@@ -1397,9 +6788,12 @@ int http_do_request(http_request* req, http_response* resp, char** ppErrMsg) {
         memcpy((void*)sLastRequest.pBody, req->pBody, req->szBody);
     }
     sLastRequest.szBody = req->szBody;
+    sLastRequest.flags = req->flags;
     if (req->zHeaders) {
         sLastRequest.zHeaders = sqlite3_mprintf("%s", req->zHeaders);
     }
+    http_stats_record(req, resp, rc, 0);
+    http_trace_record(req, resp, rc, *ppErrMsg, 0);
     return rc;
 }
 
@@ -1503,7 +6897,58 @@ static int query_headers(HINTERNET request, DWORD dwInfoLevel, char** ppResult)
     return SQLITE_OK;
 }
 
-int http_do_request(http_request* req, http_response* resp, char** ppErrMsg) {
+int http_backend_init(char** ppErrMsg) {
+    *ppErrMsg = NULL;
+    return SQLITE_OK;
+}
+
+int http_backend_get_info(http_backend_info* pInfo, char** ppErrMsg) {
+    memset(pInfo, 0, sizeof(*pInfo));
+    pInfo->zName = "winhttp";
+    return SQLITE_OK;
+}
+
+// A WinHTTP session keeps connections alive between requests, so the pool is
+// simply a session that outlives the individual requests.
+struct http_pool {
+    HINTERNET session;
+};
+
+static HINTERNET open_session() {
+    return WinHttpOpen(L"sqlite3-http",
+                       WINHTTP_ACCESS_TYPE_AUTOMATIC_PROXY,
+                       WINHTTP_NO_PROXY_NAME,
+                       WINHTTP_NO_PROXY_BYPASS,
+                       0);
+}
+
+int http_pool_open(http_pool** ppPool) {
+    http_pool* pPool = sqlite3_malloc(sizeof(*pPool));
+    if (!pPool) {
+        return SQLITE_NOMEM;
+    }
+    memset(pPool, 0, sizeof(*pPool));
+    *ppPool = pPool;
+    return SQLITE_OK;
+}
+
+void http_pool_close(http_pool* pPool) {
+    if (!pPool) {
+        return;
+    }
+    WinHttpCloseHandle(pPool->session);
+    sqlite3_free(pPool);
+}
+
+int http_share_configure(int bEnable, int nMaxConnections, char** ppErrMsg) {
+    if (bEnable) {
+        *ppErrMsg = sqlite3_mprintf("shared cache is not supported by the WinHTTP backend");
+        return SQLITE_ERROR;
+    }
+    return SQLITE_OK;
+}
+
+int http_do_request(http_pool* pPool, http_request* req, http_response* resp, char** ppErrMsg) {
     LPWSTR zUrlWide = NULL;
     LPWSTR zHostWide = NULL;
     LPWSTR zMethodWide = NULL;
@@ -1520,6 +6965,8 @@ int http_do_request(http_request* req, http_response* resp, char** ppErrMsg) {
     DWORD szWideResponseHeaders = 0;
     DWORD dwSize = 0;
     DWORD dwStatusCode;
+    sqlite3_int64 usStart = http_stats_now();
+    sqlite3_int64 usElapsed;
 
     zUrlWide = utf8_to_unicode(req->zUrl);
     if (!zUrlWide) {
@@ -1537,11 +6984,11 @@ int http_do_request(http_request* req, http_response* resp, char** ppErrMsg) {
         goto error;
     }
 
-    session = WinHttpOpen(L"sqlite3-http",
-                          WINHTTP_ACCESS_TYPE_AUTOMATIC_PROXY,
-                          WINHTTP_NO_PROXY_NAME,
-                          WINHTTP_NO_PROXY_BYPASS,
-                          0);
+    if (pPool && !pPool->session) {
+        pPool->session = open_session();
+    }
+
+    session = pPool ? pPool->session : open_session();
 
     if (!session) {
         lastErr = GetLastError();
@@ -1617,7 +7064,13 @@ int http_do_request(http_request* req, http_response* resp, char** ppErrMsg) {
     for (;;) {
         DWORD dwSize = 0;
         DWORD nRead = 0;
-        char* nb;
+        // WinHTTP's own timeouts bound each wait, cancellation is checked in
+        // between.
+        if (http_request_cancelled(req)) {
+            *ppErrMsg = sqlite3_mprintf("request cancelled");
+            rc = SQLITE_INTERRUPT;
+            goto error;
+        }
         if (!WinHttpQueryDataAvailable(request, &dwSize)) {
             lastErr = GetLastError();
             errFunc = "WinHttpQueryDataAvailable";
@@ -1626,18 +7079,37 @@ int http_do_request(http_request* req, http_response* resp, char** ppErrMsg) {
         if (dwSize == 0) {
             break;
         }
-        nb = sqlite3_realloc(resp->pBody, resp->szBody + dwSize);
-        if (!nb) {
-            rc = SQLITE_NOMEM;
+        if (req->flags & HTTP_REQUEST_NO_BODY) {
+            // Drain the body without keeping it.
+            char aDiscard[4096];
+            DWORD nToRead = dwSize < sizeof(aDiscard) ? dwSize : sizeof(aDiscard);
+            if (!WinHttpReadData(request, aDiscard, nToRead, &nRead)) {
+                lastErr = GetLastError();
+                errFunc = "WinHttpReadData";
+                goto error;
+            }
+            if (nRead == 0) {
+                break;
+            }
+            continue;
+        }
+        if (req->szMaxBody > 0 && resp->szBody + dwSize > req->szMaxBody) {
+            *ppErrMsg = sqlite3_mprintf("response body exceeds the maximum size of %lld bytes",
+                                        req->szMaxBody);
+            rc = SQLITE_TOOBIG;
+            goto error;
+        }
+        rc = http_response_reserve(resp, dwSize);
+        if (rc != SQLITE_OK) {
             goto error;
         }
-        resp->pBody = nb;
+        rc = SQLITE_ERROR;
         if (!WinHttpReadData(request, (char*)resp->pBody + resp->szBody, dwSize, &nRead)) {
             lastErr = GetLastError();
             errFunc = "WinHttpReadData";
             goto error;
         }
-        resp->szBody += dwSize;
+        resp->szBody += nRead;
         if (nRead == 0) {
             break;
         }
@@ -1670,6 +7142,7 @@ int http_do_request(http_request* req, http_response* resp, char** ppErrMsg) {
 
     remove_all_but_last_headers(resp->zHeaders);
     separate_status_and_headers(&resp->zStatus, resp->zHeaders);
+    http_response_capture_meta(resp, 0, (int)strlen(resp->zHeaders));
 
     rc = SQLITE_OK;
 
@@ -1689,29 +7162,279 @@ done:
     sqlite3_free(zHeadersWide);
     WinHttpCloseHandle(request);
     WinHttpCloseHandle(conn);
-    WinHttpCloseHandle(session);
+    if (!pPool) {
+        WinHttpCloseHandle(session);
+    }
+
+    usElapsed = http_stats_now() - usStart;
+    http_stats_record(req, resp, rc, usElapsed);
+    http_trace_record(req, resp, rc, *ppErrMsg, usElapsed);
 
     return rc;
 }
 
-#endif // HTTP_BACKEND_WINHTTP
+#endif // HTTP_BACKEND_WINHTTP
+
+/********** src/http_batch_serial.c **********/
+
+#ifndef HTTP_BACKEND_CURL
+
+
+#include <string.h>
+
+SQLITE_EXTENSION_INIT3
+
+// Backends without a concurrent interface run the requests of a batch one at
+// a time as they are asked for.
+
+typedef struct http_batch_item http_batch_item;
+struct http_batch_item {
+    http_request* req;
+    http_response* resp;
+    void* pArg;
+};
+
+struct http_batch {
+    http_pool* pPool;
+    http_batch_item* aItem;
+    int nItem;
+    int nAlloc;
+    int iNext;
+};
+
+int http_batch_open(http_pool* pPool, int nConcurrency, http_batch** ppBatch, char** ppErrMsg) {
+    http_batch* pBatch = sqlite3_malloc(sizeof(*pBatch));
+    if (!pBatch) {
+        return SQLITE_NOMEM;
+    }
+    memset(pBatch, 0, sizeof(*pBatch));
+    pBatch->pPool = pPool;
+    *ppBatch = pBatch;
+    return SQLITE_OK;
+}
+
+int http_batch_add(http_batch* pBatch, http_request* req, http_response* resp, void* pArg) {
+    if (pBatch->nItem == pBatch->nAlloc) {
+        int nAlloc = pBatch->nAlloc ? pBatch->nAlloc * 2 : 16;
+        http_batch_item* aItem = sqlite3_realloc(pBatch->aItem, sizeof(*aItem) * nAlloc);
+        if (!aItem) {
+            return SQLITE_NOMEM;
+        }
+        pBatch->aItem = aItem;
+        pBatch->nAlloc = nAlloc;
+    }
+    pBatch->aItem[pBatch->nItem].req = req;
+    pBatch->aItem[pBatch->nItem].resp = resp;
+    pBatch->aItem[pBatch->nItem].pArg = pArg;
+    pBatch->nItem++;
+    return SQLITE_OK;
+}
+
+int http_batch_next(http_batch* pBatch, void** ppArg, int* pRc, char** ppErrMsg) {
+    http_batch_item* pItem;
+    *ppErrMsg = NULL;
+    if (pBatch->iNext == pBatch->nItem) {
+        return SQLITE_DONE;
+    }
+    pItem = &pBatch->aItem[pBatch->iNext++];
+    *pRc = http_do_request(pBatch->pPool, pItem->req, pItem->resp, ppErrMsg);
+    *ppArg = pItem->pArg;
+    return SQLITE_ROW;
+}
+
+void http_batch_close(http_batch* pBatch) {
+    if (!pBatch) {
+        return;
+    }
+    sqlite3_free(pBatch->aItem);
+    sqlite3_free(pBatch);
+}
+
+#endif // HTTP_BACKEND_CURL
+
+/********** src/http_next_header.c **********/
+
+
+#include <string.h>
+
+SQLITE_EXTENSION_INIT3
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HTTP_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// AVX2 is not part of the baseline, so it is compiled separately and picked at
+// runtime. This needs the target attribute and __builtin_cpu_supports().
+#if defined(HTTP_HAVE_SSE2) && (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define HTTP_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+// clang-format off
+const unsigned char http_char_class[256] = {
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  2,  0,  0,  0,  0,  0,  0, // 00
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 10
+     2,  5,  4,  5,  5,  5,  5,  5,  4,  4,  5,  5,  4,  5,  5,  4, // 20
+    13, 13, 13, 13, 13, 13, 13, 13, 13, 13,  4,  4,  4,  4,  4,  4, // 30
+     4, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, // 40
+    21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21,  4,  4,  4,  5,  5, // 50
+     5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5, // 60
+     5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  4,  5,  4,  5,  0, // 70
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 80
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 90
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // a0
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // b0
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // c0
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // d0
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // e0
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // f0
+};
+// clang-format on
+
+int http_header_name_eq(const char* zA, int nA, const char* zB, int nB) {
+    int i;
+    if (nA != nB) {
+        return 0;
+    }
+    for (i = 0; i < nA; ++i) {
+        if (http_char_lower(zA[i]) != http_char_lower(zB[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Scanning header values dominates the cost of parsing, values such as
+// cookies and policies can be hundreds of bytes long. The scanners below find
+// the CR ending the line and the last visible character before it. Everything
+// else is left to the state machine in http_next_header().
+typedef const char* (*http_scan_value_fn)(const char* p, const char* end, const char** pLast);
+
+static const char* http_scan_value_scalar(const char* p, const char* end, const char** pLast) {
+    for (; p != end && *p != '\r'; ++p) {
+        if (http_char_is(*p, HTTP_CHAR_VCHAR)) {
+            *pLast = p;
+        }
+    }
+    return p;
+}
+
+#ifdef HTTP_HAVE_SSE2
+
+#ifdef _MSC_VER
+#include <intrin.h>
+
+static int lowest_bit(unsigned int x) {
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (int)i;
+}
+
+static int highest_bit(unsigned int x) {
+    unsigned long i;
+    _BitScanReverse(&i, x);
+    return (int)i;
+}
+#else
+static int lowest_bit(unsigned int x) {
+    return __builtin_ctz(x);
+}
+
+static int highest_bit(unsigned int x) {
+    return 31 - __builtin_clz(x);
+}
+#endif
+
+// Given the masks of CRs and visible characters in a block starting at p,
+// update *pLast and return the CR ending the line or NULL if there is none.
+static const char*
+scan_value_block(const char* p, unsigned int crMask, unsigned int vcharMask, const char** pLast) {
+    if (crMask) {
+        // Only the characters before the CR belong to the value.
+        vcharMask &= (crMask & (0u - crMask)) - 1;
+    }
+    if (vcharMask) {
+        *pLast = p + highest_bit(vcharMask);
+    }
+    return crMask ? p + lowest_bit(crMask) : NULL;
+}
+
+static const char* http_scan_value_sse2(const char* p, const char* end, const char** pLast) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lo = _mm_set1_epi8(0x20);
+    const __m128i hi = _mm_set1_epi8(0x7f);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        // Bytes are compared as signed, so 0x80-0xff are not visible.
+        __m128i vchar = _mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi));
+        unsigned int crMask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, cr));
+        unsigned int vcharMask = (unsigned int)_mm_movemask_epi8(vchar);
+        const char* pCR = scan_value_block(p, crMask, vcharMask, pLast);
+        if (pCR) {
+            return pCR;
+        }
+        p += 16;
+    }
+    return http_scan_value_scalar(p, end, pLast);
+}
+
+#endif
 
-/********** src/http_next_header.c **********/
+#ifdef HTTP_HAVE_AVX2
+
+__attribute__((target("avx2"))) static const char*
+http_scan_value_avx2(const char* p, const char* end, const char** pLast) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lo = _mm256_set1_epi8(0x20);
+    const __m256i hi = _mm256_set1_epi8(0x7f);
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i vchar = _mm256_and_si256(_mm256_cmpgt_epi8(v, lo), _mm256_cmpgt_epi8(hi, v));
+        unsigned int crMask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, cr));
+        unsigned int vcharMask = (unsigned int)_mm256_movemask_epi8(vchar);
+        const char* pCR = scan_value_block(p, crMask, vcharMask, pLast);
+        if (pCR) {
+            return pCR;
+        }
+        p += 32;
+    }
+    return http_scan_value_sse2(p, end, pLast);
+}
 
-#include <ctype.h>
-#include <sqlite3.h>
+#endif
 
-static int is_token_char(int c) {
-    return isalnum(c) || (c != 0 && strchr("!#$%&'*+-.^_`|~", c));
+static http_scan_value_fn http_scan_value_select() {
+#ifdef HTTP_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return http_scan_value_avx2;
+    }
+#endif
+#ifdef HTTP_HAVE_SSE2
+    return http_scan_value_sse2;
+#else
+    return http_scan_value_scalar;
+#endif
 }
 
-static int is_header_ws(int c) {
-    return c == ' ' || c == '\t';
-}
+#ifdef HTTP_HAVE_AVX2
+// Resolved on first use. Racing threads all store the same pointer, and the
+// pointer is accessed atomically so that this is not a data race.
+static http_scan_value_fn http_scan_value_resolved;
 
-static int is_vchar(int c) {
-    return c >= 0x21 && c <= 0x7e;
+static http_scan_value_fn http_scan_value_get() {
+    http_scan_value_fn fn = __atomic_load_n(&http_scan_value_resolved, __ATOMIC_RELAXED);
+    if (!fn) {
+        fn = http_scan_value_select();
+        __atomic_store_n(&http_scan_value_resolved, fn, __ATOMIC_RELAXED);
+    }
+    return fn;
 }
+#else
+// Without AVX2 the scanner is known at compile time.
+#define http_scan_value_get() http_scan_value_select()
+#endif
 
 // Return SQLITE_ROW if a header was extracted
 // Return SQLITE_DONE if headers has been exhausted
@@ -1730,6 +7453,7 @@ int http_next_header(const char* headers,
     const char* valueEnd = NULL;
     const char* last = NULL;
     const char* p = headers;
+    http_scan_value_fn http_scan_value = http_scan_value_get();
 
     enum {
         StateInit,
@@ -1747,8 +7471,10 @@ int http_next_header(const char* headers,
 
     *ppName = NULL;
     *pNameSize = 0;
-    *ppValue = NULL;
-    *pValueSize = 0;
+    if (ppValue) {
+        *ppValue = NULL;
+        *pValueSize = 0;
+    }
 
     if (size == 0) {
         *pParsed = 0;
@@ -1761,7 +7487,7 @@ int http_next_header(const char* headers,
             // printf("StateInit %02x %c\n", *p, isalnum(*p) ? *p : ' ');
             if (*p == '\r') {
                 state = StateCR;
-            } else if (is_header_ws(*p)) {
+            } else if (http_char_is(*p, HTTP_CHAR_WS)) {
                 // There shouldn't be whitespace here. Folding is handled in
                 // StateCR/StateCheckFold.
                 state = StateError;
@@ -1773,12 +7499,12 @@ int http_next_header(const char* headers,
 
         case StateName:
             // printf("StateName %02x %c\n", *p, isalnum(*p) ? *p : ' ');
-            if (is_token_char(*p)) {
+            if (http_char_is(*p, HTTP_CHAR_TOKEN)) {
                 // accept
             } else if (*p == ':') {
                 nameEnd = p;
                 state = StateValueLeadingWs;
-            } else if (is_header_ws(*p)) {
+            } else if (http_char_is(*p, HTTP_CHAR_WS)) {
                 nameEnd = p;
                 state = StateNameTrailingWs;
             } else {
@@ -1788,7 +7514,7 @@ int http_next_header(const char* headers,
 
         case StateNameTrailingWs:
             // printf("StateNameTrailingWs %02x %c\n", *p, isalnum(*p) ? *p : ' ');
-            if (is_header_ws(*p)) {
+            if (http_char_is(*p, HTTP_CHAR_WS)) {
                 // accept and skip
             } else if (*p == ':') {
                 state = StateValueLeadingWs;
@@ -1799,12 +7525,12 @@ int http_next_header(const char* headers,
 
         case StateValueLeadingWs:
             // printf("StateValueLeadingWs %02x %c\n", *p, isalnum(*p) ? *p : ' ');
-            if (is_header_ws(*p)) {
+            if (http_char_is(*p, HTTP_CHAR_WS)) {
                 // accept and skip
             } else if (*p == '\r') {
                 // empty value
                 state = StateCR;
-            } else if (is_vchar(*p)) {
+            } else if (http_char_is(*p, HTTP_CHAR_VCHAR)) {
                 valueStart = p;
                 last = p;
                 state = StateValue;
@@ -1815,14 +7541,14 @@ int http_next_header(const char* headers,
 
         case StateValue:
             // printf("StateValue %02x %c\n", *p, isalnum(*p) ? *p : ' ');
-            if (is_header_ws(*p)) {
-                // accept but keep separate so that we can track trailing ws
-            } else if (*p == '\r') {
+            // Everything up to the CR is accepted. Track the last visible
+            // character so that trailing ws can be dropped.
+            p = http_scan_value(p, headersEnd, &last);
+            if (p == headersEnd) {
+                --p;
+            } else {
                 valueEnd = last + 1;
                 state = StateCR;
-            } else if (is_vchar(*p)) {
-                // accept
-                last = p;
             }
             break;
 
@@ -1842,7 +7568,7 @@ int http_next_header(const char* headers,
 
         case StateCheckFold:
             // printf("StateCheckFold %02x %c\n", *p, isalnum(*p) ? *p : ' ');
-            if (is_header_ws(*p)) {
+            if (http_char_is(*p, HTTP_CHAR_WS)) {
                 state = StateValue;
             } else {
                 state = StateDone;
@@ -1865,10 +7591,743 @@ int http_next_header(const char* headers,
     *ppName = nameStart;
     *pNameSize = nameEnd - nameStart;
 
-    if (valueStart) {
+    if (valueStart && ppValue) {
         *ppValue = valueStart;
         *pValueSize = valueEnd - valueStart;
     }
 
     return SQLITE_ROW;
 }
+
+void http_header_parser_init(http_header_parser* p) {
+    memset(p, 0, sizeof(*p));
+}
+
+void http_header_parser_clear(http_header_parser* p) {
+    sqlite3_free(p->zCarry);
+    http_header_parser_init(p);
+}
+
+void http_header_parser_feed(http_header_parser* p, const char* zData, int nData) {
+    p->zIn = zData;
+    p->nIn = nData;
+    p->iScan = 0;
+}
+
+void http_header_parser_finish(http_header_parser* p) {
+    p->bEof = 1;
+}
+
+static int header_parser_carry(http_header_parser* p, const char* zData, int nData) {
+    if (nData == 0) {
+        return SQLITE_OK;
+    }
+    if (p->nCarry + nData > p->nCarryAlloc) {
+        sqlite3_int64 nAlloc = (sqlite3_int64)(p->nCarry + nData) * 2;
+        char* zCarry = sqlite3_realloc64(p->zCarry, nAlloc < 128 ? 128 : nAlloc);
+        if (!zCarry) {
+            return SQLITE_NOMEM;
+        }
+        p->zCarry = zCarry;
+        p->nCarryAlloc = nAlloc < 128 ? 128 : (int)nAlloc;
+    }
+    memcpy(p->zCarry + p->nCarry, zData, nData);
+    p->nCarry += nData;
+    return SQLITE_OK;
+}
+
+// Find where the pending header ends in the current input, splitting the
+// input exactly where http_next_header() would. A header ends at the first
+// CRLF that is not followed by whitespace, or right after the empty line
+// ending the headers. A bare LF is part of the header it appears in, even at
+// the start of a line. Returns the offset of the end, or -1 if the input runs out first.
+static int header_parser_scan(http_header_parser* p) {
+    const char* z = p->zIn;
+    int i = p->iScan;
+    while (i < p->nIn) {
+        const char* pCR;
+        if (p->bLineEnd) {
+            if (!http_char_is(z[i], HTTP_CHAR_WS)) {
+                return i;
+            }
+            p->bLineEnd = 0;
+        }
+        if (p->bCR) {
+            p->bCR = 0;
+            if (z[i] == '\n') {
+                i++;
+                if (p->nCarry + i == 2) {
+                    return i;
+                }
+                p->bLineEnd = 1;
+                continue;
+            }
+        }
+        pCR = memchr(z + i, '\r', p->nIn - i);
+        if (!pCR) {
+            i = p->nIn;
+            break;
+        }
+        i = pCR - z + 1;
+        p->bCR = 1;
+    }
+    p->iScan = i;
+    return -1;
+}
+
+int http_header_parser_next(http_header_parser* p,
+                            const char** ppName,
+                            int* pNameSize,
+                            const char** ppValue,
+                            int* pValueSize) {
+    const char* zHeader;
+    int nHeader;
+    int nParsed;
+    int iEnd;
+    int rc;
+
+    *ppName = NULL;
+    *pNameSize = 0;
+    if (ppValue) {
+        *ppValue = NULL;
+        *pValueSize = 0;
+    }
+
+    if (p->rc != SQLITE_OK) {
+        return p->rc;
+    }
+
+    iEnd = header_parser_scan(p);
+    if (iEnd < 0) {
+        if (!p->bEof) {
+            // Keep the start of the header until the rest of it arrives.
+            rc = header_parser_carry(p, p->zIn, p->nIn);
+            p->zIn += p->nIn;
+            p->iIn += p->nIn;
+            p->nIn = 0;
+            p->iScan = 0;
+            if (rc != SQLITE_OK) {
+                p->rc = rc;
+            }
+            return rc;
+        }
+        if (p->nCarry + p->nIn == 0) {
+            return SQLITE_DONE;
+        }
+        if (!p->bLineEnd) {
+            p->rc = SQLITE_ERROR;
+            return SQLITE_ERROR;
+        }
+        iEnd = p->nIn;
+    }
+
+    p->iHeader = p->iIn - p->nCarry;
+    if (p->nCarry > 0) {
+        rc = header_parser_carry(p, p->zIn, iEnd);
+        if (rc != SQLITE_OK) {
+            p->rc = rc;
+            return rc;
+        }
+        zHeader = p->zCarry;
+        nHeader = p->nCarry;
+    } else {
+        zHeader = p->zIn;
+        nHeader = iEnd;
+    }
+
+    p->zIn += iEnd;
+    p->nIn -= iEnd;
+    p->iIn += iEnd;
+    p->iScan = 0;
+    p->bLineEnd = 0;
+    p->bCR = 0;
+    p->nCarry = 0;
+
+    rc = http_next_header(zHeader, nHeader, &nParsed, ppName, pNameSize, ppValue, pValueSize);
+    if (rc == SQLITE_ERROR) {
+        p->rc = rc;
+    }
+    return rc;
+}
+
+/********** src/http_stats.c **********/
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+SQLITE_EXTENSION_INIT3
+
+// Number of shards, a power of two. Threads are spread over the shards by
+// their id, so that concurrent requests rarely wait for the same lock.
+#define HTTP_STATS_SHARDS 16
+
+// Hosts tracked by a single shard. Requests to further hosts are counted under
+// the host "*", so that crawling many hosts does not grow the tables forever.
+#define HTTP_STATS_MAX_HOSTS 1024
+
+typedef struct http_stats_shard http_stats_shard;
+struct http_stats_shard {
+    sqlite3_mutex* mutex;
+    http_stats_host* aHost;
+    int nHost;
+    int nAlloc;
+    // Open addressing hash table of the hosts, 1 + index in aHost or 0 if the
+    // slot is empty. Twice as many slots as hosts can be allocated.
+    int* aSlot;
+    int nSlot;
+};
+
+static http_stats_shard aStatsShard[HTTP_STATS_SHARDS];
+
+int http_stats_init() {
+    sqlite3_mutex* mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP2);
+    int rc = SQLITE_OK;
+    int i;
+
+    sqlite3_mutex_enter(mutex);
+    for (i = 0; i < HTTP_STATS_SHARDS && rc == SQLITE_OK; ++i) {
+        if (!aStatsShard[i].mutex) {
+            aStatsShard[i].mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_FAST);
+            if (!aStatsShard[i].mutex) {
+                rc = SQLITE_NOMEM;
+            }
+        }
+    }
+    sqlite3_mutex_leave(mutex);
+
+    return rc;
+}
+
+sqlite3_int64 http_stats_now() {
+#ifdef _WIN32
+    LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (sqlite3_int64)(now.QuadPart / freq.QuadPart * 1000000 +
+                           now.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (sqlite3_int64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static http_stats_shard* stats_shard() {
+#ifdef _WIN32
+    uint64_t id = GetCurrentThreadId();
+#else
+    uint64_t id = (uint64_t)(uintptr_t)pthread_self();
+#endif
+    return &aStatsShard[(id * 0x9e3779b97f4a7c15ull) >> 60 & (HTTP_STATS_SHARDS - 1)];
+}
+
+// Find the host part of a URL, without the user info and path.
+static int url_host(const char* zUrl, const char** pzHost) {
+    const char* zHost = strstr(zUrl, "://");
+    const char* zAt;
+    int nHost;
+    zHost = zHost ? zHost + 3 : zUrl;
+    nHost = (int)strcspn(zHost, "/?#");
+    while ((zAt = memchr(zHost, '@', nHost)) != NULL) {
+        nHost -= (int)(zAt + 1 - zHost);
+        zHost = zAt + 1;
+    }
+    *pzHost = zHost;
+    return nHost;
+}
+
+// Hosts are stored lowercase, names differing in case are the same host.
+static unsigned int stats_hash(const char* zHost, int nHost) {
+    unsigned int h = 2166136261u;
+    int i;
+    for (i = 0; i < nHost; ++i) {
+        h = (h ^ (unsigned char)http_char_lower(zHost[i])) * 16777619u;
+    }
+    return h;
+}
+
+static int* stats_find_slot(http_stats_shard* pShard, const char* zHost, int nHost) {
+    unsigned int i = stats_hash(zHost, nHost) & (pShard->nSlot - 1);
+    for (;; i = (i + 1) & (pShard->nSlot - 1)) {
+        int* pSlot = &pShard->aSlot[i];
+        const char* zName;
+        if (*pSlot == 0) {
+            return pSlot;
+        }
+        zName = pShard->aHost[*pSlot - 1].zHost;
+        if (sqlite3_strnicmp(zName, zHost, nHost) == 0 && zName[nHost] == '\0') {
+            return pSlot;
+        }
+    }
+}
+
+// Make room for one more host, growing the hash table with the array.
+static int stats_grow(http_stats_shard* pShard) {
+    http_stats_host* aHost;
+    int* aSlot;
+    int nAlloc;
+    int i;
+    if (pShard->nHost < pShard->nAlloc) {
+        return SQLITE_OK;
+    }
+    nAlloc = pShard->nAlloc ? pShard->nAlloc * 2 : 8;
+    aHost = sqlite3_realloc64(pShard->aHost, sizeof(*aHost) * nAlloc);
+    if (!aHost) {
+        return SQLITE_NOMEM;
+    }
+    pShard->aHost = aHost;
+    aSlot = sqlite3_malloc64(sizeof(*aSlot) * nAlloc * 2);
+    if (!aSlot) {
+        return SQLITE_NOMEM;
+    }
+    memset(aSlot, 0, sizeof(*aSlot) * nAlloc * 2);
+    sqlite3_free(pShard->aSlot);
+    pShard->aSlot = aSlot;
+    pShard->nSlot = nAlloc * 2;
+    pShard->nAlloc = nAlloc;
+    for (i = 0; i < pShard->nHost; ++i) {
+        const char* zHost = aHost[i].zHost;
+        *stats_find_slot(pShard, zHost, (int)strlen(zHost)) = i + 1;
+    }
+    return SQLITE_OK;
+}
+
+// Find or add the counters of a host. Returns NULL if out of memory.
+static http_stats_host* stats_host(http_stats_shard* pShard, const char* zHost, int nHost) {
+    http_stats_host* pHost;
+    int* pSlot;
+    int i;
+    if (pShard->nSlot > 0) {
+        pSlot = stats_find_slot(pShard, zHost, nHost);
+        if (*pSlot) {
+            return &pShard->aHost[*pSlot - 1];
+        }
+        if (pShard->nHost >= HTTP_STATS_MAX_HOSTS) {
+            zHost = "*";
+            nHost = 1;
+            pSlot = stats_find_slot(pShard, zHost, nHost);
+            if (*pSlot) {
+                return &pShard->aHost[*pSlot - 1];
+            }
+        }
+    }
+    if (stats_grow(pShard) != SQLITE_OK) {
+        return NULL;
+    }
+    pHost = &pShard->aHost[pShard->nHost];
+    memset(pHost, 0, sizeof(*pHost));
+    pHost->zHost = sqlite3_mprintf("%.*s", nHost, zHost);
+    if (!pHost->zHost) {
+        return NULL;
+    }
+    for (i = 0; i < nHost; ++i) {
+        pHost->zHost[i] = http_char_lower(pHost->zHost[i]);
+    }
+    *stats_find_slot(pShard, zHost, nHost) = ++pShard->nHost;
+    return pHost;
+}
+
+static int stats_bucket(sqlite3_int64 usLatency) {
+    int iBucket = 0;
+    while (iBucket < HTTP_STATS_BUCKETS - 1 && usLatency >= http_stats_bucket_limit(iBucket)) {
+        iBucket++;
+    }
+    return iBucket;
+}
+
+void http_stats_record(const http_request* req,
+                       const http_response* resp,
+                       int rc,
+                       sqlite3_int64 usElapsed) {
+    http_stats_shard* pShard = stats_shard();
+    http_stats_host* pHost;
+    const char* zHost;
+    int nHost;
+    sqlite3_int64 usLatency = usElapsed;
+
+    if (!pShard->mutex || !req->zUrl) {
+        return;
+    }
+    if (resp->bTransfer && resp->usTotal >= 0) {
+        usLatency = resp->usTotal;
+    }
+    if (usLatency < 0) {
+        usLatency = 0;
+    }
+    nHost = url_host(req->zUrl, &zHost);
+
+    sqlite3_mutex_enter(pShard->mutex);
+    pHost = stats_host(pShard, zHost, nHost);
+    if (pHost) {
+        pHost->nRequests++;
+        if (rc != SQLITE_OK) {
+            pHost->nFailed++;
+        } else if (resp->iStatusCode >= 500) {
+            pHost->n5xx++;
+        } else if (resp->iStatusCode >= 400) {
+            pHost->n4xx++;
+        }
+        if (resp->bTransfer && resp->szUpload >= 0) {
+            pHost->szSent += resp->szUpload;
+        } else if (rc == SQLITE_OK) {
+            pHost->szSent += req->szBody;
+        }
+        if (resp->bTransfer && resp->szDownload >= 0) {
+            pHost->szReceived += resp->szDownload;
+        } else {
+            pHost->szReceived += resp->szBody;
+        }
+        if (resp->bTransfer && resp->nNewConnections >= 0) {
+            pHost->nNewConnections += resp->nNewConnections;
+            pHost->nReusedConnections += resp->nNewConnections == 0;
+        }
+        pHost->usLatency += usLatency;
+        pHost->aLatency[stats_bucket(usLatency)]++;
+    }
+    sqlite3_mutex_leave(pShard->mutex);
+}
+
+static int compare_hosts(const void* a, const void* b) {
+    return strcmp(((const http_stats_host*)a)->zHost, ((const http_stats_host*)b)->zHost);
+}
+
+// Copy the hosts of every shard, then sort them and merge the counters of the
+// hosts that appear in several shards.
+int http_stats_snapshot(http_stats_host** paHost, int* pnHost) {
+    http_stats_host* aHost = NULL;
+    int nHost = 0;
+    int nAlloc = 0;
+    int rc = SQLITE_OK;
+    int i;
+    int j;
+    int k;
+
+    for (i = 0; i < HTTP_STATS_SHARDS && rc == SQLITE_OK; ++i) {
+        http_stats_shard* pShard = &aStatsShard[i];
+        if (!pShard->mutex) {
+            continue;
+        }
+        sqlite3_mutex_enter(pShard->mutex);
+        for (j = 0; j < pShard->nHost && rc == SQLITE_OK; ++j) {
+            http_stats_host* pTo;
+            if (nHost == nAlloc) {
+                http_stats_host* aNew;
+                nAlloc = nAlloc ? nAlloc * 2 : 16;
+                aNew = sqlite3_realloc64(aHost, sizeof(*aNew) * nAlloc);
+                if (!aNew) {
+                    rc = SQLITE_NOMEM;
+                    break;
+                }
+                aHost = aNew;
+            }
+            pTo = &aHost[nHost];
+            *pTo = pShard->aHost[j];
+            pTo->zHost = sqlite3_mprintf("%s", pTo->zHost);
+            if (!pTo->zHost) {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            nHost++;
+        }
+        sqlite3_mutex_leave(pShard->mutex);
+    }
+
+    if (rc != SQLITE_OK) {
+        http_stats_free(aHost, nHost);
+        return rc;
+    }
+
+    if (nHost > 0) {
+        qsort(aHost, nHost, sizeof(*aHost), compare_hosts);
+        for (i = 0, j = 1; j < nHost; ++j) {
+            http_stats_host* pTo = &aHost[i];
+            http_stats_host* pFrom = &aHost[j];
+            if (strcmp(pTo->zHost, pFrom->zHost) != 0) {
+                aHost[++i] = *pFrom;
+                continue;
+            }
+            pTo->nRequests += pFrom->nRequests;
+            pTo->nFailed += pFrom->nFailed;
+            pTo->n4xx += pFrom->n4xx;
+            pTo->n5xx += pFrom->n5xx;
+            pTo->szSent += pFrom->szSent;
+            pTo->szReceived += pFrom->szReceived;
+            pTo->nNewConnections += pFrom->nNewConnections;
+            pTo->nReusedConnections += pFrom->nReusedConnections;
+            pTo->usLatency += pFrom->usLatency;
+            for (k = 0; k < HTTP_STATS_BUCKETS; ++k) {
+                pTo->aLatency[k] += pFrom->aLatency[k];
+            }
+            sqlite3_free(pFrom->zHost);
+        }
+        nHost = i + 1;
+    }
+    *paHost = aHost;
+    *pnHost = nHost;
+    return SQLITE_OK;
+}
+
+void http_stats_free(http_stats_host* aHost, int nHost) {
+    int i;
+    for (i = 0; i < nHost; ++i) {
+        sqlite3_free(aHost[i].zHost);
+    }
+    sqlite3_free(aHost);
+}
+
+sqlite3_int64 http_stats_bucket_limit(int iBucket) {
+    return (sqlite3_int64)1024 << iBucket;
+}
+
+sqlite3_int64 http_stats_percentile(const http_stats_host* pHost, double q) {
+    sqlite3_int64 nRank = (sqlite3_int64)(q * pHost->nRequests + 0.999999);
+    sqlite3_int64 nSeen = 0;
+    int i;
+    if (pHost->nRequests == 0) {
+        return -1;
+    }
+    for (i = 0; i < HTTP_STATS_BUCKETS - 1; ++i) {
+        nSeen += pHost->aLatency[i];
+        if (nSeen >= nRank) {
+            return http_stats_bucket_limit(i);
+        }
+    }
+    // Slower than the limit of the last bounded bucket, by an unknown amount.
+    return HTTP_STATS_UNBOUNDED;
+}
+
+/********** src/http_trace.c **********/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+SQLITE_EXTENSION_INIT3
+
+// Number of entries in the rings of all requests and of slow requests, powers
+// of two. An entry is 256 bytes, so the rings take about 1 MiB.
+#define HTTP_TRACE_ENTRIES 4096
+#define HTTP_TRACE_SLOW_ENTRIES 256
+
+// The rings are shared by all threads without a lock. Writers take the next
+// request id from a counter and claim the entry it maps to by swapping in an
+// even sequence number, then publish it by making the number odd. Readers
+// copy an entry and keep it only if the number is odd and did not change
+// while copying.
+#ifdef _MSC_VER
+#define trace_increment(p) InterlockedIncrement64(p)
+#define trace_load(p) InterlockedOr64((p), 0)
+#define trace_store(p, v) InterlockedExchange64((p), (v))
+#define trace_fence() MemoryBarrier()
+
+static int trace_cas(volatile sqlite3_int64* p, sqlite3_int64 iExpected, sqlite3_int64 iNew) {
+    return InterlockedCompareExchange64(p, iNew, iExpected) == iExpected;
+}
+#else
+#define trace_increment(p) __atomic_add_fetch((p), 1, __ATOMIC_RELAXED)
+#define trace_load(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define trace_store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define trace_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+static int trace_cas(volatile sqlite3_int64* p, sqlite3_int64 iExpected, sqlite3_int64 iNew) {
+    return __atomic_compare_exchange_n(
+        p, &iExpected, iNew, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+#endif
+
+static struct {
+    volatile sqlite3_int64 bEnabled;
+    volatile sqlite3_int64 usSlow;
+    volatile sqlite3_int64 iLastId;
+    volatile sqlite3_int64 iLastSlow;
+    http_trace_entry aEntry[HTTP_TRACE_ENTRIES];
+    http_trace_entry aSlow[HTTP_TRACE_SLOW_ENTRIES];
+} trace = {0, 1000000};
+
+void http_trace_configure(int bEnable, sqlite3_int64 usSlow) {
+    if (usSlow >= 0) {
+        trace_store(&trace.usSlow, usSlow);
+    }
+    trace_store(&trace.bEnabled, bEnable != 0);
+}
+
+int http_trace_enabled() {
+    return trace_load(&trace.bEnabled) != 0;
+}
+
+static sqlite3_int64 trace_wall_clock() {
+#ifdef _WIN32
+    FILETIME ft;
+    ULARGE_INTEGER t;
+    GetSystemTimeAsFileTime(&ft);
+    t.LowPart = ft.dwLowDateTime;
+    t.HighPart = ft.dwHighDateTime;
+    return (sqlite3_int64)((t.QuadPart - 116444736000000000ull) / 10);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (sqlite3_int64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static int trace_timing(const http_response* resp, sqlite3_int64 usTiming) {
+    if (!resp->bTransfer || usTiming < 0 || usTiming > 0x7fffffff) {
+        return -1;
+    }
+    return (int)usTiming;
+}
+
+// Append a text to the entry, truncated to what is left of nLeft bytes.
+static char* trace_append(char* zOut, const char* zText, int* pnLeft) {
+    int nText = zText ? (int)strlen(zText) : 0;
+    if (nText > *pnLeft) {
+        nText = *pnLeft;
+    }
+    memcpy(zOut, zText ? zText : "", nText);
+    zOut[nText] = '\0';
+    *pnLeft -= nText;
+    return zOut + nText + 1;
+}
+
+static void trace_write(http_trace_entry* pEntry, sqlite3_int64 iId, const http_trace_entry* pNew) {
+    sqlite3_int64 iSeq = trace_load(&pEntry->iSeq);
+    // If another writer still has the entry, the ring wrapped around while it
+    // was copying. Dropping this request is cheaper than waiting.
+    if ((iSeq != 0 && (iSeq & 1) == 0) || !trace_cas(&pEntry->iSeq, iSeq, iId * 2)) {
+        return;
+    }
+    trace_fence();
+    memcpy((char*)pEntry + sizeof(pEntry->iSeq),
+           (const char*)pNew + sizeof(pNew->iSeq),
+           sizeof(*pEntry) - sizeof(pEntry->iSeq));
+    trace_store(&pEntry->iSeq, iId * 2 + 1);
+}
+
+void http_trace_record(const http_request* req,
+                       const http_response* resp,
+                       int rc,
+                       const char* zErrMsg,
+                       sqlite3_int64 usElapsed) {
+    http_trace_entry entry;
+    sqlite3_int64 iId;
+    sqlite3_int64 usSlow;
+    int nLeft = HTTP_TRACE_TEXT;
+    char* zText = entry.aText;
+
+    if (!trace_load(&trace.bEnabled)) {
+        return;
+    }
+    if (rc == SQLITE_OK) {
+        zErrMsg = NULL;
+    } else if (!zErrMsg) {
+        zErrMsg = sqlite3_errstr(rc);
+    }
+
+    entry.usTotal = resp->bTransfer && resp->usTotal >= 0 ? resp->usTotal : usElapsed;
+    entry.iStarted = trace_wall_clock() - entry.usTotal;
+    entry.szSent = resp->bTransfer && resp->szUpload >= 0 ? resp->szUpload : req->szBody;
+    entry.szReceived = resp->bTransfer && resp->szDownload >= 0 ? resp->szDownload : resp->szBody;
+    entry.usDns = trace_timing(resp, resp->usDns);
+    entry.usConnect = trace_timing(resp, resp->usConnect);
+    entry.usTls = trace_timing(resp, resp->usTls);
+    entry.usFirstByte = trace_timing(resp, resp->usFirstByte);
+    entry.iStatusCode = zErrMsg ? 0 : resp->iStatusCode;
+    zText = trace_append(zText, req->zMethod, &nLeft);
+    zText = trace_append(zText, req->zUrl, &nLeft);
+    zText = trace_append(zText, zErrMsg, &nLeft);
+    trace_append(zText, req->zSql, &nLeft);
+
+    usSlow = trace_load(&trace.usSlow);
+    entry.bSlow = usSlow > 0 && entry.usTotal >= usSlow;
+
+    iId = trace_increment(&trace.iLastId);
+    trace_write(&trace.aEntry[iId & (HTTP_TRACE_ENTRIES - 1)], iId, &entry);
+    if (entry.bSlow) {
+        // The entry keeps the request id, so that the snapshot can tell the
+        // copies in both rings apart from other requests.
+        sqlite3_int64 iSlot = trace_increment(&trace.iLastSlow);
+        trace_write(&trace.aSlow[iSlot & (HTTP_TRACE_SLOW_ENTRIES - 1)], iId, &entry);
+    }
+}
+
+// Copy the complete entries of a ring to the end of aEntry.
+static int trace_copy(http_trace_entry* aRing, int nRing, http_trace_entry* aEntry) {
+    int nEntry = 0;
+    int i;
+    for (i = 0; i < nRing; ++i) {
+        http_trace_entry* pCopy = &aEntry[nEntry];
+        sqlite3_int64 iSeq = trace_load(&aRing[i].iSeq);
+        if (iSeq == 0 || (iSeq & 1) == 0) {
+            continue;
+        }
+        memcpy(pCopy, &aRing[i], sizeof(*pCopy));
+        trace_fence();
+        if (trace_load(&aRing[i].iSeq) != iSeq) {
+            continue;
+        }
+        pCopy->iSeq = iSeq;
+        nEntry++;
+    }
+    return nEntry;
+}
+
+static int compare_entries(const void* a, const void* b) {
+    sqlite3_int64 iA = ((const http_trace_entry*)a)->iSeq;
+    sqlite3_int64 iB = ((const http_trace_entry*)b)->iSeq;
+    return iA < iB ? -1 : iA > iB;
+}
+
+int http_trace_snapshot(http_trace_entry** paEntry, int* pnEntry) {
+    http_trace_entry* aEntry;
+    int nEntry;
+    int i;
+    int j;
+
+    aEntry =
+        sqlite3_malloc64(sizeof(*aEntry) * (HTTP_TRACE_ENTRIES + HTTP_TRACE_SLOW_ENTRIES));
+    if (!aEntry) {
+        return SQLITE_NOMEM;
+    }
+    nEntry = trace_copy(trace.aEntry, HTTP_TRACE_ENTRIES, aEntry);
+    nEntry += trace_copy(trace.aSlow, HTTP_TRACE_SLOW_ENTRIES, aEntry + nEntry);
+
+    // Slow requests still in the main ring are there twice.
+    qsort(aEntry, nEntry, sizeof(*aEntry), compare_entries);
+    for (i = j = 0; i < nEntry; ++i) {
+        if (j == 0 || aEntry[j - 1].iSeq != aEntry[i].iSeq) {
+            if (i != j) {
+                aEntry[j] = aEntry[i];
+            }
+            j++;
+        }
+    }
+
+    *paEntry = aEntry;
+    *pnEntry = j;
+    return SQLITE_OK;
+}
+
+const char* http_trace_text(const http_trace_entry* pEntry, int iText) {
+    const char* zText = pEntry->aText;
+    int i;
+    for (i = 0; i < iText; ++i) {
+        zText += strlen(zText) + 1;
+    }
+    return zText[0] ? zText : NULL;
+}
@@ -6,10 +6,14 @@ int main(int argc, char const* argv[]) {
     static const char* aFilenames[] = {
         "src/http.h",
         "src/http.c",
+        "src/http_async.c",
         "src/http_backend_curl.c",
         "src/http_backend_dummy.c",
         "src/http_backend_winhttp.c",
+        "src/http_batch_serial.c",
         "src/http_next_header.c",
+        "src/http_stats.c",
+        "src/http_trace.c",
     };
 
     static const int nFilenames = sizeof(aFilenames) / sizeof(aFilenames[0]);
@@ -3,13 +3,123 @@
 SQLITE_EXTENSION_INIT1
 
 #include <assert.h>
-#include <ctype.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// An index of text headers. The index is built as the headers are scanned by
+// lookups, so a single lookup costs no more than scanning the text and every
+// further lookup on the same text is a hash probe that resumes the scan only
+// if the name has not been seen yet. The index owns a copy of the text, so it
+// can be shared between the connection, auxiliary data and cursors.
+typedef struct http_headers_index http_headers_index;
+struct http_headers_index {
+    int nRef;
+    // Set once the index has been attached to a function argument.
+    int bAuxData;
+    char* zText;
+    int nText;
+    int nTextAlloc;
+    // How much of the text has been indexed, and SQLITE_ROW while there is
+    // more to index, SQLITE_DONE at the end or SQLITE_ERROR if malformed.
+    int nParsed;
+    int eState;
+    // Name offset, name size, value offset and value size of each header. The
+    // value offset is -1 if the value is empty.
+    int* aHeader;
+    int nHeaders;
+    int nHeadersAlloc;
+    // Hash slots, 1 + index of the first header with the name or 0 if empty.
+    // Only the first nHashed headers are in the table, the rest are added
+    // when the index is used for another lookup.
+    int* aSlot;
+    int nSlots;
+    int nHashed;
+};
+
+static void httpHeadersIndexUnref(void* p) {
+    http_headers_index* pIndex = (http_headers_index*)p;
+    if (pIndex && --pIndex->nRef == 0) {
+        sqlite3_free(pIndex->zText);
+        sqlite3_free(pIndex->aHeader);
+        sqlite3_free(pIndex->aSlot);
+        sqlite3_free(pIndex);
+    }
+}
+
+// State shared by all the functions and modules registered on a single
+// database connection. Every registration holds a reference and the state is
+// freed when the last function or module is destroyed.
+typedef struct http_ext http_ext;
+struct http_ext {
+    int nRef;
+    sqlite3* db;
+    http_pool* pPool;
+    // Set by http_max_body_size(), zero means SQLITE_LIMIT_LENGTH.
+    sqlite3_int64 szMaxBody;
+    // Index of the headers last looked up on this connection, see
+    // httpHeadersCached().
+    http_headers_index* pLastIndex;
+};
+
+// Bodies larger than the maximum length of a blob could not be returned
+// anyway, so never download more than that.
+static sqlite3_int64 httpMaxBodySize(http_ext* pExt) {
+    sqlite3_int64 szLimit = sqlite3_limit(pExt->db, SQLITE_LIMIT_LENGTH, -1);
+    if (pExt->szMaxBody > 0 && pExt->szMaxBody < szLimit) {
+        return pExt->szMaxBody;
+    }
+    return szLimit;
+}
+
+// The text of the statement making a request, for http_trace. SQLite does not
+// tell a function or a virtual table which statement calls it, so this is the
+// most recently prepared statement of the calling connection that is running.
+// Statements are listed most recently prepared first, so a nested statement
+// is found before the one running it. When several unrelated statements are
+// stepped at once, the request may be attributed to the wrong one.
+static const char* httpRunningSql(sqlite3* db) {
+    sqlite3_stmt* pStmt = NULL;
+    if (!http_trace_enabled()) {
+        return NULL;
+    }
+    while ((pStmt = sqlite3_next_stmt(db, pStmt)) != NULL) {
+        if (sqlite3_stmt_busy(pStmt)) {
+            return sqlite3_sql(pStmt);
+        }
+    }
+    return NULL;
+}
+
+static void httpExtUnref(void* p) {
+    http_ext* pExt = (http_ext*)p;
+    if (--pExt->nRef == 0) {
+        http_pool_close(pExt->pPool);
+        http_async_unref();
+        httpHeadersIndexUnref(pExt->pLastIndex);
+        sqlite3_free(pExt);
+    }
+}
+
 typedef struct http_vtab http_vtab;
 struct http_vtab {
     sqlite3_vtab base;
     char* zMethod;
+    http_ext* pExt;
+};
+
+// A cursor returns one row per distinct URL. Usually there is just one, but
+// a request_url IN (...) constraint is handled by fetching the whole list
+// concurrently.
+typedef struct http_cursor_item http_cursor_item;
+struct http_cursor_item {
+    http_request req;
+    http_response resp;
 };
 
 typedef struct http_cursor http_cursor;
@@ -17,9 +127,138 @@ struct http_cursor {
     sqlite3_vtab_cursor base;
     sqlite3_int64 iRowid;
     http_request req;
-    http_response resp;
+    http_batch* pBatch;
+    http_cursor_item* aItem;
+    int nItem;
+    http_cursor_item* pCurrent;
+};
+
+void* http_body_realloc(void* pBody, sqlite3_int64 nBytes) {
+    sqlite3_int64* p = pBody ? (sqlite3_int64*)pBody - 1 : NULL;
+    assert(!p || *p == 1);
+    p = sqlite3_realloc64(p, sizeof(*p) + nBytes);
+    if (!p) {
+        return NULL;
+    }
+    if (!pBody) {
+        *p = 1;
+    }
+    return p + 1;
+}
+
+// Bodies are shared with the threads of http_async, so their reference count
+// is updated atomically. Releasing a reference must make the writes to the
+// body visible to the thread that frees it.
+#ifdef _MSC_VER
+#define body_ref_increment(p) _InterlockedIncrement64(p)
+#define body_ref_decrement(p) _InterlockedDecrement64(p)
+#else
+#define body_ref_increment(p) __atomic_add_fetch((p), 1, __ATOMIC_RELAXED)
+#define body_ref_decrement(p) __atomic_sub_fetch((p), 1, __ATOMIC_ACQ_REL)
+#endif
+
+void* http_body_ref(void* pBody) {
+    if (pBody) {
+        body_ref_increment((sqlite3_int64*)pBody - 1);
+    }
+    return pBody;
+}
+
+void http_body_unref(void* pBody) {
+    sqlite3_int64* p;
+    if (!pBody) {
+        return;
+    }
+    p = (sqlite3_int64*)pBody - 1;
+    if (body_ref_decrement(p) == 0) {
+        sqlite3_free(p);
+    }
+}
+
+int http_response_reserve(http_response* resp, sqlite3_int64 nBytes) {
+    sqlite3_int64 szNeeded = resp->szBody + nBytes;
+    sqlite3_int64 szAlloc;
+    void* p;
+    if (szNeeded <= resp->szBodyAlloc) {
+        return SQLITE_OK;
+    }
+    szAlloc = resp->szBodyAlloc * 2;
+    if (szAlloc < szNeeded) {
+        szAlloc = szNeeded;
+    }
+    p = http_body_realloc(resp->pBody, szAlloc);
+    if (!p) {
+        return SQLITE_NOMEM;
+    }
+    resp->pBody = p;
+    resp->szBodyAlloc = szAlloc;
+    return SQLITE_OK;
+}
+
+static const struct {
+    const char* zName;
+    int nName;
+} aHttpMeta[HTTP_META_COUNT] = {
+    {"content-type", 12},
+    {"content-length", 14},
+    {"etag", 4},
+    {"last-modified", 13},
+    {"content-encoding", 16},
 };
 
+void http_response_capture_meta(http_response* resp, int iOffset, int nBytes) {
+    const char* zHeaders = resp->zHeaders + iOffset;
+    const char* pName;
+    int iNameSize;
+    const char* pValue;
+    int iValueSize;
+    int nParsed;
+
+    while (nBytes > 0 && http_next_header(zHeaders,
+                                          nBytes,
+                                          &nParsed,
+                                          &pName,
+                                          &iNameSize,
+                                          &pValue,
+                                          &iValueSize) == SQLITE_ROW) {
+        http_response_capture_header(resp,
+                                     pName,
+                                     iNameSize,
+                                     (int)((pValue ? pValue : pName) - resp->zHeaders),
+                                     iValueSize);
+        zHeaders += nParsed;
+        nBytes -= nParsed;
+    }
+}
+
+void http_response_capture_header(
+    http_response* resp, const char* zName, int nName, int iValue, int nValue) {
+    int i;
+    for (i = 0; i < HTTP_META_COUNT; ++i) {
+        if (resp->aMetaOffset[i] == 0 &&
+            http_header_name_eq(aHttpMeta[i].zName, aHttpMeta[i].nName, zName, nName)) {
+            resp->aMetaOffset[i] = 1 + iValue;
+            resp->aMetaSize[i] = nValue;
+            break;
+        }
+    }
+}
+
+sqlite3_int64 http_parse_content_length(const char* zValue, int nValue) {
+    sqlite3_int64 iValue = 0;
+    int i;
+    if (nValue == 0) {
+        return -1;
+    }
+    for (i = 0; i < nValue; i++) {
+        if (!http_char_is(zValue[i], HTTP_CHAR_DIGIT) || iValue > ((sqlite3_int64)1 << 56)) {
+            return -1;
+        }
+        iValue = iValue * 10 + (zValue[i] - '0');
+    }
+    return iValue;
+}
+
 // If zHeaders contains headers for multiple responses, then this will strip
 // headers from all but the last response.
 void remove_all_but_last_headers(char* zHeaders) {
@@ -54,6 +293,18 @@ void separate_status_and_headers(char** ppStatus, char* zHeaders) {
     memmove(zHeaders, cr + 2, strlen(cr + 2) + 1);
 }
 
+#define HTTP_META_COLUMNS                                                                          \
+    "response_content_type TEXT HIDDEN, response_content_length INT HIDDEN, "                      \
+    "response_etag TEXT HIDDEN, response_last_modified TEXT HIDDEN, "                              \
+    "response_content_encoding TEXT HIDDEN"
+
+#define HTTP_TRANSFER_COLUMNS                                                                      \
+    "transfer_dns_us INT HIDDEN, transfer_connect_us INT HIDDEN, transfer_tls_us INT HIDDEN, "     \
+    "transfer_first_byte_us INT HIDDEN, transfer_total_us INT HIDDEN, "                            \
+    "transfer_bytes_sent INT HIDDEN, transfer_bytes_received INT HIDDEN, "                         \
+    "transfer_new_connections INT HIDDEN, transfer_redirects INT HIDDEN, "                         \
+    "transfer_effective_url TEXT HIDDEN, transfer_http_version TEXT HIDDEN"
+
 static int httpConnect(sqlite3* db,
                        void* pAux,
                        int argc,
@@ -61,16 +312,34 @@ static int httpConnect(sqlite3* db,
                        sqlite3_vtab** ppVtab,
                        char** pzErr) {
     http_vtab* pNew;
+    int bIsDo = sqlite3_stricmp(argv[0], "http_do") == 0;
     int rc;
 
-    rc = sqlite3_declare_vtab(db,
-                              "CREATE TABLE x(response_status TEXT, "
-                              "response_status_code INT, response_headers TEXT, "
-                              "response_body BLOB, request_method TEXT HIDDEN, "
-                              "request_url TEXT HIDDEN, "
-                              "request_headers TEXT HIDDEN, "
-                              "request_body BLOB HIDDEN)");
+    // Table-valued function arguments map to the hidden columns in order. For
+    // http_get and http_post the method is implied, so it comes last. Values
+    // of common response headers follow the arguments, in the order of the
+    // HTTP_META_* constants, and then the details of the transfer.
+    if (bIsDo) {
+        rc = sqlite3_declare_vtab(db,
+                                  "CREATE TABLE x(response_status TEXT, "
+                                  "response_status_code INT, response_headers TEXT, "
+                                  "response_body BLOB, request_method TEXT HIDDEN, "
+                                  "request_url TEXT HIDDEN, "
+                                  "request_headers TEXT HIDDEN, "
+                                  "request_body BLOB HIDDEN, " HTTP_META_COLUMNS
+                                  ", " HTTP_TRANSFER_COLUMNS ")");
+    } else {
+        rc = sqlite3_declare_vtab(db,
+                                  "CREATE TABLE x(response_status TEXT, "
+                                  "response_status_code INT, response_headers TEXT, "
+                                  "response_body BLOB, request_url TEXT HIDDEN, "
+                                  "request_headers TEXT HIDDEN, "
+                                  "request_body BLOB HIDDEN, "
+                                  "request_method TEXT HIDDEN, " HTTP_META_COLUMNS
+                                  ", " HTTP_TRANSFER_COLUMNS ")");
+    }
 
+// Column numbers of http_do. See httpColumnIndex().
 #define HTTP_COL_RESPONSE_STATUS 0
 #define HTTP_COL_RESPONSE_STATUS_CODE 1
 #define HTTP_COL_RESPONSE_HEADERS 2
@@ -79,6 +348,22 @@ static int httpConnect(sqlite3* db,
 #define HTTP_COL_REQUEST_URL 5
 #define HTTP_COL_REQUEST_HEADERS 6
 #define HTTP_COL_REQUEST_BODY 7
+#define HTTP_COL_RESPONSE_CONTENT_TYPE 8
+#define HTTP_COL_RESPONSE_CONTENT_LENGTH 9
+#define HTTP_COL_RESPONSE_ETAG 10
+#define HTTP_COL_RESPONSE_LAST_MODIFIED 11
+#define HTTP_COL_RESPONSE_CONTENT_ENCODING 12
+#define HTTP_COL_TRANSFER_DNS 13
+#define HTTP_COL_TRANSFER_CONNECT 14
+#define HTTP_COL_TRANSFER_TLS 15
+#define HTTP_COL_TRANSFER_FIRST_BYTE 16
+#define HTTP_COL_TRANSFER_TOTAL 17
+#define HTTP_COL_TRANSFER_BYTES_SENT 18
+#define HTTP_COL_TRANSFER_BYTES_RECEIVED 19
+#define HTTP_COL_TRANSFER_NEW_CONNECTIONS 20
+#define HTTP_COL_TRANSFER_REDIRECTS 21
+#define HTTP_COL_TRANSFER_EFFECTIVE_URL 22
+#define HTTP_COL_TRANSFER_HTTP_VERSION 23
 
     if (rc == SQLITE_OK) {
         pNew = sqlite3_malloc(sizeof(*pNew));
@@ -86,6 +371,7 @@ static int httpConnect(sqlite3* db,
         if (pNew == 0)
             return SQLITE_NOMEM;
         memset(pNew, 0, sizeof(*pNew));
+        pNew->pExt = (http_ext*)pAux;
         if (sqlite3_stricmp(argv[0], "http_get") == 0) {
             pNew->zMethod = sqlite3_mprintf("GET");
         } else if (sqlite3_stricmp(argv[0], "http_post") == 0) {
@@ -95,6 +381,15 @@ static int httpConnect(sqlite3* db,
     return rc;
 }
 
+// Map a column number of the table to the http_do column numbering.
+static int httpColumnIndex(const http_vtab* pVtab, int iColumn) {
+    if (pVtab->zMethod == NULL || iColumn < HTTP_COL_REQUEST_METHOD ||
+        iColumn > HTTP_COL_REQUEST_BODY) {
+        return iColumn;
+    }
+    return iColumn == HTTP_COL_REQUEST_BODY ? HTTP_COL_REQUEST_METHOD : iColumn + 1;
+}
+
 static int httpDisconnect(sqlite3_vtab* pVtab) {
     http_vtab* p = (http_vtab*)pVtab;
     sqlite3_free(p->zMethod);
@@ -104,76 +399,208 @@ static int httpDisconnect(sqlite3_vtab* pVtab) {
 
 static int httpOpen(sqlite3_vtab* p, sqlite3_vtab_cursor** ppCursor) {
     http_cursor* pCur;
-    http_vtab* pVtab = (http_vtab*)p;
     pCur = sqlite3_malloc(sizeof(*pCur));
     if (pCur == 0)
         return SQLITE_NOMEM;
     memset(pCur, 0, sizeof(*pCur));
-    if (pVtab->zMethod) {
-        pCur->req.zMethod = sqlite3_mprintf("%s", pVtab->zMethod);
-    }
     *ppCursor = &pCur->base;
     return SQLITE_OK;
 }
 
+static void httpReset(http_cursor* pCur) {
+    int i;
+    http_batch_close(pCur->pBatch);
+    for (i = 0; i < pCur->nItem; ++i) {
+        sqlite3_free(pCur->aItem[i].req.zUrl);
+        http_body_unref(pCur->aItem[i].resp.pBody);
+        sqlite3_free(pCur->aItem[i].resp.zHeaders);
+        sqlite3_free(pCur->aItem[i].resp.zStatus);
+        sqlite3_free(pCur->aItem[i].resp.zEffectiveUrl);
+    }
+    sqlite3_free(pCur->aItem);
+    sqlite3_free(pCur->req.zMethod);
+    sqlite3_free((void*)pCur->req.zHeaders);
+    sqlite3_free((void*)pCur->req.pBody);
+    memset(&pCur->req, 0, sizeof(pCur->req));
+    pCur->pBatch = NULL;
+    pCur->aItem = NULL;
+    pCur->nItem = 0;
+    pCur->pCurrent = NULL;
+    pCur->iRowid = 0;
+}
+
 static int httpClose(sqlite3_vtab_cursor* cur) {
     http_cursor* pCur = (http_cursor*)cur;
-    sqlite3_free(pCur->resp.pBody);
-    sqlite3_free(pCur->req.zUrl);
-    sqlite3_free(pCur->req.zMethod);
+    httpReset(pCur);
     sqlite3_free(pCur);
     return SQLITE_OK;
 }
 
 static int httpNext(sqlite3_vtab_cursor* cur) {
     http_cursor* pCur = (http_cursor*)cur;
+    void* pArg = NULL;
+    int rcItem = SQLITE_OK;
+    char* zErrMsg = NULL;
+    int rc;
+
+    pCur->pCurrent = NULL;
+
+    if (!pCur->pBatch) {
+        return SQLITE_OK;
+    }
+
+    rc = http_batch_next(pCur->pBatch, &pArg, &rcItem, &zErrMsg);
+    if (rc == SQLITE_DONE) {
+        return SQLITE_OK;
+    }
+    if (rc == SQLITE_ROW) {
+        rc = rcItem;
+    }
+    if (rc != SQLITE_OK) {
+        sqlite3_free(cur->pVtab->zErrMsg);
+        cur->pVtab->zErrMsg = zErrMsg;
+        return rc;
+    }
+
+    pCur->pCurrent = (http_cursor_item*)pArg;
     pCur->iRowid++;
+
     return SQLITE_OK;
 }
 
+// Return a transfer detail, or NULL if the backend does not report it.
+static void httpResultTransfer(sqlite3_context* ctx, http_response* resp, sqlite3_int64 iValue) {
+    if (resp->bTransfer && iValue >= 0) {
+        sqlite3_result_int64(ctx, iValue);
+    }
+}
+
 static int httpColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
     http_cursor* pCur = (http_cursor*)cur;
+    http_request* req = &pCur->pCurrent->req;
+    http_response* resp = &pCur->pCurrent->resp;
+    int iColumn = httpColumnIndex((http_vtab*)cur->pVtab, i);
+    int iMeta;
 
-    switch (i) {
+    switch (iColumn) {
     case HTTP_COL_RESPONSE_STATUS:
-        sqlite3_result_text(ctx, pCur->resp.zStatus, -1, SQLITE_TRANSIENT);
+        sqlite3_result_text(ctx, resp->zStatus, -1, SQLITE_TRANSIENT);
         break;
 
     case HTTP_COL_RESPONSE_STATUS_CODE:
-        sqlite3_result_int(ctx, pCur->resp.iStatusCode);
+        sqlite3_result_int(ctx, resp->iStatusCode);
         break;
 
     case HTTP_COL_RESPONSE_HEADERS:
-        sqlite3_result_text(ctx, pCur->resp.zHeaders, -1, SQLITE_TRANSIENT);
+        sqlite3_result_text(ctx, resp->zHeaders, -1, SQLITE_TRANSIENT);
         break;
 
     case HTTP_COL_RESPONSE_BODY:
-        sqlite3_result_blob(ctx, pCur->resp.pBody, pCur->resp.szBody, SQLITE_TRANSIENT);
+        sqlite3_result_blob64(ctx, http_body_ref(resp->pBody), resp->szBody, http_body_unref);
         break;
 
     case HTTP_COL_REQUEST_METHOD:
-        sqlite3_result_text(ctx, pCur->req.zMethod, -1, SQLITE_TRANSIENT);
+        sqlite3_result_text(ctx, req->zMethod, -1, SQLITE_TRANSIENT);
         break;
 
     case HTTP_COL_REQUEST_URL:
-        sqlite3_result_text(ctx, pCur->req.zUrl, -1, SQLITE_TRANSIENT);
+        sqlite3_result_text(ctx, req->zUrl, -1, SQLITE_TRANSIENT);
         break;
 
     case HTTP_COL_REQUEST_HEADERS:
-        if (pCur->req.zHeaders) {
-            sqlite3_result_text(ctx, pCur->req.zHeaders, -1, SQLITE_TRANSIENT);
+        if (req->zHeaders) {
+            sqlite3_result_text(ctx, req->zHeaders, -1, SQLITE_TRANSIENT);
         } else {
             sqlite3_result_null(ctx);
         }
         break;
 
     case HTTP_COL_REQUEST_BODY:
-        if (pCur->req.pBody) {
-            sqlite3_result_blob(ctx, pCur->req.pBody, pCur->req.szBody, SQLITE_TRANSIENT);
+        if (req->pBody) {
+            sqlite3_result_blob(ctx, req->pBody, req->szBody, SQLITE_TRANSIENT);
         } else {
             sqlite3_result_null(ctx);
         }
         break;
+
+    case HTTP_COL_RESPONSE_CONTENT_LENGTH:
+        iMeta = HTTP_META_CONTENT_LENGTH;
+        if (resp->aMetaOffset[iMeta] != 0) {
+            sqlite3_int64 szContent = http_parse_content_length(
+                resp->zHeaders + resp->aMetaOffset[iMeta] - 1, resp->aMetaSize[iMeta]);
+            if (szContent >= 0) {
+                sqlite3_result_int64(ctx, szContent);
+            }
+        }
+        break;
+
+    case HTTP_COL_RESPONSE_CONTENT_TYPE:
+    case HTTP_COL_RESPONSE_ETAG:
+    case HTTP_COL_RESPONSE_LAST_MODIFIED:
+    case HTTP_COL_RESPONSE_CONTENT_ENCODING:
+        iMeta = HTTP_META_CONTENT_TYPE + iColumn - HTTP_COL_RESPONSE_CONTENT_TYPE;
+        if (resp->aMetaOffset[iMeta] != 0) {
+            sqlite3_result_text(ctx,
+                                resp->zHeaders + resp->aMetaOffset[iMeta] - 1,
+                                resp->aMetaSize[iMeta],
+                                SQLITE_TRANSIENT);
+        }
+        break;
+
+    case HTTP_COL_TRANSFER_DNS:
+        httpResultTransfer(ctx, resp, resp->usDns);
+        break;
+
+    case HTTP_COL_TRANSFER_CONNECT:
+        httpResultTransfer(ctx, resp, resp->usConnect);
+        break;
+
+    case HTTP_COL_TRANSFER_TLS:
+        httpResultTransfer(ctx, resp, resp->usTls);
+        break;
+
+    case HTTP_COL_TRANSFER_FIRST_BYTE:
+        httpResultTransfer(ctx, resp, resp->usFirstByte);
+        break;
+
+    case HTTP_COL_TRANSFER_TOTAL:
+        httpResultTransfer(ctx, resp, resp->usTotal);
+        break;
+
+    case HTTP_COL_TRANSFER_BYTES_SENT:
+        httpResultTransfer(ctx, resp, resp->szUpload);
+        break;
+
+    case HTTP_COL_TRANSFER_BYTES_RECEIVED:
+        httpResultTransfer(ctx, resp, resp->szDownload);
+        break;
+
+    case HTTP_COL_TRANSFER_NEW_CONNECTIONS:
+        httpResultTransfer(ctx, resp, resp->nNewConnections);
+        break;
+
+    case HTTP_COL_TRANSFER_REDIRECTS:
+        httpResultTransfer(ctx, resp, resp->nRedirects);
+        break;
+
+    case HTTP_COL_TRANSFER_EFFECTIVE_URL:
+        if (resp->bTransfer) {
+            sqlite3_result_text(
+                ctx, resp->zEffectiveUrl ? resp->zEffectiveUrl : req->zUrl, -1, SQLITE_TRANSIENT);
+        }
+        break;
+
+    case HTTP_COL_TRANSFER_HTTP_VERSION:
+        if (resp->bTransfer && resp->iHttpVersion > 0) {
+            sqlite3_result_text(ctx,
+                                resp->iHttpVersion == 10   ? "1.0"
+                                : resp->iHttpVersion == 11 ? "1.1"
+                                : resp->iHttpVersion == 20 ? "2"
+                                                           : "3",
+                                -1,
+                                SQLITE_STATIC);
+        }
+        break;
     }
 
     return SQLITE_OK;
@@ -187,13 +614,88 @@ static int httpRowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
 
 static int httpEof(sqlite3_vtab_cursor* cur) {
     http_cursor* pCur = (http_cursor*)cur;
-    return pCur->iRowid >= 1;
+    return pCur->pCurrent == NULL;
 }
 
 #define HTTP_FLAG_METHOD 1
 #define HTTP_FLAG_URL 2
 #define HTTP_FLAG_HEADERS 4
 #define HTTP_FLAG_BODY 8
+#define HTTP_FLAG_URL_IN 16
+#define HTTP_FLAG_NO_BODY 32
+#define HTTP_FLAG_NO_HEADERS 64
+
+// Maximum number of concurrent requests for a request_url IN (...) list.
+#define HTTP_IN_CONCURRENCY 16
+
+static int compare_strings(const void* a, const void* b) {
+    return strcmp(*(const char**)a, *(const char**)b);
+}
+
+// Collect the distinct URLs of an IN (...) list into the cursor.
+static int httpLoadUrlList(http_cursor* pCur, sqlite3_value* pList) {
+    char** azUrl = NULL;
+    int nUrl = 0;
+    int nAlloc = 0;
+    sqlite3_value* pValue;
+    int rc;
+    int i;
+
+    for (rc = sqlite3_vtab_in_first(pList, &pValue); rc == SQLITE_OK && pValue;
+         rc = sqlite3_vtab_in_next(pList, &pValue)) {
+        if (sqlite3_value_type(pValue) == SQLITE_NULL) {
+            continue;
+        }
+        if (nUrl == nAlloc) {
+            char** azNew;
+            nAlloc = nAlloc ? nAlloc * 2 : 16;
+            azNew = sqlite3_realloc(azUrl, sizeof(*azNew) * nAlloc);
+            if (!azNew) {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            azUrl = azNew;
+        }
+        azUrl[nUrl] = sqlite3_mprintf("%s", sqlite3_value_text(pValue));
+        if (!azUrl[nUrl]) {
+            rc = SQLITE_NOMEM;
+            break;
+        }
+        nUrl++;
+    }
+
+    if (rc == SQLITE_DONE) {
+        rc = SQLITE_OK;
+    }
+
+    if (rc == SQLITE_OK && nUrl > 0) {
+        pCur->aItem = sqlite3_malloc(sizeof(*pCur->aItem) * nUrl);
+        if (!pCur->aItem) {
+            rc = SQLITE_NOMEM;
+        }
+    }
+
+    if (rc == SQLITE_OK) {
+        qsort(azUrl, nUrl, sizeof(*azUrl), compare_strings);
+        for (i = 0; i < nUrl; ++i) {
+            if (pCur->nItem > 0 && strcmp(pCur->aItem[pCur->nItem - 1].req.zUrl, azUrl[i]) == 0) {
+                sqlite3_free(azUrl[i]);
+                continue;
+            }
+            memset(&pCur->aItem[pCur->nItem], 0, sizeof(pCur->aItem[0]));
+            pCur->aItem[pCur->nItem].req.zUrl = azUrl[i];
+            pCur->nItem++;
+        }
+    } else {
+        for (i = 0; i < nUrl; ++i) {
+            sqlite3_free(azUrl[i]);
+        }
+    }
+
+    sqlite3_free(azUrl);
+
+    return rc;
+}
 
 static int httpFilter(sqlite3_vtab_cursor* pVtabCursor,
                       int idxNum,
@@ -202,35 +704,107 @@ static int httpFilter(sqlite3_vtab_cursor* pVtabCursor,
                       sqlite3_value** argv) {
     http_cursor* pCur = (http_cursor*)pVtabCursor;
     http_vtab* pVtab = (http_vtab*)pVtabCursor->pVtab;
-    int bIsDo = pVtab->zMethod == NULL;
+    sqlite3_value* pUrl;
     char* zErrMsg = NULL;
-    int rc;
-    if (bIsDo) {
-        pCur->req.zMethod = sqlite3_mprintf("%s", sqlite3_value_text(argv[0]));
-        pCur->req.zUrl = sqlite3_mprintf("%s", sqlite3_value_text(argv[1]));
-        if (idxNum & HTTP_FLAG_HEADERS) {
-            pCur->req.zHeaders = sqlite3_mprintf("%s", sqlite3_value_text(argv[2]));
+    int iArg = 0;
+    int rc = SQLITE_OK;
+    int i;
+
+    httpReset(pCur);
+
+    if (idxNum & HTTP_FLAG_METHOD) {
+        pCur->req.zMethod = sqlite3_mprintf("%s", sqlite3_value_text(argv[iArg++]));
+    } else {
+        pCur->req.zMethod = sqlite3_mprintf("%s", pVtab->zMethod);
+    }
+    pUrl = argv[iArg++];
+    if (idxNum & HTTP_FLAG_HEADERS) {
+        pCur->req.zHeaders = sqlite3_mprintf("%s", sqlite3_value_text(argv[iArg++]));
+    }
+    if (idxNum & HTTP_FLAG_BODY) {
+        // The body must outlive this call when requests run in a batch.
+        pCur->req.szBody = sqlite3_value_bytes(argv[iArg]);
+        pCur->req.pBody = sqlite3_malloc64(pCur->req.szBody + 1);
+        if (pCur->req.pBody) {
+            memcpy((void*)pCur->req.pBody, sqlite3_value_blob(argv[iArg]), pCur->req.szBody);
         }
-        if (idxNum & HTTP_FLAG_BODY) {
-            pCur->req.szBody = sqlite3_value_bytes(argv[3]);
-            pCur->req.pBody = sqlite3_value_blob(argv[3]);
+        iArg++;
+    }
+
+    if (!pCur->req.zMethod || ((idxNum & HTTP_FLAG_BODY) && !pCur->req.pBody)) {
+        return SQLITE_NOMEM;
+    }
+
+    if (idxNum & HTTP_FLAG_NO_BODY) {
+        pCur->req.flags |= HTTP_REQUEST_NO_BODY;
+    }
+    if (idxNum & HTTP_FLAG_NO_HEADERS) {
+        pCur->req.flags |= HTTP_REQUEST_NO_HEADERS;
+    }
+    pCur->req.szMaxBody = httpMaxBodySize(pVtab->pExt);
+    pCur->req.zSql = httpRunningSql(pVtab->pExt->db);
+
+    if (idxNum & HTTP_FLAG_URL_IN) {
+        rc = httpLoadUrlList(pCur, pUrl);
+        if (rc != SQLITE_OK) {
+            return rc;
         }
     } else {
-        pCur->req.zUrl = sqlite3_mprintf("%s", sqlite3_value_text(argv[0]));
-        if (idxNum & HTTP_FLAG_HEADERS) {
-            pCur->req.zHeaders = sqlite3_mprintf("%s", sqlite3_value_text(argv[1]));
+        pCur->aItem = sqlite3_malloc(sizeof(*pCur->aItem));
+        if (!pCur->aItem) {
+            return SQLITE_NOMEM;
         }
-        if (idxNum & HTTP_FLAG_BODY) {
-            pCur->req.szBody = sqlite3_value_bytes(argv[2]);
-            pCur->req.pBody = sqlite3_value_blob(argv[2]);
+        memset(pCur->aItem, 0, sizeof(*pCur->aItem));
+        pCur->aItem->req.zUrl = sqlite3_mprintf("%s", sqlite3_value_text(pUrl));
+        pCur->nItem = 1;
+    }
+
+    for (i = 0; i < pCur->nItem; ++i) {
+        http_request* req = &pCur->aItem[i].req;
+        req->zMethod = pCur->req.zMethod;
+        req->zHeaders = pCur->req.zHeaders;
+        req->pBody = pCur->req.pBody;
+        req->szBody = pCur->req.szBody;
+        req->flags = pCur->req.flags;
+        req->szMaxBody = pCur->req.szMaxBody;
+        req->zSql = pCur->req.zSql;
+    }
+
+    if (!(idxNum & HTTP_FLAG_URL_IN)) {
+        rc = http_do_request(pVtab->pExt->pPool, &pCur->aItem->req, &pCur->aItem->resp, &zErrMsg);
+        if (rc != SQLITE_OK) {
+            sqlite3_free(pCur->base.pVtab->zErrMsg);
+            pCur->base.pVtab->zErrMsg = zErrMsg;
+            return rc;
         }
+        pCur->pCurrent = pCur->aItem;
+        pCur->iRowid = 1;
+        return SQLITE_OK;
+    }
+
+    rc = http_batch_open(pVtab->pExt->pPool, HTTP_IN_CONCURRENCY, &pCur->pBatch, &zErrMsg);
+    for (i = 0; i < pCur->nItem && rc == SQLITE_OK; ++i) {
+        http_cursor_item* pItem = &pCur->aItem[i];
+        rc = http_batch_add(pCur->pBatch, &pItem->req, &pItem->resp, pItem);
     }
-    rc = http_do_request(&pCur->req, &pCur->resp, &zErrMsg);
     if (rc != SQLITE_OK) {
         sqlite3_free(pCur->base.pVtab->zErrMsg);
         pCur->base.pVtab->zErrMsg = zErrMsg;
+        return rc;
     }
-    return rc;
+
+    return httpNext(pVtabCursor);
+}
+
+// Ask SQLite to pass the whole right-hand side of an IN constraint at once.
+// sqlite3_vtab_in() only exists since 3.38.0, older versions pass one value
+// at a time as an equality constraint.
+static int httpVtabInAll(sqlite3_index_info* pIdxInfo, int iConstraint) {
+    if (sqlite3_libversion_number() < 3038000 || !sqlite3_vtab_in(pIdxInfo, iConstraint, -1)) {
+        return 0;
+    }
+    sqlite3_vtab_in(pIdxInfo, iConstraint, 1);
+    return 1;
 }
 
 static int httpBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
@@ -238,60 +812,55 @@ static int httpBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
     int bIsDo = pTab->zMethod == NULL;
     int i;
     int idxNum = 0;
+    int aConstraint[HTTP_COL_REQUEST_BODY + 1];
+    int nArg = 0;
     const struct sqlite3_index_constraint* pConstraint;
 
+    for (i = 0; i <= HTTP_COL_REQUEST_BODY; ++i) {
+        aConstraint[i] = -1;
+    }
+
     pConstraint = pIdxInfo->aConstraint;
 
     for (i = 0; i < pIdxInfo->nConstraint; ++i, ++pConstraint) {
-        if (!pIdxInfo->aConstraint[i].usable) {
+        int iColumn = httpColumnIndex(pTab, pConstraint->iColumn);
+        // Constraints on the response are checked by SQLite.
+        if (iColumn < HTTP_COL_REQUEST_METHOD || iColumn > HTTP_COL_REQUEST_BODY) {
+            continue;
+        }
+        if (!pConstraint->usable) {
             return SQLITE_CONSTRAINT;
         }
         if (pConstraint->op != SQLITE_INDEX_CONSTRAINT_EQ) {
             return SQLITE_CONSTRAINT;
         };
-        switch (pConstraint->iColumn) {
+        switch (iColumn) {
         case HTTP_COL_REQUEST_METHOD:
-            if (bIsDo) {
-                idxNum |= HTTP_FLAG_METHOD;
-            } else {
-                idxNum |= HTTP_FLAG_URL;
+            if (!bIsDo) {
+                sqlite3_free(tab->zErrMsg);
+                tab->zErrMsg = sqlite3_mprintf("too many arguments");
+                return SQLITE_ERROR;
             }
-            pIdxInfo->aConstraintUsage[i].argvIndex = 1;
-            pIdxInfo->aConstraintUsage[i].omit = 1;
+            idxNum |= HTTP_FLAG_METHOD;
             break;
 
         case HTTP_COL_REQUEST_URL:
-            if (bIsDo) {
-                idxNum |= HTTP_FLAG_URL;
-            } else {
-                idxNum |= HTTP_FLAG_HEADERS;
+            idxNum |= HTTP_FLAG_URL;
+            // Fetch the whole list at once instead of one request per value.
+            if (httpVtabInAll(pIdxInfo, i)) {
+                idxNum |= HTTP_FLAG_URL_IN;
             }
-            pIdxInfo->aConstraintUsage[i].argvIndex = 2;
-            pIdxInfo->aConstraintUsage[i].omit = 1;
             break;
 
         case HTTP_COL_REQUEST_HEADERS:
-            if (bIsDo) {
-                idxNum |= HTTP_FLAG_HEADERS;
-            } else {
-                idxNum |= HTTP_FLAG_BODY;
-            }
-            pIdxInfo->aConstraintUsage[i].argvIndex = 3;
-            pIdxInfo->aConstraintUsage[i].omit = 1;
+            idxNum |= HTTP_FLAG_HEADERS;
             break;
 
         case HTTP_COL_REQUEST_BODY:
-            if (bIsDo) {
-                idxNum |= HTTP_FLAG_BODY;
-            } else {
-                sqlite3_free(tab->zErrMsg);
-                tab->zErrMsg = sqlite3_mprintf("too many arguments");
-                return SQLITE_ERROR;
-            }
-            pIdxInfo->aConstraintUsage[i].argvIndex = 4;
-            pIdxInfo->aConstraintUsage[i].omit = 1;
+            idxNum |= HTTP_FLAG_BODY;
             break;
         }
+        aConstraint[iColumn] = i;
     }
 
     if (bIsDo && !(idxNum & HTTP_FLAG_METHOD)) {
@@ -306,8 +875,32 @@ static int httpBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
         return SQLITE_ERROR;
     }
 
-    pIdxInfo->estimatedCost = (double)1;
-    pIdxInfo->estimatedRows = 1;
+    // Arguments are passed to xFilter in column order.
+    for (i = HTTP_COL_REQUEST_METHOD; i <= HTTP_COL_REQUEST_BODY; ++i) {
+        if (aConstraint[i] >= 0) {
+            pIdxInfo->aConstraintUsage[aConstraint[i]].argvIndex = ++nArg;
+            pIdxInfo->aConstraintUsage[aConstraint[i]].omit = 1;
+        }
+    }
+
+    // The status line and the values of common headers come with the
+    // headers, so they are skipped only when none of them is read.
+    if (!(pIdxInfo->colUsed & ((sqlite3_uint64)1 << HTTP_COL_RESPONSE_BODY))) {
+        idxNum |= HTTP_FLAG_NO_BODY;
+    }
+    if (!(pIdxInfo->colUsed & (((sqlite3_uint64)1 << HTTP_COL_RESPONSE_STATUS) |
+                               ((sqlite3_uint64)1 << HTTP_COL_RESPONSE_HEADERS) |
+                               ((sqlite3_uint64)0x1f << HTTP_COL_RESPONSE_CONTENT_TYPE)))) {
+        idxNum |= HTTP_FLAG_NO_HEADERS;
+    }
+
+    if (idxNum & HTTP_FLAG_URL_IN) {
+        pIdxInfo->estimatedCost = (double)10;
+        pIdxInfo->estimatedRows = 10;
+    } else {
+        pIdxInfo->estimatedCost = (double)1;
+        pIdxInfo->estimatedRows = 1;
+    }
     pIdxInfo->idxNum = idxNum;
 
     return SQLITE_OK;
@@ -340,183 +933,766 @@ static sqlite3_module httpModule = {
     /* xShadowName */ 0,
 };
 
-static void httpSimpleFunc(sqlite3_context* ctx,
-                           int argc,
-                           sqlite3_value** argv,
-                           const char* zTable,
-                           const char* zColumn,
-                           int bText) {
-    char* zSql;
-    int rc;
-    sqlite3_stmt* pStmt;
-
-    if (argc == 0) {
-        sqlite3_result_error(ctx, "not enough arguments", -1);
-        return;
-    }
+// Default number of concurrent requests for http_get_many.
+#define HTTP_MANY_DEFAULT_CONCURRENCY 16
 
-    if (argc == 1) {
-        zSql = sqlite3_mprintf(
-            "select \"%w\" from \"%w\"(%Q)", zColumn, zTable, sqlite3_value_text(argv[0]));
-    }
+#define HTTP_MANY_COL_REQUEST_INDEX 0
+#define HTTP_MANY_COL_RESPONSE_STATUS 1
+#define HTTP_MANY_COL_RESPONSE_STATUS_CODE 2
+#define HTTP_MANY_COL_RESPONSE_HEADERS 3
+#define HTTP_MANY_COL_RESPONSE_BODY 4
+#define HTTP_MANY_COL_REQUESTS 5
+#define HTTP_MANY_COL_MAX_CONCURRENCY 6
+#define HTTP_MANY_COL_REQUEST_METHOD 7
+#define HTTP_MANY_COL_REQUEST_URL 8
+#define HTTP_MANY_COL_REQUEST_HEADERS 9
+#define HTTP_MANY_COL_REQUEST_BODY 10
+#define HTTP_MANY_COL_RESPONSE_ERROR 11
 
-    if (argc == 2) {
-        zSql = sqlite3_mprintf("select \"%w\" from \"%w\"(%Q, %Q)",
-                               zColumn,
-                               zTable,
-                               sqlite3_value_text(argv[0]),
-                               sqlite3_value_text(argv[1]));
-    }
+typedef struct http_many_vtab http_many_vtab;
+struct http_many_vtab {
+    sqlite3_vtab base;
+    sqlite3* db;
+    http_ext* pExt;
+};
 
-    if (argc == 3) {
-        zSql = sqlite3_mprintf("select \"%w\" from \"%w\"(%Q, %Q, %Q)",
-                               zColumn,
-                               zTable,
-                               sqlite3_value_text(argv[0]),
-                               sqlite3_value_text(argv[1]),
-                               sqlite3_value_text(argv[2]));
-    }
+typedef struct http_many_item http_many_item;
+struct http_many_item {
+    int iIndex;
+    int rc;
+    char* zErrMsg;
+    http_request req;
+    http_response resp;
+};
 
-    if (argc >= 4) {
-        zSql = sqlite3_mprintf("select \"%w\" from \"%w\"(%Q, %Q, %Q, %Q)",
-                               zColumn,
-                               zTable,
-                               sqlite3_value_text(argv[0]),
-                               sqlite3_value_text(argv[1]),
-                               sqlite3_value_text(argv[2]),
-                               sqlite3_value_text(argv[2]));
-    }
+typedef struct http_many_cursor http_many_cursor;
+struct http_many_cursor {
+    sqlite3_vtab_cursor base;
+    sqlite3_int64 iRowid;
+    http_batch* pBatch;
+    http_many_item* aItem;
+    int nItem;
+    http_many_item* pCurrent;
+};
 
-    if (zSql == 0) {
-        sqlite3_result_error_code(ctx, SQLITE_NOMEM);
-        return;
-    }
+static void http_many_item_clear(http_many_item* pItem) {
+    sqlite3_free(pItem->zErrMsg);
+    sqlite3_free(pItem->req.zMethod);
+    sqlite3_free(pItem->req.zUrl);
+    sqlite3_free((void*)pItem->req.zHeaders);
+    sqlite3_free((void*)pItem->req.pBody);
+    http_body_unref(pItem->resp.pBody);
+    sqlite3_free(pItem->resp.zHeaders);
+    sqlite3_free(pItem->resp.zStatus);
+    sqlite3_free(pItem->resp.zEffectiveUrl);
+    memset(pItem, 0, sizeof(*pItem));
+}
 
-    rc = sqlite3_prepare_v2(sqlite3_context_db_handle(ctx), zSql, -1, &pStmt, 0);
+static int httpManyConnect(sqlite3* db,
+                           void* pAux,
+                           int argc,
+                           const char* const* argv,
+                           sqlite3_vtab** ppVtab,
+                           char** pzErr) {
+    http_many_vtab* pNew;
+    int rc;
 
-    sqlite3_free(zSql);
+    rc = sqlite3_declare_vtab(db,
+                              "CREATE TABLE x(request_index INT, response_status TEXT, "
+                              "response_status_code INT, response_headers TEXT, "
+                              "response_body BLOB, requests TEXT HIDDEN, "
+                              "max_concurrency INT HIDDEN, request_method TEXT HIDDEN, "
+                              "request_url TEXT HIDDEN, request_headers TEXT HIDDEN, "
+                              "request_body BLOB HIDDEN, response_error TEXT HIDDEN)");
 
-    if (rc != SQLITE_OK) {
-        sqlite3_result_error_code(ctx, rc);
-        return;
+    if (rc == SQLITE_OK) {
+        pNew = sqlite3_malloc(sizeof(*pNew));
+        *ppVtab = (sqlite3_vtab*)pNew;
+        if (pNew == 0)
+            return SQLITE_NOMEM;
+        memset(pNew, 0, sizeof(*pNew));
+        pNew->db = db;
+        pNew->pExt = (http_ext*)pAux;
     }
+    return rc;
+}
 
-    rc = sqlite3_step(pStmt);
+static int httpManyDisconnect(sqlite3_vtab* pVtab) {
+    sqlite3_free(pVtab);
+    return SQLITE_OK;
+}
 
-    if (rc == SQLITE_ROW) {
-        int size = sqlite3_column_bytes(pStmt, 0);
-        if (bText) {
-            sqlite3_result_text(ctx, sqlite3_column_text(pStmt, 0), size, SQLITE_TRANSIENT);
-        } else {
-            sqlite3_result_blob(ctx, sqlite3_column_blob(pStmt, 0), size, SQLITE_TRANSIENT);
+static int httpManyOpen(sqlite3_vtab* p, sqlite3_vtab_cursor** ppCursor) {
+    http_many_cursor* pCur;
+    pCur = sqlite3_malloc(sizeof(*pCur));
+    if (pCur == 0)
+        return SQLITE_NOMEM;
+    memset(pCur, 0, sizeof(*pCur));
+    *ppCursor = &pCur->base;
+    return SQLITE_OK;
+}
+
+static void httpManyReset(http_many_cursor* pCur) {
+    int i;
+    // Closing the batch cancels whatever is still in flight.
+    http_batch_close(pCur->pBatch);
+    for (i = 0; i < pCur->nItem; ++i) {
+        http_many_item_clear(&pCur->aItem[i]);
+    }
+    sqlite3_free(pCur->aItem);
+    pCur->pBatch = NULL;
+    pCur->aItem = NULL;
+    pCur->nItem = 0;
+    pCur->pCurrent = NULL;
+    pCur->iRowid = 0;
+}
+
+static int httpManyClose(sqlite3_vtab_cursor* cur) {
+    http_many_cursor* pCur = (http_many_cursor*)cur;
+    httpManyReset(pCur);
+    sqlite3_free(pCur);
+    return SQLITE_OK;
+}
+
+// Advance to the next completed request.
+static int httpManyNext(sqlite3_vtab_cursor* cur) {
+    http_many_cursor* pCur = (http_many_cursor*)cur;
+    void* pArg = NULL;
+    int rcItem = SQLITE_OK;
+    char* zErrMsg = NULL;
+    int rc;
+
+    // Responses are released as soon as the row has been consumed.
+    if (pCur->pCurrent) {
+        http_many_item_clear(pCur->pCurrent);
+        pCur->pCurrent = NULL;
+    }
+
+    rc = http_batch_next(pCur->pBatch, &pArg, &rcItem, &zErrMsg);
+    if (rc == SQLITE_DONE) {
+        return SQLITE_OK;
+    }
+    if (rc != SQLITE_ROW) {
+        sqlite3_free(cur->pVtab->zErrMsg);
+        cur->pVtab->zErrMsg = zErrMsg;
+        return rc;
+    }
+
+    pCur->pCurrent = (http_many_item*)pArg;
+    pCur->pCurrent->rc = rcItem;
+    pCur->pCurrent->zErrMsg = zErrMsg;
+    if (rcItem != SQLITE_OK && !zErrMsg) {
+        pCur->pCurrent->zErrMsg = sqlite3_mprintf("%s", sqlite3_errstr(rcItem));
+    }
+    pCur->iRowid++;
+
+    return SQLITE_OK;
+}
+
+static int httpManyColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
+    http_many_cursor* pCur = (http_many_cursor*)cur;
+    http_many_item* pItem = pCur->pCurrent;
+    int bOk = pItem->rc == SQLITE_OK;
+
+    switch (i) {
+    case HTTP_MANY_COL_REQUEST_INDEX:
+        sqlite3_result_int(ctx, pItem->iIndex);
+        break;
+
+    case HTTP_MANY_COL_RESPONSE_STATUS:
+        if (bOk) {
+            sqlite3_result_text(ctx, pItem->resp.zStatus, -1, SQLITE_TRANSIENT);
         }
-        sqlite3_finalize(pStmt);
-        return;
+        break;
+
+    case HTTP_MANY_COL_RESPONSE_STATUS_CODE:
+        if (bOk) {
+            sqlite3_result_int(ctx, pItem->resp.iStatusCode);
+        }
+        break;
+
+    case HTTP_MANY_COL_RESPONSE_HEADERS:
+        if (bOk) {
+            sqlite3_result_text(ctx, pItem->resp.zHeaders, -1, SQLITE_TRANSIENT);
+        }
+        break;
+
+    case HTTP_MANY_COL_RESPONSE_BODY:
+        if (bOk) {
+            sqlite3_result_blob64(
+                ctx, http_body_ref(pItem->resp.pBody), pItem->resp.szBody, http_body_unref);
+        }
+        break;
+
+    case HTTP_MANY_COL_REQUEST_METHOD:
+        sqlite3_result_text(ctx, pItem->req.zMethod, -1, SQLITE_TRANSIENT);
+        break;
+
+    case HTTP_MANY_COL_REQUEST_URL:
+        sqlite3_result_text(ctx, pItem->req.zUrl, -1, SQLITE_TRANSIENT);
+        break;
+
+    case HTTP_MANY_COL_REQUEST_HEADERS:
+        if (pItem->req.zHeaders) {
+            sqlite3_result_text(ctx, pItem->req.zHeaders, -1, SQLITE_TRANSIENT);
+        }
+        break;
+
+    case HTTP_MANY_COL_REQUEST_BODY:
+        if (pItem->req.pBody) {
+            sqlite3_result_blob(ctx, pItem->req.pBody, pItem->req.szBody, SQLITE_TRANSIENT);
+        }
+        break;
+
+    case HTTP_MANY_COL_RESPONSE_ERROR:
+        if (pItem->zErrMsg) {
+            sqlite3_result_text(ctx, pItem->zErrMsg, -1, SQLITE_TRANSIENT);
+        }
+        break;
+    }
+
+    return SQLITE_OK;
+}
+
+static int httpManyRowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
+    http_many_cursor* pCur = (http_many_cursor*)cur;
+    *pRowid = pCur->iRowid;
+    return SQLITE_OK;
+}
+
+static int httpManyEof(sqlite3_vtab_cursor* cur) {
+    http_many_cursor* pCur = (http_many_cursor*)cur;
+    return pCur->pCurrent == NULL;
+}
+
+static char* dup_value_text(sqlite3_value* pValue) {
+    if (sqlite3_value_type(pValue) == SQLITE_NULL) {
+        return NULL;
     }
+    return sqlite3_mprintf("%s", sqlite3_value_text(pValue));
+}
+
+// Each element of the requests array is either a URL or an object with url,
+// method, headers and body fields.
+static int httpManyLoadRequests(http_many_cursor* pCur, sqlite3* db, sqlite3_value* pRequests) {
+    static const char zSql[] =
+        "SELECT key, CASE type WHEN 'object' THEN json_extract(value, '$.url') ELSE value END, "
+        "CASE type WHEN 'object' THEN json_extract(value, '$.method') END, "
+        "CASE type WHEN 'object' THEN json_extract(value, '$.headers') END, "
+        "CASE type WHEN 'object' THEN json_extract(value, '$.body') END "
+        "FROM json_each(?)";
+    sqlite3_stmt* pStmt;
+    int nAlloc = 0;
+    int rc;
 
-    rc = sqlite3_finalize(pStmt);
+    rc = sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0);
     if (rc != SQLITE_OK) {
-        sqlite3_result_error_code(ctx, rc);
+        return rc;
+    }
+
+    sqlite3_bind_value(pStmt, 1, pRequests);
+
+    while ((rc = sqlite3_step(pStmt)) == SQLITE_ROW) {
+        http_many_item* pItem;
+        if (pCur->nItem == nAlloc) {
+            http_many_item* aItem;
+            nAlloc = nAlloc ? nAlloc * 2 : 16;
+            aItem = sqlite3_realloc(pCur->aItem, sizeof(*aItem) * nAlloc);
+            if (!aItem) {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            pCur->aItem = aItem;
+        }
+        pItem = &pCur->aItem[pCur->nItem++];
+        memset(pItem, 0, sizeof(*pItem));
+        pItem->iIndex = sqlite3_column_int(pStmt, 0);
+        pItem->req.zUrl = dup_value_text(sqlite3_column_value(pStmt, 1));
+        pItem->req.zMethod = dup_value_text(sqlite3_column_value(pStmt, 2));
+        if (!pItem->req.zMethod) {
+            pItem->req.zMethod = sqlite3_mprintf("GET");
+        }
+        pItem->req.zHeaders = dup_value_text(sqlite3_column_value(pStmt, 3));
+        if (sqlite3_column_type(pStmt, 4) != SQLITE_NULL) {
+            pItem->req.szBody = sqlite3_column_bytes(pStmt, 4);
+            pItem->req.pBody = sqlite3_malloc64(pItem->req.szBody + 1);
+            if (pItem->req.pBody) {
+                memcpy((void*)pItem->req.pBody, sqlite3_column_blob(pStmt, 4), pItem->req.szBody);
+            }
+        }
+        if (!pItem->req.zUrl) {
+            rc = SQLITE_ERROR;
+            break;
+        }
     }
+
+    sqlite3_finalize(pStmt);
+
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
 }
 
-static void httpGetBodyFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    httpSimpleFunc(ctx, argc, argv, "http_get", "response_body", 0);
+static int httpManyFilter(sqlite3_vtab_cursor* pVtabCursor,
+                          int idxNum,
+                          const char* idxStr,
+                          int argc,
+                          sqlite3_value** argv) {
+    http_many_cursor* pCur = (http_many_cursor*)pVtabCursor;
+    http_many_vtab* pVtab = (http_many_vtab*)pVtabCursor->pVtab;
+    int nConcurrency = HTTP_MANY_DEFAULT_CONCURRENCY;
+    const char* zSql;
+    char* zErrMsg = NULL;
+    int rc;
+    int i;
+
+    httpManyReset(pCur);
+
+    if (argc > 1 && sqlite3_value_type(argv[1]) != SQLITE_NULL) {
+        nConcurrency = sqlite3_value_int(argv[1]);
+    }
+
+    rc = httpManyLoadRequests(pCur, pVtab->db, argv[0]);
+    if (rc == SQLITE_NOMEM) {
+        return rc;
+    }
+    if (rc != SQLITE_OK) {
+        sqlite3_free(pVtab->base.zErrMsg);
+        pVtab->base.zErrMsg = sqlite3_mprintf("http_get_many: invalid requests");
+        return rc;
+    }
+
+    zSql = httpRunningSql(pVtab->db);
+    rc = http_batch_open(pVtab->pExt->pPool, nConcurrency, &pCur->pBatch, &zErrMsg);
+    for (i = 0; i < pCur->nItem && rc == SQLITE_OK; ++i) {
+        http_many_item* pItem = &pCur->aItem[i];
+        pItem->req.flags = idxNum;
+        pItem->req.szMaxBody = httpMaxBodySize(pVtab->pExt);
+        pItem->req.zSql = zSql;
+        rc = http_batch_add(pCur->pBatch, &pItem->req, &pItem->resp, pItem);
+    }
+    if (rc != SQLITE_OK) {
+        sqlite3_free(pVtab->base.zErrMsg);
+        pVtab->base.zErrMsg = zErrMsg;
+        return rc;
+    }
+
+    return httpManyNext(pVtabCursor);
 }
 
-static void httpPostBodyFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    httpSimpleFunc(ctx, argc, argv, "http_post", "response_body", 0);
+static int httpManyBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
+    int bRequestsSeen = 0;
+    int i;
+
+    for (i = 0; i < pIdxInfo->nConstraint; ++i) {
+        int iColumn = pIdxInfo->aConstraint[i].iColumn;
+        if (iColumn != HTTP_MANY_COL_REQUESTS && iColumn != HTTP_MANY_COL_MAX_CONCURRENCY) {
+            continue;
+        }
+        if (!pIdxInfo->aConstraint[i].usable) {
+            return SQLITE_CONSTRAINT;
+        }
+        if (pIdxInfo->aConstraint[i].op != SQLITE_INDEX_CONSTRAINT_EQ) {
+            return SQLITE_CONSTRAINT;
+        }
+        if (iColumn == HTTP_MANY_COL_REQUESTS) {
+            pIdxInfo->aConstraintUsage[i].argvIndex = 1;
+            bRequestsSeen = 1;
+        } else {
+            pIdxInfo->aConstraintUsage[i].argvIndex = 2;
+        }
+        pIdxInfo->aConstraintUsage[i].omit = 1;
+    }
+
+    if (!bRequestsSeen) {
+        sqlite3_free(tab->zErrMsg);
+        tab->zErrMsg = sqlite3_mprintf("requests missing");
+        return SQLITE_ERROR;
+    }
+
+    // idxNum holds the HTTP_REQUEST_* flags for the parts the query doesn't read.
+    if (!(pIdxInfo->colUsed & ((sqlite3_uint64)1 << HTTP_MANY_COL_RESPONSE_BODY))) {
+        pIdxInfo->idxNum |= HTTP_REQUEST_NO_BODY;
+    }
+    if (!(pIdxInfo->colUsed & (((sqlite3_uint64)1 << HTTP_MANY_COL_RESPONSE_STATUS) |
+                               ((sqlite3_uint64)1 << HTTP_MANY_COL_RESPONSE_HEADERS)))) {
+        pIdxInfo->idxNum |= HTTP_REQUEST_NO_HEADERS;
+    }
+
+    pIdxInfo->estimatedCost = (double)100;
+    pIdxInfo->estimatedRows = 100;
+
+    return SQLITE_OK;
 }
 
-static void httpDoBodyFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    httpSimpleFunc(ctx, argc, argv, "http_do", "response_body", 0);
+static sqlite3_module httpManyModule = {
+    /* iVersion    */ 0,
+    /* xCreate     */ 0,
+    /* xConnect    */ httpManyConnect,
+    /* xBestIndex  */ httpManyBestIndex,
+    /* xDisconnect */ httpManyDisconnect,
+    /* xDestroy    */ 0,
+    /* xOpen       */ httpManyOpen,
+    /* xClose      */ httpManyClose,
+    /* xFilter     */ httpManyFilter,
+    /* xNext       */ httpManyNext,
+    /* xEof        */ httpManyEof,
+    /* xColumn     */ httpManyColumn,
+    /* xRowid      */ httpManyRowid,
+    /* xUpdate     */ 0,
+    /* xBegin      */ 0,
+    /* xSync       */ 0,
+    /* xCommit     */ 0,
+    /* xRollback   */ 0,
+    /* xFindMethod */ 0,
+    /* xRename     */ 0,
+    /* xSavepoint  */ 0,
+    /* xRelease    */ 0,
+    /* xRollbackTo */ 0,
+    /* xShadowName */ 0,
+};
+
+// Responses returned by the http_*_response functions are packed into a single
+// blob: a fixed size header followed by the status line, headers and body. All
+// integers are stored big-endian.
+//
+//   0  magic "HRSP"
+//   4  status code
+//   8  status line size
+//  12  headers size
+//  16  body size
+//  20  status line, headers, body
+#define HTTP_RESPONSE_MAGIC "HRSP"
+#define HTTP_RESPONSE_HEADER_SIZE 20
+
+typedef struct http_response_view http_response_view;
+struct http_response_view {
+    int iStatusCode;
+    const char* zStatus;
+    int szStatus;
+    const char* zHeaders;
+    int szHeaders;
+    const unsigned char* pBody;
+    int szBody;
+};
+
+static void put_u32(unsigned char* p, unsigned int v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
 }
 
-static void httpGetHeadersFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    httpSimpleFunc(ctx, argc, argv, "http_get", "response_headers", 1);
+static unsigned int get_u32(const unsigned char* p) {
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) |
+           (unsigned int)p[3];
 }
 
-static void httpPostHeadersFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    httpSimpleFunc(ctx, argc, argv, "http_post", "response_headers", 1);
+static unsigned char* httpResponsePack(const http_response* resp, sqlite3_int64* pnBlob) {
+    unsigned int szStatus = resp->zStatus ? strlen(resp->zStatus) : 0;
+    unsigned int szHeaders = resp->zHeaders ? strlen(resp->zHeaders) : 0;
+    unsigned int szBody = resp->pBody ? (unsigned int)resp->szBody : 0;
+    sqlite3_int64 nBlob = HTTP_RESPONSE_HEADER_SIZE + (sqlite3_int64)szStatus + szHeaders + szBody;
+    unsigned char* pBlob;
+    unsigned char* p;
+
+    pBlob = sqlite3_malloc64(nBlob);
+    if (!pBlob) {
+        return NULL;
+    }
+
+    memcpy(pBlob, HTTP_RESPONSE_MAGIC, 4);
+    put_u32(pBlob + 4, (unsigned int)resp->iStatusCode);
+    put_u32(pBlob + 8, szStatus);
+    put_u32(pBlob + 12, szHeaders);
+    put_u32(pBlob + 16, szBody);
+    p = pBlob + HTTP_RESPONSE_HEADER_SIZE;
+    if (szStatus) {
+        memcpy(p, resp->zStatus, szStatus);
+        p += szStatus;
+    }
+    if (szHeaders) {
+        memcpy(p, resp->zHeaders, szHeaders);
+        p += szHeaders;
+    }
+    if (szBody) {
+        memcpy(p, resp->pBody, szBody);
+    }
+
+    *pnBlob = nBlob;
+    return pBlob;
 }
 
-static void httpDoHeadersFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    httpSimpleFunc(ctx, argc, argv, "http_do", "response_headers", 1);
+// Point pView into a response blob. Returns SQLITE_ERROR if the value is not
+// a response.
+static int httpResponseUnpack(sqlite3_value* pValue, http_response_view* pView) {
+    const unsigned char* pBlob;
+    sqlite3_int64 nBlob;
+
+    if (sqlite3_value_type(pValue) != SQLITE_BLOB) {
+        return SQLITE_ERROR;
+    }
+    pBlob = sqlite3_value_blob(pValue);
+    nBlob = sqlite3_value_bytes(pValue);
+    if (nBlob < HTTP_RESPONSE_HEADER_SIZE || memcmp(pBlob, HTTP_RESPONSE_MAGIC, 4) != 0) {
+        return SQLITE_ERROR;
+    }
+
+    pView->iStatusCode = (int)get_u32(pBlob + 4);
+    pView->szStatus = (int)get_u32(pBlob + 8);
+    pView->szHeaders = (int)get_u32(pBlob + 12);
+    pView->szBody = (int)get_u32(pBlob + 16);
+    if (pView->szStatus < 0 || pView->szHeaders < 0 || pView->szBody < 0 ||
+        nBlob != HTTP_RESPONSE_HEADER_SIZE + (sqlite3_int64)pView->szStatus + pView->szHeaders +
+                     pView->szBody) {
+        return SQLITE_ERROR;
+    }
+    pView->zStatus = (const char*)pBlob + HTTP_RESPONSE_HEADER_SIZE;
+    pView->zHeaders = pView->zStatus + pView->szStatus;
+    pView->pBody = (const unsigned char*)pView->zHeaders + pView->szHeaders;
+
+    return SQLITE_OK;
 }
 
-static void httpHeadersFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    char* zHeaders = NULL;
-    int i;
-    int size = 0;
-    int offset = 0;
-    if (argc < 2) {
-        sqlite3_result_error(ctx, "http_headers: expected at least 2 arguments", -1);
+#define HTTP_RESULT_BODY 0
+#define HTTP_RESULT_HEADERS 1
+#define HTTP_RESULT_RESPONSE 2
+
+// Run the request directly, without going through the http_get/http_post/
+// http_do tables. The arguments are the same as for the tables: url, headers
+// and body for http_get and http_post, method first for http_do.
+static void httpSimpleFunc(sqlite3_context* ctx,
+                           int argc,
+                           sqlite3_value** argv,
+                           const char* zMethod,
+                           int eResult) {
+    http_ext* pExt = (http_ext*)sqlite3_user_data(ctx);
+    http_request req;
+    http_response resp;
+    char* zErrMsg = NULL;
+    int nMaxArgs = zMethod ? 3 : 4;
+    int iArg = 0;
+    int rc;
+
+    if (argc == 0) {
+        sqlite3_result_error(ctx, "not enough arguments", -1);
         return;
     }
-    if (argc % 2 != 0) {
-        sqlite3_result_error(ctx, "http_headers: even number of arguments expected", -1);
+
+    if (argc > nMaxArgs) {
+        sqlite3_result_error(ctx, "too many arguments", -1);
         return;
     }
-    for (i = 0; i < argc; i += 2) {
-        size += sqlite3_value_bytes(argv[i]) + 2;
-        size += sqlite3_value_bytes(argv[i + 1]) + 2;
+
+    memset(&req, 0, sizeof(req));
+    memset(&resp, 0, sizeof(resp));
+
+    req.zMethod = zMethod ? (char*)zMethod : (char*)sqlite3_value_text(argv[iArg++]);
+    if (!req.zMethod) {
+        sqlite3_result_error(ctx, "method missing", -1);
+        return;
     }
-    zHeaders = sqlite3_malloc(size);
-    if (!zHeaders) {
-        sqlite3_result_error_code(ctx, SQLITE_NOMEM);
+
+    req.zUrl = iArg < argc ? (char*)sqlite3_value_text(argv[iArg]) : NULL;
+    iArg++;
+    if (!req.zUrl) {
+        sqlite3_result_error(ctx, "url missing", -1);
         return;
     }
-    for (i = 0; i < argc; i += 2) {
-        memcpy(zHeaders + offset, sqlite3_value_text(argv[i]), sqlite3_value_bytes(argv[i]));
-        offset += sqlite3_value_bytes(argv[i]);
 
-        memcpy(zHeaders + offset, ": ", 2);
-        offset += 2;
+    if (iArg < argc) {
+        req.zHeaders = (const char*)sqlite3_value_text(argv[iArg]);
+    }
+    iArg++;
 
-        memcpy(
-            zHeaders + offset, sqlite3_value_text(argv[i + 1]), sqlite3_value_bytes(argv[i + 1]));
-        offset += sqlite3_value_bytes(argv[i + 1]);
+    // Bodies are passed as is, so binary data survives the round trip.
+    if (iArg < argc && sqlite3_value_type(argv[iArg]) != SQLITE_NULL) {
+        req.pBody = sqlite3_value_blob(argv[iArg]);
+        req.szBody = sqlite3_value_bytes(argv[iArg]);
+        if (!req.pBody) {
+            req.pBody = "";
+        }
+    }
 
-        memcpy(zHeaders + offset, "\r\n", 2);
-        offset += 2;
+    req.szMaxBody = httpMaxBodySize(pExt);
+    req.zSql = httpRunningSql(sqlite3_context_db_handle(ctx));
+    if (eResult == HTTP_RESULT_BODY) {
+        req.flags |= HTTP_REQUEST_NO_HEADERS;
+    } else if (eResult == HTTP_RESULT_HEADERS) {
+        req.flags |= HTTP_REQUEST_NO_BODY;
     }
-    assert(offset == size);
-    sqlite3_result_text(ctx, zHeaders, size, sqlite3_free);
-}
 
-static void httpHeadersHasFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    int zHeadersSize = sqlite3_value_bytes(argv[0]);
-    const char* zHeaders = sqlite3_value_text(argv[0]);
-    int zHeaderSize = sqlite3_value_bytes(argv[1]);
-    const char* zHeader = sqlite3_value_text(argv[1]);
-    while (zHeadersSize > 0) {
-        int iParsed = 0;
-        const char* pName;
-        int iNameSize;
-        int rc = http_next_header(zHeaders, zHeadersSize, &iParsed, &pName, &iNameSize, NULL, NULL);
-        if (rc == SQLITE_ERROR) {
-            sqlite3_result_error(ctx, "http_headers_has: malformed headers", -1);
-            return;
-        }
-        if (rc == SQLITE_DONE) {
-            sqlite3_result_int(ctx, 0);
-            return;
+    rc = http_do_request(pExt->pPool, &req, &resp, &zErrMsg);
+    if (rc != SQLITE_OK) {
+        if (zErrMsg) {
+            sqlite3_result_error(ctx, zErrMsg, -1);
+            sqlite3_free(zErrMsg);
+        } else {
+            sqlite3_result_error_code(ctx, rc);
         }
-        zHeaders += iParsed;
-        zHeadersSize -= iParsed;
-        if (iNameSize == zHeaderSize && sqlite3_strnicmp(zHeader, pName, zHeaderSize) == 0) {
-            sqlite3_result_int(ctx, 1);
-            return;
+        goto done;
+    }
+
+    // Hand the response buffers over to SQLite instead of copying them.
+    switch (eResult) {
+    case HTTP_RESULT_BODY:
+        sqlite3_result_blob64(ctx, resp.pBody, resp.szBody, http_body_unref);
+        resp.pBody = NULL;
+        break;
+
+    case HTTP_RESULT_HEADERS:
+        sqlite3_result_text(ctx, resp.zHeaders, -1, sqlite3_free);
+        resp.zHeaders = NULL;
+        break;
+
+    case HTTP_RESULT_RESPONSE: {
+        sqlite3_int64 nBlob;
+        unsigned char* pBlob = httpResponsePack(&resp, &nBlob);
+        if (pBlob) {
+            sqlite3_result_blob64(ctx, pBlob, nBlob, sqlite3_free);
+        } else {
+            sqlite3_result_error_nomem(ctx);
         }
+        break;
+    }
     }
-    sqlite3_result_int(ctx, 0);
-}
 
-static void httpHeadersGetFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
-    int zHeadersSize = sqlite3_value_bytes(argv[0]);
-    const char* zHeaders = sqlite3_value_text(argv[0]);
-    int zHeaderSize = sqlite3_value_bytes(argv[1]);
-    const char* zHeader = sqlite3_value_text(argv[1]);
+done:
+
+    http_body_unref(resp.pBody);
+    sqlite3_free(resp.zHeaders);
+    sqlite3_free(resp.zStatus);
+    sqlite3_free(resp.zEffectiveUrl);
+}
+
+static void httpGetBodyFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpSimpleFunc(ctx, argc, argv, "GET", HTTP_RESULT_BODY);
+}
+
+static void httpPostBodyFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpSimpleFunc(ctx, argc, argv, "POST", HTTP_RESULT_BODY);
+}
+
+static void httpDoBodyFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpSimpleFunc(ctx, argc, argv, NULL, HTTP_RESULT_BODY);
+}
+
+static void httpGetHeadersFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpSimpleFunc(ctx, argc, argv, "GET", HTTP_RESULT_HEADERS);
+}
+
+static void httpPostHeadersFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpSimpleFunc(ctx, argc, argv, "POST", HTTP_RESULT_HEADERS);
+}
+
+static void httpDoHeadersFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpSimpleFunc(ctx, argc, argv, NULL, HTTP_RESULT_HEADERS);
+}
+
+static void httpGetResponseFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpSimpleFunc(ctx, argc, argv, "GET", HTTP_RESULT_RESPONSE);
+}
+
+static void httpPostResponseFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpSimpleFunc(ctx, argc, argv, "POST", HTTP_RESULT_RESPONSE);
+}
+
+static void httpDoResponseFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpSimpleFunc(ctx, argc, argv, NULL, HTTP_RESULT_RESPONSE);
+}
+
+#define HTTP_RESPONSE_FIELD_STATUS 0
+#define HTTP_RESPONSE_FIELD_STATUS_CODE 1
+#define HTTP_RESPONSE_FIELD_HEADERS 2
+#define HTTP_RESPONSE_FIELD_BODY 3
+
+static void httpResponseFieldFunc(sqlite3_context* ctx,
+                                  int argc,
+                                  sqlite3_value** argv,
+                                  const char* zFunc,
+                                  int eField) {
+    http_response_view view;
+    char* zErrMsg;
+
+    if (argc != 1) {
+        zErrMsg = sqlite3_mprintf("%s: expected 1 argument", zFunc);
+        sqlite3_result_error(ctx, zErrMsg, -1);
+        sqlite3_free(zErrMsg);
+        return;
+    }
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        return;
+    }
+
+    if (httpResponseUnpack(argv[0], &view) != SQLITE_OK) {
+        zErrMsg = sqlite3_mprintf("%s: not a response", zFunc);
+        sqlite3_result_error(ctx, zErrMsg, -1);
+        sqlite3_free(zErrMsg);
+        return;
+    }
+
+    switch (eField) {
+    case HTTP_RESPONSE_FIELD_STATUS:
+        sqlite3_result_text(ctx, view.zStatus, view.szStatus, SQLITE_TRANSIENT);
+        break;
+
+    case HTTP_RESPONSE_FIELD_STATUS_CODE:
+        sqlite3_result_int(ctx, view.iStatusCode);
+        break;
+
+    case HTTP_RESPONSE_FIELD_HEADERS:
+        sqlite3_result_text(ctx, view.zHeaders, view.szHeaders, SQLITE_TRANSIENT);
+        break;
+
+    case HTTP_RESPONSE_FIELD_BODY:
+        sqlite3_result_blob(ctx, view.pBody, view.szBody, SQLITE_TRANSIENT);
+        break;
+    }
+}
+
+static void httpResponseStatusFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpResponseFieldFunc(ctx, argc, argv, "http_response_status", HTTP_RESPONSE_FIELD_STATUS);
+}
+
+static void httpResponseStatusCodeFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpResponseFieldFunc(
+        ctx, argc, argv, "http_response_status_code", HTTP_RESPONSE_FIELD_STATUS_CODE);
+}
+
+static void httpResponseHeadersFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpResponseFieldFunc(ctx, argc, argv, "http_response_headers", HTTP_RESPONSE_FIELD_HEADERS);
+}
+
+static void httpResponseBodyFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    httpResponseFieldFunc(ctx, argc, argv, "http_response_body", HTTP_RESPONSE_FIELD_BODY);
+}
+
+// Return the value of the first header with the given name, or NULL if there
+// is no such header.
+static void httpResponseHeaderFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    http_response_view view;
+    const char* zHeaders;
+    int zHeadersSize;
+    const char* zHeader;
+    int zHeaderSize;
+
+    if (argc != 2) {
+        sqlite3_result_error(ctx, "http_response_header: expected 2 arguments", -1);
+        return;
+    }
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        return;
+    }
+
+    if (httpResponseUnpack(argv[0], &view) != SQLITE_OK) {
+        sqlite3_result_error(ctx, "http_response_header: not a response", -1);
+        return;
+    }
+
+    zHeaders = view.zHeaders;
+    zHeadersSize = view.szHeaders;
+    zHeader = (const char*)sqlite3_value_text(argv[1]);
+    zHeaderSize = sqlite3_value_bytes(argv[1]);
     while (zHeadersSize > 0) {
         int iParsed = 0;
         const char* pName;
@@ -526,58 +1702,1903 @@ static void httpHeadersGetFunc(sqlite3_context* ctx, int argc, sqlite3_value** a
         int rc = http_next_header(
             zHeaders, zHeadersSize, &iParsed, &pName, &iNameSize, &pValue, &iValueSize);
         if (rc == SQLITE_ERROR) {
-            sqlite3_result_error(ctx, "http_headers_get: malformed headers", -1);
+            sqlite3_result_error(ctx, "http_response_header: malformed headers", -1);
             return;
         }
         if (rc == SQLITE_DONE) {
-            sqlite3_result_int(ctx, 0);
             return;
         }
         zHeaders += iParsed;
         zHeadersSize -= iParsed;
-        if (iNameSize == zHeaderSize && sqlite3_strnicmp(zHeader, pName, zHeaderSize) == 0) {
+        if (http_header_name_eq(pName, iNameSize, zHeader, zHeaderSize)) {
             sqlite3_result_text(ctx, pValue, iValueSize, SQLITE_TRANSIENT);
             return;
         }
     }
 }
 
-#define HTTP_HEADERS_EACH_COL_NAME 0
-#define HTTP_HEADERS_EACH_COL_VALUE 1
-#define HTTP_HEADERS_EACH_COL_HEADERS 2
+static void httpHeadersFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    char* zHeaders = NULL;
+    int i;
+    int size = 0;
+    int offset = 0;
+    if (argc < 2) {
+        sqlite3_result_error(ctx, "http_headers: expected at least 2 arguments", -1);
+        return;
+    }
+    if (argc % 2 != 0) {
+        sqlite3_result_error(ctx, "http_headers: even number of arguments expected", -1);
+        return;
+    }
+    for (i = 0; i < argc; i += 2) {
+        size += sqlite3_value_bytes(argv[i]) + 2;
+        size += sqlite3_value_bytes(argv[i + 1]) + 2;
+    }
+    zHeaders = sqlite3_malloc(size);
+    if (!zHeaders) {
+        sqlite3_result_error_code(ctx, SQLITE_NOMEM);
+        return;
+    }
+    for (i = 0; i < argc; i += 2) {
+        memcpy(zHeaders + offset, sqlite3_value_text(argv[i]), sqlite3_value_bytes(argv[i]));
+        offset += sqlite3_value_bytes(argv[i]);
+
+        memcpy(zHeaders + offset, ": ", 2);
+        offset += 2;
+
+        memcpy(
+            zHeaders + offset, sqlite3_value_text(argv[i + 1]), sqlite3_value_bytes(argv[i + 1]));
+        offset += sqlite3_value_bytes(argv[i + 1]);
+
+        memcpy(zHeaders + offset, "\r\n", 2);
+        offset += 2;
+    }
+    assert(offset == size);
+    sqlite3_result_text(ctx, zHeaders, size, sqlite3_free);
+}
+
+// Headers parsed by http_headers_parse() are packed into a blob that can be
+// searched without parsing the text again. The fixed size header is followed
+// by a table of headers, a hash table and the string data. The integers in the
+// tables are 2 bytes wide when the headers are small enough, which they nearly
+// always are, and 4 bytes otherwise. All integers are stored big-endian.
+//
+//   0  magic "HHDR"
+//   4  number of headers
+//   8  number of hash slots, a power of two
+//  12  size of the string data
+//  16  width of the integers in the tables, 2 or 4
+//  20  headers: name offset, name size, value offset, value size
+//      hash slots: 1 + index of the first header with the name, 0 if empty
+//      string data: lowercase names, each stored once, and values
+#define HTTP_HEADERS_MAGIC "HHDR"
+#define HTTP_HEADERS_HEADER_SIZE 20
+
+typedef struct http_headers_view http_headers_view;
+struct http_headers_view {
+    int nHeaders;
+    int nSlots;
+    int nWidth;
+    const unsigned char* aHeader;
+    const unsigned char* aSlot;
+    const char* zData;
+    int szData;
+};
+
+static void put_uw(unsigned char* p, int nWidth, unsigned int v) {
+    if (nWidth == 2) {
+        p[0] = (unsigned char)(v >> 8);
+        p[1] = (unsigned char)v;
+    } else {
+        put_u32(p, v);
+    }
+}
+
+static unsigned int get_uw(const unsigned char* p, int nWidth) {
+    return nWidth == 2 ? ((unsigned int)p[0] << 8) | (unsigned int)p[1] : get_u32(p);
+}
+
+// FNV-1a over the lowercased name.
+static unsigned int httpHeaderHash(const char* zName, int nName) {
+    unsigned int h = 2166136261u;
+    int i;
+    for (i = 0; i < nName; ++i) {
+        h = (h ^ http_char_lower(zName[i])) * 16777619u;
+    }
+    return h;
+}
+
+// Returns NULL and sets *pnBlob to -1 if the headers are malformed, or to 0 if
+// out of memory.
+static unsigned char* httpHeadersPack(const char* zHeaders, int szHeaders, sqlite3_int64* pnBlob) {
+    const char* p;
+    int n;
+    int nHeaders = 0;
+    int nSlots = 1;
+    int nWidth;
+    sqlite3_int64 szData = 0;
+    sqlite3_int64 nBlob;
+    unsigned char* pBlob;
+    unsigned char* aHeader;
+    unsigned char* aSlot;
+    char* zData;
+    int iHeader = 0;
+    int iData = 0;
+
+    // Count the headers first to size the blob.
+    for (p = zHeaders, n = szHeaders; n > 0;) {
+        int iParsed = 0;
+        const char* pName;
+        int iNameSize;
+        const char* pValue;
+        int iValueSize;
+        int rc = http_next_header(p, n, &iParsed, &pName, &iNameSize, &pValue, &iValueSize);
+        if (rc == SQLITE_ERROR) {
+            *pnBlob = -1;
+            return NULL;
+        }
+        if (rc == SQLITE_DONE) {
+            break;
+        }
+        nHeaders++;
+        szData += iNameSize + iValueSize;
+        p += iParsed;
+        n -= iParsed;
+    }
+    while (nSlots < nHeaders * 2) {
+        nSlots *= 2;
+    }
+    nWidth = szData <= 0xffff && nHeaders < 0xffff ? 2 : 4;
+
+    nBlob = HTTP_HEADERS_HEADER_SIZE + (sqlite3_int64)nHeaders * 4 * nWidth +
+            (sqlite3_int64)nSlots * nWidth + szData;
+    pBlob = sqlite3_malloc64(nBlob);
+    if (!pBlob) {
+        *pnBlob = 0;
+        return NULL;
+    }
+    aHeader = pBlob + HTTP_HEADERS_HEADER_SIZE;
+    aSlot = aHeader + nHeaders * 4 * nWidth;
+    zData = (char*)aSlot + nSlots * nWidth;
+    memset(aSlot, 0, nSlots * nWidth);
+
+    for (p = zHeaders, n = szHeaders; iHeader < nHeaders; ++iHeader) {
+        int iParsed = 0;
+        const char* pName;
+        int iNameSize;
+        const char* pValue;
+        int iValueSize;
+        unsigned char* pHeader = aHeader + iHeader * 4 * nWidth;
+        unsigned int iSlot;
+        int iName = -1;
+        int i;
+        http_next_header(p, n, &iParsed, &pName, &iNameSize, &pValue, &iValueSize);
+        p += iParsed;
+        n -= iParsed;
+
+        // Find the slot of the name, reusing the name if it was seen before.
+        iSlot = httpHeaderHash(pName, iNameSize) & (nSlots - 1);
+        while (get_uw(aSlot + iSlot * nWidth, nWidth) != 0) {
+            const unsigned char* pOther =
+                aHeader + (get_uw(aSlot + iSlot * nWidth, nWidth) - 1) * 4 * nWidth;
+            int iOtherName = get_uw(pOther, nWidth);
+            if (http_header_name_eq(
+                    zData + iOtherName, get_uw(pOther + nWidth, nWidth), pName, iNameSize)) {
+                iName = iOtherName;
+                break;
+            }
+            iSlot = (iSlot + 1) & (nSlots - 1);
+        }
+        if (iName < 0) {
+            iName = iData;
+            for (i = 0; i < iNameSize; ++i) {
+                zData[iData++] = http_char_lower(pName[i]);
+            }
+            put_uw(aSlot + iSlot * nWidth, nWidth, iHeader + 1);
+        }
+
+        put_uw(pHeader, nWidth, iName);
+        put_uw(pHeader + nWidth, nWidth, iNameSize);
+        put_uw(pHeader + 2 * nWidth, nWidth, iData);
+        put_uw(pHeader + 3 * nWidth, nWidth, iValueSize);
+        if (iValueSize > 0) {
+            memcpy(zData + iData, pValue, iValueSize);
+        }
+        iData += iValueSize;
+    }
+
+    memcpy(pBlob, HTTP_HEADERS_MAGIC, 4);
+    put_u32(pBlob + 4, nHeaders);
+    put_u32(pBlob + 8, nSlots);
+    put_u32(pBlob + 12, iData);
+    put_u32(pBlob + 16, nWidth);
+
+    *pnBlob = nBlob - szData + iData;
+    return pBlob;
+}
+
+// Point pView into a parsed headers blob. Returns SQLITE_ERROR if the value is
+// not one.
+static int httpHeadersUnpack(sqlite3_value* pValue, http_headers_view* pView) {
+    const unsigned char* pBlob;
+    sqlite3_int64 nBlob;
+
+    if (sqlite3_value_type(pValue) != SQLITE_BLOB) {
+        return SQLITE_ERROR;
+    }
+    pBlob = sqlite3_value_blob(pValue);
+    nBlob = sqlite3_value_bytes(pValue);
+    if (nBlob < HTTP_HEADERS_HEADER_SIZE || memcmp(pBlob, HTTP_HEADERS_MAGIC, 4) != 0) {
+        return SQLITE_ERROR;
+    }
+
+    pView->nHeaders = (int)get_u32(pBlob + 4);
+    pView->nSlots = (int)get_u32(pBlob + 8);
+    pView->szData = (int)get_u32(pBlob + 12);
+    pView->nWidth = (int)get_u32(pBlob + 16);
+    if (pView->nHeaders < 0 || pView->nSlots <= 0 || (pView->nSlots & (pView->nSlots - 1)) ||
+        pView->szData < 0 || (pView->nWidth != 2 && pView->nWidth != 4) ||
+        nBlob != HTTP_HEADERS_HEADER_SIZE + (sqlite3_int64)pView->nHeaders * 4 * pView->nWidth +
+                     (sqlite3_int64)pView->nSlots * pView->nWidth + pView->szData) {
+        return SQLITE_ERROR;
+    }
+    pView->aHeader = pBlob + HTTP_HEADERS_HEADER_SIZE;
+    pView->aSlot = pView->aHeader + pView->nHeaders * 4 * pView->nWidth;
+    pView->zData = (const char*)pView->aSlot + pView->nSlots * pView->nWidth;
+
+    return SQLITE_OK;
+}
+
+// Get the name and value of the iHeader'th header. Returns SQLITE_ERROR if the
+// blob is corrupt.
+static int httpHeadersViewGet(const http_headers_view* pView,
+                              int iHeader,
+                              const char** ppName,
+                              int* pNameSize,
+                              const char** ppValue,
+                              int* pValueSize) {
+    int nWidth = pView->nWidth;
+    const unsigned char* pHeader = pView->aHeader + iHeader * 4 * nWidth;
+    unsigned int iName = get_uw(pHeader, nWidth);
+    unsigned int nName = get_uw(pHeader + nWidth, nWidth);
+    unsigned int iValue = get_uw(pHeader + 2 * nWidth, nWidth);
+    unsigned int nValue = get_uw(pHeader + 3 * nWidth, nWidth);
+    if (iName > (unsigned int)pView->szData || nName > pView->szData - iName ||
+        iValue > (unsigned int)pView->szData || nValue > pView->szData - iValue) {
+        return SQLITE_ERROR;
+    }
+    *ppName = pView->zData + iName;
+    *pNameSize = (int)nName;
+    // Empty values are NULL, as with http_next_header().
+    *ppValue = nValue > 0 ? pView->zData + iValue : NULL;
+    *pValueSize = (int)nValue;
+    return SQLITE_OK;
+}
+
+// Find the first header with the given name. Returns SQLITE_ROW with its value,
+// SQLITE_DONE if there is none or SQLITE_ERROR if the blob is corrupt.
+static int httpHeadersViewFind(const http_headers_view* pView,
+                               const char* zName,
+                               int nName,
+                               const char** ppValue,
+                               int* pValueSize) {
+    unsigned int iSlot = httpHeaderHash(zName, nName) & (pView->nSlots - 1);
+    int nProbe;
+    for (nProbe = 0; nProbe < pView->nSlots; ++nProbe) {
+        unsigned int iHeader = get_uw(pView->aSlot + iSlot * pView->nWidth, pView->nWidth);
+        const char* pName;
+        int iNameSize;
+        if (iHeader == 0) {
+            return SQLITE_DONE;
+        }
+        if (iHeader > (unsigned int)pView->nHeaders ||
+            httpHeadersViewGet(pView, iHeader - 1, &pName, &iNameSize, ppValue, pValueSize) !=
+                SQLITE_OK) {
+            return SQLITE_ERROR;
+        }
+        if (http_header_name_eq(pName, iNameSize, zName, nName)) {
+            return SQLITE_ROW;
+        }
+        iSlot = (iSlot + 1) & (pView->nSlots - 1);
+    }
+    return SQLITE_DONE;
+}
+
+// Parse headers into the blob form understood by http_headers_has,
+// http_headers_get and http_headers_each.
+static void httpHeadersParseFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    const char* zHeaders;
+    int szHeaders;
+    unsigned char* pBlob;
+    sqlite3_int64 nBlob;
+
+    if (argc != 1) {
+        sqlite3_result_error(ctx, "http_headers_parse: expected 1 argument", -1);
+        return;
+    }
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        return;
+    }
+
+    zHeaders = (const char*)sqlite3_value_text(argv[0]);
+    szHeaders = sqlite3_value_bytes(argv[0]);
+    pBlob = httpHeadersPack(zHeaders, szHeaders, &nBlob);
+    if (!pBlob && nBlob < 0) {
+        sqlite3_result_error(ctx, "http_headers_parse: malformed headers", -1);
+        return;
+    }
+    if (!pBlob) {
+        sqlite3_result_error_nomem(ctx);
+        return;
+    }
+    sqlite3_result_blob64(ctx, pBlob, nBlob, sqlite3_free);
+}
+
+// Start indexing a new text. The text is copied into the index. Buffers grown
+// past HTTP_HEADERS_INDEX_KEEP bytes for a large text are released when a
+// smaller text comes along, so that the index on the connection does not hold
+// on to the largest headers it has ever seen.
+#define HTTP_HEADERS_INDEX_KEEP 16384
+
+static int httpHeadersIndexReset(http_headers_index* pIndex, const char* zText, int nText) {
+    if (pIndex->nTextAlloc > HTTP_HEADERS_INDEX_KEEP && nText <= HTTP_HEADERS_INDEX_KEEP) {
+        sqlite3_free(pIndex->zText);
+        sqlite3_free(pIndex->aHeader);
+        sqlite3_free(pIndex->aSlot);
+        pIndex->zText = NULL;
+        pIndex->nTextAlloc = 0;
+        pIndex->aHeader = NULL;
+        pIndex->nHeadersAlloc = 0;
+        pIndex->aSlot = NULL;
+        pIndex->nSlots = 0;
+    }
+    if (nText > pIndex->nTextAlloc) {
+        char* z = sqlite3_realloc(pIndex->zText, nText);
+        if (!z) {
+            return SQLITE_NOMEM;
+        }
+        pIndex->zText = z;
+        pIndex->nTextAlloc = nText;
+    }
+    if (nText > 0) {
+        memcpy(pIndex->zText, zText, nText);
+    }
+    pIndex->nText = nText;
+    pIndex->nParsed = 0;
+    pIndex->eState = SQLITE_ROW;
+    pIndex->nHeaders = 0;
+    pIndex->nHashed = 0;
+    pIndex->bAuxData = 0;
+    return SQLITE_OK;
+}
+
+// Insert the iHeader'th header into the hash table unless there already is a
+// header with the same name.
+// The index is rebuilt for every new text, so its hash only looks at the
+// length and a few characters of the name. Collisions are resolved by
+// comparing the names.
+static unsigned int httpHeadersIndexHash(const char* zName, int nName) {
+    unsigned int h = (unsigned int)nName;
+    if (nName > 0) {
+        h = h * 31 + http_char_lower(zName[0]);
+        h = h * 31 + http_char_lower(zName[nName / 2]);
+        h = h * 31 + http_char_lower(zName[nName - 1]);
+    }
+    return h * 2654435761u >> 8;
+}
+
+static void httpHeadersIndexInsert(http_headers_index* pIndex, int iHeader) {
+    const int* aHeader = pIndex->aHeader + iHeader * 4;
+    const char* zName = pIndex->zText + aHeader[0];
+    unsigned int iSlot = httpHeadersIndexHash(zName, aHeader[1]) & (pIndex->nSlots - 1);
+    while (pIndex->aSlot[iSlot] != 0) {
+        const int* aOther = pIndex->aHeader + (pIndex->aSlot[iSlot] - 1) * 4;
+        if (http_header_name_eq(pIndex->zText + aOther[0], aOther[1], zName, aHeader[1])) {
+            return;
+        }
+        iSlot = (iSlot + 1) & (pIndex->nSlots - 1);
+    }
+    pIndex->aSlot[iSlot] = iHeader + 1;
+}
+
+// Index the next header. Returns SQLITE_ROW, SQLITE_DONE if all headers have
+// been indexed, SQLITE_ERROR if the headers are malformed or SQLITE_NOMEM.
+static int httpHeadersIndexNext(http_headers_index* pIndex) {
+    int iParsed = 0;
+    const char* pName;
+    int iNameSize;
+    const char* pValue;
+    int iValueSize;
+    int* aHeader;
+    int rc;
+
+    if (pIndex->eState != SQLITE_ROW || pIndex->nParsed == pIndex->nText) {
+        pIndex->eState = pIndex->eState == SQLITE_ROW ? SQLITE_DONE : pIndex->eState;
+        return pIndex->eState;
+    }
+
+    if (pIndex->nHeaders == pIndex->nHeadersAlloc) {
+        int nAlloc = pIndex->nHeadersAlloc ? pIndex->nHeadersAlloc * 2 : 16;
+        int* a = sqlite3_realloc64(pIndex->aHeader, sizeof(int) * 4 * (sqlite3_int64)nAlloc);
+        if (!a) {
+            return SQLITE_NOMEM;
+        }
+        pIndex->aHeader = a;
+        pIndex->nHeadersAlloc = nAlloc;
+    }
+    rc = http_next_header(pIndex->zText + pIndex->nParsed,
+                          pIndex->nText - pIndex->nParsed,
+                          &iParsed,
+                          &pName,
+                          &iNameSize,
+                          &pValue,
+                          &iValueSize);
+    if (rc != SQLITE_ROW) {
+        pIndex->eState = rc;
+        return rc;
+    }
+    pIndex->nParsed += iParsed;
+
+    aHeader = pIndex->aHeader + pIndex->nHeaders * 4;
+    aHeader[0] = (int)(pName - pIndex->zText);
+    aHeader[1] = iNameSize;
+    aHeader[2] = pValue ? (int)(pValue - pIndex->zText) : -1;
+    aHeader[3] = iValueSize;
+    pIndex->nHeaders++;
+    return SQLITE_ROW;
+}
+
+// Add the headers indexed so far to the hash table, keeping it at most half
+// full.
+static int httpHeadersIndexHashAll(http_headers_index* pIndex) {
+    if (pIndex->nHeaders * 2 > pIndex->nSlots) {
+        int nSlots = pIndex->nSlots ? pIndex->nSlots : 32;
+        int* a;
+        while (pIndex->nHeaders * 2 > nSlots) {
+            nSlots *= 2;
+        }
+        a = sqlite3_realloc64(pIndex->aSlot, sizeof(int) * (sqlite3_int64)nSlots);
+        if (!a) {
+            return SQLITE_NOMEM;
+        }
+        pIndex->aSlot = a;
+        pIndex->nSlots = nSlots;
+        pIndex->nHashed = 0;
+    }
+    if (pIndex->nHashed == 0) {
+        memset(pIndex->aSlot, 0, sizeof(int) * pIndex->nSlots);
+    }
+    for (; pIndex->nHashed < pIndex->nHeaders; ++pIndex->nHashed) {
+        httpHeadersIndexInsert(pIndex, pIndex->nHashed);
+    }
+    return SQLITE_OK;
+}
+
+// Get the name and value of the iHeader'th header. The value is NULL if it is
+// empty, as with http_next_header().
+static void httpHeadersIndexGet(const http_headers_index* pIndex,
+                                int iHeader,
+                                const char** ppName,
+                                int* pNameSize,
+                                const char** ppValue,
+                                int* pValueSize) {
+    const int* aHeader = pIndex->aHeader + iHeader * 4;
+    *ppName = pIndex->zText + aHeader[0];
+    *pNameSize = aHeader[1];
+    *ppValue = aHeader[2] < 0 ? NULL : pIndex->zText + aHeader[2];
+    *pValueSize = aHeader[3];
+}
+
+// Find the first header with the given name, indexing more of the headers if
+// needed. Returns SQLITE_ROW with its value, SQLITE_DONE if there is none,
+// SQLITE_ERROR if the headers are malformed or SQLITE_NOMEM.
+static int httpHeadersIndexFind(http_headers_index* pIndex,
+                                const char* zName,
+                                int nName,
+                                const char** ppValue,
+                                int* pValueSize) {
+    const char* pName;
+    int iNameSize;
+    int rc;
+    if (pIndex->nHeaders > 0) {
+        unsigned int iSlot;
+        rc = httpHeadersIndexHashAll(pIndex);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        iSlot = httpHeadersIndexHash(zName, nName) & (pIndex->nSlots - 1);
+        while (pIndex->aSlot[iSlot] != 0) {
+            httpHeadersIndexGet(
+                pIndex, pIndex->aSlot[iSlot] - 1, &pName, &iNameSize, ppValue, pValueSize);
+            if (http_header_name_eq(pName, iNameSize, zName, nName)) {
+                return SQLITE_ROW;
+            }
+            iSlot = (iSlot + 1) & (pIndex->nSlots - 1);
+        }
+    }
+    // Any match from here on is the first one, earlier ones would have been
+    // found in the hash table.
+    while ((rc = httpHeadersIndexNext(pIndex)) == SQLITE_ROW) {
+        httpHeadersIndexGet(
+            pIndex, pIndex->nHeaders - 1, &pName, &iNameSize, ppValue, pValueSize);
+        if (http_header_name_eq(pName, iNameSize, zName, nName)) {
+            return SQLITE_ROW;
+        }
+    }
+    return rc;
+}
+
+// Queries often look up several headers from the same text, for example
+// http_headers_get(h, 'a'), http_headers_get(h, 'b') on each row. The index of
+// the last headers is kept on the connection and reused if the text is the
+// same. *pbHit is set if it was.
+static int httpHeadersCached(http_ext* pExt,
+                             const char* zHeaders,
+                             int szHeaders,
+                             http_headers_index** ppIndex,
+                             int* pbHit) {
+    http_headers_index* pIndex = pExt->pLastIndex;
+    int rc;
+
+    if (pIndex && szHeaders == pIndex->nText &&
+        (szHeaders == 0 || memcmp(zHeaders, pIndex->zText, szHeaders) == 0)) {
+        *ppIndex = pIndex;
+        *pbHit = 1;
+        return SQLITE_OK;
+    }
+
+    // The index can be reused unless something else still refers to it.
+    if (!pIndex || pIndex->nRef > 1) {
+        httpHeadersIndexUnref(pIndex);
+        pIndex = pExt->pLastIndex = sqlite3_malloc(sizeof(*pIndex));
+        if (!pIndex) {
+            return SQLITE_NOMEM;
+        }
+        memset(pIndex, 0, sizeof(*pIndex));
+        pIndex->nRef = 1;
+    }
+    rc = httpHeadersIndexReset(pIndex, zHeaders, szHeaders);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    *ppIndex = pIndex;
+    *pbHit = 0;
+    return SQLITE_OK;
+}
+
+// Get the index of the text headers in the first argument of the function.
+// The index is also attached to the argument when the headers are looked up
+// again, so that constant headers are not even compared on later calls.
+static int httpHeadersIndexFor(sqlite3_context* ctx,
+                               sqlite3_value* pHeaders,
+                               http_headers_index** ppIndex) {
+    http_headers_index* pIndex = sqlite3_get_auxdata(ctx, 0);
+    const char* zHeaders;
+    int zHeadersSize;
+    int bHit;
+    int rc;
+
+    if (pIndex) {
+        *ppIndex = pIndex;
+        return SQLITE_OK;
+    }
+
+    zHeaders = (const char*)sqlite3_value_text(pHeaders);
+    zHeadersSize = sqlite3_value_bytes(pHeaders);
+    rc = httpHeadersCached(sqlite3_user_data(ctx), zHeaders, zHeadersSize, &pIndex, &bHit);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    if (bHit && !pIndex->bAuxData) {
+        pIndex->bAuxData = 1;
+        pIndex->nRef++;
+        sqlite3_set_auxdata(ctx, 0, pIndex, httpHeadersIndexUnref);
+    }
+    *ppIndex = pIndex;
+    return SQLITE_OK;
+}
+
+// Look up the first header with the given name in either text or parsed
+// headers. Returns SQLITE_ROW, SQLITE_DONE if there is no such header,
+// SQLITE_ERROR if the headers are malformed or SQLITE_NOMEM.
+static int httpHeadersFind(sqlite3_context* ctx,
+                           sqlite3_value* pHeaders,
+                           const char* zName,
+                           int nName,
+                           const char** ppValue,
+                           int* pValueSize) {
+    http_headers_view view;
+    http_headers_index* pIndex;
+    int rc;
+
+    if (httpHeadersUnpack(pHeaders, &view) == SQLITE_OK) {
+        return httpHeadersViewFind(&view, zName, nName, ppValue, pValueSize);
+    }
+
+    rc = httpHeadersIndexFor(ctx, pHeaders, &pIndex);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    return httpHeadersIndexFind(pIndex, zName, nName, ppValue, pValueSize);
+}
+
+static void httpHeadersHasFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    int zHeaderSize = sqlite3_value_bytes(argv[1]);
+    const char* zHeader = sqlite3_value_text(argv[1]);
+    const char* pValue;
+    int iValueSize;
+    int rc = httpHeadersFind(ctx, argv[0], zHeader, zHeaderSize, &pValue, &iValueSize);
+    if (rc == SQLITE_NOMEM) {
+        sqlite3_result_error_nomem(ctx);
+        return;
+    }
+    if (rc == SQLITE_ERROR) {
+        sqlite3_result_error(ctx, "http_headers_has: malformed headers", -1);
+        return;
+    }
+    sqlite3_result_int(ctx, rc == SQLITE_ROW);
+}
+
+static void httpHeadersGetFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    int zHeaderSize = sqlite3_value_bytes(argv[1]);
+    const char* zHeader = sqlite3_value_text(argv[1]);
+    const char* pValue;
+    int iValueSize;
+    int rc = httpHeadersFind(ctx, argv[0], zHeader, zHeaderSize, &pValue, &iValueSize);
+    if (rc == SQLITE_NOMEM) {
+        sqlite3_result_error_nomem(ctx);
+        return;
+    }
+    if (rc == SQLITE_ERROR) {
+        sqlite3_result_error(ctx, "http_headers_get: malformed headers", -1);
+        return;
+    }
+    if (rc == SQLITE_ROW) {
+        sqlite3_result_text(ctx, pValue, iValueSize, SQLITE_TRANSIENT);
+    }
+}
+
+// Size of a string encoded as a JSON string, including the quotes.
+static sqlite3_int64 httpJsonStringSize(const char* z, int n) {
+    sqlite3_int64 nJson = n + 2;
+    int i;
+    for (i = 0; i < n; ++i) {
+        unsigned char c = (unsigned char)z[i];
+        if (c < 0x20) {
+            nJson += 5;
+        } else if (c == '"' || c == '\\') {
+            nJson += 1;
+        }
+    }
+    return nJson;
+}
+
+// Write a string encoded as a JSON string and return the end of the output.
+static char* httpJsonWriteString(char* zOut, const char* z, int n) {
+    static const char aHex[] = "0123456789abcdef";
+    int i;
+    *zOut++ = '"';
+    for (i = 0; i < n; ++i) {
+        unsigned char c = (unsigned char)z[i];
+        if (c < 0x20) {
+            memcpy(zOut, "\\u00", 4);
+            zOut[4] = aHex[c >> 4];
+            zOut[5] = aHex[c & 15];
+            zOut += 6;
+        } else if (c == '"' || c == '\\') {
+            *zOut++ = '\\';
+            *zOut++ = (char)c;
+        } else {
+            *zOut++ = (char)c;
+        }
+    }
+    *zOut++ = '"';
+    return zOut;
+}
+
+// http_headers_extract(headers, name, ...) returns a JSON object with a key
+// for each name. The value is null if there is no such header, a string if
+// there is one and an array of strings if the header is repeated. The headers
+// are scanned once no matter how many names are extracted.
+static void httpHeadersExtractFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    http_headers_view view;
+    http_headers_index* pIndex = NULL;
+    const char** azName = NULL;
+    int* anName;
+    int* aCount;
+    int* aFirst;
+    int* aMatch;
+    int nHeaders;
+    sqlite3_int64 nJson = 2;
+    char* zJson;
+    char* zOut;
+    const char* pName;
+    int iNameSize;
+    const char* pValue;
+    int iValueSize;
+    int rc = SQLITE_OK;
+    int i;
+    int j;
+
+    if (argc < 1) {
+        sqlite3_result_error(ctx, "http_headers_extract: expected at least 1 argument", -1);
+        return;
+    }
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        return;
+    }
+
+    if (httpHeadersUnpack(argv[0], &view) == SQLITE_OK) {
+        nHeaders = view.nHeaders;
+    } else {
+        rc = httpHeadersIndexFor(ctx, argv[0], &pIndex);
+        while (rc == SQLITE_OK && (rc = httpHeadersIndexNext(pIndex)) == SQLITE_ROW) {
+            rc = SQLITE_OK;
+        }
+        if (rc != SQLITE_DONE) {
+            goto done;
+        }
+        rc = SQLITE_OK;
+        nHeaders = pIndex->nHeaders;
+    }
+
+    azName = sqlite3_malloc64(sizeof(*azName) * argc + sizeof(int) * (4 * argc + nHeaders));
+    if (!azName) {
+        rc = SQLITE_NOMEM;
+        goto done;
+    }
+    anName = (int*)(azName + argc);
+    aCount = anName + argc;
+    aFirst = aCount + argc;
+    aMatch = aFirst + argc;
+
+    // Names that are NULL or repeat an earlier name are skipped.
+    for (j = 1; j < argc; ++j) {
+        azName[j] = (const char*)sqlite3_value_text(argv[j]);
+        anName[j] = sqlite3_value_bytes(argv[j]);
+        aCount[j] = 0;
+        aFirst[j] = -1;
+        if (!azName[j] && sqlite3_value_type(argv[j]) != SQLITE_NULL) {
+            rc = SQLITE_NOMEM;
+            goto done;
+        }
+        for (i = 1; azName[j] && i < j; ++i) {
+            if (azName[i] && anName[i] == anName[j] &&
+                http_header_name_eq(azName[i], anName[i], azName[j], anName[j])) {
+                azName[j] = NULL;
+            }
+        }
+    }
+
+    // Match every header against the names and size the result on the way.
+    for (i = 0; i < nHeaders; ++i) {
+        if (pIndex) {
+            httpHeadersIndexGet(pIndex, i, &pName, &iNameSize, &pValue, &iValueSize);
+        } else if (httpHeadersViewGet(&view, i, &pName, &iNameSize, &pValue, &iValueSize) !=
+                   SQLITE_OK) {
+            rc = SQLITE_ERROR;
+            goto done;
+        }
+        aMatch[i] = 0;
+        for (j = 1; j < argc; ++j) {
+            if (azName[j] && anName[j] == iNameSize &&
+                http_header_name_eq(azName[j], anName[j], pName, iNameSize)) {
+                aMatch[i] = j;
+                if (aCount[j]++ == 0) {
+                    aFirst[j] = i;
+                }
+                nJson += httpJsonStringSize(pValue, iValueSize);
+                break;
+            }
+        }
+    }
+    for (j = 1; j < argc; ++j) {
+        if (azName[j]) {
+            // The key, colon, comma and either null, the commas of an array
+            // and its brackets or nothing more for a single value.
+            nJson += httpJsonStringSize(azName[j], anName[j]) + 2;
+            nJson += aCount[j] == 0 ? 4 : aCount[j] == 1 ? 0 : aCount[j] + 1;
+        }
+    }
+
+    zJson = zOut = sqlite3_malloc64(nJson);
+    if (!zJson) {
+        rc = SQLITE_NOMEM;
+        goto done;
+    }
+    *zOut++ = '{';
+    for (j = 1; j < argc; ++j) {
+        if (!azName[j]) {
+            continue;
+        }
+        if (zOut > zJson + 1) {
+            *zOut++ = ',';
+        }
+        zOut = httpJsonWriteString(zOut, azName[j], anName[j]);
+        *zOut++ = ':';
+        if (aCount[j] == 0) {
+            memcpy(zOut, "null", 4);
+            zOut += 4;
+            continue;
+        }
+        if (aCount[j] > 1) {
+            *zOut++ = '[';
+        }
+        for (i = aFirst[j]; i < nHeaders; ++i) {
+            if (aMatch[i] != j) {
+                continue;
+            }
+            if (i != aFirst[j]) {
+                *zOut++ = ',';
+            }
+            if (pIndex) {
+                httpHeadersIndexGet(pIndex, i, &pName, &iNameSize, &pValue, &iValueSize);
+            } else {
+                httpHeadersViewGet(&view, i, &pName, &iNameSize, &pValue, &iValueSize);
+            }
+            zOut = httpJsonWriteString(zOut, pValue, iValueSize);
+        }
+        if (aCount[j] > 1) {
+            *zOut++ = ']';
+        }
+    }
+    *zOut++ = '}';
+    assert(zOut <= zJson + nJson);
+    sqlite3_result_text64(ctx, zJson, zOut - zJson, sqlite3_free, SQLITE_UTF8);
+    sqlite3_result_subtype(ctx, 'J');
+
+done:
+
+    sqlite3_free(azName);
+
+    if (rc == SQLITE_NOMEM) {
+        sqlite3_result_error_nomem(ctx);
+    } else if (rc == SQLITE_ERROR) {
+        sqlite3_result_error(ctx, "http_headers_extract: malformed headers", -1);
+    } else if (rc != SQLITE_OK) {
+        sqlite3_result_error_code(ctx, rc);
+    }
+}
+
+static void httpShareFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    int bEnable;
+    int nMaxConnections = 0;
+    char* zErrMsg = NULL;
+    int rc;
+    if (argc < 1 || argc > 2) {
+        sqlite3_result_error(ctx, "http_share: expected 1 or 2 arguments", -1);
+        return;
+    }
+    bEnable = sqlite3_value_int(argv[0]);
+    if (argc == 2) {
+        nMaxConnections = sqlite3_value_int(argv[1]);
+    }
+    rc = http_share_configure(bEnable, nMaxConnections, &zErrMsg);
+    if (rc != SQLITE_OK) {
+        if (zErrMsg) {
+            sqlite3_result_error(ctx, zErrMsg, -1);
+            sqlite3_free(zErrMsg);
+        } else {
+            sqlite3_result_error_code(ctx, rc);
+        }
+        return;
+    }
+    sqlite3_result_int(ctx, bEnable != 0);
+}
+
+// Get or set the maximum size of response bodies on this connection. Zero
+// restores the default, which is the maximum length of a blob.
+static void httpMaxBodySizeFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    http_ext* pExt = (http_ext*)sqlite3_user_data(ctx);
+    if (argc > 1) {
+        sqlite3_result_error(ctx, "http_max_body_size: expected 0 or 1 arguments", -1);
+        return;
+    }
+    if (argc == 1) {
+        sqlite3_int64 szMaxBody = sqlite3_value_int64(argv[0]);
+        pExt->szMaxBody = szMaxBody > 0 ? szMaxBody : 0;
+    }
+    sqlite3_result_int64(ctx, httpMaxBodySize(pExt));
+}
+
+static void httpEnqueueFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    http_request req;
+    sqlite3_int64 iId;
+    int rc;
+
+    if (argc < 2 || argc > 4) {
+        sqlite3_result_error(ctx, "http_enqueue: expected 2 to 4 arguments", -1);
+        return;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.zMethod = (char*)sqlite3_value_text(argv[0]);
+    req.zUrl = (char*)sqlite3_value_text(argv[1]);
+    if (!req.zMethod || !req.zUrl) {
+        sqlite3_result_error(ctx, "http_enqueue: method and url must not be NULL", -1);
+        return;
+    }
+    if (argc > 2) {
+        req.zHeaders = (const char*)sqlite3_value_text(argv[2]);
+    }
+    if (argc > 3 && sqlite3_value_type(argv[3]) != SQLITE_NULL) {
+        req.pBody = sqlite3_value_blob(argv[3]);
+        req.szBody = sqlite3_value_bytes(argv[3]);
+        if (!req.pBody) {
+            req.pBody = "";
+        }
+    }
+
+    req.szMaxBody = httpMaxBodySize((http_ext*)sqlite3_user_data(ctx));
+    req.zSql = httpRunningSql(sqlite3_context_db_handle(ctx));
+
+    rc = http_async_enqueue(&req, &iId);
+    if (rc != SQLITE_OK) {
+        if (rc == SQLITE_NOMEM) {
+            sqlite3_result_error_nomem(ctx);
+        } else {
+            sqlite3_result_error(ctx, "http_enqueue: failed to start worker threads", -1);
+        }
+        return;
+    }
+
+    sqlite3_result_int64(ctx, iId);
+}
+
+static void httpWaitFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    int msTimeout = -1;
+    int eState;
+    int rc;
+
+    if (argc < 1 || argc > 2) {
+        sqlite3_result_error(ctx, "http_wait: expected 1 or 2 arguments", -1);
+        return;
+    }
+    if (argc == 2 && sqlite3_value_type(argv[1]) != SQLITE_NULL) {
+        msTimeout = sqlite3_value_int(argv[1]);
+        if (msTimeout < 0) {
+            msTimeout = -1;
+        }
+    }
+
+    rc = http_async_wait(sqlite3_value_int64(argv[0]), msTimeout, &eState);
+    if (rc == SQLITE_NOTFOUND) {
+        sqlite3_result_error(ctx, "http_wait: no such request", -1);
+        return;
+    }
+
+    sqlite3_result_int(ctx, eState == HTTP_ASYNC_DONE || eState == HTTP_ASYNC_ERROR);
+}
+
+#define HTTP_RESULTS_COL_ID 0
+#define HTTP_RESULTS_COL_STATE 1
+#define HTTP_RESULTS_COL_RESPONSE_STATUS 2
+#define HTTP_RESULTS_COL_RESPONSE_STATUS_CODE 3
+#define HTTP_RESULTS_COL_RESPONSE_HEADERS 4
+#define HTTP_RESULTS_COL_RESPONSE_BODY 5
+#define HTTP_RESULTS_COL_RESPONSE_ERROR 6
+#define HTTP_RESULTS_COL_REQUEST_METHOD 7
+#define HTTP_RESULTS_COL_REQUEST_URL 8
+#define HTTP_RESULTS_COL_REQUEST_HEADERS 9
+#define HTTP_RESULTS_COL_REQUEST_BODY 10
+
+#define HTTP_RESULTS_FLAG_ID 1
+
+typedef struct http_results_cursor http_results_cursor;
+struct http_results_cursor {
+    sqlite3_vtab_cursor base;
+    http_async_entry entry;
+    int bSingle;
+    int bEof;
+};
+
+static int httpResultsConnect(sqlite3* db,
+                              void* pAux,
+                              int argc,
+                              const char* const* argv,
+                              sqlite3_vtab** ppVtab,
+                              char** pzErr) {
+    sqlite3_vtab* pNew;
+    int rc;
+
+    rc = sqlite3_declare_vtab(db,
+                              "CREATE TABLE x(id INT, state TEXT, response_status TEXT, "
+                              "response_status_code INT, response_headers TEXT, "
+                              "response_body BLOB, response_error TEXT, request_method TEXT, "
+                              "request_url TEXT, request_headers TEXT, request_body BLOB)");
+
+    if (rc == SQLITE_OK) {
+        pNew = sqlite3_malloc(sizeof(*pNew));
+        *ppVtab = pNew;
+        if (pNew == 0)
+            return SQLITE_NOMEM;
+        memset(pNew, 0, sizeof(*pNew));
+    }
+    return rc;
+}
+
+static int httpResultsDisconnect(sqlite3_vtab* pVtab) {
+    sqlite3_free(pVtab);
+    return SQLITE_OK;
+}
+
+static int httpResultsOpen(sqlite3_vtab* p, sqlite3_vtab_cursor** ppCursor) {
+    http_results_cursor* pCur;
+    pCur = sqlite3_malloc(sizeof(*pCur));
+    if (pCur == 0)
+        return SQLITE_NOMEM;
+    memset(pCur, 0, sizeof(*pCur));
+    *ppCursor = &pCur->base;
+    return SQLITE_OK;
+}
+
+static int httpResultsClose(sqlite3_vtab_cursor* cur) {
+    http_results_cursor* pCur = (http_results_cursor*)cur;
+    http_async_entry_clear(&pCur->entry);
+    sqlite3_free(pCur);
+    return SQLITE_OK;
+}
+
+// Each row is a snapshot of the request taken when the cursor moves onto it.
+static int httpResultsLoad(http_results_cursor* pCur, sqlite3_int64 iId, int bNext) {
+    int rc;
+    http_async_entry_clear(&pCur->entry);
+    rc = http_async_get(iId, bNext, &pCur->entry);
+    if (rc == SQLITE_DONE) {
+        pCur->bEof = 1;
+        return SQLITE_OK;
+    }
+    if (rc != SQLITE_ROW) {
+        return rc;
+    }
+    pCur->bEof = 0;
+    return SQLITE_OK;
+}
+
+static int httpResultsNext(sqlite3_vtab_cursor* cur) {
+    http_results_cursor* pCur = (http_results_cursor*)cur;
+    if (pCur->bSingle) {
+        pCur->bEof = 1;
+        return SQLITE_OK;
+    }
+    return httpResultsLoad(pCur, pCur->entry.iId, 1);
+}
+
+static int httpResultsColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
+    static const char* aStates[] = {"queued", "running", "done", "error"};
+    http_results_cursor* pCur = (http_results_cursor*)cur;
+    http_async_entry* pEntry = &pCur->entry;
+    int bOk = pEntry->eState == HTTP_ASYNC_DONE;
+
+    switch (i) {
+    case HTTP_RESULTS_COL_ID:
+        sqlite3_result_int64(ctx, pEntry->iId);
+        break;
+
+    case HTTP_RESULTS_COL_STATE:
+        sqlite3_result_text(ctx, aStates[pEntry->eState], -1, SQLITE_STATIC);
+        break;
+
+    case HTTP_RESULTS_COL_RESPONSE_STATUS:
+        if (bOk) {
+            sqlite3_result_text(ctx, pEntry->resp.zStatus, -1, SQLITE_TRANSIENT);
+        }
+        break;
+
+    case HTTP_RESULTS_COL_RESPONSE_STATUS_CODE:
+        if (bOk) {
+            sqlite3_result_int(ctx, pEntry->resp.iStatusCode);
+        }
+        break;
+
+    case HTTP_RESULTS_COL_RESPONSE_HEADERS:
+        if (bOk) {
+            sqlite3_result_text(ctx, pEntry->resp.zHeaders, -1, SQLITE_TRANSIENT);
+        }
+        break;
+
+    case HTTP_RESULTS_COL_RESPONSE_BODY:
+        if (bOk) {
+            sqlite3_result_blob64(
+                ctx, http_body_ref(pEntry->resp.pBody), pEntry->resp.szBody, http_body_unref);
+        }
+        break;
+
+    case HTTP_RESULTS_COL_RESPONSE_ERROR:
+        if (pEntry->zErrMsg) {
+            sqlite3_result_text(ctx, pEntry->zErrMsg, -1, SQLITE_TRANSIENT);
+        }
+        break;
+
+    case HTTP_RESULTS_COL_REQUEST_METHOD:
+        sqlite3_result_text(ctx, pEntry->req.zMethod, -1, SQLITE_TRANSIENT);
+        break;
+
+    case HTTP_RESULTS_COL_REQUEST_URL:
+        sqlite3_result_text(ctx, pEntry->req.zUrl, -1, SQLITE_TRANSIENT);
+        break;
+
+    case HTTP_RESULTS_COL_REQUEST_HEADERS:
+        if (pEntry->req.zHeaders) {
+            sqlite3_result_text(ctx, pEntry->req.zHeaders, -1, SQLITE_TRANSIENT);
+        }
+        break;
+
+    case HTTP_RESULTS_COL_REQUEST_BODY:
+        if (pEntry->req.pBody) {
+            sqlite3_result_blob(ctx, pEntry->req.pBody, pEntry->req.szBody, SQLITE_TRANSIENT);
+        }
+        break;
+    }
+
+    return SQLITE_OK;
+}
+
+static int httpResultsRowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
+    http_results_cursor* pCur = (http_results_cursor*)cur;
+    *pRowid = pCur->entry.iId;
+    return SQLITE_OK;
+}
+
+static int httpResultsEof(sqlite3_vtab_cursor* cur) {
+    http_results_cursor* pCur = (http_results_cursor*)cur;
+    return pCur->bEof;
+}
+
+static int httpResultsFilter(sqlite3_vtab_cursor* pVtabCursor,
+                             int idxNum,
+                             const char* idxStr,
+                             int argc,
+                             sqlite3_value** argv) {
+    http_results_cursor* pCur = (http_results_cursor*)pVtabCursor;
+    if (idxNum & HTTP_RESULTS_FLAG_ID) {
+        pCur->bSingle = 1;
+        return httpResultsLoad(pCur, sqlite3_value_int64(argv[0]), 0);
+    }
+    pCur->bSingle = 0;
+    return httpResultsLoad(pCur, 0, 1);
+}
+
+static int httpResultsBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
+    int i;
+
+    for (i = 0; i < pIdxInfo->nConstraint; ++i) {
+        int iColumn = pIdxInfo->aConstraint[i].iColumn;
+        if (iColumn != HTTP_RESULTS_COL_ID && iColumn != -1) {
+            continue;
+        }
+        if (!pIdxInfo->aConstraint[i].usable ||
+            pIdxInfo->aConstraint[i].op != SQLITE_INDEX_CONSTRAINT_EQ) {
+            continue;
+        }
+        pIdxInfo->aConstraintUsage[i].argvIndex = 1;
+        pIdxInfo->aConstraintUsage[i].omit = 1;
+        pIdxInfo->idxNum = HTTP_RESULTS_FLAG_ID;
+        pIdxInfo->idxFlags = SQLITE_INDEX_SCAN_UNIQUE;
+        pIdxInfo->estimatedCost = (double)1;
+        pIdxInfo->estimatedRows = 1;
+        return SQLITE_OK;
+    }
+
+    pIdxInfo->estimatedCost = (double)1000;
+    pIdxInfo->estimatedRows = 1000;
+
+    return SQLITE_OK;
+}
+
+// Only DELETE is supported. Deleting a queued request cancels it.
+static int httpResultsUpdate(sqlite3_vtab* pVtab,
+                             int argc,
+                             sqlite3_value** argv,
+                             sqlite_int64* pRowid) {
+    int rc;
+
+    if (argc != 1) {
+        sqlite3_free(pVtab->zErrMsg);
+        pVtab->zErrMsg = sqlite3_mprintf("http_results: only DELETE is supported");
+        return SQLITE_ERROR;
+    }
+
+    rc = http_async_remove(sqlite3_value_int64(argv[0]));
+    if (rc == SQLITE_BUSY) {
+        sqlite3_free(pVtab->zErrMsg);
+        pVtab->zErrMsg = sqlite3_mprintf("http_results: request is running");
+        return SQLITE_ERROR;
+    }
+
+    return rc;
+}
+
+static sqlite3_module httpResultsModule = {
+    /* iVersion    */ 0,
+    /* xCreate     */ 0,
+    /* xConnect    */ httpResultsConnect,
+    /* xBestIndex  */ httpResultsBestIndex,
+    /* xDisconnect */ httpResultsDisconnect,
+    /* xDestroy    */ 0,
+    /* xOpen       */ httpResultsOpen,
+    /* xClose      */ httpResultsClose,
+    /* xFilter     */ httpResultsFilter,
+    /* xNext       */ httpResultsNext,
+    /* xEof        */ httpResultsEof,
+    /* xColumn     */ httpResultsColumn,
+    /* xRowid      */ httpResultsRowid,
+    /* xUpdate     */ httpResultsUpdate,
+    /* xBegin      */ 0,
+    /* xSync       */ 0,
+    /* xCommit     */ 0,
+    /* xRollback   */ 0,
+    /* xFindMethod */ 0,
+    /* xRename     */ 0,
+    /* xSavepoint  */ 0,
+    /* xRelease    */ 0,
+    /* xRollbackTo */ 0,
+    /* xShadowName */ 0,
+};
+
+#define HTTP_HEADERS_EACH_COL_NAME 0
+#define HTTP_HEADERS_EACH_COL_VALUE 1
+#define HTTP_HEADERS_EACH_COL_HEADERS 2
+
+// How the name constraint passed to xFilter after the headers is matched.
+#define HTTP_HEADERS_EACH_NAME_EQ 1
+#define HTTP_HEADERS_EACH_NAME_IN 2
+#define HTTP_HEADERS_EACH_NAME_LIKE 3
+#define HTTP_HEADERS_EACH_NAME_GLOB 4
+
+typedef struct http_headers_each_vtab http_headers_each_vtab;
+struct http_headers_each_vtab {
+    sqlite3_vtab base;
+    http_ext* pExt;
+};
+
+typedef struct http_headers_each_cursor http_headers_each_cursor;
+struct http_headers_each_cursor {
+    sqlite3_vtab_cursor base;
+    sqlite3_int64 iRowid;
+    const char* zHeaders;
+    int zHeadersSize;
+    const char* name;
+    int nameSize;
+    const char* value;
+    int valueSize;
+    int done;
+    // Set when iterating over headers returned by http_headers_parse().
+    // Otherwise the text headers are iterated through their index.
+    int bParsed;
+    http_headers_view view;
+    http_headers_index* pIndex;
+    // Set to HTTP_HEADERS_EACH_NAME_* when the headers are filtered by name.
+    // Only headers with one of the names, or starting with the prefix for LIKE
+    // and GLOB, are returned.
+    int eName;
+    int nName;
+    struct http_headers_each_name {
+        char* zName;
+        int nName;
+    } * aName;
+};
+
+static void httpHeadersEachClearNames(http_headers_each_cursor* pCur) {
+    int i;
+    for (i = 0; i < pCur->nName; ++i) {
+        sqlite3_free(pCur->aName[i].zName);
+    }
+    sqlite3_free(pCur->aName);
+    pCur->aName = NULL;
+    pCur->eName = 0;
+    pCur->nName = 0;
+}
+
+// Add the first nName bytes of a name to filter by.
+static int httpHeadersEachAddName(http_headers_each_cursor* pCur,
+                                  const char* zName,
+                                  int nName) {
+    struct http_headers_each_name* aName;
+    struct http_headers_each_name* pName;
+    aName = sqlite3_realloc64(pCur->aName, sizeof(*aName) * (pCur->nName + 1));
+    if (!aName) {
+        return SQLITE_NOMEM;
+    }
+    pCur->aName = aName;
+    pName = &aName[pCur->nName];
+    pName->zName = sqlite3_malloc(nName + 1);
+    if (!pName->zName) {
+        return SQLITE_NOMEM;
+    }
+    memcpy(pName->zName, zName, nName);
+    pName->zName[nName] = '\0';
+    pName->nName = nName;
+    pCur->nName++;
+    return SQLITE_OK;
+}
+
+// Load the names to filter by. NULL names match nothing. LIKE and GLOB
+// patterns are reduced to the literal prefix before the first wildcard, SQLite
+// checks the rest of the pattern.
+static int httpHeadersEachLoadNames(http_headers_each_cursor* pCur,
+                                    int eName,
+                                    sqlite3_value* pValue) {
+    sqlite3_value* pItem;
+    const char* zName;
+    int nPrefix;
+    int rc = SQLITE_OK;
+
+    pCur->eName = eName;
+    switch (eName) {
+    case HTTP_HEADERS_EACH_NAME_EQ:
+        zName = (const char*)sqlite3_value_text(pValue);
+        if (zName) {
+            rc = httpHeadersEachAddName(pCur, zName, sqlite3_value_bytes(pValue));
+        } else if (sqlite3_value_type(pValue) != SQLITE_NULL) {
+            rc = SQLITE_NOMEM;
+        }
+        break;
+
+    case HTTP_HEADERS_EACH_NAME_IN:
+        for (rc = sqlite3_vtab_in_first(pValue, &pItem); rc == SQLITE_OK && pItem;
+             rc = sqlite3_vtab_in_next(pValue, &pItem)) {
+            zName = (const char*)sqlite3_value_text(pItem);
+            if (zName) {
+                rc = httpHeadersEachAddName(pCur, zName, sqlite3_value_bytes(pItem));
+            } else if (sqlite3_value_type(pItem) != SQLITE_NULL) {
+                rc = SQLITE_NOMEM;
+            }
+            if (rc != SQLITE_OK) {
+                return rc;
+            }
+        }
+        if (rc == SQLITE_DONE) {
+            rc = SQLITE_OK;
+        }
+        break;
+
+    case HTTP_HEADERS_EACH_NAME_LIKE:
+    case HTTP_HEADERS_EACH_NAME_GLOB:
+        zName = (const char*)sqlite3_value_text(pValue);
+        if (!zName) {
+            rc = sqlite3_value_type(pValue) == SQLITE_NULL ? SQLITE_OK : SQLITE_NOMEM;
+            break;
+        }
+        nPrefix = (int)strcspn(zName, eName == HTTP_HEADERS_EACH_NAME_LIKE ? "%_" : "*?[");
+        if (nPrefix == 0 && zName[0] != '\0') {
+            // Any name may match a pattern starting with a wildcard.
+            pCur->eName = 0;
+            break;
+        }
+        rc = httpHeadersEachAddName(pCur, zName, nPrefix);
+        break;
+    }
+    return rc;
+}
+
+// Check the current header against the names.
+static int httpHeadersEachMatch(http_headers_each_cursor* pCur) {
+    int bPrefix = pCur->eName >= HTTP_HEADERS_EACH_NAME_LIKE;
+    int i;
+    for (i = 0; i < pCur->nName; ++i) {
+        struct http_headers_each_name* pName = &pCur->aName[i];
+        int nName = bPrefix ? pName->nName : pCur->nameSize;
+        if (pCur->nameSize < nName ||
+            !http_header_name_eq(pName->zName, pName->nName, pCur->name, nName)) {
+            continue;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+static int httpHeadersEachConnect(sqlite3* db,
+                                  void* pAux,
+                                  int argc,
+                                  const char* const* argv,
+                                  sqlite3_vtab** ppVtab,
+                                  char** pzErr) {
+    http_headers_each_vtab* pNew;
+    int rc;
+    // Header names are case-insensitive, and so are comparisons on the name
+    // column whether or not they are pushed down into xFilter.
+    rc = sqlite3_declare_vtab(
+        db, "CREATE TABLE x(name TEXT COLLATE NOCASE, value TEXT, headers TEXT HIDDEN)");
+    if (rc == SQLITE_OK) {
+        pNew = sqlite3_malloc(sizeof(*pNew));
+        *ppVtab = (sqlite3_vtab*)pNew;
+        if (pNew == 0)
+            return SQLITE_NOMEM;
+        memset(pNew, 0, sizeof(*pNew));
+        pNew->pExt = (http_ext*)pAux;
+    }
+    return rc;
+}
+
+static int httpHeadersEachDisconnect(sqlite3_vtab* pVtab) {
+    http_headers_each_vtab* p = (http_headers_each_vtab*)pVtab;
+    sqlite3_free(p);
+    return SQLITE_OK;
+}
+
+static int httpHeadersEachOpen(sqlite3_vtab* p, sqlite3_vtab_cursor** ppCursor) {
+    http_headers_each_cursor* pCur;
+    pCur = sqlite3_malloc(sizeof(*pCur));
+    if (pCur == 0)
+        return SQLITE_NOMEM;
+    memset(pCur, 0, sizeof(*pCur));
+    *ppCursor = &pCur->base;
+    return SQLITE_OK;
+}
+
+static int httpHeadersEachClose(sqlite3_vtab_cursor* cur) {
+    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
+    httpHeadersIndexUnref(pCur->pIndex);
+    httpHeadersEachClearNames(pCur);
+    sqlite3_free(pCur);
+    return SQLITE_OK;
+}
+
+// Move to the header at pCur->iRowid.
+static int httpHeadersEachStep(http_headers_each_cursor* pCur) {
+    int rc;
+    if (pCur->bParsed) {
+        if (pCur->iRowid > pCur->view.nHeaders) {
+            pCur->done = 1;
+            return SQLITE_OK;
+        }
+        rc = httpHeadersViewGet(&pCur->view,
+                                (int)pCur->iRowid - 1,
+                                &pCur->name,
+                                &pCur->nameSize,
+                                &pCur->value,
+                                &pCur->valueSize);
+    } else {
+        rc = SQLITE_ROW;
+        if (pCur->iRowid > pCur->pIndex->nHeaders) {
+            rc = httpHeadersIndexNext(pCur->pIndex);
+        }
+        if (rc == SQLITE_ROW) {
+            httpHeadersIndexGet(pCur->pIndex,
+                                (int)pCur->iRowid - 1,
+                                &pCur->name,
+                                &pCur->nameSize,
+                                &pCur->value,
+                                &pCur->valueSize);
+        }
+    }
+    if (rc == SQLITE_NOMEM) {
+        return rc;
+    }
+    if (rc == SQLITE_ERROR) {
+        sqlite3_free(pCur->base.pVtab->zErrMsg);
+        pCur->base.pVtab->zErrMsg = sqlite3_mprintf("http_headers_each: malformed headers");
+        return SQLITE_ERROR;
+    }
+    pCur->done = rc == SQLITE_DONE;
+    if (pCur->done) {
+        // Let the next lookup reuse the index.
+        httpHeadersIndexUnref(pCur->pIndex);
+        pCur->pIndex = NULL;
+    }
+    return SQLITE_OK;
+}
+
+// Move to the first header at or after pCur->iRowid that passes the name
+// filter. A filtered scan must return the same rows as SQLite filtering an
+// unfiltered one, so it always runs to the end of the headers: any name may
+// be repeated, even those a sender should not repeat.
+static int httpHeadersEachSeek(http_headers_each_cursor* pCur) {
+    int rc;
+    for (;;) {
+        rc = httpHeadersEachStep(pCur);
+        if (rc != SQLITE_OK || pCur->done || !pCur->eName || httpHeadersEachMatch(pCur)) {
+            return rc;
+        }
+        pCur->iRowid++;
+    }
+}
+
+static int httpHeadersEachNext(sqlite3_vtab_cursor* cur) {
+    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
+    pCur->iRowid++;
+    return httpHeadersEachSeek(pCur);
+}
+
+static int httpHeadersEachColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
+    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
+    switch (i) {
+    case HTTP_HEADERS_EACH_COL_NAME:
+        sqlite3_result_text(ctx, pCur->name, pCur->nameSize, SQLITE_TRANSIENT);
+        break;
+
+    case HTTP_HEADERS_EACH_COL_VALUE:
+        sqlite3_result_text(ctx, pCur->value, pCur->valueSize, SQLITE_TRANSIENT);
+        break;
+
+    case HTTP_HEADERS_EACH_COL_HEADERS:
+        if (pCur->bParsed) {
+            sqlite3_result_blob(ctx, pCur->zHeaders, pCur->zHeadersSize, SQLITE_TRANSIENT);
+        } else {
+            sqlite3_result_text(ctx, pCur->zHeaders, pCur->zHeadersSize, SQLITE_TRANSIENT);
+        }
+        break;
+
+    default:
+        sqlite3_result_error(ctx, "unknown column", -1);
+        break;
+    }
+    return SQLITE_OK;
+}
+
+static int httpHeadersEachRowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
+    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
+    *pRowid = pCur->iRowid;
+    return SQLITE_OK;
+}
+
+static int httpHeadersEachEof(sqlite3_vtab_cursor* cur) {
+    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
+    return pCur->done;
+}
+
+static int httpHeadersEachFilter(sqlite3_vtab_cursor* pVtabCursor,
+                                 int idxNum,
+                                 const char* idxStr,
+                                 int argc,
+                                 sqlite3_value** argv) {
+    http_headers_each_cursor* pCur = (http_headers_each_cursor*)pVtabCursor;
+    http_headers_each_vtab* pTab = (http_headers_each_vtab*)pVtabCursor->pVtab;
+    int rc;
+    httpHeadersIndexUnref(pCur->pIndex);
+    pCur->pIndex = NULL;
+    pCur->done = 0;
+    httpHeadersEachClearNames(pCur);
+    if (idxNum) {
+        rc = httpHeadersEachLoadNames(pCur, idxNum, argv[1]);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+    }
+    pCur->bParsed = httpHeadersUnpack(argv[0], &pCur->view) == SQLITE_OK;
+    if (pCur->bParsed) {
+        pCur->zHeaders = sqlite3_value_blob(argv[0]);
+        pCur->zHeadersSize = sqlite3_value_bytes(argv[0]);
+    } else {
+        int bHit;
+        rc = httpHeadersCached(pTab->pExt,
+                               (const char*)sqlite3_value_text(argv[0]),
+                               sqlite3_value_bytes(argv[0]),
+                               &pCur->pIndex,
+                               &bHit);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        pCur->pIndex->nRef++;
+        pCur->zHeaders = pCur->pIndex->zText;
+        pCur->zHeadersSize = pCur->pIndex->nText;
+    }
+    pCur->iRowid = 1;
+    return httpHeadersEachSeek(pCur);
+}
+
+// The cursor compares names case-insensitively, which skips no header that
+// could be equal under BINARY or NOCASE. Other collations are left to SQLite.
+// Older versions cannot report it, so the column's NOCASE is assumed.
+static int httpHeadersEachCanMatch(sqlite3_index_info* pIdxInfo, int iConstraint) {
+    const char* zColl;
+    if (sqlite3_libversion_number() < 3022000) {
+        return 1;
+    }
+    zColl = sqlite3_vtab_collation(pIdxInfo, iConstraint);
+    return !zColl || sqlite3_stricmp(zColl, "BINARY") == 0 || sqlite3_stricmp(zColl, "NOCASE") == 0;
+}
+
+static int httpHeadersEachBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
+    int bHeadersSeen = 0;
+    int iName = -1;
+    int eName = 0;
+
+    for (int i = 0; i < pIdxInfo->nConstraint; ++i) {
+        const struct sqlite3_index_constraint* pConstraint = &pIdxInfo->aConstraint[i];
+        if (pConstraint->iColumn == HTTP_HEADERS_EACH_COL_HEADERS) {
+            if (!pConstraint->usable) {
+                return SQLITE_CONSTRAINT;
+            }
+            pIdxInfo->aConstraintUsage[i].argvIndex = 1;
+            pIdxInfo->aConstraintUsage[i].omit = 1;
+            bHeadersSeen = 1;
+        } else if (pConstraint->iColumn == HTTP_HEADERS_EACH_COL_NAME && pConstraint->usable) {
+            // Use one name constraint, preferring equality.
+            if (pConstraint->op == SQLITE_INDEX_CONSTRAINT_EQ &&
+                eName != HTTP_HEADERS_EACH_NAME_EQ && httpHeadersEachCanMatch(pIdxInfo, i)) {
+                iName = i;
+                eName = HTTP_HEADERS_EACH_NAME_EQ;
+            } else if (pConstraint->op == SQLITE_INDEX_CONSTRAINT_LIKE && !eName) {
+                iName = i;
+                eName = HTTP_HEADERS_EACH_NAME_LIKE;
+            } else if (pConstraint->op == SQLITE_INDEX_CONSTRAINT_GLOB && !eName) {
+                iName = i;
+                eName = HTTP_HEADERS_EACH_NAME_GLOB;
+            }
+        }
+    }
+
+    if (!bHeadersSeen) {
+        sqlite3_free(tab->zErrMsg);
+        tab->zErrMsg = sqlite3_mprintf("headers missing");
+        return SQLITE_ERROR;
+    }
+
+    // The cursor only skips headers that cannot match, SQLite still checks
+    // every constraint with the collation of the query.
+    if (eName) {
+        pIdxInfo->aConstraintUsage[iName].argvIndex = 2;
+        if (eName == HTTP_HEADERS_EACH_NAME_EQ && httpVtabInAll(pIdxInfo, iName)) {
+            eName = HTTP_HEADERS_EACH_NAME_IN;
+        }
+    }
+    pIdxInfo->idxNum = eName;
+
+    // All headers are scanned in any case, but a filtered scan returns fewer
+    // rows and copies less.
+    switch (eName) {
+    case HTTP_HEADERS_EACH_NAME_EQ:
+        pIdxInfo->estimatedCost = (double)5;
+        pIdxInfo->estimatedRows = 1;
+        break;
+    case HTTP_HEADERS_EACH_NAME_IN:
+        pIdxInfo->estimatedCost = (double)6;
+        pIdxInfo->estimatedRows = 3;
+        break;
+    case HTTP_HEADERS_EACH_NAME_LIKE:
+    case HTTP_HEADERS_EACH_NAME_GLOB:
+        pIdxInfo->estimatedCost = (double)8;
+        pIdxInfo->estimatedRows = 5;
+        break;
+    default:
+        pIdxInfo->estimatedCost = (double)10;
+        pIdxInfo->estimatedRows = 20;
+        break;
+    }
+
+    return SQLITE_OK;
+}
+
+static sqlite3_module httpHeadersEachModule = {
+    /* iVersion    */ 0,
+    /* xCreate     */ 0,
+    /* xConnect    */ httpHeadersEachConnect,
+    /* xBestIndex  */ httpHeadersEachBestIndex,
+    /* xDisconnect */ httpHeadersEachDisconnect,
+    /* xDestroy    */ 0,
+    /* xOpen       */ httpHeadersEachOpen,
+    /* xClose      */ httpHeadersEachClose,
+    /* xFilter     */ httpHeadersEachFilter,
+    /* xNext       */ httpHeadersEachNext,
+    /* xEof        */ httpHeadersEachEof,
+    /* xColumn     */ httpHeadersEachColumn,
+    /* xRowid      */ httpHeadersEachRowid,
+    /* xUpdate     */ 0,
+    /* xBegin      */ 0,
+    /* xSync       */ 0,
+    /* xCommit     */ 0,
+    /* xRollback   */ 0,
+    /* xFindMethod */ 0,
+    /* xRename     */ 0,
+    /* xSavepoint  */ 0,
+    /* xRelease    */ 0,
+    /* xRollbackTo */ 0,
+    /* xShadowName */ 0,
+};
+
+#define HTTP_BACKEND_INFO_COL_NAME 0
+#define HTTP_BACKEND_INFO_COL_VALUE 1
+
+#define HTTP_BACKEND_INFO_ROWS 7
+
+typedef struct http_backend_info_cursor http_backend_info_cursor;
+struct http_backend_info_cursor {
+    sqlite3_vtab_cursor base;
+    sqlite3_int64 iRowid;
+    http_backend_info info;
+};
+
+static int httpBackendInfoConnect(sqlite3* db,
+                                  void* pAux,
+                                  int argc,
+                                  const char* const* argv,
+                                  sqlite3_vtab** ppVtab,
+                                  char** pzErr) {
+    sqlite3_vtab* pNew;
+    int rc;
+    rc = sqlite3_declare_vtab(db, "CREATE TABLE x(name TEXT, value)");
+    if (rc == SQLITE_OK) {
+        pNew = sqlite3_malloc(sizeof(*pNew));
+        *ppVtab = pNew;
+        if (pNew == 0)
+            return SQLITE_NOMEM;
+        memset(pNew, 0, sizeof(*pNew));
+    }
+    return rc;
+}
+
+static int httpBackendInfoDisconnect(sqlite3_vtab* pVtab) {
+    sqlite3_free(pVtab);
+    return SQLITE_OK;
+}
+
+static int httpBackendInfoOpen(sqlite3_vtab* p, sqlite3_vtab_cursor** ppCursor) {
+    http_backend_info_cursor* pCur;
+    pCur = sqlite3_malloc(sizeof(*pCur));
+    if (pCur == 0)
+        return SQLITE_NOMEM;
+    memset(pCur, 0, sizeof(*pCur));
+    *ppCursor = &pCur->base;
+    return SQLITE_OK;
+}
+
+static int httpBackendInfoClose(sqlite3_vtab_cursor* cur) {
+    sqlite3_free(cur);
+    return SQLITE_OK;
+}
+
+static int httpBackendInfoNext(sqlite3_vtab_cursor* cur) {
+    http_backend_info_cursor* pCur = (http_backend_info_cursor*)cur;
+    pCur->iRowid++;
+    return SQLITE_OK;
+}
+
+static void result_text_or_null(sqlite3_context* ctx, const char* zText) {
+    if (zText) {
+        sqlite3_result_text(ctx, zText, -1, SQLITE_STATIC);
+    } else {
+        sqlite3_result_null(ctx);
+    }
+}
+
+static int httpBackendInfoColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
+    static const char* aNames[HTTP_BACKEND_INFO_ROWS] = {
+        "backend",
+        "version",
+        "ssl_version",
+        "http2",
+        "http3",
+        "compression",
+        "share",
+    };
+    http_backend_info_cursor* pCur = (http_backend_info_cursor*)cur;
+    const http_backend_info* pInfo = &pCur->info;
+    int iRow = (int)pCur->iRowid - 1;
+
+    if (i == HTTP_BACKEND_INFO_COL_NAME) {
+        sqlite3_result_text(ctx, aNames[iRow], -1, SQLITE_STATIC);
+        return SQLITE_OK;
+    }
+
+    switch (iRow) {
+    case 0:
+        result_text_or_null(ctx, pInfo->zName);
+        break;
+    case 1:
+        result_text_or_null(ctx, pInfo->zVersion);
+        break;
+    case 2:
+        result_text_or_null(ctx, pInfo->zSslVersion);
+        break;
+    case 3:
+        sqlite3_result_int(ctx, pInfo->bHttp2);
+        break;
+    case 4:
+        sqlite3_result_int(ctx, pInfo->bHttp3);
+        break;
+    case 5:
+        result_text_or_null(ctx, pInfo->zCompression);
+        break;
+    case 6:
+        sqlite3_result_int(ctx, pInfo->bShare);
+        break;
+    }
+
+    return SQLITE_OK;
+}
+
+static int httpBackendInfoRowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
+    http_backend_info_cursor* pCur = (http_backend_info_cursor*)cur;
+    *pRowid = pCur->iRowid;
+    return SQLITE_OK;
+}
+
+static int httpBackendInfoEof(sqlite3_vtab_cursor* cur) {
+    http_backend_info_cursor* pCur = (http_backend_info_cursor*)cur;
+    return pCur->iRowid > HTTP_BACKEND_INFO_ROWS;
+}
+
+static int httpBackendInfoFilter(sqlite3_vtab_cursor* pVtabCursor,
+                                 int idxNum,
+                                 const char* idxStr,
+                                 int argc,
+                                 sqlite3_value** argv) {
+    http_backend_info_cursor* pCur = (http_backend_info_cursor*)pVtabCursor;
+    char* zErrMsg = NULL;
+    int rc = http_backend_get_info(&pCur->info, &zErrMsg);
+    if (rc != SQLITE_OK) {
+        sqlite3_free(pVtabCursor->pVtab->zErrMsg);
+        pVtabCursor->pVtab->zErrMsg = zErrMsg;
+        return rc;
+    }
+    pCur->iRowid = 1;
+    return SQLITE_OK;
+}
 
-typedef struct http_headers_each_vtab http_headers_each_vtab;
-struct http_headers_each_vtab {
-    sqlite3_vtab base;
+static int httpBackendInfoBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
+    pIdxInfo->estimatedCost = (double)HTTP_BACKEND_INFO_ROWS;
+    pIdxInfo->estimatedRows = HTTP_BACKEND_INFO_ROWS;
+    return SQLITE_OK;
+}
+
+static sqlite3_module httpBackendInfoModule = {
+    /* iVersion    */ 0,
+    /* xCreate     */ 0,
+    /* xConnect    */ httpBackendInfoConnect,
+    /* xBestIndex  */ httpBackendInfoBestIndex,
+    /* xDisconnect */ httpBackendInfoDisconnect,
+    /* xDestroy    */ 0,
+    /* xOpen       */ httpBackendInfoOpen,
+    /* xClose      */ httpBackendInfoClose,
+    /* xFilter     */ httpBackendInfoFilter,
+    /* xNext       */ httpBackendInfoNext,
+    /* xEof        */ httpBackendInfoEof,
+    /* xColumn     */ httpBackendInfoColumn,
+    /* xRowid      */ httpBackendInfoRowid,
+    /* xUpdate     */ 0,
+    /* xBegin      */ 0,
+    /* xSync       */ 0,
+    /* xCommit     */ 0,
+    /* xRollback   */ 0,
+    /* xFindMethod */ 0,
+    /* xRename     */ 0,
+    /* xSavepoint  */ 0,
+    /* xRelease    */ 0,
+    /* xRollbackTo */ 0,
+    /* xShadowName */ 0,
 };
 
-typedef struct http_headers_each_cursor http_headers_each_cursor;
-struct http_headers_each_cursor {
+#define HTTP_STATS_COL_HOST 0
+#define HTTP_STATS_COL_REQUESTS 1
+#define HTTP_STATS_COL_FAILED 2
+#define HTTP_STATS_COL_STATUS_4XX 3
+#define HTTP_STATS_COL_STATUS_5XX 4
+#define HTTP_STATS_COL_BYTES_SENT 5
+#define HTTP_STATS_COL_BYTES_RECEIVED 6
+#define HTTP_STATS_COL_CONNECTIONS_NEW 7
+#define HTTP_STATS_COL_CONNECTIONS_REUSED 8
+#define HTTP_STATS_COL_LATENCY_TOTAL 9
+#define HTTP_STATS_COL_LATENCY_P50 10
+#define HTTP_STATS_COL_LATENCY_P95 11
+#define HTTP_STATS_COL_LATENCY_P99 12
+
+typedef struct http_stats_cursor http_stats_cursor;
+struct http_stats_cursor {
     sqlite3_vtab_cursor base;
     sqlite3_int64 iRowid;
-    const char* zHeaders;
-    int zHeadersSize;
-    const char* p;
-    const char* name;
-    int nameSize;
-    const char* value;
-    int valueSize;
-    int available;
-    int done;
+    http_stats_host* aHost;
+    int nHost;
 };
 
-static int httpHeadersEachConnect(sqlite3* db,
-                                  void* pAux,
-                                  int argc,
-                                  const char* const* argv,
-                                  sqlite3_vtab** ppVtab,
-                                  char** pzErr) {
-    http_headers_each_vtab* pNew;
+static int httpStatsConnect(sqlite3* db,
+                            void* pAux,
+                            int argc,
+                            const char* const* argv,
+                            sqlite3_vtab** ppVtab,
+                            char** pzErr) {
+    sqlite3_vtab* pNew;
     int rc;
-    rc = sqlite3_declare_vtab(db, "CREATE TABLE x(name TEXT, value TEXT, headers TEXT HIDDEN)");
+    rc = sqlite3_declare_vtab(db,
+                              "CREATE TABLE x(host TEXT, requests INT, failed INT, "
+                              "status_4xx INT, status_5xx INT, bytes_sent INT, "
+                              "bytes_received INT, connections_new INT, "
+                              "connections_reused INT, latency_total_us INT, "
+                              "latency_p50_us INT, latency_p95_us INT, latency_p99_us INT)");
     if (rc == SQLITE_OK) {
         pNew = sqlite3_malloc(sizeof(*pNew));
-        *ppVtab = (sqlite3_vtab*)pNew;
+        *ppVtab = pNew;
         if (pNew == 0)
             return SQLITE_NOMEM;
         memset(pNew, 0, sizeof(*pNew));
@@ -585,14 +3606,13 @@ static int httpHeadersEachConnect(sqlite3* db,
     return rc;
 }
 
-static int httpHeadersEachDisconnect(sqlite3_vtab* pVtab) {
-    http_headers_each_vtab* p = (http_headers_each_vtab*)pVtab;
-    sqlite3_free(p);
+static int httpStatsDisconnect(sqlite3_vtab* pVtab) {
+    sqlite3_free(pVtab);
     return SQLITE_OK;
 }
 
-static int httpHeadersEachOpen(sqlite3_vtab* p, sqlite3_vtab_cursor** ppCursor) {
-    http_headers_each_cursor* pCur;
+static int httpStatsOpen(sqlite3_vtab* p, sqlite3_vtab_cursor** ppCursor) {
+    http_stats_cursor* pCur;
     pCur = sqlite3_malloc(sizeof(*pCur));
     if (pCur == 0)
         return SQLITE_NOMEM;
@@ -601,138 +3621,323 @@ static int httpHeadersEachOpen(sqlite3_vtab* p, sqlite3_vtab_cursor** ppCursor)
     return SQLITE_OK;
 }
 
-static int httpHeadersEachClose(sqlite3_vtab_cursor* cur) {
-    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
+static int httpStatsClose(sqlite3_vtab_cursor* cur) {
+    http_stats_cursor* pCur = (http_stats_cursor*)cur;
+    http_stats_free(pCur->aHost, pCur->nHost);
     sqlite3_free(pCur);
     return SQLITE_OK;
 }
 
-static int httpHeadersEachNext(sqlite3_vtab_cursor* cur) {
-    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
+static int httpStatsNext(sqlite3_vtab_cursor* cur) {
+    http_stats_cursor* pCur = (http_stats_cursor*)cur;
     pCur->iRowid++;
-    int nparsed = 0;
-    int rc = http_next_header(pCur->p,
-                              pCur->available,
-                              &nparsed,
-                              &pCur->name,
-                              &pCur->nameSize,
-                              &pCur->value,
-                              &pCur->valueSize);
-    pCur->p += nparsed;
-    pCur->available -= nparsed;
-    if (rc == SQLITE_ERROR) {
-        sqlite3_free(cur->pVtab->zErrMsg);
-        cur->pVtab->zErrMsg = sqlite3_mprintf("http_headers_each: malformed headers");
-        return SQLITE_ERROR;
-    }
-    pCur->done = rc == SQLITE_DONE;
     return SQLITE_OK;
 }
 
-static int httpHeadersEachColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
-    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
+static int httpStatsColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
+    http_stats_cursor* pCur = (http_stats_cursor*)cur;
+    const http_stats_host* pHost = &pCur->aHost[pCur->iRowid - 1];
+    sqlite3_int64 usPercentile;
+
     switch (i) {
-    case HTTP_HEADERS_EACH_COL_NAME:
-        sqlite3_result_text(ctx, pCur->name, pCur->nameSize, SQLITE_TRANSIENT);
+    case HTTP_STATS_COL_HOST:
+        sqlite3_result_text(ctx, pHost->zHost, -1, SQLITE_TRANSIENT);
         break;
-
-    case HTTP_HEADERS_EACH_COL_VALUE:
-        sqlite3_result_text(ctx, pCur->value, pCur->valueSize, SQLITE_TRANSIENT);
+    case HTTP_STATS_COL_REQUESTS:
+        sqlite3_result_int64(ctx, pHost->nRequests);
         break;
-
-    case HTTP_HEADERS_EACH_COL_HEADERS:
-        sqlite3_result_text(ctx, pCur->zHeaders, pCur->zHeadersSize, SQLITE_TRANSIENT);
+    case HTTP_STATS_COL_FAILED:
+        sqlite3_result_int64(ctx, pHost->nFailed);
         break;
-
-    default:
-        sqlite3_result_error(ctx, "unknown column", -1);
+    case HTTP_STATS_COL_STATUS_4XX:
+        sqlite3_result_int64(ctx, pHost->n4xx);
+        break;
+    case HTTP_STATS_COL_STATUS_5XX:
+        sqlite3_result_int64(ctx, pHost->n5xx);
+        break;
+    case HTTP_STATS_COL_BYTES_SENT:
+        sqlite3_result_int64(ctx, pHost->szSent);
+        break;
+    case HTTP_STATS_COL_BYTES_RECEIVED:
+        sqlite3_result_int64(ctx, pHost->szReceived);
+        break;
+    case HTTP_STATS_COL_CONNECTIONS_NEW:
+        sqlite3_result_int64(ctx, pHost->nNewConnections);
+        break;
+    case HTTP_STATS_COL_CONNECTIONS_REUSED:
+        sqlite3_result_int64(ctx, pHost->nReusedConnections);
+        break;
+    case HTTP_STATS_COL_LATENCY_TOTAL:
+        sqlite3_result_int64(ctx, pHost->usLatency);
+        break;
+    case HTTP_STATS_COL_LATENCY_P50:
+    case HTTP_STATS_COL_LATENCY_P95:
+    case HTTP_STATS_COL_LATENCY_P99:
+        usPercentile = http_stats_percentile(pHost,
+                                             i == HTTP_STATS_COL_LATENCY_P50   ? 0.50
+                                             : i == HTTP_STATS_COL_LATENCY_P95 ? 0.95
+                                                                               : 0.99);
+        // Requests slower than the histogram are reported as +Inf, not as the
+        // limit of the last bounded bucket.
+        if (usPercentile == HTTP_STATS_UNBOUNDED) {
+            sqlite3_result_double(ctx, HUGE_VAL);
+        } else if (usPercentile >= 0) {
+            sqlite3_result_int64(ctx, usPercentile);
+        }
         break;
     }
     return SQLITE_OK;
 }
 
-static int httpHeadersEachRowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
-    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
+static int httpStatsRowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
+    http_stats_cursor* pCur = (http_stats_cursor*)cur;
     *pRowid = pCur->iRowid;
     return SQLITE_OK;
 }
 
-static int httpHeadersEachEof(sqlite3_vtab_cursor* cur) {
-    http_headers_each_cursor* pCur = (http_headers_each_cursor*)cur;
-    return pCur->done;
+static int httpStatsEof(sqlite3_vtab_cursor* cur) {
+    http_stats_cursor* pCur = (http_stats_cursor*)cur;
+    return pCur->iRowid > pCur->nHost;
 }
 
-static int httpHeadersEachFilter(sqlite3_vtab_cursor* pVtabCursor,
-                                 int idxNum,
-                                 const char* idxStr,
-                                 int argc,
-                                 sqlite3_value** argv) {
-    http_headers_each_cursor* pCur = (http_headers_each_cursor*)pVtabCursor;
-    pCur->zHeadersSize = sqlite3_value_bytes(argv[0]);
-    pCur->available = pCur->zHeadersSize;
-    pCur->zHeaders = sqlite3_value_text(argv[0]);
-    pCur->p = pCur->zHeaders;
-    int nparsed = 0;
-    int rc = http_next_header(pCur->p,
-                              pCur->available,
-                              &nparsed,
-                              &pCur->name,
-                              &pCur->nameSize,
-                              &pCur->value,
-                              &pCur->valueSize);
-    pCur->p += nparsed;
-    pCur->available -= nparsed;
+// The statistics are copied when the scan starts, so that the shards are not
+// locked while the query runs.
+static int httpStatsFilter(sqlite3_vtab_cursor* pVtabCursor,
+                           int idxNum,
+                           const char* idxStr,
+                           int argc,
+                           sqlite3_value** argv) {
+    http_stats_cursor* pCur = (http_stats_cursor*)pVtabCursor;
+    http_stats_free(pCur->aHost, pCur->nHost);
+    pCur->aHost = NULL;
+    pCur->nHost = 0;
     pCur->iRowid = 1;
-    if (rc == SQLITE_ERROR) {
-        sqlite3_free(pVtabCursor->pVtab->zErrMsg);
-        pVtabCursor->pVtab->zErrMsg = sqlite3_mprintf("http_headers_each: malformed headers");
-        return SQLITE_ERROR;
+    return http_stats_snapshot(&pCur->aHost, &pCur->nHost);
+}
+
+static int httpStatsBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
+    pIdxInfo->estimatedCost = (double)10;
+    pIdxInfo->estimatedRows = 10;
+    return SQLITE_OK;
+}
+
+static sqlite3_module httpStatsModule = {
+    /* iVersion    */ 0,
+    /* xCreate     */ 0,
+    /* xConnect    */ httpStatsConnect,
+    /* xBestIndex  */ httpStatsBestIndex,
+    /* xDisconnect */ httpStatsDisconnect,
+    /* xDestroy    */ 0,
+    /* xOpen       */ httpStatsOpen,
+    /* xClose      */ httpStatsClose,
+    /* xFilter     */ httpStatsFilter,
+    /* xNext       */ httpStatsNext,
+    /* xEof        */ httpStatsEof,
+    /* xColumn     */ httpStatsColumn,
+    /* xRowid      */ httpStatsRowid,
+    /* xUpdate     */ 0,
+    /* xBegin      */ 0,
+    /* xSync       */ 0,
+    /* xCommit     */ 0,
+    /* xRollback   */ 0,
+    /* xFindMethod */ 0,
+    /* xRename     */ 0,
+    /* xSavepoint  */ 0,
+    /* xRelease    */ 0,
+    /* xRollbackTo */ 0,
+    /* xShadowName */ 0,
+};
+
+#define HTTP_TRACE_COL_ID 0
+#define HTTP_TRACE_COL_STARTED_AT 1
+#define HTTP_TRACE_COL_REQUEST_METHOD 2
+#define HTTP_TRACE_COL_REQUEST_URL 3
+#define HTTP_TRACE_COL_REQUEST_SQL 4
+#define HTTP_TRACE_COL_RESPONSE_STATUS_CODE 5
+#define HTTP_TRACE_COL_RESPONSE_ERROR 6
+#define HTTP_TRACE_COL_TRANSFER_DNS_US 7
+#define HTTP_TRACE_COL_TRANSFER_CONNECT_US 8
+#define HTTP_TRACE_COL_TRANSFER_TLS_US 9
+#define HTTP_TRACE_COL_TRANSFER_FIRST_BYTE_US 10
+#define HTTP_TRACE_COL_TRANSFER_TOTAL_US 11
+#define HTTP_TRACE_COL_TRANSFER_BYTES_SENT 12
+#define HTTP_TRACE_COL_TRANSFER_BYTES_RECEIVED 13
+#define HTTP_TRACE_COL_SLOW 14
+
+typedef struct http_trace_cursor http_trace_cursor;
+struct http_trace_cursor {
+    sqlite3_vtab_cursor base;
+    sqlite3_int64 iRowid;
+    http_trace_entry* aEntry;
+    int nEntry;
+};
+
+static int httpTraceConnect(sqlite3* db,
+                            void* pAux,
+                            int argc,
+                            const char* const* argv,
+                            sqlite3_vtab** ppVtab,
+                            char** pzErr) {
+    sqlite3_vtab* pNew;
+    int rc;
+    rc = sqlite3_declare_vtab(db,
+                              "CREATE TABLE x(id INT, started_at REAL, request_method TEXT, "
+                              "request_url TEXT, request_sql TEXT, response_status_code INT, "
+                              "response_error TEXT, transfer_dns_us INT, transfer_connect_us INT, "
+                              "transfer_tls_us INT, transfer_first_byte_us INT, "
+                              "transfer_total_us INT, transfer_bytes_sent INT, "
+                              "transfer_bytes_received INT, slow INT)");
+    if (rc == SQLITE_OK) {
+        pNew = sqlite3_malloc(sizeof(*pNew));
+        *ppVtab = pNew;
+        if (pNew == 0)
+            return SQLITE_NOMEM;
+        memset(pNew, 0, sizeof(*pNew));
     }
-    pCur->done = rc == SQLITE_DONE;
+    return rc;
+}
+
+static int httpTraceDisconnect(sqlite3_vtab* pVtab) {
+    sqlite3_free(pVtab);
     return SQLITE_OK;
 }
 
-static int httpHeadersEachBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
-    http_vtab* pTab = (http_vtab*)tab;
-    int bHeadersSeen = 0;
+static int httpTraceOpen(sqlite3_vtab* p, sqlite3_vtab_cursor** ppCursor) {
+    http_trace_cursor* pCur;
+    pCur = sqlite3_malloc(sizeof(*pCur));
+    if (pCur == 0)
+        return SQLITE_NOMEM;
+    memset(pCur, 0, sizeof(*pCur));
+    *ppCursor = &pCur->base;
+    return SQLITE_OK;
+}
 
-    for (int i = 0; i < pIdxInfo->nConstraint; ++i) {
-        if (pIdxInfo->aConstraint[i].iColumn == HTTP_HEADERS_EACH_COL_HEADERS) {
-            if (!pIdxInfo->aConstraint[i].usable) {
-                return SQLITE_CONSTRAINT;
-            }
-            pIdxInfo->aConstraintUsage[i].argvIndex = 1;
-            pIdxInfo->aConstraintUsage[i].omit = 1;
-            bHeadersSeen = 1;
-        }
+static int httpTraceClose(sqlite3_vtab_cursor* cur) {
+    http_trace_cursor* pCur = (http_trace_cursor*)cur;
+    sqlite3_free(pCur->aEntry);
+    sqlite3_free(pCur);
+    return SQLITE_OK;
+}
+
+static int httpTraceNext(sqlite3_vtab_cursor* cur) {
+    http_trace_cursor* pCur = (http_trace_cursor*)cur;
+    pCur->iRowid++;
+    return SQLITE_OK;
+}
+
+static void httpResultTraceTiming(sqlite3_context* ctx, int usTiming) {
+    if (usTiming >= 0) {
+        sqlite3_result_int(ctx, usTiming);
     }
+}
 
-    if (!bHeadersSeen) {
-        sqlite3_free(tab->zErrMsg);
-        tab->zErrMsg = sqlite3_mprintf("headers missing");
-        return SQLITE_ERROR;
+static void httpResultTraceText(sqlite3_context* ctx, const http_trace_entry* pEntry, int iText) {
+    const char* zText = http_trace_text(pEntry, iText);
+    if (zText) {
+        sqlite3_result_text(ctx, zText, -1, SQLITE_TRANSIENT);
+    }
+}
+
+static int httpTraceColumn(sqlite3_vtab_cursor* cur, sqlite3_context* ctx, int i) {
+    http_trace_cursor* pCur = (http_trace_cursor*)cur;
+    const http_trace_entry* pEntry = &pCur->aEntry[pCur->iRowid - 1];
+
+    switch (i) {
+    case HTTP_TRACE_COL_ID:
+        sqlite3_result_int64(ctx, pEntry->iSeq / 2);
+        break;
+    case HTTP_TRACE_COL_STARTED_AT:
+        sqlite3_result_double(ctx, pEntry->iStarted / 1e6);
+        break;
+    case HTTP_TRACE_COL_REQUEST_METHOD:
+        httpResultTraceText(ctx, pEntry, HTTP_TRACE_METHOD);
+        break;
+    case HTTP_TRACE_COL_REQUEST_URL:
+        httpResultTraceText(ctx, pEntry, HTTP_TRACE_URL);
+        break;
+    case HTTP_TRACE_COL_REQUEST_SQL:
+        httpResultTraceText(ctx, pEntry, HTTP_TRACE_SQL);
+        break;
+    case HTTP_TRACE_COL_RESPONSE_STATUS_CODE:
+        if (pEntry->iStatusCode) {
+            sqlite3_result_int(ctx, pEntry->iStatusCode);
+        }
+        break;
+    case HTTP_TRACE_COL_RESPONSE_ERROR:
+        httpResultTraceText(ctx, pEntry, HTTP_TRACE_ERROR);
+        break;
+    case HTTP_TRACE_COL_TRANSFER_DNS_US:
+        httpResultTraceTiming(ctx, pEntry->usDns);
+        break;
+    case HTTP_TRACE_COL_TRANSFER_CONNECT_US:
+        httpResultTraceTiming(ctx, pEntry->usConnect);
+        break;
+    case HTTP_TRACE_COL_TRANSFER_TLS_US:
+        httpResultTraceTiming(ctx, pEntry->usTls);
+        break;
+    case HTTP_TRACE_COL_TRANSFER_FIRST_BYTE_US:
+        httpResultTraceTiming(ctx, pEntry->usFirstByte);
+        break;
+    case HTTP_TRACE_COL_TRANSFER_TOTAL_US:
+        sqlite3_result_int64(ctx, pEntry->usTotal);
+        break;
+    case HTTP_TRACE_COL_TRANSFER_BYTES_SENT:
+        sqlite3_result_int64(ctx, pEntry->szSent);
+        break;
+    case HTTP_TRACE_COL_TRANSFER_BYTES_RECEIVED:
+        sqlite3_result_int64(ctx, pEntry->szReceived);
+        break;
+    case HTTP_TRACE_COL_SLOW:
+        sqlite3_result_int(ctx, pEntry->bSlow);
+        break;
     }
+    return SQLITE_OK;
+}
+
+static int httpTraceRowid(sqlite3_vtab_cursor* cur, sqlite_int64* pRowid) {
+    http_trace_cursor* pCur = (http_trace_cursor*)cur;
+    *pRowid = pCur->iRowid;
+    return SQLITE_OK;
+}
 
-    pIdxInfo->estimatedCost = (double)1;
-    // pIdxInfo->estimatedRows = 1;
+static int httpTraceEof(sqlite3_vtab_cursor* cur) {
+    http_trace_cursor* pCur = (http_trace_cursor*)cur;
+    return pCur->iRowid > pCur->nEntry;
+}
+
+static int httpTraceFilter(sqlite3_vtab_cursor* pVtabCursor,
+                           int idxNum,
+                           const char* idxStr,
+                           int argc,
+                           sqlite3_value** argv) {
+    http_trace_cursor* pCur = (http_trace_cursor*)pVtabCursor;
+    sqlite3_free(pCur->aEntry);
+    pCur->aEntry = NULL;
+    pCur->nEntry = 0;
+    pCur->iRowid = 1;
+    return http_trace_snapshot(&pCur->aEntry, &pCur->nEntry);
+}
 
+static int httpTraceBestIndex(sqlite3_vtab* tab, sqlite3_index_info* pIdxInfo) {
+    pIdxInfo->estimatedCost = (double)1000;
+    pIdxInfo->estimatedRows = 1000;
     return SQLITE_OK;
 }
 
-static sqlite3_module httpHeadersEachModule = {
+static sqlite3_module httpTraceModule = {
     /* iVersion    */ 0,
     /* xCreate     */ 0,
-    /* xConnect    */ httpHeadersEachConnect,
-    /* xBestIndex  */ httpHeadersEachBestIndex,
-    /* xDisconnect */ httpHeadersEachDisconnect,
+    /* xConnect    */ httpTraceConnect,
+    /* xBestIndex  */ httpTraceBestIndex,
+    /* xDisconnect */ httpTraceDisconnect,
     /* xDestroy    */ 0,
-    /* xOpen       */ httpHeadersEachOpen,
-    /* xClose      */ httpHeadersEachClose,
-    /* xFilter     */ httpHeadersEachFilter,
-    /* xNext       */ httpHeadersEachNext,
-    /* xEof        */ httpHeadersEachEof,
-    /* xColumn     */ httpHeadersEachColumn,
-    /* xRowid      */ httpHeadersEachRowid,
+    /* xOpen       */ httpTraceOpen,
+    /* xClose      */ httpTraceClose,
+    /* xFilter     */ httpTraceFilter,
+    /* xNext       */ httpTraceNext,
+    /* xEof        */ httpTraceEof,
+    /* xColumn     */ httpTraceColumn,
+    /* xRowid      */ httpTraceRowid,
     /* xUpdate     */ 0,
     /* xBegin      */ 0,
     /* xSync       */ 0,
@@ -746,9 +3951,209 @@ static sqlite3_module httpHeadersEachModule = {
     /* xShadowName */ 0,
 };
 
+// http_trace_enable(enable [, slow_ms]) turns the trace of all connections on
+// or off. Requests taking at least slow_ms milliseconds are kept apart, so
+// they are not pushed out by many fast requests. Zero keeps none apart.
+static void httpTraceEnableFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    int bEnable;
+    sqlite3_int64 usSlow = -1;
+    if (argc < 1 || argc > 2) {
+        sqlite3_result_error(ctx, "http_trace_enable: expected 1 or 2 arguments", -1);
+        return;
+    }
+    bEnable = sqlite3_value_int(argv[0]);
+    if (argc == 2) {
+        double msSlow = sqlite3_value_double(argv[1]);
+        usSlow = msSlow > 0 ? (sqlite3_int64)(msSlow * 1000) : 0;
+    }
+    http_trace_configure(bEnable, usSlow);
+    sqlite3_result_int(ctx, bEnable != 0);
+}
+
+// Append a counter of every host in the Prometheus text format.
+static void httpMetricsCounter(sqlite3_str* pStr,
+                               const http_stats_host* aHost,
+                               int nHost,
+                               const char* zName,
+                               const char* zHelp,
+                               const char* zLabel,
+                               size_t iOffset) {
+    int i;
+    sqlite3_str_appendf(pStr, "# HELP %s %s\n# TYPE %s counter\n", zName, zHelp, zName);
+    for (i = 0; i < nHost; ++i) {
+        sqlite3_str_appendf(pStr,
+                            "%s{host=\"%s\"%s} %lld\n",
+                            zName,
+                            aHost[i].zHost,
+                            zLabel,
+                            *(const sqlite3_int64*)((const char*)&aHost[i] + iOffset));
+    }
+}
+
+// Escape a label value as Prometheus requires: backslash, double quote and
+// newline are written as \\, \" and \n.
+static int httpMetricsEscape(char** pzValue) {
+    const char* zValue = *pzValue;
+    sqlite3_str* pStr;
+    char* zEscaped;
+
+    if (zValue[strcspn(zValue, "\\\"\n")] == '\0') {
+        return SQLITE_OK;
+    }
+    pStr = sqlite3_str_new(NULL);
+    for (; *zValue; ++zValue) {
+        switch (*zValue) {
+        case '\\':
+            sqlite3_str_append(pStr, "\\\\", 2);
+            break;
+        case '"':
+            sqlite3_str_append(pStr, "\\\"", 2);
+            break;
+        case '\n':
+            sqlite3_str_append(pStr, "\\n", 2);
+            break;
+        default:
+            sqlite3_str_appendchar(pStr, 1, *zValue);
+        }
+    }
+    zEscaped = sqlite3_str_finish(pStr);
+    if (!zEscaped) {
+        return SQLITE_NOMEM;
+    }
+    sqlite3_free(*pzValue);
+    *pzValue = zEscaped;
+    return SQLITE_OK;
+}
+
+// http_metrics() returns the statistics of http_stats in the Prometheus text
+// exposition format.
+static void httpMetricsFunc(sqlite3_context* ctx, int argc, sqlite3_value** argv) {
+    http_stats_host* aHost = NULL;
+    int nHost = 0;
+    sqlite3_str* pStr;
+    sqlite3_int64 nCount;
+    int rc;
+    int i;
+    int j;
+
+    if (argc != 0) {
+        sqlite3_result_error(ctx, "http_metrics: expected no arguments", -1);
+        return;
+    }
+
+    rc = http_stats_snapshot(&aHost, &nHost);
+    if (rc != SQLITE_OK) {
+        sqlite3_result_error_code(ctx, rc);
+        return;
+    }
+
+    // The snapshot is ours, so the host names are escaped in place.
+    for (i = 0; i < nHost; ++i) {
+        if (httpMetricsEscape(&aHost[i].zHost) != SQLITE_OK) {
+            http_stats_free(aHost, nHost);
+            sqlite3_result_error_nomem(ctx);
+            return;
+        }
+    }
+
+    pStr = sqlite3_str_new(sqlite3_context_db_handle(ctx));
+    httpMetricsCounter(pStr,
+                       aHost,
+                       nHost,
+                       "http_requests_total",
+                       "Requests made.",
+                       "",
+                       offsetof(http_stats_host, nRequests));
+    sqlite3_str_appendf(pStr,
+                        "# HELP http_request_errors_total Failed requests and error "
+                        "responses.\n# TYPE http_request_errors_total counter\n");
+    for (i = 0; i < nHost; ++i) {
+        sqlite3_str_appendf(pStr,
+                            "http_request_errors_total{host=\"%s\",class=\"failed\"} %lld\n"
+                            "http_request_errors_total{host=\"%s\",class=\"4xx\"} %lld\n"
+                            "http_request_errors_total{host=\"%s\",class=\"5xx\"} %lld\n",
+                            aHost[i].zHost,
+                            aHost[i].nFailed,
+                            aHost[i].zHost,
+                            aHost[i].n4xx,
+                            aHost[i].zHost,
+                            aHost[i].n5xx);
+    }
+    httpMetricsCounter(pStr,
+                       aHost,
+                       nHost,
+                       "http_sent_bytes_total",
+                       "Bytes of request bodies sent.",
+                       "",
+                       offsetof(http_stats_host, szSent));
+    httpMetricsCounter(pStr,
+                       aHost,
+                       nHost,
+                       "http_received_bytes_total",
+                       "Bytes of response bodies received.",
+                       "",
+                       offsetof(http_stats_host, szReceived));
+    sqlite3_str_appendf(pStr,
+                        "# HELP http_connections_total Connections opened and reused.\n"
+                        "# TYPE http_connections_total counter\n");
+    for (i = 0; i < nHost; ++i) {
+        sqlite3_str_appendf(pStr,
+                            "http_connections_total{host=\"%s\",reused=\"false\"} %lld\n"
+                            "http_connections_total{host=\"%s\",reused=\"true\"} %lld\n",
+                            aHost[i].zHost,
+                            aHost[i].nNewConnections,
+                            aHost[i].zHost,
+                            aHost[i].nReusedConnections);
+    }
+    sqlite3_str_appendf(pStr,
+                        "# HELP http_request_duration_seconds Request latency.\n"
+                        "# TYPE http_request_duration_seconds histogram\n");
+    for (i = 0; i < nHost; ++i) {
+        nCount = 0;
+        for (j = 0; j < HTTP_STATS_BUCKETS - 1; ++j) {
+            nCount += aHost[i].aLatency[j];
+            sqlite3_str_appendf(pStr,
+                                "http_request_duration_seconds_bucket{host=\"%s\",le=\"%.6f\"} %lld\n",
+                                aHost[i].zHost,
+                                http_stats_bucket_limit(j) / 1e6,
+                                nCount);
+        }
+        sqlite3_str_appendf(pStr,
+                            "http_request_duration_seconds_bucket{host=\"%s\",le=\"+Inf\"} %lld\n"
+                            "http_request_duration_seconds_sum{host=\"%s\"} %.6f\n"
+                            "http_request_duration_seconds_count{host=\"%s\"} %lld\n",
+                            aHost[i].zHost,
+                            aHost[i].nRequests,
+                            aHost[i].zHost,
+                            aHost[i].usLatency / 1e6,
+                            aHost[i].zHost,
+                            aHost[i].nRequests);
+    }
+
+    http_stats_free(aHost, nHost);
+
+    rc = sqlite3_str_errcode(pStr);
+    if (rc != SQLITE_OK) {
+        sqlite3_free(sqlite3_str_finish(pStr));
+        sqlite3_result_error_code(ctx, rc);
+        return;
+    }
+    i = sqlite3_str_length(pStr);
+    sqlite3_result_text(ctx, sqlite3_str_finish(pStr), i, sqlite3_free);
+}
+
+// Functions returning JSON must declare that they set a subtype on newer
+// versions of SQLite.
+#ifdef SQLITE_RESULT_SUBTYPE
+#define HTTP_RESULT_SUBTYPE SQLITE_RESULT_SUBTYPE
+#else
+#define HTTP_RESULT_SUBTYPE 0
+#endif
+
 static const struct Func {
     const char* name;
     void (*xFunc)(sqlite3_context*, int, sqlite3_value**);
+    int flags;
 } funcs[] = {
     {"http_get_body", httpGetBodyFunc},
     {"http_post_body", httpPostBodyFunc},
@@ -756,9 +4161,25 @@ static const struct Func {
     {"http_get_headers", httpGetHeadersFunc},
     {"http_post_headers", httpPostHeadersFunc},
     {"http_do_headers", httpDoHeadersFunc},
+    {"http_get_response", httpGetResponseFunc},
+    {"http_post_response", httpPostResponseFunc},
+    {"http_do_response", httpDoResponseFunc},
+    {"http_response_status", httpResponseStatusFunc},
+    {"http_response_status_code", httpResponseStatusCodeFunc},
+    {"http_response_headers", httpResponseHeadersFunc},
+    {"http_response_body", httpResponseBodyFunc},
+    {"http_response_header", httpResponseHeaderFunc},
     {"http_headers", httpHeadersFunc},
     {"http_headers_has", httpHeadersHasFunc},
     {"http_headers_get", httpHeadersGetFunc},
+    {"http_headers_parse", httpHeadersParseFunc},
+    {"http_headers_extract", httpHeadersExtractFunc, HTTP_RESULT_SUBTYPE},
+    {"http_share", httpShareFunc},
+    {"http_max_body_size", httpMaxBodySizeFunc},
+    {"http_enqueue", httpEnqueueFunc},
+    {"http_wait", httpWaitFunc},
+    {"http_metrics", httpMetricsFunc},
+    {"http_trace_enable", httpTraceEnableFunc},
     {NULL, NULL},
 };
 
@@ -769,7 +4190,12 @@ static const struct Module {
     {"http_get", &httpModule},
     {"http_post", &httpModule},
     {"http_do", &httpModule},
+    {"http_get_many", &httpManyModule},
     {"http_headers_each", &httpHeadersEachModule},
+    {"http_backend_info", &httpBackendInfoModule},
+    {"http_results", &httpResultsModule},
+    {"http_stats", &httpStatsModule},
+    {"http_trace", &httpTraceModule},
     {NULL, NULL},
 };
 
@@ -780,12 +4206,42 @@ __declspec(dllexport)
     int rc = SQLITE_OK;
     SQLITE_EXTENSION_INIT2(pApi);
     int i;
+    http_ext* pExt;
+    char* zErrMsg = NULL;
+    pExt = sqlite3_malloc(sizeof(*pExt));
+    if (!pExt) {
+        return SQLITE_NOMEM;
+    }
+    memset(pExt, 0, sizeof(*pExt));
+    pExt->nRef = 1;
+    pExt->db = db;
+    http_async_ref();
+    // Load the backend eagerly so that the first request doesn't pay for it.
+    // Failures are reported again when a request is made.
+    http_backend_init(&zErrMsg);
+    sqlite3_free(zErrMsg);
+    rc = http_stats_init();
+    if (rc == SQLITE_OK) {
+        rc = http_pool_open(&pExt->pPool);
+    }
+    // The destructor is invoked also when registration fails, so take the
+    // reference before each call.
     for (i = 0; funcs[i].name && rc == SQLITE_OK; ++i) {
-        rc = sqlite3_create_function(
-            db, funcs[i].name, -1, SQLITE_UTF8, NULL, funcs[i].xFunc, NULL, NULL);
+        pExt->nRef++;
+        rc = sqlite3_create_function_v2(db,
+                                        funcs[i].name,
+                                        -1,
+                                        SQLITE_UTF8 | funcs[i].flags,
+                                        pExt,
+                                        funcs[i].xFunc,
+                                        NULL,
+                                        NULL,
+                                        httpExtUnref);
     }
     for (i = 0; modules[i].name && rc == SQLITE_OK; ++i) {
-        rc = sqlite3_create_module(db, modules[i].name, modules[i].module, 0);
+        pExt->nRef++;
+        rc = sqlite3_create_module_v2(db, modules[i].name, modules[i].module, pExt, httpExtUnref);
     }
+    httpExtUnref(pExt);
     return rc;
 }
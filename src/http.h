@@ -31,6 +31,11 @@
 
 #include "sqlite3ext.h"
 
+// Parts of the response the caller is not going to read. Backends may skip
+// collecting them, in which case the corresponding fields stay NULL.
+#define HTTP_REQUEST_NO_BODY 1
+#define HTTP_REQUEST_NO_HEADERS 2
+
 typedef struct http_request http_request;
 struct http_request {
     char* zMethod;
@@ -38,19 +43,306 @@ struct http_request {
     const void* pBody;
     sqlite3_int64 szBody;
     const char* zHeaders;
+    int flags;
+    // Fail the request if the body is larger than this, zero means no limit.
+    sqlite3_int64 szMaxBody;
+    // Text of the statement that made the request, for http_trace. Only set
+    // while tracing is enabled.
+    const char* zSql;
+    // The backend gives up on the request once this is set, NULL if the
+    // request can't be cancelled. Read with http_request_cancelled().
+    const int* pbCancel;
 };
 
+int http_request_cancelled(const http_request* req);
+
+// Headers whose values are located while the headers are captured, so that
+// they can be returned without scanning the headers again.
+#define HTTP_META_CONTENT_TYPE 0
+#define HTTP_META_CONTENT_LENGTH 1
+#define HTTP_META_ETAG 2
+#define HTTP_META_LAST_MODIFIED 3
+#define HTTP_META_CONTENT_ENCODING 4
+#define HTTP_META_COUNT 5
+
 typedef struct http_response http_response;
 struct http_response {
+    // Allocated with http_body_realloc() and released with http_body_unref().
     void* pBody;
     sqlite3_int64 szBody;
+    sqlite3_int64 szBodyAlloc;
     char* zHeaders;
     int szHeaders;
     int iStatusCode;
     char* zStatus;
+    // 1 + offset of the value of each HTTP_META_* header in zHeaders and the
+    // size of the value, or 0 if there is no such header.
+    int aMetaOffset[HTTP_META_COUNT];
+    int aMetaSize[HTTP_META_COUNT];
+    // Set if the backend reports the transfer details below. Details that are
+    // not known are -1.
+    int bTransfer;
+    // Microseconds from the start of the request until the name was resolved,
+    // the connection was made, the TLS handshake was done and the first byte
+    // of the response arrived, and until the transfer was complete.
+    sqlite3_int64 usDns;
+    sqlite3_int64 usConnect;
+    sqlite3_int64 usTls;
+    sqlite3_int64 usFirstByte;
+    sqlite3_int64 usTotal;
+    // Bytes of body sent and received.
+    sqlite3_int64 szUpload;
+    sqlite3_int64 szDownload;
+    // Connections opened for the request, zero if an existing one was reused.
+    int nNewConnections;
+    int nRedirects;
+    // 10, 11, 20 or 30 for HTTP/1.0, HTTP/1.1, HTTP/2 and HTTP/3.
+    int iHttpVersion;
+    // The URL of the last request if redirects were followed, otherwise NULL.
+    char* zEffectiveUrl;
+};
+
+// Response bodies are reference counted, so that the same buffer can be handed
+// to SQLite any number of times without copying. http_body_unref() can be used
+// as the destructor of sqlite3_result_blob(). The buffer can only be resized
+// while there is a single reference to it.
+void* http_body_realloc(void* pBody, sqlite3_int64 nBytes);
+void* http_body_ref(void* pBody);
+void http_body_unref(void* pBody);
+
+// Make room for nBytes more bytes of body. The buffer grows geometrically, so
+// appending chunk by chunk copies the body only a constant number of times.
+int http_response_reserve(http_response* resp, sqlite3_int64 nBytes);
+
+// Locate the HTTP_META_* headers among the nBytes of resp->zHeaders starting
+// at iOffset. Backends that get all of the headers at once call this once.
+// The first header with each name is kept.
+void http_response_capture_meta(http_response* resp, int iOffset, int nBytes);
+
+// Record a single header whose value is at offset iValue of resp->zHeaders,
+// for backends that parse the headers as they arrive.
+void http_response_capture_header(
+    http_response* resp, const char* zName, int nName, int iValue, int nValue);
+
+// Return the value of a Content-Length header, or -1 if it is not a number.
+sqlite3_int64 http_parse_content_length(const char* zValue, int nValue);
+
+// Load the backend and probe its capabilities. Safe to call from any thread,
+// the work is done only once.
+int http_backend_init(char** ppErrMsg);
+
+typedef struct http_backend_info http_backend_info;
+struct http_backend_info {
+    const char* zName;
+    const char* zVersion;
+    const char* zSslVersion;
+    // Comma separated list of supported content encodings
+    const char* zCompression;
+    int bHttp2;
+    int bHttp3;
+    int bShare;
 };
 
-int http_do_request(http_request* req, http_response* resp, char** ppErrMsg);
+int http_backend_get_info(http_backend_info* pInfo, char** ppErrMsg);
+
+// A pool of reusable backend connections. Each database connection owns one
+// pool so that consecutive requests to the same host can reuse warm
+// connections instead of paying for a new TCP connect and TLS handshake.
+typedef struct http_pool http_pool;
+
+int http_pool_open(http_pool** ppPool);
+void http_pool_close(http_pool* pPool);
+
+// Enable or disable the process-wide cache of resolved names, TLS sessions and
+// connections shared by all pools. nMaxConnections limits the size of the
+// shared connection cache, zero means backend default.
+int http_share_configure(int bEnable, int nMaxConnections, char** ppErrMsg);
+
+int http_do_request(http_pool* pPool, http_request* req, http_response* resp, char** ppErrMsg);
+
+// A batch runs many requests concurrently. The request and response passed to
+// http_batch_add() must stay valid until they are returned by
+// http_batch_next() or the batch is closed.
+typedef struct http_batch http_batch;
+
+int http_batch_open(http_pool* pPool, int nConcurrency, http_batch** ppBatch, char** ppErrMsg);
+int http_batch_add(http_batch* pBatch, http_request* req, http_response* resp, void* pArg);
+
+// Wait for the next request to complete. Returns SQLITE_ROW with the pArg of
+// the completed request, its result code in *pRc and error message in
+// *ppErrMsg. Returns SQLITE_DONE when all requests have completed.
+int http_batch_next(http_batch* pBatch, void** ppArg, int* pRc, char** ppErrMsg);
+
+// Close the batch, cancelling any requests still in flight.
+void http_batch_close(http_batch* pBatch);
+
+// Asynchronous requests are queued and run by a process-wide pool of worker
+// threads. Results are kept by id until they are removed, or until too many
+// newer requests have finished. Running requests are cancelled when the
+// workers are stopped.
+#define HTTP_ASYNC_QUEUED 0
+#define HTTP_ASYNC_RUNNING 1
+#define HTTP_ASYNC_DONE 2
+#define HTTP_ASYNC_ERROR 3
+
+typedef struct http_async_entry http_async_entry;
+struct http_async_entry {
+    sqlite3_int64 iId;
+    int eState;
+    int rc;
+    char* zErrMsg;
+    http_request req;
+    http_response resp;
+};
+
+// Every database connection holds a reference. The workers are stopped when
+// the last reference is released.
+void http_async_ref();
+void http_async_unref();
+
+// Queue a copy of the request and return its id in *piId.
+int http_async_enqueue(const http_request* req, sqlite3_int64* piId);
+
+// Wait up to msTimeout milliseconds (forever if negative) for the request to
+// complete and return its state in *peState. Returns SQLITE_NOTFOUND if there
+// is no such request.
+int http_async_wait(sqlite3_int64 iId, int msTimeout, int* peState);
+
+// Copy the request with the given id, or the first one after it if bNext is
+// set, into *pCopy. Returns SQLITE_ROW or SQLITE_DONE if there is none. The
+// copy must be released with http_async_entry_clear().
+int http_async_get(sqlite3_int64 iId, int bNext, http_async_entry* pCopy);
+void http_async_entry_clear(http_async_entry* pEntry);
+
+// Remove a queued or completed request. Returns SQLITE_BUSY if it is running.
+int http_async_remove(sqlite3_int64 iId);
+
+// Process-wide statistics of the requests made by all connections, kept per
+// host. The counters are sharded by thread, so recording a request only waits
+// for threads that happen to share the shard.
+#define HTTP_STATS_BUCKETS 24
+
+typedef struct http_stats_host http_stats_host;
+struct http_stats_host {
+    char* zHost;
+    sqlite3_int64 nRequests;
+    // Requests that failed without a response, and responses with a 4xx or
+    // 5xx status.
+    sqlite3_int64 nFailed;
+    sqlite3_int64 n4xx;
+    sqlite3_int64 n5xx;
+    sqlite3_int64 szSent;
+    sqlite3_int64 szReceived;
+    sqlite3_int64 nNewConnections;
+    sqlite3_int64 nReusedConnections;
+    // Sum of the latencies in microseconds, and the number of requests by
+    // latency. Bucket i counts requests that took less than
+    // http_stats_bucket_limit(i), the last bucket all slower requests.
+    sqlite3_int64 usLatency;
+    sqlite3_int64 aLatency[HTTP_STATS_BUCKETS];
+};
+
+// Must be called before requests are recorded. Safe to call any number of
+// times from any thread.
+int http_stats_init();
+
+// Microseconds from an arbitrary point in time, for measuring latencies.
+sqlite3_int64 http_stats_now();
+
+// Record a finished request. The total time reported by the backend in the
+// response is used if there is one, usElapsed otherwise.
+void http_stats_record(const http_request* req,
+                       const http_response* resp,
+                       int rc,
+                       sqlite3_int64 usElapsed);
+
+// Merge the statistics of all shards into an array sorted by host. The array
+// must be released with http_stats_free().
+int http_stats_snapshot(http_stats_host** paHost, int* pnHost);
+void http_stats_free(http_stats_host* aHost, int nHost);
+
+sqlite3_int64 http_stats_bucket_limit(int iBucket);
+
+// Returned by http_stats_percentile() when the percentile falls in the last
+// bucket, which has no upper limit.
+#define HTTP_STATS_UNBOUNDED ((sqlite3_int64)(~(sqlite3_uint64)0 >> 1))
+
+// Estimate the latency within which the fraction q of the requests completed.
+// Returns the limit of the histogram bucket the percentile falls in,
+// HTTP_STATS_UNBOUNDED if it is slower than every limit, or -1 if there are no
+// requests.
+sqlite3_int64 http_stats_percentile(const http_stats_host* pHost, double q);
+
+// Process-wide trace of the most recent requests. Finished requests are
+// written to a ring buffer of fixed-size entries without taking locks, and
+// requests slower than a threshold are also kept in a smaller ring, so that
+// outliers survive bursts of fast requests.
+#define HTTP_TRACE_METHOD 0
+#define HTTP_TRACE_URL 1
+#define HTTP_TRACE_ERROR 2
+#define HTTP_TRACE_SQL 3
+
+// Room for the method, URL, error message and statement text of an entry,
+// not counting their terminators. Longer texts are truncated.
+#define HTTP_TRACE_TEXT 188
+
+typedef struct http_trace_entry http_trace_entry;
+struct http_trace_entry {
+    // Twice the id of the request while it is written, one more once it is
+    // complete. Zero for an unused entry.
+    sqlite3_int64 iSeq;
+    // Wall-clock time the request started, in microseconds since the epoch.
+    sqlite3_int64 iStarted;
+    sqlite3_int64 usTotal;
+    sqlite3_int64 szSent;
+    sqlite3_int64 szReceived;
+    // Phase timings from the backend, -1 if unknown.
+    int usDns;
+    int usConnect;
+    int usTls;
+    int usFirstByte;
+    int iStatusCode;
+    char bSlow;
+    char aText[HTTP_TRACE_TEXT + 4];
+};
+
+// Enable or disable tracing. Requests that take at least usSlow microseconds
+// are kept in the ring of slow requests, zero disables it and a negative value
+// keeps the current threshold.
+void http_trace_configure(int bEnable, sqlite3_int64 usSlow);
+int http_trace_enabled();
+
+// Record a finished request if tracing is enabled. zErrMsg is only looked at
+// if the request failed.
+void http_trace_record(const http_request* req,
+                       const http_response* resp,
+                       int rc,
+                       const char* zErrMsg,
+                       sqlite3_int64 usElapsed);
+
+// Copy the complete entries of both rings into an array ordered by request
+// id. The array must be released with sqlite3_free().
+int http_trace_snapshot(http_trace_entry** paEntry, int* pnEntry);
+
+// One of the texts of an entry, NULL if it is empty.
+const char* http_trace_text(const http_trace_entry* pEntry, int iText);
+
+// Character classes used when parsing, looking up and building headers. The
+// table does not depend on the locale, bytes 0x80-0xff belong to no class.
+#define HTTP_CHAR_TOKEN 1 // tchar of RFC 9110, the characters of a header name
+#define HTTP_CHAR_WS 2    // space and horizontal tab
+#define HTTP_CHAR_VCHAR 4 // visible ASCII characters
+#define HTTP_CHAR_DIGIT 8
+#define HTTP_CHAR_UPPER 16
+
+extern const unsigned char http_char_class[256];
+
+#define http_char_is(c, mask) ((http_char_class[(unsigned char)(c)] & (mask)) != 0)
+#define http_char_lower(c) \
+    (http_char_is(c, HTTP_CHAR_UPPER) ? (unsigned char)(c) | 0x20 : (unsigned char)(c))
+
+// Compare two header names case-insensitively. Returns non-zero if equal.
+int http_header_name_eq(const char* zA, int nA, const char* zB, int nB);
 
 int http_next_header(const char* headers,
                      int size,
@@ -60,6 +352,50 @@ int http_next_header(const char* headers,
                      const char** ppValue,
                      int* pValueSize);
 
+// An incremental version of http_next_header() for headers that arrive in
+// pieces. Chunks of any size are passed to http_header_parser_feed() and
+// headers are taken out with http_header_parser_next(), which returns
+//
+// - SQLITE_ROW with the next header,
+// - SQLITE_DONE at the empty line ending the headers,
+// - SQLITE_OK when it needs more input,
+// - SQLITE_ERROR on malformed input or SQLITE_NOMEM.
+//
+// A header cannot be returned before the first byte of the next line has been
+// seen, since that line may continue the value. Only the bytes of a header
+// that is split between chunks are copied, everything else is parsed in place.
+// Returned names and values are valid until the next call to the parser and
+// as long as the chunk they were fed in.
+typedef struct http_header_parser http_header_parser;
+struct http_header_parser {
+    const char* zIn;
+    int nIn;
+    int iScan;
+    int bLineEnd;
+    int bCR;
+    int bEof;
+    int rc;
+    char* zCarry;
+    int nCarry;
+    int nCarryAlloc;
+    // Offset of zIn in the whole input, and of the last header returned,
+    // which is where its name starts.
+    int iIn;
+    int iHeader;
+};
+
+void http_header_parser_init(http_header_parser* p);
+void http_header_parser_clear(http_header_parser* p);
+// The parser must have returned SQLITE_OK (or not been used) before feeding.
+void http_header_parser_feed(http_header_parser* p, const char* zData, int nData);
+// Signal that there is no more input, the last header may now be returned.
+void http_header_parser_finish(http_header_parser* p);
+int http_header_parser_next(http_header_parser* p,
+                            const char** ppName,
+                            int* pNameSize,
+                            const char** ppValue,
+                            int* pValueSize);
+
 void remove_all_but_last_headers(char* zHeaders);
 void separate_status_and_headers(char** ppStatus, char* zHeaders);
 
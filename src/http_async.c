@@ -0,0 +1,568 @@
+#include "http.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+SQLITE_EXTENSION_INIT3
+
+// Number of background threads running queued requests.
+#define HTTP_ASYNC_WORKERS 4
+
+// Number of finished requests kept for http_results. Past this the oldest
+// results are dropped, so that requests nobody collects don't pile up.
+#define HTTP_ASYNC_MAX_FINISHED 1000
+
+#ifdef _WIN32
+typedef SRWLOCK http_async_mutex;
+typedef CONDITION_VARIABLE http_async_cond;
+typedef HANDLE http_async_thread;
+#define HTTP_ASYNC_MUTEX_INIT SRWLOCK_INIT
+#define HTTP_ASYNC_COND_INIT CONDITION_VARIABLE_INIT
+#else
+typedef pthread_mutex_t http_async_mutex;
+typedef pthread_cond_t http_async_cond;
+typedef pthread_t http_async_thread;
+#define HTTP_ASYNC_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define HTTP_ASYNC_COND_INIT PTHREAD_COND_INITIALIZER
+#endif
+
+// bStop is also read by the backends, without the mutex, to cancel running
+// requests.
+#ifdef _MSC_VER
+#define load_acquire(p) InterlockedCompareExchange((volatile LONG*)(p), 0, 0)
+#define store_release(p, v) InterlockedExchange((volatile LONG*)(p), (v))
+#else
+#define load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#endif
+
+typedef struct http_async_node http_async_node;
+struct http_async_node {
+    http_async_entry entry;
+    http_async_node* pNextQueued;
+};
+
+// All asynchronous requests of the process. Entries are kept in id order until
+// they are removed. Queued entries are additionally linked in FIFO order.
+// nFinished counts the entries that are done or failed.
+static struct {
+    http_async_mutex mutex;
+    http_async_cond workCond;
+    http_async_cond doneCond;
+    http_async_node** aNode;
+    int nNode;
+    int nAlloc;
+    int nFinished;
+    http_async_node* pQueueHead;
+    http_async_node* pQueueTail;
+    sqlite3_int64 iNextId;
+    int nRef;
+    int bStop;
+    int nWorker;
+    http_async_thread aWorker[HTTP_ASYNC_WORKERS];
+} async = {
+    HTTP_ASYNC_MUTEX_INIT,
+    HTTP_ASYNC_COND_INIT,
+    HTTP_ASYNC_COND_INIT,
+};
+
+#ifdef _WIN32
+static void async_lock() {
+    AcquireSRWLockExclusive(&async.mutex);
+}
+
+static void async_unlock() {
+    ReleaseSRWLockExclusive(&async.mutex);
+}
+
+static void async_wait(http_async_cond* cond) {
+    SleepConditionVariableSRW(cond, &async.mutex, INFINITE, 0);
+}
+
+// Returns zero if the wait timed out.
+static int async_timedwait(http_async_cond* cond, int msTimeout) {
+    return SleepConditionVariableSRW(cond, &async.mutex, msTimeout, 0);
+}
+
+static sqlite3_int64 async_now_ms() {
+    return (sqlite3_int64)GetTickCount64();
+}
+
+static void async_broadcast(http_async_cond* cond) {
+    WakeAllConditionVariable(cond);
+}
+
+static void async_signal(http_async_cond* cond) {
+    WakeConditionVariable(cond);
+}
+#else
+static void async_lock() {
+    pthread_mutex_lock(&async.mutex);
+}
+
+static void async_unlock() {
+    pthread_mutex_unlock(&async.mutex);
+}
+
+static void async_wait(http_async_cond* cond) {
+    pthread_cond_wait(cond, &async.mutex);
+}
+
+// Returns zero if the wait timed out.
+static int async_timedwait(http_async_cond* cond, int msTimeout) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += msTimeout / 1000;
+    ts.tv_nsec += (long)(msTimeout % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return pthread_cond_timedwait(cond, &async.mutex, &ts) == 0;
+}
+
+static sqlite3_int64 async_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (sqlite3_int64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void async_broadcast(http_async_cond* cond) {
+    pthread_cond_broadcast(cond);
+}
+
+static void async_signal(http_async_cond* cond) {
+    pthread_cond_signal(cond);
+}
+#endif
+
+void http_async_entry_clear(http_async_entry* pEntry) {
+    sqlite3_free(pEntry->zErrMsg);
+    sqlite3_free(pEntry->req.zMethod);
+    sqlite3_free(pEntry->req.zUrl);
+    sqlite3_free((void*)pEntry->req.zHeaders);
+    sqlite3_free((void*)pEntry->req.pBody);
+    sqlite3_free((void*)pEntry->req.zSql);
+    http_body_unref(pEntry->resp.pBody);
+    sqlite3_free(pEntry->resp.zHeaders);
+    sqlite3_free(pEntry->resp.zStatus);
+    sqlite3_free(pEntry->resp.zEffectiveUrl);
+    memset(pEntry, 0, sizeof(*pEntry));
+}
+
+int http_request_cancelled(const http_request* req) {
+    return req->pbCancel && load_acquire(req->pbCancel);
+}
+
+// Return the index of the first node with id >= iId.
+static int async_find(sqlite3_int64 iId) {
+    int lo = 0;
+    int hi = async.nNode;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (async.aNode[mid]->entry.iId < iId) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static http_async_node* async_lookup(sqlite3_int64 iId) {
+    int i = async_find(iId);
+    if (i < async.nNode && async.aNode[i]->entry.iId == iId) {
+        return async.aNode[i];
+    }
+    return NULL;
+}
+
+// Delete the node at index i, which must not be queued or running.
+static void async_delete(int i) {
+    http_async_node* pNode = async.aNode[i];
+    if (pNode->entry.eState == HTTP_ASYNC_DONE || pNode->entry.eState == HTTP_ASYNC_ERROR) {
+        async.nFinished--;
+    }
+    memmove(&async.aNode[i], &async.aNode[i + 1], sizeof(async.aNode[0]) * (async.nNode - i - 1));
+    async.nNode--;
+    http_async_entry_clear(&pNode->entry);
+    sqlite3_free(pNode);
+}
+
+// Drop the oldest finished requests past the limit. Ids only grow, so those
+// are the first finished ones in aNode.
+static void async_trim() {
+    int i = 0;
+    while (async.nFinished > HTTP_ASYNC_MAX_FINISHED) {
+        while (async.aNode[i]->entry.eState != HTTP_ASYNC_DONE &&
+               async.aNode[i]->entry.eState != HTTP_ASYNC_ERROR) {
+            i++;
+        }
+        async_delete(i);
+    }
+}
+
+static void async_run(http_pool* pPool, http_async_node* pNode) {
+    http_async_entry* pEntry = &pNode->entry;
+    char* zErrMsg = NULL;
+    int rc = http_do_request(pPool, &pEntry->req, &pEntry->resp, &zErrMsg);
+    async_lock();
+    pEntry->rc = rc;
+    pEntry->zErrMsg = zErrMsg;
+    if (rc != SQLITE_OK && !zErrMsg) {
+        pEntry->zErrMsg = sqlite3_mprintf("%s", sqlite3_errstr(rc));
+    }
+    pEntry->eState = rc == SQLITE_OK ? HTTP_ASYNC_DONE : HTTP_ASYNC_ERROR;
+    async.nFinished++;
+    async_trim();
+    async_broadcast(&async.doneCond);
+    async_unlock();
+}
+
+static void async_worker() {
+    http_pool* pPool = NULL;
+    http_async_node* pNode;
+
+    http_pool_open(&pPool);
+
+    async_lock();
+    for (;;) {
+        while (!async.bStop && !async.pQueueHead) {
+            async_wait(&async.workCond);
+        }
+        if (async.bStop) {
+            break;
+        }
+        pNode = async.pQueueHead;
+        async.pQueueHead = pNode->pNextQueued;
+        if (!async.pQueueHead) {
+            async.pQueueTail = NULL;
+        }
+        pNode->pNextQueued = NULL;
+        pNode->entry.eState = HTTP_ASYNC_RUNNING;
+        async_unlock();
+        // The node stays in aNode and can't be removed while it is running.
+        async_run(pPool, pNode);
+        async_lock();
+    }
+    async_unlock();
+
+    http_pool_close(pPool);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI async_thread_main(LPVOID arg) {
+    async_worker();
+    return 0;
+}
+
+static int async_thread_start(http_async_thread* pThread) {
+    *pThread = CreateThread(NULL, 0, async_thread_main, NULL, 0, NULL);
+    return *pThread != NULL;
+}
+
+static void async_thread_join(http_async_thread thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+#else
+static void* async_thread_main(void* arg) {
+    async_worker();
+    return NULL;
+}
+
+static int async_thread_start(http_async_thread* pThread) {
+    return pthread_create(pThread, NULL, async_thread_main, NULL) == 0;
+}
+
+static void async_thread_join(http_async_thread thread) {
+    pthread_join(thread, NULL);
+}
+#endif
+
+void http_async_ref() {
+    async_lock();
+    async.nRef++;
+    async_unlock();
+}
+
+// Wait until the workers stopped by http_async_unref() are gone and the
+// requests dropped. Must be called with the mutex held.
+static void async_wait_stopped() {
+    while (async.bStop) {
+        async_wait(&async.doneCond);
+    }
+}
+
+// When the last database connection using the extension goes away the workers
+// are stopped, so that the library can be unloaded safely. Requests that are
+// still queued are dropped and running requests are cancelled, so that a
+// stalled server doesn't keep the connection from closing. Requests queued by
+// a new connection in the meantime wait for the stop to complete.
+void http_async_unref() {
+    int nWorker;
+    int i;
+
+    async_lock();
+    async_wait_stopped();
+    if (--async.nRef > 0) {
+        async_unlock();
+        return;
+    }
+    store_release(&async.bStop, 1);
+    nWorker = async.nWorker;
+    async_broadcast(&async.workCond);
+    async_unlock();
+
+    for (i = 0; i < nWorker; ++i) {
+        async_thread_join(async.aWorker[i]);
+    }
+
+    async_lock();
+    for (i = 0; i < async.nNode; ++i) {
+        http_async_entry_clear(&async.aNode[i]->entry);
+        sqlite3_free(async.aNode[i]);
+    }
+    sqlite3_free(async.aNode);
+    async.aNode = NULL;
+    async.nNode = 0;
+    async.nAlloc = 0;
+    async.nFinished = 0;
+    async.pQueueHead = NULL;
+    async.pQueueTail = NULL;
+    async.nWorker = 0;
+    store_release(&async.bStop, 0);
+    async_broadcast(&async.doneCond);
+    async_unlock();
+}
+
+static char* dup_text(const char* zText) {
+    return zText ? sqlite3_mprintf("%s", zText) : NULL;
+}
+
+int http_async_enqueue(const http_request* req, sqlite3_int64* piId) {
+    http_async_node* pNode;
+    http_request* pReq;
+    int rc = SQLITE_OK;
+
+    pNode = sqlite3_malloc(sizeof(*pNode));
+    if (!pNode) {
+        return SQLITE_NOMEM;
+    }
+    memset(pNode, 0, sizeof(*pNode));
+
+    pReq = &pNode->entry.req;
+    pReq->zMethod = dup_text(req->zMethod);
+    pReq->zUrl = dup_text(req->zUrl);
+    pReq->zHeaders = dup_text(req->zHeaders);
+    pReq->flags = req->flags;
+    pReq->szMaxBody = req->szMaxBody;
+    pReq->zSql = dup_text(req->zSql);
+    pReq->pbCancel = &async.bStop;
+    if (req->pBody) {
+        pReq->szBody = req->szBody;
+        pReq->pBody = sqlite3_malloc64(req->szBody + 1);
+        if (pReq->pBody) {
+            memcpy((void*)pReq->pBody, req->pBody, req->szBody);
+        }
+    }
+    if (!pReq->zMethod || !pReq->zUrl || (req->zHeaders && !pReq->zHeaders) ||
+        (req->zSql && !pReq->zSql) || (req->pBody && !pReq->pBody)) {
+        http_async_entry_clear(&pNode->entry);
+        sqlite3_free(pNode);
+        return SQLITE_NOMEM;
+    }
+
+    async_lock();
+    async_wait_stopped();
+
+    if (async.nNode == async.nAlloc) {
+        int nAlloc = async.nAlloc ? async.nAlloc * 2 : 64;
+        http_async_node** aNode = sqlite3_realloc(async.aNode, sizeof(*aNode) * nAlloc);
+        if (!aNode) {
+            rc = SQLITE_NOMEM;
+            goto done;
+        }
+        async.aNode = aNode;
+        async.nAlloc = nAlloc;
+    }
+
+    // Workers are started lazily when the first request is queued.
+    while (async.nWorker < HTTP_ASYNC_WORKERS) {
+        if (!async_thread_start(&async.aWorker[async.nWorker])) {
+            break;
+        }
+        async.nWorker++;
+    }
+    if (async.nWorker == 0) {
+        rc = SQLITE_ERROR;
+        goto done;
+    }
+
+    pNode->entry.iId = ++async.iNextId;
+    pNode->entry.eState = HTTP_ASYNC_QUEUED;
+    async.aNode[async.nNode++] = pNode;
+    if (async.pQueueTail) {
+        async.pQueueTail->pNextQueued = pNode;
+    } else {
+        async.pQueueHead = pNode;
+    }
+    async.pQueueTail = pNode;
+    *piId = pNode->entry.iId;
+    pNode = NULL;
+    async_signal(&async.workCond);
+
+done:
+
+    async_unlock();
+
+    if (pNode) {
+        http_async_entry_clear(&pNode->entry);
+        sqlite3_free(pNode);
+    }
+
+    return rc;
+}
+
+int http_async_wait(sqlite3_int64 iId, int msTimeout, int* peState) {
+    http_async_node* pNode;
+    // Every completion wakes all waiters, so the timeout is counted from here.
+    sqlite3_int64 msDeadline = msTimeout > 0 ? async_now_ms() + msTimeout : 0;
+    int rc = SQLITE_OK;
+
+    async_lock();
+    for (;;) {
+        pNode = async_lookup(iId);
+        if (!pNode) {
+            rc = SQLITE_NOTFOUND;
+            break;
+        }
+        if (pNode->entry.eState == HTTP_ASYNC_DONE || pNode->entry.eState == HTTP_ASYNC_ERROR ||
+            msTimeout == 0) {
+            break;
+        }
+        if (msTimeout < 0) {
+            async_wait(&async.doneCond);
+        } else {
+            sqlite3_int64 msLeft = msDeadline - async_now_ms();
+            if (msLeft <= 0 || !async_timedwait(&async.doneCond, (int)msLeft)) {
+                // Timed out. Report whatever the state is now.
+                msTimeout = 0;
+            }
+        }
+    }
+    if (pNode) {
+        *peState = pNode->entry.eState;
+    }
+    async_unlock();
+
+    return rc;
+}
+
+int http_async_get(sqlite3_int64 iId, int bNext, http_async_entry* pCopy) {
+    http_async_entry* pEntry;
+    int rc = SQLITE_ROW;
+    int i;
+
+    memset(pCopy, 0, sizeof(*pCopy));
+
+    async_lock();
+
+    i = async_find(bNext ? iId + 1 : iId);
+    if (i == async.nNode || (!bNext && async.aNode[i]->entry.iId != iId)) {
+        rc = SQLITE_DONE;
+        goto done;
+    }
+
+    pEntry = &async.aNode[i]->entry;
+    pCopy->iId = pEntry->iId;
+    pCopy->eState = pEntry->eState;
+    pCopy->rc = pEntry->rc;
+    pCopy->req.zMethod = dup_text(pEntry->req.zMethod);
+    pCopy->req.zUrl = dup_text(pEntry->req.zUrl);
+    pCopy->req.zHeaders = dup_text(pEntry->req.zHeaders);
+    if (pEntry->req.pBody) {
+        pCopy->req.pBody = sqlite3_malloc64(pEntry->req.szBody + 1);
+        if (!pCopy->req.pBody) {
+            rc = SQLITE_NOMEM;
+            goto done;
+        }
+        memcpy((void*)pCopy->req.pBody, pEntry->req.pBody, pEntry->req.szBody);
+        pCopy->req.szBody = pEntry->req.szBody;
+    }
+    // The response is only touched by the worker while the request runs.
+    if (pEntry->eState == HTTP_ASYNC_DONE || pEntry->eState == HTTP_ASYNC_ERROR) {
+        pCopy->zErrMsg = dup_text(pEntry->zErrMsg);
+        pCopy->resp.zStatus = dup_text(pEntry->resp.zStatus);
+        pCopy->resp.zHeaders = dup_text(pEntry->resp.zHeaders);
+        pCopy->resp.szHeaders = pEntry->resp.szHeaders;
+        pCopy->resp.iStatusCode = pEntry->resp.iStatusCode;
+        memcpy(pCopy->resp.aMetaOffset, pEntry->resp.aMetaOffset, sizeof(pCopy->resp.aMetaOffset));
+        memcpy(pCopy->resp.aMetaSize, pEntry->resp.aMetaSize, sizeof(pCopy->resp.aMetaSize));
+        if (pEntry->resp.pBody) {
+            pCopy->resp.pBody = http_body_realloc(NULL, pEntry->resp.szBody);
+            if (!pCopy->resp.pBody) {
+                rc = SQLITE_NOMEM;
+                goto done;
+            }
+            memcpy(pCopy->resp.pBody, pEntry->resp.pBody, pEntry->resp.szBody);
+            pCopy->resp.szBody = pEntry->resp.szBody;
+            pCopy->resp.szBodyAlloc = pEntry->resp.szBody;
+        }
+    }
+
+done:
+
+    async_unlock();
+
+    if (rc == SQLITE_NOMEM) {
+        http_async_entry_clear(pCopy);
+    }
+
+    return rc;
+}
+
+int http_async_remove(sqlite3_int64 iId) {
+    http_async_node* pNode;
+    http_async_node** ppPrev;
+    http_async_node* pPrev = NULL;
+    int rc = SQLITE_OK;
+    int i;
+
+    async_lock();
+
+    i = async_find(iId);
+    if (i == async.nNode || async.aNode[i]->entry.iId != iId) {
+        goto done;
+    }
+    pNode = async.aNode[i];
+
+    if (pNode->entry.eState == HTTP_ASYNC_RUNNING) {
+        rc = SQLITE_BUSY;
+        goto done;
+    }
+
+    if (pNode->entry.eState == HTTP_ASYNC_QUEUED) {
+        for (ppPrev = &async.pQueueHead; *ppPrev != pNode; ppPrev = &(*ppPrev)->pNextQueued) {
+            pPrev = *ppPrev;
+        }
+        *ppPrev = pNode->pNextQueued;
+        if (async.pQueueTail == pNode) {
+            async.pQueueTail = pPrev;
+        }
+    }
+
+    async_delete(i);
+
+done:
+
+    async_unlock();
+
+    return rc;
+}
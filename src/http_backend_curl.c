@@ -4,6 +4,7 @@
 
 #include <assert.h>
 #include <string.h>
+#include <time.h>
 
 SQLITE_EXTENSION_INIT3
 
@@ -42,7 +43,12 @@ void* http_dlsym(void* library, const char* zName) {
 #endif
 
 typedef struct CURL CURL;
+typedef struct CURLSH CURLSH;
+typedef struct CURLM CURLM;
 typedef int CURLcode;
+typedef int CURLMcode;
+typedef int CURLSHcode;
+typedef int CURLSHoption;
 typedef int CURLoption;
 typedef int CURLINFO;
 typedef int CURLversion;
@@ -70,18 +76,82 @@ typedef int CURLversion;
 #define CURLOPT_NOBODY (44)
 #define CURLOPT_CUSTOMREQUEST (10000 + 36)
 #define CURLOPT_PUT (54)
+#define CURLOPT_SHARE (10000 + 100)
+#define CURLOPT_MAXCONNECTS (71)
+#define CURLOPT_NOPROGRESS (43)
+#define CURLOPT_XFERINFOFUNCTION (20000 + 219)
+#define CURLOPT_XFERINFODATA (10000 + 57)
+
+#define CURLOPT_PRIVATE (10000 + 103)
+
+#define CURLM_OK 0
+
+#define CURLMSG_DONE 1
+
+#define CURLSHE_OK 0
+
+#define CURLSHOPT_SHARE 1
+#define CURLSHOPT_LOCKFUNC 3
+#define CURLSHOPT_UNLOCKFUNC 4
+
+#define CURL_LOCK_DATA_DNS 3
+#define CURL_LOCK_DATA_SSL_SESSION 4
+#define CURL_LOCK_DATA_CONNECT 5
+#define CURL_LOCK_DATA_LAST 8
 
 #define CURLSSLOPT_NATIVE_CA (1 << 4)
 
 #define CURLVERSION_NOW 9
 
+#define CURLINFO_EFFECTIVE_URL (0x100000 + 1)
 #define CURLINFO_RESPONSE_CODE (0x200000 + 2)
+#define CURLINFO_SIZE_UPLOAD_T (0x600000 + 7)
+#define CURLINFO_SIZE_DOWNLOAD_T (0x600000 + 8)
+#define CURLINFO_REDIRECT_COUNT (0x200000 + 20)
+#define CURLINFO_PRIVATE (0x100000 + 21)
+#define CURLINFO_NUM_CONNECTS (0x200000 + 26)
+#define CURLINFO_HTTP_VERSION (0x200000 + 46)
+#define CURLINFO_TOTAL_TIME_T (0x600000 + 50)
+#define CURLINFO_NAMELOOKUP_TIME_T (0x600000 + 51)
+#define CURLINFO_CONNECT_TIME_T (0x600000 + 52)
+#define CURLINFO_STARTTRANSFER_TIME_T (0x600000 + 54)
+#define CURLINFO_APPCONNECT_TIME_T (0x600000 + 56)
+
+#define CURL_HTTP_VERSION_1_0 1
+#define CURL_HTTP_VERSION_1_1 2
+#define CURL_HTTP_VERSION_2_0 3
+#define CURL_HTTP_VERSION_3 30
+
+typedef sqlite3_int64 curl_off_t;
+
+struct CURLMsg {
+    int msg;
+    CURL* easy_handle;
+    union {
+        void* whatever;
+        CURLcode result;
+    } data;
+};
+typedef struct CURLMsg CURLMsg;
+
+#define CURL_VERSION_SSL (1 << 2)
+#define CURL_VERSION_LIBZ (1 << 3)
+#define CURL_VERSION_HTTP2 (1 << 16)
+#define CURL_VERSION_BROTLI (1 << 23)
+#define CURL_VERSION_HTTP3 (1 << 25)
+#define CURL_VERSION_ZSTD (1 << 26)
 
 // The struct is bigger but I don't need more information for now...
 struct curl_version_info_data {
     CURLversion age;
     const char* version;
     unsigned int version_num;
+    const char* host;
+    int features;
+    const char* ssl_version;
+    long ssl_version_num;
+    const char* libz_version;
+    const char* const* protocols;
 };
 typedef struct curl_version_info_data curl_version_info_data;
 
@@ -89,6 +159,7 @@ struct curl_slist;
 
 typedef CURL* (*curl_easy_init_t)();
 typedef void (*curl_easy_cleanup_t)(CURL*);
+typedef void (*curl_easy_reset_t)(CURL*);
 typedef CURLcode (*curl_easy_setopt_t)(CURL*, CURLoption, ...);
 typedef CURLcode (*curl_easy_perform_t)(CURL*);
 typedef CURLcode (*curl_easy_getinfo_t)(CURL*, CURLINFO, ...);
@@ -97,11 +168,25 @@ typedef curl_version_info_data* (*curl_version_info_t)(CURLversion);
 typedef struct curl_slist* (*curl_slist_append_t)(struct curl_slist*, const char*);
 typedef void (*curl_slist_free_all_t)(struct curl_slist*);
 typedef const char* (*curl_easy_strerror_t)(CURLcode);
+typedef CURLM* (*curl_multi_init_t)();
+typedef CURLMcode (*curl_multi_cleanup_t)(CURLM*);
+typedef CURLMcode (*curl_multi_add_handle_t)(CURLM*, CURL*);
+typedef CURLMcode (*curl_multi_remove_handle_t)(CURLM*, CURL*);
+typedef CURLMcode (*curl_multi_perform_t)(CURLM*, int*);
+typedef CURLMcode (*curl_multi_wait_t)(CURLM*, void*, unsigned int, int, int*);
+typedef CURLMsg* (*curl_multi_info_read_t)(CURLM*, int*);
+typedef const char* (*curl_multi_strerror_t)(CURLMcode);
+typedef CURLSH* (*curl_share_init_t)();
+typedef CURLSHcode (*curl_share_setopt_t)(CURLSH*, CURLSHoption, ...);
+typedef CURLSHcode (*curl_share_cleanup_t)(CURLSH*);
+typedef void (*curl_lock_function)(CURL*, int, int, void*);
+typedef void (*curl_unlock_function)(CURL*, int, void*);
 
 struct curl_api_routines {
     void* pLibrary;
     curl_easy_init_t easy_init;
     curl_easy_cleanup_t easy_cleanup;
+    curl_easy_reset_t easy_reset;
     curl_easy_setopt_t easy_setopt;
     curl_easy_perform_t easy_perform;
     curl_easy_getinfo_t easy_getinfo;
@@ -110,12 +195,24 @@ struct curl_api_routines {
     curl_slist_append_t slist_append;
     curl_slist_free_all_t slist_free_all;
     curl_easy_strerror_t easy_strerror;
+    curl_multi_init_t multi_init;
+    curl_multi_cleanup_t multi_cleanup;
+    curl_multi_add_handle_t multi_add_handle;
+    curl_multi_remove_handle_t multi_remove_handle;
+    curl_multi_perform_t multi_perform;
+    curl_multi_wait_t multi_wait;
+    curl_multi_info_read_t multi_info_read;
+    curl_multi_strerror_t multi_strerror;
+    curl_share_init_t share_init;
+    curl_share_setopt_t share_setopt;
+    curl_share_cleanup_t share_cleanup;
 };
 
 static struct curl_api_routines curl_api;
 
 #define curl_easy_init curl_api.easy_init
 #define curl_easy_cleanup curl_api.easy_cleanup
+#define curl_easy_reset curl_api.easy_reset
 #define curl_easy_setopt curl_api.easy_setopt
 #define curl_easy_perform curl_api.easy_perform
 #define curl_easy_getinfo curl_api.easy_getinfo
@@ -124,6 +221,17 @@ static struct curl_api_routines curl_api;
 #define curl_slist_append curl_api.slist_append
 #define curl_slist_free_all curl_api.slist_free_all
 #define curl_easy_strerror curl_api.easy_strerror
+#define curl_multi_init curl_api.multi_init
+#define curl_multi_cleanup curl_api.multi_cleanup
+#define curl_multi_add_handle curl_api.multi_add_handle
+#define curl_multi_remove_handle curl_api.multi_remove_handle
+#define curl_multi_perform curl_api.multi_perform
+#define curl_multi_wait curl_api.multi_wait
+#define curl_multi_info_read curl_api.multi_info_read
+#define curl_multi_strerror curl_api.multi_strerror
+#define curl_share_init curl_api.share_init
+#define curl_share_setopt curl_api.share_setopt
+#define curl_share_cleanup curl_api.share_cleanup
 
 static const char* aCurlLibNames[] = {
 #ifdef _WIN32
@@ -137,7 +245,7 @@ static const char* aCurlLibNames[] = {
 
 static const int szCurlLibNames = sizeof(aCurlLibNames) / sizeof(aCurlLibNames[0]);
 
-int http_backend_curl_load(char** zErrMsg) {
+static int http_backend_curl_load(char** zErrMsg) {
     assert(zErrMsg != NULL);
 
     *zErrMsg = NULL;
@@ -163,6 +271,11 @@ int http_backend_curl_load(char** zErrMsg) {
         *zErrMsg = sqlite3_mprintf("failed to load curl_easy_cleanup");
         goto error;
     }
+    curl_easy_reset = (curl_easy_reset_t)http_dlsym(curl_api.pLibrary, "curl_easy_reset");
+    if (!curl_easy_reset) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_easy_reset");
+        goto error;
+    }
     curl_easy_setopt = (curl_easy_setopt_t)http_dlsym(curl_api.pLibrary, "curl_easy_setopt");
     if (!curl_easy_setopt) {
         *zErrMsg = sqlite3_mprintf("failed to load curl_easy_setopt");
@@ -204,6 +317,65 @@ int http_backend_curl_load(char** zErrMsg) {
         *zErrMsg = sqlite3_mprintf("failed to load curl_easy_strerror");
         goto error;
     }
+    curl_multi_init = (curl_multi_init_t)http_dlsym(curl_api.pLibrary, "curl_multi_init");
+    if (!curl_multi_init) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_multi_init");
+        goto error;
+    }
+    curl_multi_cleanup = (curl_multi_cleanup_t)http_dlsym(curl_api.pLibrary, "curl_multi_cleanup");
+    if (!curl_multi_cleanup) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_multi_cleanup");
+        goto error;
+    }
+    curl_multi_add_handle =
+        (curl_multi_add_handle_t)http_dlsym(curl_api.pLibrary, "curl_multi_add_handle");
+    if (!curl_multi_add_handle) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_multi_add_handle");
+        goto error;
+    }
+    curl_multi_remove_handle =
+        (curl_multi_remove_handle_t)http_dlsym(curl_api.pLibrary, "curl_multi_remove_handle");
+    if (!curl_multi_remove_handle) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_multi_remove_handle");
+        goto error;
+    }
+    curl_multi_perform = (curl_multi_perform_t)http_dlsym(curl_api.pLibrary, "curl_multi_perform");
+    if (!curl_multi_perform) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_multi_perform");
+        goto error;
+    }
+    curl_multi_wait = (curl_multi_wait_t)http_dlsym(curl_api.pLibrary, "curl_multi_wait");
+    if (!curl_multi_wait) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_multi_wait");
+        goto error;
+    }
+    curl_multi_info_read =
+        (curl_multi_info_read_t)http_dlsym(curl_api.pLibrary, "curl_multi_info_read");
+    if (!curl_multi_info_read) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_multi_info_read");
+        goto error;
+    }
+    curl_multi_strerror =
+        (curl_multi_strerror_t)http_dlsym(curl_api.pLibrary, "curl_multi_strerror");
+    if (!curl_multi_strerror) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_multi_strerror");
+        goto error;
+    }
+    curl_share_init = (curl_share_init_t)http_dlsym(curl_api.pLibrary, "curl_share_init");
+    if (!curl_share_init) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_share_init");
+        goto error;
+    }
+    curl_share_setopt = (curl_share_setopt_t)http_dlsym(curl_api.pLibrary, "curl_share_setopt");
+    if (!curl_share_setopt) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_share_setopt");
+        goto error;
+    }
+    curl_share_cleanup = (curl_share_cleanup_t)http_dlsym(curl_api.pLibrary, "curl_share_cleanup");
+    if (!curl_share_cleanup) {
+        *zErrMsg = sqlite3_mprintf("failed to load curl_share_cleanup");
+        goto error;
+    }
 
     return SQLITE_OK;
 
@@ -217,31 +389,338 @@ error:
     return SQLITE_ERROR;
 }
 
-static size_t write_callback(char* ptr, size_t size, size_t nmemb, void* userdata) {
-    http_response* pResp = (http_response*)userdata;
-    char* p;
-    p = sqlite3_realloc(pResp->pBody, pResp->szBody + size * nmemb);
-    if (!p) {
-        return 0;
+// Flags read on every request without taking the global mutex. They are only
+// set under the mutex, after everything they guard has been written.
+#ifdef _MSC_VER
+#define load_acquire(p) InterlockedCompareExchange((volatile LONG*)(p), 0, 0)
+#define store_release(p, v) InterlockedExchange((volatile LONG*)(p), (v))
+#else
+#define load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#endif
+
+// Capabilities of the loaded library, probed once by http_backend_init().
+static struct {
+    int bInitialized;
+    int bNativeCa;
+    int bHttp2;
+    int bHttp3;
+    const char* zVersion;
+    const char* zSslVersion;
+    char zCompression[32];
+} curl_caps;
+
+static void probe_capabilities() {
+    curl_version_info_data* pInfo = curl_version_info(CURLVERSION_NOW);
+    char* z = curl_caps.zCompression;
+
+    curl_caps.zVersion = pInfo->version;
+    curl_caps.zSslVersion = (pInfo->features & CURL_VERSION_SSL) ? pInfo->ssl_version : NULL;
+    curl_caps.bHttp2 = (pInfo->features & CURL_VERSION_HTTP2) != 0;
+    curl_caps.bHttp3 = (pInfo->features & CURL_VERSION_HTTP3) != 0;
+    // Since 7.71.0 (Jun 24 2020). Makes life easier on Windows at least.
+    curl_caps.bNativeCa = pInfo->version_num >= ((7 << 16) | (71 << 8));
+
+    // The buffer is large enough for all of the encodings.
+    z[0] = '\0';
+    if (pInfo->features & CURL_VERSION_LIBZ) {
+        strcat(z, "deflate,gzip");
+    }
+    if (pInfo->features & CURL_VERSION_BROTLI) {
+        strcat(z, z[0] ? ",br" : "br");
+    }
+    if (pInfo->features & CURL_VERSION_ZSTD) {
+        strcat(z, z[0] ? ",zstd" : "zstd");
     }
-    pResp->pBody = p;
-    memcpy((char*)pResp->pBody + pResp->szBody, ptr, size * nmemb);
-    pResp->szBody += size * nmemb;
-    return size * nmemb;
 }
 
-static size_t header_callback(char* ptr, size_t size, size_t nmemb, void* userdata) {
-    http_response* pResp = (http_response*)userdata;
-    char* p;
-    p = sqlite3_realloc(pResp->zHeaders, pResp->szHeaders + size * nmemb + 1);
+int http_backend_init(char** ppErrMsg) {
+    sqlite3_mutex* mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+    int rc = SQLITE_OK;
+
+    *ppErrMsg = NULL;
+
+    if (load_acquire(&curl_caps.bInitialized)) {
+        return SQLITE_OK;
+    }
+
+    sqlite3_mutex_enter(mutex);
+    if (!curl_caps.bInitialized) {
+        rc = http_backend_curl_load(ppErrMsg);
+        if (rc == SQLITE_OK) {
+            probe_capabilities();
+            store_release(&curl_caps.bInitialized, 1);
+        }
+    }
+    sqlite3_mutex_leave(mutex);
+
+    return rc;
+}
+
+int http_backend_get_info(http_backend_info* pInfo, char** ppErrMsg) {
+    int rc = http_backend_init(ppErrMsg);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+    memset(pInfo, 0, sizeof(*pInfo));
+    pInfo->zName = "curl";
+    pInfo->zVersion = curl_caps.zVersion;
+    pInfo->zSslVersion = curl_caps.zSslVersion;
+    pInfo->zCompression = curl_caps.zCompression[0] ? curl_caps.zCompression : NULL;
+    pInfo->bHttp2 = curl_caps.bHttp2;
+    pInfo->bHttp3 = curl_caps.bHttp3;
+    pInfo->bShare = 1;
+    return SQLITE_OK;
+}
+
+// Maximum number of idle handles kept in a pool.
+#define HTTP_POOL_MAX_IDLE 16
+
+// Maximum number of idle handles kept for a single origin.
+#define HTTP_POOL_MAX_IDLE_PER_HOST 4
+
+// Idle handles older than this (in seconds) are evicted from the pool.
+#define HTTP_POOL_IDLE_TIMEOUT 60
+
+typedef struct http_pool_entry http_pool_entry;
+struct http_pool_entry {
+    CURL* curl;
+    char* zOrigin;
+    time_t tLastUsed;
+};
+
+// Every curl easy handle keeps a cache of live connections, resolved names and
+// TLS sessions. Handles are kept around after a request and handed out again
+// for requests to the same origin so that the connection can be reused.
+struct http_pool {
+    http_pool_entry aIdle[HTTP_POOL_MAX_IDLE];
+    int nIdle;
+};
+
+int http_pool_open(http_pool** ppPool) {
+    http_pool* pPool = sqlite3_malloc(sizeof(*pPool));
+    if (!pPool) {
+        return SQLITE_NOMEM;
+    }
+    memset(pPool, 0, sizeof(*pPool));
+    *ppPool = pPool;
+    return SQLITE_OK;
+}
+
+static void http_pool_remove(http_pool* pPool, int i) {
+    assert(i >= 0 && i < pPool->nIdle);
+    memmove(&pPool->aIdle[i],
+            &pPool->aIdle[i + 1],
+            sizeof(pPool->aIdle[0]) * (pPool->nIdle - i - 1));
+    pPool->nIdle--;
+}
+
+static void http_pool_evict(http_pool* pPool, int i) {
+    curl_easy_cleanup(pPool->aIdle[i].curl);
+    sqlite3_free(pPool->aIdle[i].zOrigin);
+    http_pool_remove(pPool, i);
+}
+
+void http_pool_close(http_pool* pPool) {
+    if (!pPool) {
+        return;
+    }
+    while (pPool->nIdle > 0) {
+        http_pool_evict(pPool, pPool->nIdle - 1);
+    }
+    sqlite3_free(pPool);
+}
+
+// Return the length of the scheme://authority part of zUrl.
+static int url_origin_length(const char* zUrl) {
+    const char* p = strstr(zUrl, "://");
     if (!p) {
-        return 0;
+        return strlen(zUrl);
     }
-    pResp->zHeaders = p;
-    memcpy(pResp->zHeaders + pResp->szHeaders, ptr, size * nmemb);
-    pResp->szHeaders += size * nmemb;
-    pResp->zHeaders[pResp->szHeaders] = '\0';
-    return size * nmemb;
+    p += 3;
+    while (*p && *p != '/' && *p != '?' && *p != '#') {
+        ++p;
+    }
+    return p - zUrl;
+}
+
+static void http_pool_expire(http_pool* pPool, time_t now) {
+    int i = 0;
+    while (i < pPool->nIdle) {
+        if (now - pPool->aIdle[i].tLastUsed >= HTTP_POOL_IDLE_TIMEOUT) {
+            http_pool_evict(pPool, i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+// Take a handle from the pool, preferring the most recently used handle that
+// has talked to the same origin. Returns NULL if the pool has nothing to offer.
+static CURL* http_pool_acquire(http_pool* pPool, const char* zUrl, char** pzOrigin) {
+    int nOrigin = url_origin_length(zUrl);
+    CURL* curl;
+    int i;
+
+    *pzOrigin = NULL;
+
+    if (!pPool) {
+        return NULL;
+    }
+
+    http_pool_expire(pPool, time(NULL));
+
+    for (i = pPool->nIdle - 1; i >= 0; --i) {
+        const char* zOrigin = pPool->aIdle[i].zOrigin;
+        if (sqlite3_strnicmp(zOrigin, zUrl, nOrigin) == 0 && zOrigin[nOrigin] == '\0') {
+            curl = pPool->aIdle[i].curl;
+            *pzOrigin = pPool->aIdle[i].zOrigin;
+            http_pool_remove(pPool, i);
+            return curl;
+        }
+    }
+
+    *pzOrigin = sqlite3_mprintf("%.*s", nOrigin, zUrl);
+
+    return NULL;
+}
+
+// Return a handle to the pool. Options are reset but the connection cache of
+// the handle stays intact. Takes ownership of zOrigin.
+static void http_pool_release(http_pool* pPool, CURL* curl, char* zOrigin) {
+    int nSameOrigin = 0;
+    int iOldestSameOrigin = -1;
+    int i;
+
+    if (!pPool || !zOrigin) {
+        curl_easy_cleanup(curl);
+        sqlite3_free(zOrigin);
+        return;
+    }
+
+    curl_easy_reset(curl);
+
+    for (i = 0; i < pPool->nIdle; ++i) {
+        if (sqlite3_stricmp(pPool->aIdle[i].zOrigin, zOrigin) == 0) {
+            if (iOldestSameOrigin < 0) {
+                iOldestSameOrigin = i;
+            }
+            ++nSameOrigin;
+        }
+    }
+
+    if (nSameOrigin >= HTTP_POOL_MAX_IDLE_PER_HOST) {
+        http_pool_evict(pPool, iOldestSameOrigin);
+    } else if (pPool->nIdle == HTTP_POOL_MAX_IDLE) {
+        http_pool_evict(pPool, 0);
+    }
+
+    pPool->aIdle[pPool->nIdle].curl = curl;
+    pPool->aIdle[pPool->nIdle].zOrigin = zOrigin;
+    pPool->aIdle[pPool->nIdle].tLastUsed = time(NULL);
+    pPool->nIdle++;
+}
+
+// Process-wide share object. When enabled, every easy handle in every pool is
+// attached to it so that the DNS cache, TLS sessions and live connections are
+// shared between database connections and threads. Once created the share is
+// never freed because handles in other connections may still refer to it.
+// The share is created before bEnabled is first set, so handles can be
+// attached without taking the global mutex.
+static struct {
+    CURLSH* share;
+    sqlite3_mutex* aLock[CURL_LOCK_DATA_LAST];
+    int bEnabled;
+    long nMaxConnects;
+} http_share_state;
+
+static void share_lock(CURL* curl, int data, int access, void* userptr) {
+    sqlite3_mutex_enter(http_share_state.aLock[data]);
+}
+
+static void share_unlock(CURL* curl, int data, void* userptr) {
+    sqlite3_mutex_leave(http_share_state.aLock[data]);
+}
+
+static int http_share_create(char** ppErrMsg) {
+    CURLSH* share;
+    int i;
+
+    for (i = 0; i < CURL_LOCK_DATA_LAST; ++i) {
+        if (!http_share_state.aLock[i]) {
+            http_share_state.aLock[i] = sqlite3_mutex_alloc(SQLITE_MUTEX_FAST);
+            if (!http_share_state.aLock[i]) {
+                return SQLITE_NOMEM;
+            }
+        }
+    }
+
+    share = curl_share_init();
+    if (!share) {
+        *ppErrMsg = sqlite3_mprintf("curl_share_init failed");
+        return SQLITE_ERROR;
+    }
+
+    if (curl_share_setopt(share, CURLSHOPT_LOCKFUNC, (curl_lock_function)share_lock) !=
+            CURLSHE_OK ||
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, (curl_unlock_function)share_unlock) !=
+            CURLSHE_OK ||
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS) != CURLSHE_OK ||
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION) != CURLSHE_OK) {
+        curl_share_cleanup(share);
+        *ppErrMsg = sqlite3_mprintf("curl_share_setopt failed");
+        return SQLITE_ERROR;
+    }
+
+    // Connection sharing is available since 7.57.0. Older versions still get
+    // the DNS and TLS session caches.
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+    http_share_state.share = share;
+
+    return SQLITE_OK;
+}
+
+int http_share_configure(int bEnable, int nMaxConnections, char** ppErrMsg) {
+    sqlite3_mutex* mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+    int rc;
+
+    rc = http_backend_init(ppErrMsg);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+
+    sqlite3_mutex_enter(mutex);
+    if (bEnable && !http_share_state.share) {
+        rc = http_share_create(ppErrMsg);
+    }
+    if (rc == SQLITE_OK) {
+        store_release(&http_share_state.nMaxConnects, nMaxConnections > 0 ? nMaxConnections : 0);
+        store_release(&http_share_state.bEnabled, bEnable);
+    }
+    sqlite3_mutex_leave(mutex);
+
+    return rc;
+}
+
+// Attach curl to the share if sharing is enabled, or detach it otherwise.
+// Pooled handles stay attached across curl_easy_reset().
+static CURLcode http_share_attach(CURL* curl) {
+    CURLSH* share = NULL;
+    long nMaxConnects = 0;
+    CURLcode curlrc;
+
+    if (load_acquire(&http_share_state.bEnabled)) {
+        share = http_share_state.share;
+        nMaxConnects = load_acquire(&http_share_state.nMaxConnects);
+    }
+
+    curlrc = curl_easy_setopt(curl, CURLOPT_SHARE, share);
+    if (curlrc == CURLE_OK && nMaxConnects > 0) {
+        curlrc = curl_easy_setopt(curl, CURLOPT_MAXCONNECTS, nMaxConnects);
+    }
+
+    return curlrc;
 }
 
 struct readdata {
@@ -294,185 +773,674 @@ static int set_curl_error_message(char** ppErrMsg, CURLcode rc, const char* mess
     return SQLITE_ERROR;
 }
 
-int http_do_request(http_request* req, http_response* resp, char** ppErrMsg) {
-    int rc;
+// State of a single transfer. Everything curl keeps a pointer to while the
+// transfer is running lives here.
+typedef struct http_transfer http_transfer;
+struct http_transfer {
     CURL* curl;
-    char aErrorBuf[CURL_ERROR_SIZE];
-    curl_version_info_data* pCurlVersionInfo;
-    long responseCode;
-    struct curl_slist* headers = NULL;
-    CURLcode curlrc;
+    char* zOrigin;
+    struct curl_slist* headers;
     struct readdata readdata;
+    http_request* req;
+    http_response* resp;
+    void* pArg;
+    int bNoBody;
+    int bTooLarge;
+    int bCancelled;
+    // Set while the headers are those of an interim response or a redirect,
+    // whose Content-Length is not the length of the body that is kept.
+    int bNotFinal;
+    http_header_parser headerParser;
+    char aErrorBuf[CURL_ERROR_SIZE];
+};
 
-    rc = http_backend_curl_load(ppErrMsg);
-    if (rc != SQLITE_OK) {
-        return rc;
+// Append a chunk of the body, failing the transfer if the body grows past
+// the limit set in the request.
+static size_t write_callback(char* ptr, size_t size, size_t nmemb, void* userdata) {
+    http_transfer* t = (http_transfer*)userdata;
+    http_response* pResp = t->resp;
+    sqlite3_int64 n = (sqlite3_int64)(size * nmemb);
+    if (t->req->szMaxBody > 0 && pResp->szBody + n > t->req->szMaxBody) {
+        t->bTooLarge = 1;
+        return 0;
+    }
+    if (http_response_reserve(pResp, n) != SQLITE_OK) {
+        return 0;
     }
+    memcpy((char*)pResp->pBody + pResp->szBody, ptr, n);
+    pResp->szBody += n;
+    return size * nmemb;
+}
 
-    pCurlVersionInfo = curl_version_info(CURLVERSION_NOW);
+// Called at least once a second while the transfer runs, stalled or not.
+static int xferinfo_callback(void* clientp,
+                             curl_off_t dltotal,
+                             curl_off_t dlnow,
+                             curl_off_t ultotal,
+                             curl_off_t ulnow) {
+    http_transfer* t = (http_transfer*)clientp;
+    t->bCancelled = http_request_cancelled(t->req);
+    return t->bCancelled;
+}
 
-    curl = curl_easy_init();
-    if (!curl) {
+// Used when the body is not needed. The data still has to be read off the
+// connection, but it is not buffered.
+static size_t discard_callback(char* ptr, size_t size, size_t nmemb, void* userdata) {
+    return size * nmemb;
+}
+
+// The headers are parsed as curl hands them over line by line. A header is
+// only complete once the next line has arrived, so every header is seen by the
+// time the empty line ending the headers is. The body buffer is sized up
+// front when the length is known, so that it is allocated once, and bodies
+// that are too large are rejected before any of it is downloaded. The values
+// of the HTTP_META_* headers are located in pResp->zHeaders, which holds the
+// same bytes as the parser's input.
+static int parse_header_callback(http_transfer* t, char* ptr, size_t n) {
+    http_response* pResp = t->resp;
+    const char* zName;
+    int nName;
+    const char* zValue;
+    int nValue;
+    sqlite3_int64 szContent;
+    int rc;
+
+    http_header_parser_feed(&t->headerParser, ptr, (int)n);
+    while ((rc = http_header_parser_next(
+                &t->headerParser, &zName, &nName, &zValue, &nValue)) == SQLITE_ROW) {
+        if (!(t->req->flags & HTTP_REQUEST_NO_HEADERS)) {
+            http_response_capture_header(
+                pResp,
+                zName,
+                nName,
+                t->headerParser.iHeader + (int)((zValue ? zValue : zName) - zName),
+                nValue);
+        }
+        if (t->bNoBody || t->bNotFinal ||
+            !http_header_name_eq(zName, nName, "content-length", 14)) {
+            continue;
+        }
+        if ((szContent = http_parse_content_length(zValue, nValue)) < 0) {
+            continue;
+        }
+        if (t->req->szMaxBody > 0 && szContent > t->req->szMaxBody) {
+            t->bTooLarge = 1;
+            return 0;
+        }
+        if (pResp->szBody == 0 && http_response_reserve(pResp, szContent) != SQLITE_OK) {
+            return 0;
+        }
+    }
+
+    // Malformed headers only mean that the body is not pre-sized.
+    return rc != SQLITE_NOMEM;
+}
+
+// Whether the status line is that of a 1xx response or of a redirect curl may
+// follow. Redirects without a Location header are final, but their body is
+// still not worth sizing up front, write_callback enforces the limit anyway.
+static int status_line_not_final(const char* zLine, size_t n) {
+    const char* zCode = memchr(zLine, ' ', n);
+    if (!zCode || zLine + n - zCode < 4) {
+        return 0;
+    }
+    switch (zCode[1]) {
+    case '1':
+        return 1;
+    case '3':
+        return zCode[2] == '0' && (zCode[3] == '1' || zCode[3] == '2' || zCode[3] == '3' ||
+                                   zCode[3] == '7' || zCode[3] == '8');
+    default:
+        return 0;
+    }
+}
+
+static size_t header_callback(char* ptr, size_t size, size_t nmemb, void* userdata) {
+    http_transfer* t = (http_transfer*)userdata;
+    http_response* pResp = t->resp;
+    size_t n = size * nmemb;
+    char* p;
+
+    // A status line starts a new response. Redirects and interim responses
+    // come before the final one, so throw away whatever was collected so far
+    // and keep only the headers of the last response.
+    if (n >= 5 && memcmp(ptr, "HTTP/", 5) == 0) {
+        http_header_parser_clear(&t->headerParser);
+        t->bNotFinal = status_line_not_final(ptr, n);
+        if (t->req->flags & HTTP_REQUEST_NO_HEADERS) {
+            return n;
+        }
+        while (n > 0 && (ptr[n - 1] == '\r' || ptr[n - 1] == '\n')) {
+            n--;
+        }
+        sqlite3_free(pResp->zStatus);
+        pResp->zStatus = sqlite3_mprintf("%.*s", (int)n, ptr);
+        if (!pResp->zStatus) {
+            return 0;
+        }
+        pResp->szHeaders = 0;
+        if (pResp->zHeaders) {
+            pResp->zHeaders[0] = '\0';
+        }
+        memset(pResp->aMetaOffset, 0, sizeof(pResp->aMetaOffset));
+        return size * nmemb;
+    }
+
+    if (!(t->req->flags & HTTP_REQUEST_NO_HEADERS)) {
+        if (!pResp->zHeaders || sqlite3_msize(pResp->zHeaders) < pResp->szHeaders + n + 1) {
+            p = sqlite3_realloc64(pResp->zHeaders, (pResp->szHeaders + n + 1) * 2);
+            if (!p) {
+                return 0;
+            }
+            pResp->zHeaders = p;
+        }
+        memcpy(pResp->zHeaders + pResp->szHeaders, ptr, n);
+        pResp->szHeaders += n;
+        pResp->zHeaders[pResp->szHeaders] = '\0';
+    } else if (t->bNoBody) {
+        return n;
+    }
+
+    if (!parse_header_callback(t, ptr, n)) {
+        return 0;
+    }
+    return n;
+}
+
+// Take a handle from the pool and configure it for t->req.
+static int transfer_setup(http_pool* pPool, http_transfer* t, char** ppErrMsg) {
+    int rc;
+    CURLcode curlrc;
+
+    t->curl = http_pool_acquire(pPool, t->req->zUrl, &t->zOrigin);
+    if (!t->curl) {
+        t->curl = curl_easy_init();
+    }
+    if (!t->curl) {
         *ppErrMsg = sqlite3_mprintf("curl_easy_init failed");
         rc = SQLITE_ERROR;
         goto error;
     }
 
-    memset(aErrorBuf, 0, sizeof(aErrorBuf));
-    if ((curlrc = curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, aErrorBuf)) != CURLE_OK) {
+    memset(t->aErrorBuf, 0, sizeof(t->aErrorBuf));
+    if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_ERRORBUFFER, t->aErrorBuf)) != CURLE_OK) {
+        rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+        goto error;
+    }
+
+    if ((curlrc = http_share_attach(t->curl)) != CURLE_OK) {
         rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
         goto error;
     }
 
-    if ((curlrc = curl_easy_setopt(curl, CURLOPT_URL, req->zUrl)) != CURLE_OK) {
+    if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_URL, t->req->zUrl)) != CURLE_OK) {
         rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
         goto error;
     }
 
-    if ((curlrc = curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L)) != CURLE_OK) {
+    if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_FOLLOWLOCATION, 1L)) != CURLE_OK) {
         rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
         goto error;
     }
 
-    if (sqlite3_stricmp(req->zMethod, "GET") == 0) {
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L)) != CURLE_OK) {
+    if (sqlite3_stricmp(t->req->zMethod, "GET") == 0) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_HTTPGET, 1L)) != CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
-    } else if (sqlite3_stricmp(req->zMethod, "POST") == 0) {
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_POST, 1L)) != CURLE_OK) {
+    } else if (sqlite3_stricmp(t->req->zMethod, "POST") == 0) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_POST, 1L)) != CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_POSTFIELDS, req->pBody)) != CURLE_OK) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_POSTFIELDS, t->req->pBody)) != CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, req->szBody)) !=
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_POSTFIELDSIZE_LARGE, t->req->szBody)) !=
             CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
-    } else if (sqlite3_stricmp(req->zMethod, "PUT") == 0) {
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_PUT, 1L)) != CURLE_OK) {
+    } else if (sqlite3_stricmp(t->req->zMethod, "PUT") == 0) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_PUT, 1L)) != CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
-    } else if (sqlite3_stricmp(req->zMethod, "HEAD") == 0) {
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_NOBODY, 1L)) != CURLE_OK) {
+    } else if (sqlite3_stricmp(t->req->zMethod, "HEAD") == 0) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_NOBODY, 1L)) != CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
     } else {
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L)) != CURLE_OK) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_HTTPGET, 1L)) != CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
 
-        if (req->pBody && req->szBody) {
-            if ((curlrc = curl_easy_setopt(curl, CURLOPT_PUT, 1L)) != CURLE_OK) {
+        if (t->req->pBody && t->req->szBody) {
+            if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_PUT, 1L)) != CURLE_OK) {
                 rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
                 goto error;
             }
         }
 
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, req->zMethod)) != CURLE_OK) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_CUSTOMREQUEST, t->req->zMethod)) !=
+            CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
     }
 
-    if (req->pBody && req->szBody && sqlite3_stricmp(req->zMethod, "POST") != 0) {
-        readdata.pBody = (const char*)req->pBody;
-        readdata.szBody = (size_t)req->szBody;
+    if (t->req->pBody && t->req->szBody && sqlite3_stricmp(t->req->zMethod, "POST") != 0) {
+        t->readdata.pBody = (const char*)t->req->pBody;
+        t->readdata.szBody = (size_t)t->req->szBody;
 
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, req->szBody)) != CURLE_OK) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_INFILESIZE_LARGE, t->req->szBody)) !=
+            CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
 
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_callback)) != CURLE_OK) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_READFUNCTION, read_callback)) != CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
 
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_READDATA, &readdata)) != CURLE_OK) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_READDATA, &t->readdata)) != CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
     }
 
-    // Since 7.71.0 (Jun 24 2020). Makes life easier on Windows at least.
-    if (pCurlVersionInfo->version_num >= ((7 << 16) | (71 << 8))) {
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_SSL_OPTIONS, CURLSSLOPT_NATIVE_CA)) !=
+    if (curl_caps.bNativeCa) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_SSL_OPTIONS, CURLSSLOPT_NATIVE_CA)) !=
             CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
     }
 
-    if ((curlrc = curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback)) != CURLE_OK) {
+    // HEAD responses announce the length of a body that never comes.
+    t->bNoBody = (t->req->flags & HTTP_REQUEST_NO_BODY) ||
+                 sqlite3_stricmp(t->req->zMethod, "HEAD") == 0;
+
+    if (t->bNoBody) {
+        curlrc = curl_easy_setopt(t->curl, CURLOPT_WRITEFUNCTION, discard_callback);
+    } else {
+        curlrc = curl_easy_setopt(t->curl, CURLOPT_WRITEFUNCTION, write_callback);
+    }
+    if (curlrc != CURLE_OK) {
         rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
         goto error;
     }
 
-    if ((curlrc = curl_easy_setopt(curl, CURLOPT_WRITEDATA, resp)) != CURLE_OK) {
+    if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_WRITEDATA, t)) != CURLE_OK) {
         rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
         goto error;
     }
 
-    if ((curlrc = curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback)) != CURLE_OK) {
-        rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
-        goto error;
+    if (t->req->pbCancel) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_XFERINFOFUNCTION, xferinfo_callback)) !=
+            CURLE_OK) {
+            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+            goto error;
+        }
+
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_XFERINFODATA, t)) != CURLE_OK) {
+            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+            goto error;
+        }
+
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_NOPROGRESS, 0L)) != CURLE_OK) {
+            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+            goto error;
+        }
     }
 
-    if ((curlrc = curl_easy_setopt(curl, CURLOPT_HEADERDATA, resp)) != CURLE_OK) {
-        rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
-        goto error;
+    // Without a header function curl doesn't keep the headers anywhere. The
+    // headers are still looked at for Content-Length when the body is needed.
+    if (!(t->req->flags & HTTP_REQUEST_NO_HEADERS) || !t->bNoBody) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_HEADERFUNCTION, header_callback)) !=
+            CURLE_OK) {
+            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+            goto error;
+        }
+
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_HEADERDATA, t)) != CURLE_OK) {
+            rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
+            goto error;
+        }
     }
 
     // Remove content-type header by default...
-    headers = curl_slist_append(NULL, "content-type;");
-    if (!headers) {
+    t->headers = curl_slist_append(NULL, "content-type;");
+    if (!t->headers) {
         *ppErrMsg = sqlite3_mprintf("curl_slist_append failed");
         rc = SQLITE_ERROR;
         goto error;
     }
 
-    if (req->zHeaders) {
-        if (!headers_to_curl_headers(&headers, req->zHeaders, strlen(req->zHeaders))) {
+    if (t->req->zHeaders) {
+        if (!headers_to_curl_headers(&t->headers, t->req->zHeaders, strlen(t->req->zHeaders))) {
             *ppErrMsg = sqlite3_mprintf("failed to convert headers for curl");
             rc = SQLITE_ERROR;
             goto error;
         }
-        if ((curlrc = curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers)) != CURLE_OK) {
+        if ((curlrc = curl_easy_setopt(t->curl, CURLOPT_HTTPHEADER, t->headers)) != CURLE_OK) {
             rc = set_curl_error_message(ppErrMsg, curlrc, "curl_easy_setopt");
             goto error;
         }
     }
 
-    if (curl_easy_perform(curl) != CURLE_OK) {
-        *ppErrMsg = sqlite3_mprintf("curl_easy_perform failed: %s", aErrorBuf);
-        rc = SQLITE_ERROR;
-        goto error;
+    rc = SQLITE_OK;
+
+error:
+
+    return rc;
+}
+
+// Get a time or size, or -1 if this version of curl does not know it.
+static sqlite3_int64 transfer_info_off_t(CURL* curl, CURLINFO info) {
+    curl_off_t value;
+    return curl_easy_getinfo(curl, info, &value) == CURLE_OK ? value : -1;
+}
+
+static long transfer_info_long(CURL* curl, CURLINFO info) {
+    long value;
+    return curl_easy_getinfo(curl, info, &value) == CURLE_OK ? value : -1;
+}
+
+// Collect the timings and connection details of a finished transfer.
+static int transfer_info(http_transfer* t) {
+    http_response* pResp = t->resp;
+    char* zUrl = NULL;
+
+    pResp->bTransfer = 1;
+    pResp->usDns = transfer_info_off_t(t->curl, CURLINFO_NAMELOOKUP_TIME_T);
+    pResp->usConnect = transfer_info_off_t(t->curl, CURLINFO_CONNECT_TIME_T);
+    pResp->usTls = transfer_info_off_t(t->curl, CURLINFO_APPCONNECT_TIME_T);
+    pResp->usFirstByte = transfer_info_off_t(t->curl, CURLINFO_STARTTRANSFER_TIME_T);
+    pResp->usTotal = transfer_info_off_t(t->curl, CURLINFO_TOTAL_TIME_T);
+    pResp->szUpload = transfer_info_off_t(t->curl, CURLINFO_SIZE_UPLOAD_T);
+    pResp->szDownload = transfer_info_off_t(t->curl, CURLINFO_SIZE_DOWNLOAD_T);
+    pResp->nNewConnections = transfer_info_long(t->curl, CURLINFO_NUM_CONNECTS);
+    pResp->nRedirects = transfer_info_long(t->curl, CURLINFO_REDIRECT_COUNT);
+
+    switch (transfer_info_long(t->curl, CURLINFO_HTTP_VERSION)) {
+    case CURL_HTTP_VERSION_1_0:
+        pResp->iHttpVersion = 10;
+        break;
+    case CURL_HTTP_VERSION_1_1:
+        pResp->iHttpVersion = 11;
+        break;
+    case CURL_HTTP_VERSION_2_0:
+        pResp->iHttpVersion = 20;
+        break;
+    case CURL_HTTP_VERSION_3:
+        pResp->iHttpVersion = 30;
+        break;
+    default:
+        pResp->iHttpVersion = -1;
+        break;
     }
 
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
-    resp->iStatusCode = responseCode;
+    // The URL is only copied when a redirect changed it.
+    sqlite3_free(pResp->zEffectiveUrl);
+    pResp->zEffectiveUrl = NULL;
+    if (curl_easy_getinfo(t->curl, CURLINFO_EFFECTIVE_URL, &zUrl) == CURLE_OK && zUrl &&
+        strcmp(zUrl, t->req->zUrl) != 0) {
+        pResp->zEffectiveUrl = sqlite3_mprintf("%s", zUrl);
+        if (!pResp->zEffectiveUrl) {
+            return SQLITE_NOMEM;
+        }
+    }
 
-    remove_all_but_last_headers(resp->zHeaders);
-    separate_status_and_headers(&resp->zStatus, resp->zHeaders);
+    return SQLITE_OK;
+}
 
-    rc = SQLITE_OK;
+// Collect the results of a finished transfer into t->resp.
+static int transfer_result(http_transfer* t, CURLcode result, char** ppErrMsg) {
+    long responseCode;
 
-error:
+    if (t->bTooLarge) {
+        *ppErrMsg = sqlite3_mprintf("response body exceeds the maximum size of %lld bytes",
+                                    t->req->szMaxBody);
+        return SQLITE_TOOBIG;
+    }
+
+    if (t->bCancelled) {
+        *ppErrMsg = sqlite3_mprintf("request cancelled");
+        return SQLITE_INTERRUPT;
+    }
+
+    if (result != CURLE_OK) {
+        *ppErrMsg = sqlite3_mprintf("curl_easy_perform failed: %s",
+                                    t->aErrorBuf[0] ? t->aErrorBuf : curl_easy_strerror(result));
+        return SQLITE_ERROR;
+    }
+
+    curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &responseCode);
+    t->resp->iStatusCode = responseCode;
+
+    return transfer_info(t);
+}
+
+// Finish a single transfer or one in a batch, and record it in the statistics
+// and the trace.
+static int transfer_finish(http_transfer* t, CURLcode result, char** ppErrMsg) {
+    int rc = transfer_result(t, result, ppErrMsg);
+    sqlite3_int64 usElapsed = transfer_info_off_t(t->curl, CURLINFO_TOTAL_TIME_T);
+    http_stats_record(t->req, t->resp, rc, usElapsed);
+    http_trace_record(t->req, t->resp, rc, *ppErrMsg, usElapsed);
+    return rc;
+}
 
-done:
+// Return the handle of the transfer to the pool.
+static void transfer_cleanup(http_pool* pPool, http_transfer* t) {
+    if (t->curl) {
+        http_pool_release(pPool, t->curl, t->zOrigin);
+    } else {
+        sqlite3_free(t->zOrigin);
+    }
+    curl_slist_free_all(t->headers);
+    http_header_parser_clear(&t->headerParser);
+    t->curl = NULL;
+    t->zOrigin = NULL;
+    t->headers = NULL;
+}
 
-    curl_easy_cleanup(curl);
-    curl_slist_free_all(headers);
+int http_do_request(http_pool* pPool, http_request* req, http_response* resp, char** ppErrMsg) {
+    http_transfer t;
+    int rc;
+
+    rc = http_backend_init(ppErrMsg);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+
+    memset(&t, 0, sizeof(t));
+    t.req = req;
+    t.resp = resp;
+
+    rc = transfer_setup(pPool, &t, ppErrMsg);
+    if (rc == SQLITE_OK) {
+        rc = transfer_finish(&t, curl_easy_perform(t.curl), ppErrMsg);
+    }
+
+    transfer_cleanup(pPool, &t);
 
     return rc;
 }
 
+// Maximum time to block in curl_multi_wait() before checking the transfers
+// again.
+#define HTTP_BATCH_WAIT_MS 1000
+
+// Transfers of a batch are driven by a curl multi handle. At most nConcurrency
+// transfers are running at any time, the rest wait in aTransfer until a slot
+// frees up.
+struct http_batch {
+    http_pool* pPool;
+    CURLM* multi;
+    int nConcurrency;
+    http_transfer** aTransfer;
+    int nTransfer;
+    int nAlloc;
+    int iNextStart;
+    int nRunning;
+};
+
+int http_batch_open(http_pool* pPool, int nConcurrency, http_batch** ppBatch, char** ppErrMsg) {
+    http_batch* pBatch;
+    int rc;
+
+    rc = http_backend_init(ppErrMsg);
+    if (rc != SQLITE_OK) {
+        return rc;
+    }
+
+    pBatch = sqlite3_malloc(sizeof(*pBatch));
+    if (!pBatch) {
+        return SQLITE_NOMEM;
+    }
+    memset(pBatch, 0, sizeof(*pBatch));
+    pBatch->pPool = pPool;
+    pBatch->nConcurrency = nConcurrency > 0 ? nConcurrency : 1;
+    pBatch->multi = curl_multi_init();
+    if (!pBatch->multi) {
+        sqlite3_free(pBatch);
+        *ppErrMsg = sqlite3_mprintf("curl_multi_init failed");
+        return SQLITE_ERROR;
+    }
+
+    *ppBatch = pBatch;
+
+    return SQLITE_OK;
+}
+
+int http_batch_add(http_batch* pBatch, http_request* req, http_response* resp, void* pArg) {
+    http_transfer* t;
+
+    if (pBatch->nTransfer == pBatch->nAlloc) {
+        int nAlloc = pBatch->nAlloc ? pBatch->nAlloc * 2 : 16;
+        http_transfer** aTransfer =
+            sqlite3_realloc(pBatch->aTransfer, sizeof(*aTransfer) * nAlloc);
+        if (!aTransfer) {
+            return SQLITE_NOMEM;
+        }
+        pBatch->aTransfer = aTransfer;
+        pBatch->nAlloc = nAlloc;
+    }
+
+    t = sqlite3_malloc(sizeof(*t));
+    if (!t) {
+        return SQLITE_NOMEM;
+    }
+    memset(t, 0, sizeof(*t));
+    t->req = req;
+    t->resp = resp;
+    t->pArg = pArg;
+
+    pBatch->aTransfer[pBatch->nTransfer++] = t;
+
+    return SQLITE_OK;
+}
+
+// Remove a transfer from the batch. The handle goes back to the pool.
+static void batch_remove(http_batch* pBatch, http_transfer* t) {
+    int i;
+    for (i = 0; i < pBatch->nTransfer; ++i) {
+        if (pBatch->aTransfer[i] == t) {
+            break;
+        }
+    }
+    assert(i < pBatch->nTransfer);
+    if (i < pBatch->iNextStart) {
+        pBatch->iNextStart--;
+    }
+    memmove(&pBatch->aTransfer[i],
+            &pBatch->aTransfer[i + 1],
+            sizeof(pBatch->aTransfer[0]) * (pBatch->nTransfer - i - 1));
+    pBatch->nTransfer--;
+    transfer_cleanup(pBatch->pPool, t);
+    sqlite3_free(t);
+}
+
+int http_batch_next(http_batch* pBatch, void** ppArg, int* pRc, char** ppErrMsg) {
+    CURLMcode mrc;
+    CURLMsg* msg;
+    http_transfer* t;
+    int nQueued;
+    int nRunning;
+
+    *ppErrMsg = NULL;
+
+    for (;;) {
+        // Fill the free slots. A transfer that can't be set up completes
+        // immediately with an error.
+        while (pBatch->nRunning < pBatch->nConcurrency &&
+               pBatch->iNextStart < pBatch->nTransfer) {
+            t = pBatch->aTransfer[pBatch->iNextStart++];
+            *pRc = transfer_setup(pBatch->pPool, t, ppErrMsg);
+            if (*pRc == SQLITE_OK &&
+                (curl_easy_setopt(t->curl, CURLOPT_PRIVATE, t) != CURLE_OK ||
+                 curl_multi_add_handle(pBatch->multi, t->curl) != CURLM_OK)) {
+                *ppErrMsg = sqlite3_mprintf("curl_multi_add_handle failed");
+                *pRc = SQLITE_ERROR;
+            }
+            if (*pRc != SQLITE_OK) {
+                *ppArg = t->pArg;
+                batch_remove(pBatch, t);
+                return SQLITE_ROW;
+            }
+            pBatch->nRunning++;
+        }
+
+        if ((msg = curl_multi_info_read(pBatch->multi, &nQueued)) != NULL) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&t);
+            *pRc = transfer_finish(t, msg->data.result, ppErrMsg);
+            *ppArg = t->pArg;
+            curl_multi_remove_handle(pBatch->multi, t->curl);
+            pBatch->nRunning--;
+            batch_remove(pBatch, t);
+            return SQLITE_ROW;
+        }
+
+        if (pBatch->nRunning == 0) {
+            return SQLITE_DONE;
+        }
+
+        mrc = curl_multi_perform(pBatch->multi, &nRunning);
+        if (mrc == CURLM_OK && nRunning == pBatch->nRunning) {
+            mrc = curl_multi_wait(pBatch->multi, NULL, 0, HTTP_BATCH_WAIT_MS, NULL);
+        }
+        if (mrc != CURLM_OK) {
+            *ppErrMsg = sqlite3_mprintf("curl_multi failed: %s", curl_multi_strerror(mrc));
+            return SQLITE_ERROR;
+        }
+    }
+}
+
+void http_batch_close(http_batch* pBatch) {
+    int i;
+    if (!pBatch) {
+        return;
+    }
+    // Anything still in flight is cancelled.
+    for (i = 0; i < pBatch->iNextStart; ++i) {
+        curl_multi_remove_handle(pBatch->multi, pBatch->aTransfer[i]->curl);
+    }
+    for (i = 0; i < pBatch->nTransfer; ++i) {
+        transfer_cleanup(pBatch->pPool, pBatch->aTransfer[i]);
+        sqlite3_free(pBatch->aTransfer[i]);
+    }
+    curl_multi_cleanup(pBatch->multi);
+    sqlite3_free(pBatch->aTransfer);
+    sqlite3_free(pBatch);
+}
+
 #endif // HTTP_BACKEND_CURL
@@ -6,7 +6,13 @@
 
 SQLITE_EXTENSION_INIT3
 
+struct http_pool {
+    int nRequests;
+};
+
 static http_request sLastRequest;
+static int sShareEnabled;
+static int sShareMaxConnections;
 static http_response* sResponse;
 static char* sErrMsg;
 
@@ -20,6 +26,7 @@ void http_backend_dummy_set_errmsg(const char* zErrMsg) {
 
 void http_backend_dummy_reset_request() {
     sqlite3_free(sLastRequest.zMethod);
+    sqlite3_free(sLastRequest.zUrl);
     sqlite3_free((void*)sLastRequest.pBody);
     sqlite3_free((void*)sLastRequest.zHeaders);
     memset(&sLastRequest, 0, sizeof(sLastRequest));
@@ -29,11 +36,65 @@ const http_request* http_backend_dummy_get_last_request() {
     return &sLastRequest;
 }
 
-int http_do_request(http_request* req, http_response* resp, char** ppErrMsg) {
+int http_backend_init(char** ppErrMsg) {
+    *ppErrMsg = NULL;
+    return SQLITE_OK;
+}
+
+int http_backend_get_info(http_backend_info* pInfo, char** ppErrMsg) {
+    memset(pInfo, 0, sizeof(*pInfo));
+    pInfo->zName = "dummy";
+    pInfo->zVersion = "0";
+    pInfo->bShare = 1;
+    return SQLITE_OK;
+}
+
+int http_pool_open(http_pool** ppPool) {
+    http_pool* pPool = sqlite3_malloc(sizeof(*pPool));
+    if (!pPool) {
+        return SQLITE_NOMEM;
+    }
+    memset(pPool, 0, sizeof(*pPool));
+    *ppPool = pPool;
+    return SQLITE_OK;
+}
+
+void http_pool_close(http_pool* pPool) {
+    sqlite3_free(pPool);
+}
+
+int http_share_configure(int bEnable, int nMaxConnections, char** ppErrMsg) {
+    sShareEnabled = bEnable;
+    sShareMaxConnections = nMaxConnections;
+    return SQLITE_OK;
+}
+
+int http_backend_dummy_get_share(int* pMaxConnections) {
+    *pMaxConnections = sShareMaxConnections;
+    return sShareEnabled;
+}
+
+int http_do_request(http_pool* pPool, http_request* req, http_response* resp, char** ppErrMsg) {
     int rc = SQLITE_OK;
-    if (sResponse) {
+    if (pPool) {
+        pPool->nRequests++;
+    }
+    if (sResponse && req->szMaxBody > 0 && sResponse->szBody > req->szMaxBody) {
+        http_body_unref(sResponse->pBody);
+        sqlite3_free(sResponse->zHeaders);
+        sqlite3_free(sResponse->zStatus);
+        sqlite3_free(sResponse->zEffectiveUrl);
+        sResponse = NULL;
+        *ppErrMsg = sqlite3_mprintf("response body exceeds the maximum size of %lld bytes",
+                                    req->szMaxBody);
+        rc = SQLITE_TOOBIG;
+    } else if (sResponse) {
         *resp = *sResponse;
         sResponse = NULL;
+        if (resp->zHeaders) {
+            memset(resp->aMetaOffset, 0, sizeof(resp->aMetaOffset));
+            http_response_capture_meta(resp, 0, resp->szHeaders);
+        }
     } else if (sErrMsg) {
         *ppErrMsg = sErrMsg;
         sErrMsg = NULL;
@@ -53,9 +114,12 @@ int http_do_request(http_request* req, http_response* resp, char** ppErrMsg) {
         memcpy((void*)sLastRequest.pBody, req->pBody, req->szBody);
     }
     sLastRequest.szBody = req->szBody;
+    sLastRequest.flags = req->flags;
     if (req->zHeaders) {
         sLastRequest.zHeaders = sqlite3_mprintf("%s", req->zHeaders);
     }
+    http_stats_record(req, resp, rc, 0);
+    http_trace_record(req, resp, rc, *ppErrMsg, 0);
     return rc;
 }
 
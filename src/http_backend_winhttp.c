@@ -95,7 +95,58 @@ static int query_headers(HINTERNET request, DWORD dwInfoLevel, char** ppResult)
     return SQLITE_OK;
 }
 
-int http_do_request(http_request* req, http_response* resp, char** ppErrMsg) {
+int http_backend_init(char** ppErrMsg) {
+    *ppErrMsg = NULL;
+    return SQLITE_OK;
+}
+
+int http_backend_get_info(http_backend_info* pInfo, char** ppErrMsg) {
+    memset(pInfo, 0, sizeof(*pInfo));
+    pInfo->zName = "winhttp";
+    return SQLITE_OK;
+}
+
+// A WinHTTP session keeps connections alive between requests, so the pool is
+// simply a session that outlives the individual requests.
+struct http_pool {
+    HINTERNET session;
+};
+
+static HINTERNET open_session() {
+    return WinHttpOpen(L"sqlite3-http",
+                       WINHTTP_ACCESS_TYPE_AUTOMATIC_PROXY,
+                       WINHTTP_NO_PROXY_NAME,
+                       WINHTTP_NO_PROXY_BYPASS,
+                       0);
+}
+
+int http_pool_open(http_pool** ppPool) {
+    http_pool* pPool = sqlite3_malloc(sizeof(*pPool));
+    if (!pPool) {
+        return SQLITE_NOMEM;
+    }
+    memset(pPool, 0, sizeof(*pPool));
+    *ppPool = pPool;
+    return SQLITE_OK;
+}
+
+void http_pool_close(http_pool* pPool) {
+    if (!pPool) {
+        return;
+    }
+    WinHttpCloseHandle(pPool->session);
+    sqlite3_free(pPool);
+}
+
+int http_share_configure(int bEnable, int nMaxConnections, char** ppErrMsg) {
+    if (bEnable) {
+        *ppErrMsg = sqlite3_mprintf("shared cache is not supported by the WinHTTP backend");
+        return SQLITE_ERROR;
+    }
+    return SQLITE_OK;
+}
+
+int http_do_request(http_pool* pPool, http_request* req, http_response* resp, char** ppErrMsg) {
     LPWSTR zUrlWide = NULL;
     LPWSTR zHostWide = NULL;
     LPWSTR zMethodWide = NULL;
@@ -112,6 +163,8 @@ int http_do_request(http_request* req, http_response* resp, char** ppErrMsg) {
     DWORD szWideResponseHeaders = 0;
     DWORD dwSize = 0;
     DWORD dwStatusCode;
+    sqlite3_int64 usStart = http_stats_now();
+    sqlite3_int64 usElapsed;
 
     zUrlWide = utf8_to_unicode(req->zUrl);
     if (!zUrlWide) {
@@ -129,11 +182,11 @@ int http_do_request(http_request* req, http_response* resp, char** ppErrMsg) {
         goto error;
     }
 
-    session = WinHttpOpen(L"sqlite3-http",
-                          WINHTTP_ACCESS_TYPE_AUTOMATIC_PROXY,
-                          WINHTTP_NO_PROXY_NAME,
-                          WINHTTP_NO_PROXY_BYPASS,
-                          0);
+    if (pPool && !pPool->session) {
+        pPool->session = open_session();
+    }
+
+    session = pPool ? pPool->session : open_session();
 
     if (!session) {
         lastErr = GetLastError();
@@ -209,7 +262,13 @@ int http_do_request(http_request* req, http_response* resp, char** ppErrMsg) {
     for (;;) {
         DWORD dwSize = 0;
         DWORD nRead = 0;
-        char* nb;
+        // WinHTTP's own timeouts bound each wait, cancellation is checked in
+        // between.
+        if (http_request_cancelled(req)) {
+            *ppErrMsg = sqlite3_mprintf("request cancelled");
+            rc = SQLITE_INTERRUPT;
+            goto error;
+        }
         if (!WinHttpQueryDataAvailable(request, &dwSize)) {
             lastErr = GetLastError();
             errFunc = "WinHttpQueryDataAvailable";
@@ -218,18 +277,37 @@ int http_do_request(http_request* req, http_response* resp, char** ppErrMsg) {
         if (dwSize == 0) {
             break;
         }
-        nb = sqlite3_realloc(resp->pBody, resp->szBody + dwSize);
-        if (!nb) {
-            rc = SQLITE_NOMEM;
+        if (req->flags & HTTP_REQUEST_NO_BODY) {
+            // Drain the body without keeping it.
+            char aDiscard[4096];
+            DWORD nToRead = dwSize < sizeof(aDiscard) ? dwSize : sizeof(aDiscard);
+            if (!WinHttpReadData(request, aDiscard, nToRead, &nRead)) {
+                lastErr = GetLastError();
+                errFunc = "WinHttpReadData";
+                goto error;
+            }
+            if (nRead == 0) {
+                break;
+            }
+            continue;
+        }
+        if (req->szMaxBody > 0 && resp->szBody + dwSize > req->szMaxBody) {
+            *ppErrMsg = sqlite3_mprintf("response body exceeds the maximum size of %lld bytes",
+                                        req->szMaxBody);
+            rc = SQLITE_TOOBIG;
             goto error;
         }
-        resp->pBody = nb;
+        rc = http_response_reserve(resp, dwSize);
+        if (rc != SQLITE_OK) {
+            goto error;
+        }
+        rc = SQLITE_ERROR;
         if (!WinHttpReadData(request, (char*)resp->pBody + resp->szBody, dwSize, &nRead)) {
             lastErr = GetLastError();
             errFunc = "WinHttpReadData";
             goto error;
         }
-        resp->szBody += dwSize;
+        resp->szBody += nRead;
         if (nRead == 0) {
             break;
         }
@@ -262,6 +340,7 @@ int http_do_request(http_request* req, http_response* resp, char** ppErrMsg) {
 
     remove_all_but_last_headers(resp->zHeaders);
     separate_status_and_headers(&resp->zStatus, resp->zHeaders);
+    http_response_capture_meta(resp, 0, (int)strlen(resp->zHeaders));
 
     rc = SQLITE_OK;
 
@@ -281,7 +360,13 @@ done:
     sqlite3_free(zHeadersWide);
     WinHttpCloseHandle(request);
     WinHttpCloseHandle(conn);
-    WinHttpCloseHandle(session);
+    if (!pPool) {
+        WinHttpCloseHandle(session);
+    }
+
+    usElapsed = http_stats_now() - usStart;
+    http_stats_record(req, resp, rc, usElapsed);
+    http_trace_record(req, resp, rc, *ppErrMsg, usElapsed);
 
     return rc;
 }
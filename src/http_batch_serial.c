@@ -0,0 +1,75 @@
+#ifndef HTTP_BACKEND_CURL
+
+#include "http.h"
+
+#include <string.h>
+
+SQLITE_EXTENSION_INIT3
+
+// Backends without a concurrent interface run the requests of a batch one at
+// a time as they are asked for.
+
+typedef struct http_batch_item http_batch_item;
+struct http_batch_item {
+    http_request* req;
+    http_response* resp;
+    void* pArg;
+};
+
+struct http_batch {
+    http_pool* pPool;
+    http_batch_item* aItem;
+    int nItem;
+    int nAlloc;
+    int iNext;
+};
+
+int http_batch_open(http_pool* pPool, int nConcurrency, http_batch** ppBatch, char** ppErrMsg) {
+    http_batch* pBatch = sqlite3_malloc(sizeof(*pBatch));
+    if (!pBatch) {
+        return SQLITE_NOMEM;
+    }
+    memset(pBatch, 0, sizeof(*pBatch));
+    pBatch->pPool = pPool;
+    *ppBatch = pBatch;
+    return SQLITE_OK;
+}
+
+int http_batch_add(http_batch* pBatch, http_request* req, http_response* resp, void* pArg) {
+    if (pBatch->nItem == pBatch->nAlloc) {
+        int nAlloc = pBatch->nAlloc ? pBatch->nAlloc * 2 : 16;
+        http_batch_item* aItem = sqlite3_realloc(pBatch->aItem, sizeof(*aItem) * nAlloc);
+        if (!aItem) {
+            return SQLITE_NOMEM;
+        }
+        pBatch->aItem = aItem;
+        pBatch->nAlloc = nAlloc;
+    }
+    pBatch->aItem[pBatch->nItem].req = req;
+    pBatch->aItem[pBatch->nItem].resp = resp;
+    pBatch->aItem[pBatch->nItem].pArg = pArg;
+    pBatch->nItem++;
+    return SQLITE_OK;
+}
+
+int http_batch_next(http_batch* pBatch, void** ppArg, int* pRc, char** ppErrMsg) {
+    http_batch_item* pItem;
+    *ppErrMsg = NULL;
+    if (pBatch->iNext == pBatch->nItem) {
+        return SQLITE_DONE;
+    }
+    pItem = &pBatch->aItem[pBatch->iNext++];
+    *pRc = http_do_request(pBatch->pPool, pItem->req, pItem->resp, ppErrMsg);
+    *ppArg = pItem->pArg;
+    return SQLITE_ROW;
+}
+
+void http_batch_close(http_batch* pBatch) {
+    if (!pBatch) {
+        return;
+    }
+    sqlite3_free(pBatch->aItem);
+    sqlite3_free(pBatch);
+}
+
+#endif // HTTP_BACKEND_CURL
@@ -1,17 +1,185 @@
-#include <ctype.h>
-#include <sqlite3.h>
+#include "http.h"
 
-static int is_token_char(int c) {
-    return isalnum(c) || (c != 0 && strchr("!#$%&'*+-.^_`|~", c));
+#include <string.h>
+
+SQLITE_EXTENSION_INIT3
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HTTP_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// AVX2 is not part of the baseline, so it is compiled separately and picked at
+// runtime. This needs the target attribute and __builtin_cpu_supports().
+#if defined(HTTP_HAVE_SSE2) && (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define HTTP_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+// clang-format off
+const unsigned char http_char_class[256] = {
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  2,  0,  0,  0,  0,  0,  0, // 00
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 10
+     2,  5,  4,  5,  5,  5,  5,  5,  4,  4,  5,  5,  4,  5,  5,  4, // 20
+    13, 13, 13, 13, 13, 13, 13, 13, 13, 13,  4,  4,  4,  4,  4,  4, // 30
+     4, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, // 40
+    21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21,  4,  4,  4,  5,  5, // 50
+     5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5, // 60
+     5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  5,  4,  5,  4,  5,  0, // 70
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 80
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 90
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // a0
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // b0
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // c0
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // d0
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // e0
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // f0
+};
+// clang-format on
+
+int http_header_name_eq(const char* zA, int nA, const char* zB, int nB) {
+    int i;
+    if (nA != nB) {
+        return 0;
+    }
+    for (i = 0; i < nA; ++i) {
+        if (http_char_lower(zA[i]) != http_char_lower(zB[i])) {
+            return 0;
+        }
+    }
+    return 1;
 }
 
-static int is_header_ws(int c) {
-    return c == ' ' || c == '\t';
+// Scanning header values dominates the cost of parsing, values such as
+// cookies and policies can be hundreds of bytes long. The scanners below find
+// the CR ending the line and the last visible character before it. Everything
+// else is left to the state machine in http_next_header().
+typedef const char* (*http_scan_value_fn)(const char* p, const char* end, const char** pLast);
+
+static const char* http_scan_value_scalar(const char* p, const char* end, const char** pLast) {
+    for (; p != end && *p != '\r'; ++p) {
+        if (http_char_is(*p, HTTP_CHAR_VCHAR)) {
+            *pLast = p;
+        }
+    }
+    return p;
 }
 
-static int is_vchar(int c) {
-    return c >= 0x21 && c <= 0x7e;
+#ifdef HTTP_HAVE_SSE2
+
+#ifdef _MSC_VER
+#include <intrin.h>
+
+static int lowest_bit(unsigned int x) {
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (int)i;
+}
+
+static int highest_bit(unsigned int x) {
+    unsigned long i;
+    _BitScanReverse(&i, x);
+    return (int)i;
+}
+#else
+static int lowest_bit(unsigned int x) {
+    return __builtin_ctz(x);
+}
+
+static int highest_bit(unsigned int x) {
+    return 31 - __builtin_clz(x);
 }
+#endif
+
+// Given the masks of CRs and visible characters in a block starting at p,
+// update *pLast and return the CR ending the line or NULL if there is none.
+static const char*
+scan_value_block(const char* p, unsigned int crMask, unsigned int vcharMask, const char** pLast) {
+    if (crMask) {
+        // Only the characters before the CR belong to the value.
+        vcharMask &= (crMask & (0u - crMask)) - 1;
+    }
+    if (vcharMask) {
+        *pLast = p + highest_bit(vcharMask);
+    }
+    return crMask ? p + lowest_bit(crMask) : NULL;
+}
+
+static const char* http_scan_value_sse2(const char* p, const char* end, const char** pLast) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lo = _mm_set1_epi8(0x20);
+    const __m128i hi = _mm_set1_epi8(0x7f);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        // Bytes are compared as signed, so 0x80-0xff are not visible.
+        __m128i vchar = _mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi));
+        unsigned int crMask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, cr));
+        unsigned int vcharMask = (unsigned int)_mm_movemask_epi8(vchar);
+        const char* pCR = scan_value_block(p, crMask, vcharMask, pLast);
+        if (pCR) {
+            return pCR;
+        }
+        p += 16;
+    }
+    return http_scan_value_scalar(p, end, pLast);
+}
+
+#endif
+
+#ifdef HTTP_HAVE_AVX2
+
+__attribute__((target("avx2"))) static const char*
+http_scan_value_avx2(const char* p, const char* end, const char** pLast) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lo = _mm256_set1_epi8(0x20);
+    const __m256i hi = _mm256_set1_epi8(0x7f);
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i vchar = _mm256_and_si256(_mm256_cmpgt_epi8(v, lo), _mm256_cmpgt_epi8(hi, v));
+        unsigned int crMask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, cr));
+        unsigned int vcharMask = (unsigned int)_mm256_movemask_epi8(vchar);
+        const char* pCR = scan_value_block(p, crMask, vcharMask, pLast);
+        if (pCR) {
+            return pCR;
+        }
+        p += 32;
+    }
+    return http_scan_value_sse2(p, end, pLast);
+}
+
+#endif
+
+static http_scan_value_fn http_scan_value_select() {
+#ifdef HTTP_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return http_scan_value_avx2;
+    }
+#endif
+#ifdef HTTP_HAVE_SSE2
+    return http_scan_value_sse2;
+#else
+    return http_scan_value_scalar;
+#endif
+}
+
+#ifdef HTTP_HAVE_AVX2
+// Resolved on first use. Racing threads all store the same pointer, and the
+// pointer is accessed atomically so that this is not a data race.
+static http_scan_value_fn http_scan_value_resolved;
+
+static http_scan_value_fn http_scan_value_get() {
+    http_scan_value_fn fn = __atomic_load_n(&http_scan_value_resolved, __ATOMIC_RELAXED);
+    if (!fn) {
+        fn = http_scan_value_select();
+        __atomic_store_n(&http_scan_value_resolved, fn, __ATOMIC_RELAXED);
+    }
+    return fn;
+}
+#else
+// Without AVX2 the scanner is known at compile time.
+#define http_scan_value_get() http_scan_value_select()
+#endif
 
 // Return SQLITE_ROW if a header was extracted
 // Return SQLITE_DONE if headers has been exhausted
@@ -30,6 +198,7 @@ int http_next_header(const char* headers,
     const char* valueEnd = NULL;
     const char* last = NULL;
     const char* p = headers;
+    http_scan_value_fn http_scan_value = http_scan_value_get();
 
     enum {
         StateInit,
@@ -47,8 +216,10 @@ int http_next_header(const char* headers,
 
     *ppName = NULL;
     *pNameSize = 0;
-    *ppValue = NULL;
-    *pValueSize = 0;
+    if (ppValue) {
+        *ppValue = NULL;
+        *pValueSize = 0;
+    }
 
     if (size == 0) {
         *pParsed = 0;
@@ -61,7 +232,7 @@ int http_next_header(const char* headers,
             // printf("StateInit %02x %c\n", *p, isalnum(*p) ? *p : ' ');
             if (*p == '\r') {
                 state = StateCR;
-            } else if (is_header_ws(*p)) {
+            } else if (http_char_is(*p, HTTP_CHAR_WS)) {
                 // There shouldn't be whitespace here. Folding is handled in
                 // StateCR/StateCheckFold.
                 state = StateError;
@@ -73,12 +244,12 @@ int http_next_header(const char* headers,
 
         case StateName:
             // printf("StateName %02x %c\n", *p, isalnum(*p) ? *p : ' ');
-            if (is_token_char(*p)) {
+            if (http_char_is(*p, HTTP_CHAR_TOKEN)) {
                 // accept
             } else if (*p == ':') {
                 nameEnd = p;
                 state = StateValueLeadingWs;
-            } else if (is_header_ws(*p)) {
+            } else if (http_char_is(*p, HTTP_CHAR_WS)) {
                 nameEnd = p;
                 state = StateNameTrailingWs;
             } else {
@@ -88,7 +259,7 @@ int http_next_header(const char* headers,
 
         case StateNameTrailingWs:
             // printf("StateNameTrailingWs %02x %c\n", *p, isalnum(*p) ? *p : ' ');
-            if (is_header_ws(*p)) {
+            if (http_char_is(*p, HTTP_CHAR_WS)) {
                 // accept and skip
             } else if (*p == ':') {
                 state = StateValueLeadingWs;
@@ -99,12 +270,12 @@ int http_next_header(const char* headers,
 
         case StateValueLeadingWs:
             // printf("StateValueLeadingWs %02x %c\n", *p, isalnum(*p) ? *p : ' ');
-            if (is_header_ws(*p)) {
+            if (http_char_is(*p, HTTP_CHAR_WS)) {
                 // accept and skip
             } else if (*p == '\r') {
                 // empty value
                 state = StateCR;
-            } else if (is_vchar(*p)) {
+            } else if (http_char_is(*p, HTTP_CHAR_VCHAR)) {
                 valueStart = p;
                 last = p;
                 state = StateValue;
@@ -115,14 +286,14 @@ int http_next_header(const char* headers,
 
         case StateValue:
             // printf("StateValue %02x %c\n", *p, isalnum(*p) ? *p : ' ');
-            if (is_header_ws(*p)) {
-                // accept but keep separate so that we can track trailing ws
-            } else if (*p == '\r') {
+            // Everything up to the CR is accepted. Track the last visible
+            // character so that trailing ws can be dropped.
+            p = http_scan_value(p, headersEnd, &last);
+            if (p == headersEnd) {
+                --p;
+            } else {
                 valueEnd = last + 1;
                 state = StateCR;
-            } else if (is_vchar(*p)) {
-                // accept
-                last = p;
             }
             break;
 
@@ -142,7 +313,7 @@ int http_next_header(const char* headers,
 
         case StateCheckFold:
             // printf("StateCheckFold %02x %c\n", *p, isalnum(*p) ? *p : ' ');
-            if (is_header_ws(*p)) {
+            if (http_char_is(*p, HTTP_CHAR_WS)) {
                 state = StateValue;
             } else {
                 state = StateDone;
@@ -165,10 +336,161 @@ int http_next_header(const char* headers,
     *ppName = nameStart;
     *pNameSize = nameEnd - nameStart;
 
-    if (valueStart) {
+    if (valueStart && ppValue) {
         *ppValue = valueStart;
         *pValueSize = valueEnd - valueStart;
     }
 
     return SQLITE_ROW;
 }
+
+void http_header_parser_init(http_header_parser* p) {
+    memset(p, 0, sizeof(*p));
+}
+
+void http_header_parser_clear(http_header_parser* p) {
+    sqlite3_free(p->zCarry);
+    http_header_parser_init(p);
+}
+
+void http_header_parser_feed(http_header_parser* p, const char* zData, int nData) {
+    p->zIn = zData;
+    p->nIn = nData;
+    p->iScan = 0;
+}
+
+void http_header_parser_finish(http_header_parser* p) {
+    p->bEof = 1;
+}
+
+static int header_parser_carry(http_header_parser* p, const char* zData, int nData) {
+    if (nData == 0) {
+        return SQLITE_OK;
+    }
+    if (p->nCarry + nData > p->nCarryAlloc) {
+        sqlite3_int64 nAlloc = (sqlite3_int64)(p->nCarry + nData) * 2;
+        char* zCarry = sqlite3_realloc64(p->zCarry, nAlloc < 128 ? 128 : nAlloc);
+        if (!zCarry) {
+            return SQLITE_NOMEM;
+        }
+        p->zCarry = zCarry;
+        p->nCarryAlloc = nAlloc < 128 ? 128 : (int)nAlloc;
+    }
+    memcpy(p->zCarry + p->nCarry, zData, nData);
+    p->nCarry += nData;
+    return SQLITE_OK;
+}
+
+// Find where the pending header ends in the current input, splitting the
+// input exactly where http_next_header() would. A header ends at the first
+// CRLF that is not followed by whitespace, or right after the empty line
+// ending the headers. A bare LF is part of the header it appears in, even at
+// the start of a line. Returns the offset of the end, or -1 if the input runs out first.
+static int header_parser_scan(http_header_parser* p) {
+    const char* z = p->zIn;
+    int i = p->iScan;
+    while (i < p->nIn) {
+        const char* pCR;
+        if (p->bLineEnd) {
+            if (!http_char_is(z[i], HTTP_CHAR_WS)) {
+                return i;
+            }
+            p->bLineEnd = 0;
+        }
+        if (p->bCR) {
+            p->bCR = 0;
+            if (z[i] == '\n') {
+                i++;
+                if (p->nCarry + i == 2) {
+                    return i;
+                }
+                p->bLineEnd = 1;
+                continue;
+            }
+        }
+        pCR = memchr(z + i, '\r', p->nIn - i);
+        if (!pCR) {
+            i = p->nIn;
+            break;
+        }
+        i = pCR - z + 1;
+        p->bCR = 1;
+    }
+    p->iScan = i;
+    return -1;
+}
+
+int http_header_parser_next(http_header_parser* p,
+                            const char** ppName,
+                            int* pNameSize,
+                            const char** ppValue,
+                            int* pValueSize) {
+    const char* zHeader;
+    int nHeader;
+    int nParsed;
+    int iEnd;
+    int rc;
+
+    *ppName = NULL;
+    *pNameSize = 0;
+    if (ppValue) {
+        *ppValue = NULL;
+        *pValueSize = 0;
+    }
+
+    if (p->rc != SQLITE_OK) {
+        return p->rc;
+    }
+
+    iEnd = header_parser_scan(p);
+    if (iEnd < 0) {
+        if (!p->bEof) {
+            // Keep the start of the header until the rest of it arrives.
+            rc = header_parser_carry(p, p->zIn, p->nIn);
+            p->zIn += p->nIn;
+            p->iIn += p->nIn;
+            p->nIn = 0;
+            p->iScan = 0;
+            if (rc != SQLITE_OK) {
+                p->rc = rc;
+            }
+            return rc;
+        }
+        if (p->nCarry + p->nIn == 0) {
+            return SQLITE_DONE;
+        }
+        if (!p->bLineEnd) {
+            p->rc = SQLITE_ERROR;
+            return SQLITE_ERROR;
+        }
+        iEnd = p->nIn;
+    }
+
+    p->iHeader = p->iIn - p->nCarry;
+    if (p->nCarry > 0) {
+        rc = header_parser_carry(p, p->zIn, iEnd);
+        if (rc != SQLITE_OK) {
+            p->rc = rc;
+            return rc;
+        }
+        zHeader = p->zCarry;
+        nHeader = p->nCarry;
+    } else {
+        zHeader = p->zIn;
+        nHeader = iEnd;
+    }
+
+    p->zIn += iEnd;
+    p->nIn -= iEnd;
+    p->iIn += iEnd;
+    p->iScan = 0;
+    p->bLineEnd = 0;
+    p->bCR = 0;
+    p->nCarry = 0;
+
+    rc = http_next_header(zHeader, nHeader, &nParsed, ppName, pNameSize, ppValue, pValueSize);
+    if (rc == SQLITE_ERROR) {
+        p->rc = rc;
+    }
+    return rc;
+}
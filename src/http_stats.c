@@ -0,0 +1,354 @@
+#include "http.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+SQLITE_EXTENSION_INIT3
+
+// Number of shards, a power of two. Threads are spread over the shards by
+// their id, so that concurrent requests rarely wait for the same lock.
+#define HTTP_STATS_SHARDS 16
+
+// Hosts tracked by a single shard. Requests to further hosts are counted under
+// the host "*", so that crawling many hosts does not grow the tables forever.
+#define HTTP_STATS_MAX_HOSTS 1024
+
+typedef struct http_stats_shard http_stats_shard;
+struct http_stats_shard {
+    sqlite3_mutex* mutex;
+    http_stats_host* aHost;
+    int nHost;
+    int nAlloc;
+    // Open addressing hash table of the hosts, 1 + index in aHost or 0 if the
+    // slot is empty. Twice as many slots as hosts can be allocated.
+    int* aSlot;
+    int nSlot;
+};
+
+static http_stats_shard aStatsShard[HTTP_STATS_SHARDS];
+
+int http_stats_init() {
+    sqlite3_mutex* mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP2);
+    int rc = SQLITE_OK;
+    int i;
+
+    sqlite3_mutex_enter(mutex);
+    for (i = 0; i < HTTP_STATS_SHARDS && rc == SQLITE_OK; ++i) {
+        if (!aStatsShard[i].mutex) {
+            aStatsShard[i].mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_FAST);
+            if (!aStatsShard[i].mutex) {
+                rc = SQLITE_NOMEM;
+            }
+        }
+    }
+    sqlite3_mutex_leave(mutex);
+
+    return rc;
+}
+
+sqlite3_int64 http_stats_now() {
+#ifdef _WIN32
+    LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (sqlite3_int64)(now.QuadPart / freq.QuadPart * 1000000 +
+                           now.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (sqlite3_int64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static http_stats_shard* stats_shard() {
+#ifdef _WIN32
+    uint64_t id = GetCurrentThreadId();
+#else
+    uint64_t id = (uint64_t)(uintptr_t)pthread_self();
+#endif
+    return &aStatsShard[(id * 0x9e3779b97f4a7c15ull) >> 60 & (HTTP_STATS_SHARDS - 1)];
+}
+
+// Find the host part of a URL, without the user info and path.
+static int url_host(const char* zUrl, const char** pzHost) {
+    const char* zHost = strstr(zUrl, "://");
+    const char* zAt;
+    int nHost;
+    zHost = zHost ? zHost + 3 : zUrl;
+    nHost = (int)strcspn(zHost, "/?#");
+    while ((zAt = memchr(zHost, '@', nHost)) != NULL) {
+        nHost -= (int)(zAt + 1 - zHost);
+        zHost = zAt + 1;
+    }
+    *pzHost = zHost;
+    return nHost;
+}
+
+// Hosts are stored lowercase, names differing in case are the same host.
+static unsigned int stats_hash(const char* zHost, int nHost) {
+    unsigned int h = 2166136261u;
+    int i;
+    for (i = 0; i < nHost; ++i) {
+        h = (h ^ (unsigned char)http_char_lower(zHost[i])) * 16777619u;
+    }
+    return h;
+}
+
+static int* stats_find_slot(http_stats_shard* pShard, const char* zHost, int nHost) {
+    unsigned int i = stats_hash(zHost, nHost) & (pShard->nSlot - 1);
+    for (;; i = (i + 1) & (pShard->nSlot - 1)) {
+        int* pSlot = &pShard->aSlot[i];
+        const char* zName;
+        if (*pSlot == 0) {
+            return pSlot;
+        }
+        zName = pShard->aHost[*pSlot - 1].zHost;
+        if (sqlite3_strnicmp(zName, zHost, nHost) == 0 && zName[nHost] == '\0') {
+            return pSlot;
+        }
+    }
+}
+
+// Make room for one more host, growing the hash table with the array.
+static int stats_grow(http_stats_shard* pShard) {
+    http_stats_host* aHost;
+    int* aSlot;
+    int nAlloc;
+    int i;
+    if (pShard->nHost < pShard->nAlloc) {
+        return SQLITE_OK;
+    }
+    nAlloc = pShard->nAlloc ? pShard->nAlloc * 2 : 8;
+    aHost = sqlite3_realloc64(pShard->aHost, sizeof(*aHost) * nAlloc);
+    if (!aHost) {
+        return SQLITE_NOMEM;
+    }
+    pShard->aHost = aHost;
+    aSlot = sqlite3_malloc64(sizeof(*aSlot) * nAlloc * 2);
+    if (!aSlot) {
+        return SQLITE_NOMEM;
+    }
+    memset(aSlot, 0, sizeof(*aSlot) * nAlloc * 2);
+    sqlite3_free(pShard->aSlot);
+    pShard->aSlot = aSlot;
+    pShard->nSlot = nAlloc * 2;
+    pShard->nAlloc = nAlloc;
+    for (i = 0; i < pShard->nHost; ++i) {
+        const char* zHost = aHost[i].zHost;
+        *stats_find_slot(pShard, zHost, (int)strlen(zHost)) = i + 1;
+    }
+    return SQLITE_OK;
+}
+
+// Find or add the counters of a host. Returns NULL if out of memory.
+static http_stats_host* stats_host(http_stats_shard* pShard, const char* zHost, int nHost) {
+    http_stats_host* pHost;
+    int* pSlot;
+    int i;
+    if (pShard->nSlot > 0) {
+        pSlot = stats_find_slot(pShard, zHost, nHost);
+        if (*pSlot) {
+            return &pShard->aHost[*pSlot - 1];
+        }
+        if (pShard->nHost >= HTTP_STATS_MAX_HOSTS) {
+            zHost = "*";
+            nHost = 1;
+            pSlot = stats_find_slot(pShard, zHost, nHost);
+            if (*pSlot) {
+                return &pShard->aHost[*pSlot - 1];
+            }
+        }
+    }
+    if (stats_grow(pShard) != SQLITE_OK) {
+        return NULL;
+    }
+    pHost = &pShard->aHost[pShard->nHost];
+    memset(pHost, 0, sizeof(*pHost));
+    pHost->zHost = sqlite3_mprintf("%.*s", nHost, zHost);
+    if (!pHost->zHost) {
+        return NULL;
+    }
+    for (i = 0; i < nHost; ++i) {
+        pHost->zHost[i] = http_char_lower(pHost->zHost[i]);
+    }
+    *stats_find_slot(pShard, zHost, nHost) = ++pShard->nHost;
+    return pHost;
+}
+
+static int stats_bucket(sqlite3_int64 usLatency) {
+    int iBucket = 0;
+    while (iBucket < HTTP_STATS_BUCKETS - 1 && usLatency >= http_stats_bucket_limit(iBucket)) {
+        iBucket++;
+    }
+    return iBucket;
+}
+
+void http_stats_record(const http_request* req,
+                       const http_response* resp,
+                       int rc,
+                       sqlite3_int64 usElapsed) {
+    http_stats_shard* pShard = stats_shard();
+    http_stats_host* pHost;
+    const char* zHost;
+    int nHost;
+    sqlite3_int64 usLatency = usElapsed;
+
+    if (!pShard->mutex || !req->zUrl) {
+        return;
+    }
+    if (resp->bTransfer && resp->usTotal >= 0) {
+        usLatency = resp->usTotal;
+    }
+    if (usLatency < 0) {
+        usLatency = 0;
+    }
+    nHost = url_host(req->zUrl, &zHost);
+
+    sqlite3_mutex_enter(pShard->mutex);
+    pHost = stats_host(pShard, zHost, nHost);
+    if (pHost) {
+        pHost->nRequests++;
+        if (rc != SQLITE_OK) {
+            pHost->nFailed++;
+        } else if (resp->iStatusCode >= 500) {
+            pHost->n5xx++;
+        } else if (resp->iStatusCode >= 400) {
+            pHost->n4xx++;
+        }
+        if (resp->bTransfer && resp->szUpload >= 0) {
+            pHost->szSent += resp->szUpload;
+        } else if (rc == SQLITE_OK) {
+            pHost->szSent += req->szBody;
+        }
+        if (resp->bTransfer && resp->szDownload >= 0) {
+            pHost->szReceived += resp->szDownload;
+        } else {
+            pHost->szReceived += resp->szBody;
+        }
+        if (resp->bTransfer && resp->nNewConnections >= 0) {
+            pHost->nNewConnections += resp->nNewConnections;
+            pHost->nReusedConnections += resp->nNewConnections == 0;
+        }
+        pHost->usLatency += usLatency;
+        pHost->aLatency[stats_bucket(usLatency)]++;
+    }
+    sqlite3_mutex_leave(pShard->mutex);
+}
+
+static int compare_hosts(const void* a, const void* b) {
+    return strcmp(((const http_stats_host*)a)->zHost, ((const http_stats_host*)b)->zHost);
+}
+
+// Copy the hosts of every shard, then sort them and merge the counters of the
+// hosts that appear in several shards.
+int http_stats_snapshot(http_stats_host** paHost, int* pnHost) {
+    http_stats_host* aHost = NULL;
+    int nHost = 0;
+    int nAlloc = 0;
+    int rc = SQLITE_OK;
+    int i;
+    int j;
+    int k;
+
+    for (i = 0; i < HTTP_STATS_SHARDS && rc == SQLITE_OK; ++i) {
+        http_stats_shard* pShard = &aStatsShard[i];
+        if (!pShard->mutex) {
+            continue;
+        }
+        sqlite3_mutex_enter(pShard->mutex);
+        for (j = 0; j < pShard->nHost && rc == SQLITE_OK; ++j) {
+            http_stats_host* pTo;
+            if (nHost == nAlloc) {
+                http_stats_host* aNew;
+                nAlloc = nAlloc ? nAlloc * 2 : 16;
+                aNew = sqlite3_realloc64(aHost, sizeof(*aNew) * nAlloc);
+                if (!aNew) {
+                    rc = SQLITE_NOMEM;
+                    break;
+                }
+                aHost = aNew;
+            }
+            pTo = &aHost[nHost];
+            *pTo = pShard->aHost[j];
+            pTo->zHost = sqlite3_mprintf("%s", pTo->zHost);
+            if (!pTo->zHost) {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            nHost++;
+        }
+        sqlite3_mutex_leave(pShard->mutex);
+    }
+
+    if (rc != SQLITE_OK) {
+        http_stats_free(aHost, nHost);
+        return rc;
+    }
+
+    if (nHost > 0) {
+        qsort(aHost, nHost, sizeof(*aHost), compare_hosts);
+        for (i = 0, j = 1; j < nHost; ++j) {
+            http_stats_host* pTo = &aHost[i];
+            http_stats_host* pFrom = &aHost[j];
+            if (strcmp(pTo->zHost, pFrom->zHost) != 0) {
+                aHost[++i] = *pFrom;
+                continue;
+            }
+            pTo->nRequests += pFrom->nRequests;
+            pTo->nFailed += pFrom->nFailed;
+            pTo->n4xx += pFrom->n4xx;
+            pTo->n5xx += pFrom->n5xx;
+            pTo->szSent += pFrom->szSent;
+            pTo->szReceived += pFrom->szReceived;
+            pTo->nNewConnections += pFrom->nNewConnections;
+            pTo->nReusedConnections += pFrom->nReusedConnections;
+            pTo->usLatency += pFrom->usLatency;
+            for (k = 0; k < HTTP_STATS_BUCKETS; ++k) {
+                pTo->aLatency[k] += pFrom->aLatency[k];
+            }
+            sqlite3_free(pFrom->zHost);
+        }
+        nHost = i + 1;
+    }
+    *paHost = aHost;
+    *pnHost = nHost;
+    return SQLITE_OK;
+}
+
+void http_stats_free(http_stats_host* aHost, int nHost) {
+    int i;
+    for (i = 0; i < nHost; ++i) {
+        sqlite3_free(aHost[i].zHost);
+    }
+    sqlite3_free(aHost);
+}
+
+sqlite3_int64 http_stats_bucket_limit(int iBucket) {
+    return (sqlite3_int64)1024 << iBucket;
+}
+
+sqlite3_int64 http_stats_percentile(const http_stats_host* pHost, double q) {
+    sqlite3_int64 nRank = (sqlite3_int64)(q * pHost->nRequests + 0.999999);
+    sqlite3_int64 nSeen = 0;
+    int i;
+    if (pHost->nRequests == 0) {
+        return -1;
+    }
+    for (i = 0; i < HTTP_STATS_BUCKETS - 1; ++i) {
+        nSeen += pHost->aLatency[i];
+        if (nSeen >= nRank) {
+            return http_stats_bucket_limit(i);
+        }
+    }
+    // Slower than the limit of the last bounded bucket, by an unknown amount.
+    return HTTP_STATS_UNBOUNDED;
+}
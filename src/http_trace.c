@@ -0,0 +1,224 @@
+#include "http.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+SQLITE_EXTENSION_INIT3
+
+// Number of entries in the rings of all requests and of slow requests, powers
+// of two. An entry is 256 bytes, so the rings take about 1 MiB.
+#define HTTP_TRACE_ENTRIES 4096
+#define HTTP_TRACE_SLOW_ENTRIES 256
+
+// The rings are shared by all threads without a lock. Writers take the next
+// request id from a counter and claim the entry it maps to by swapping in an
+// even sequence number, then publish it by making the number odd. Readers
+// copy an entry and keep it only if the number is odd and did not change
+// while copying.
+#ifdef _MSC_VER
+#define trace_increment(p) InterlockedIncrement64(p)
+#define trace_load(p) InterlockedOr64((p), 0)
+#define trace_store(p, v) InterlockedExchange64((p), (v))
+#define trace_fence() MemoryBarrier()
+
+static int trace_cas(volatile sqlite3_int64* p, sqlite3_int64 iExpected, sqlite3_int64 iNew) {
+    return InterlockedCompareExchange64(p, iNew, iExpected) == iExpected;
+}
+#else
+#define trace_increment(p) __atomic_add_fetch((p), 1, __ATOMIC_RELAXED)
+#define trace_load(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define trace_store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define trace_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+static int trace_cas(volatile sqlite3_int64* p, sqlite3_int64 iExpected, sqlite3_int64 iNew) {
+    return __atomic_compare_exchange_n(
+        p, &iExpected, iNew, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+#endif
+
+static struct {
+    volatile sqlite3_int64 bEnabled;
+    volatile sqlite3_int64 usSlow;
+    volatile sqlite3_int64 iLastId;
+    volatile sqlite3_int64 iLastSlow;
+    http_trace_entry aEntry[HTTP_TRACE_ENTRIES];
+    http_trace_entry aSlow[HTTP_TRACE_SLOW_ENTRIES];
+} trace = {0, 1000000};
+
+void http_trace_configure(int bEnable, sqlite3_int64 usSlow) {
+    if (usSlow >= 0) {
+        trace_store(&trace.usSlow, usSlow);
+    }
+    trace_store(&trace.bEnabled, bEnable != 0);
+}
+
+int http_trace_enabled() {
+    return trace_load(&trace.bEnabled) != 0;
+}
+
+static sqlite3_int64 trace_wall_clock() {
+#ifdef _WIN32
+    FILETIME ft;
+    ULARGE_INTEGER t;
+    GetSystemTimeAsFileTime(&ft);
+    t.LowPart = ft.dwLowDateTime;
+    t.HighPart = ft.dwHighDateTime;
+    return (sqlite3_int64)((t.QuadPart - 116444736000000000ull) / 10);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (sqlite3_int64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static int trace_timing(const http_response* resp, sqlite3_int64 usTiming) {
+    if (!resp->bTransfer || usTiming < 0 || usTiming > 0x7fffffff) {
+        return -1;
+    }
+    return (int)usTiming;
+}
+
+// Append a text to the entry, truncated to what is left of nLeft bytes.
+static char* trace_append(char* zOut, const char* zText, int* pnLeft) {
+    int nText = zText ? (int)strlen(zText) : 0;
+    if (nText > *pnLeft) {
+        nText = *pnLeft;
+    }
+    memcpy(zOut, zText ? zText : "", nText);
+    zOut[nText] = '\0';
+    *pnLeft -= nText;
+    return zOut + nText + 1;
+}
+
+static void trace_write(http_trace_entry* pEntry, sqlite3_int64 iId, const http_trace_entry* pNew) {
+    sqlite3_int64 iSeq = trace_load(&pEntry->iSeq);
+    // If another writer still has the entry, the ring wrapped around while it
+    // was copying. Dropping this request is cheaper than waiting.
+    if ((iSeq != 0 && (iSeq & 1) == 0) || !trace_cas(&pEntry->iSeq, iSeq, iId * 2)) {
+        return;
+    }
+    trace_fence();
+    memcpy((char*)pEntry + sizeof(pEntry->iSeq),
+           (const char*)pNew + sizeof(pNew->iSeq),
+           sizeof(*pEntry) - sizeof(pEntry->iSeq));
+    trace_store(&pEntry->iSeq, iId * 2 + 1);
+}
+
+void http_trace_record(const http_request* req,
+                       const http_response* resp,
+                       int rc,
+                       const char* zErrMsg,
+                       sqlite3_int64 usElapsed) {
+    http_trace_entry entry;
+    sqlite3_int64 iId;
+    sqlite3_int64 usSlow;
+    int nLeft = HTTP_TRACE_TEXT;
+    char* zText = entry.aText;
+
+    if (!trace_load(&trace.bEnabled)) {
+        return;
+    }
+    if (rc == SQLITE_OK) {
+        zErrMsg = NULL;
+    } else if (!zErrMsg) {
+        zErrMsg = sqlite3_errstr(rc);
+    }
+
+    entry.usTotal = resp->bTransfer && resp->usTotal >= 0 ? resp->usTotal : usElapsed;
+    entry.iStarted = trace_wall_clock() - entry.usTotal;
+    entry.szSent = resp->bTransfer && resp->szUpload >= 0 ? resp->szUpload : req->szBody;
+    entry.szReceived = resp->bTransfer && resp->szDownload >= 0 ? resp->szDownload : resp->szBody;
+    entry.usDns = trace_timing(resp, resp->usDns);
+    entry.usConnect = trace_timing(resp, resp->usConnect);
+    entry.usTls = trace_timing(resp, resp->usTls);
+    entry.usFirstByte = trace_timing(resp, resp->usFirstByte);
+    entry.iStatusCode = zErrMsg ? 0 : resp->iStatusCode;
+    zText = trace_append(zText, req->zMethod, &nLeft);
+    zText = trace_append(zText, req->zUrl, &nLeft);
+    zText = trace_append(zText, zErrMsg, &nLeft);
+    trace_append(zText, req->zSql, &nLeft);
+
+    usSlow = trace_load(&trace.usSlow);
+    entry.bSlow = usSlow > 0 && entry.usTotal >= usSlow;
+
+    iId = trace_increment(&trace.iLastId);
+    trace_write(&trace.aEntry[iId & (HTTP_TRACE_ENTRIES - 1)], iId, &entry);
+    if (entry.bSlow) {
+        // The entry keeps the request id, so that the snapshot can tell the
+        // copies in both rings apart from other requests.
+        sqlite3_int64 iSlot = trace_increment(&trace.iLastSlow);
+        trace_write(&trace.aSlow[iSlot & (HTTP_TRACE_SLOW_ENTRIES - 1)], iId, &entry);
+    }
+}
+
+// Copy the complete entries of a ring to the end of aEntry.
+static int trace_copy(http_trace_entry* aRing, int nRing, http_trace_entry* aEntry) {
+    int nEntry = 0;
+    int i;
+    for (i = 0; i < nRing; ++i) {
+        http_trace_entry* pCopy = &aEntry[nEntry];
+        sqlite3_int64 iSeq = trace_load(&aRing[i].iSeq);
+        if (iSeq == 0 || (iSeq & 1) == 0) {
+            continue;
+        }
+        memcpy(pCopy, &aRing[i], sizeof(*pCopy));
+        trace_fence();
+        if (trace_load(&aRing[i].iSeq) != iSeq) {
+            continue;
+        }
+        pCopy->iSeq = iSeq;
+        nEntry++;
+    }
+    return nEntry;
+}
+
+static int compare_entries(const void* a, const void* b) {
+    sqlite3_int64 iA = ((const http_trace_entry*)a)->iSeq;
+    sqlite3_int64 iB = ((const http_trace_entry*)b)->iSeq;
+    return iA < iB ? -1 : iA > iB;
+}
+
+int http_trace_snapshot(http_trace_entry** paEntry, int* pnEntry) {
+    http_trace_entry* aEntry;
+    int nEntry;
+    int i;
+    int j;
+
+    aEntry =
+        sqlite3_malloc64(sizeof(*aEntry) * (HTTP_TRACE_ENTRIES + HTTP_TRACE_SLOW_ENTRIES));
+    if (!aEntry) {
+        return SQLITE_NOMEM;
+    }
+    nEntry = trace_copy(trace.aEntry, HTTP_TRACE_ENTRIES, aEntry);
+    nEntry += trace_copy(trace.aSlow, HTTP_TRACE_SLOW_ENTRIES, aEntry + nEntry);
+
+    // Slow requests still in the main ring are there twice.
+    qsort(aEntry, nEntry, sizeof(*aEntry), compare_entries);
+    for (i = j = 0; i < nEntry; ++i) {
+        if (j == 0 || aEntry[j - 1].iSeq != aEntry[i].iSeq) {
+            if (i != j) {
+                aEntry[j] = aEntry[i];
+            }
+            j++;
+        }
+    }
+
+    *paEntry = aEntry;
+    *pnEntry = j;
+    return SQLITE_OK;
+}
+
+const char* http_trace_text(const http_trace_entry* pEntry, int iText) {
+    const char* zText = pEntry->aText;
+    int i;
+    for (i = 0; i < iText; ++i) {
+        zText += strlen(zText) + 1;
+    }
+    return zText[0] ? zText : NULL;
+}
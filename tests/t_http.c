@@ -10,6 +10,7 @@ void http_backend_dummy_set_errmsg(const char* zErrMsg);
 void http_backend_dummy_set_response(http_response* response);
 void http_backend_dummy_reset_request();
 const http_request* http_backend_dummy_get_last_request();
+int http_backend_dummy_get_share(int* pMaxConnections);
 
 int sqlite3_http_init(sqlite3*, char**, const sqlite3_api_routines*);
 
@@ -21,8 +22,10 @@ void new_text_response(http_response* response,
     memset(response, 0, sizeof(*response));
     assert(zStatus != NULL);
     if (zBody) {
-        response->pBody = sqlite3_mprintf("%s", zBody);
         response->szBody = strlen(zBody);
+        response->pBody = http_body_realloc(NULL, response->szBody);
+        memcpy(response->pBody, zBody, response->szBody);
+        response->szBodyAlloc = response->szBody;
     }
     if (zHeaders) {
         response->zHeaders = sqlite3_mprintf("%s", zHeaders);
@@ -106,6 +109,153 @@ void test_http_get_request_headers() {
     ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
 }
 
+void test_http_get_unused_columns() {
+    sqlite3_stmt* stmt;
+    http_response response;
+    new_text_response(&response, "hello, world!", "Foo: Bar\r\n\r\n", 200, "HTTP/1.0 200 OK");
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db,
+                                     "select response_status_code from "
+                                     "http_get('http://example.com')",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 0), 200);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+    ASSERT_INT_EQ(http_backend_dummy_get_last_request()->flags,
+                  HTTP_REQUEST_NO_BODY | HTTP_REQUEST_NO_HEADERS);
+
+    new_text_response(&response, "hello, world!", "Foo: Bar\r\n\r\n", 200, "HTTP/1.0 200 OK");
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db,
+                                     "select response_status from http_get('http://example.com')",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+    ASSERT_INT_EQ(http_backend_dummy_get_last_request()->flags, HTTP_REQUEST_NO_BODY);
+
+    new_text_response(&response, "hello, world!", "Foo: Bar\r\n\r\n", 200, "HTTP/1.0 200 OK");
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(
+        sqlite3_prepare_v2(db, "select * from http_get('http://example.com')", -1, &stmt, NULL),
+        SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+    ASSERT_INT_EQ(http_backend_dummy_get_last_request()->flags, 0);
+}
+
+void test_http_get_response_meta() {
+    sqlite3_stmt* stmt;
+    http_response response;
+    new_text_response(&response,
+                      "hello, world!",
+                      "Content-Type: text/plain\r\nContent-Length:  13 \r\nETag: \"x\"\r\n"
+                      "content-type: text/html\r\nContent-Encoding:\r\n\r\n",
+                      200,
+                      "HTTP/1.0 200 OK");
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db,
+                                     "select response_content_type, response_content_length,"
+                                     " response_etag, response_last_modified,"
+                                     " response_content_encoding"
+                                     " from http_get('http://example.com')",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 0), "text/plain");
+    ASSERT_INT_EQ(sqlite3_column_type(stmt, 1), SQLITE_INTEGER);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 1), 13);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 2), "\"x\"");
+    ASSERT_INT_EQ(sqlite3_column_type(stmt, 3), SQLITE_NULL);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 4), "");
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+    // The headers are needed for the values even if they are not read.
+    ASSERT_INT_EQ(http_backend_dummy_get_last_request()->flags, HTTP_REQUEST_NO_BODY);
+
+    new_text_response(&response, NULL, "Content-Length: x\r\n\r\n", 200, "HTTP/1.0 200 OK");
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db,
+                                     "select response_content_length, response_content_type"
+                                     " from http_get('http://example.com')",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_INT_EQ(sqlite3_column_type(stmt, 0), SQLITE_NULL);
+    ASSERT_INT_EQ(sqlite3_column_type(stmt, 1), SQLITE_NULL);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+}
+
+void test_http_get_transfer() {
+    sqlite3_stmt* stmt;
+    http_response response;
+    const char* zSql = "select transfer_dns_us, transfer_connect_us, transfer_tls_us,"
+                       " transfer_first_byte_us, transfer_total_us, transfer_bytes_sent,"
+                       " transfer_bytes_received, transfer_new_connections, transfer_redirects,"
+                       " transfer_effective_url, transfer_http_version"
+                       " from http_get('http://example.com')";
+    int i;
+
+    new_text_response(&response, "hello, world!", "Foo: Bar\r\n\r\n", 200, "HTTP/1.0 200 OK");
+    response.bTransfer = 1;
+    response.usDns = 10;
+    response.usConnect = 20;
+    response.usTls = -1;
+    response.usFirstByte = 40;
+    response.usTotal = 50;
+    response.szUpload = 0;
+    response.szDownload = 13;
+    response.nNewConnections = 1;
+    response.nRedirects = 1;
+    response.iHttpVersion = 20;
+    response.zEffectiveUrl = sqlite3_mprintf("https://example.com/");
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL), SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 0), 10);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 1), 20);
+    ASSERT_INT_EQ(sqlite3_column_type(stmt, 2), SQLITE_NULL);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 3), 40);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 4), 50);
+    ASSERT_INT_EQ(sqlite3_column_type(stmt, 5), SQLITE_INTEGER);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 5), 0);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 6), 13);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 7), 1);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 8), 1);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 9), "https://example.com/");
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 10), "2");
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+
+    // Without redirects the effective URL is the request URL.
+    new_text_response(&response, "hello, world!", "Foo: Bar\r\n\r\n", 200, "HTTP/1.0 200 OK");
+    response.bTransfer = 1;
+    response.iHttpVersion = 11;
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL), SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 9), "http://example.com");
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 10), "1.1");
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+
+    // Nothing is known if the backend does not report the details.
+    new_text_response(&response, "hello, world!", "Foo: Bar\r\n\r\n", 200, "HTTP/1.0 200 OK");
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL), SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    for (i = 0; i < 11; ++i) {
+        ASSERT_INT_EQ(sqlite3_column_type(stmt, i), SQLITE_NULL);
+    }
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+}
+
 void test_http_post() {
     sqlite3_stmt* stmt;
     http_response response;
@@ -206,6 +356,670 @@ void test_http_post_request_body() {
     ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
 }
 
+void test_http_do_body() {
+    sqlite3_stmt* stmt;
+    http_response response;
+    new_text_response(&response, "hello, world!", "Foo: Bar\r\n\r\n", 200, "HTTP/1.0 200 OK");
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db,
+                                     "select http_do_body('PUT', 'http://example.com', "
+                                     "http_headers('Req1', 'Val1'), x'00ff00')",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_INT_EQ(sqlite3_column_type(stmt, 0), SQLITE_BLOB);
+    ASSERT_INT_EQ(sqlite3_column_bytes(stmt, 0), 13);
+    ASSERT_MEM_EQ(sqlite3_column_blob(stmt, 0), "hello, world!", 13);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+    ASSERT_STR_EQ(http_backend_dummy_get_last_request()->zMethod, "PUT");
+    ASSERT_STR_EQ(http_backend_dummy_get_last_request()->zHeaders, "Req1: Val1\r\n");
+    ASSERT_INT_EQ(http_backend_dummy_get_last_request()->szBody, 3);
+    ASSERT_MEM_EQ(http_backend_dummy_get_last_request()->pBody, "\x00\xff\x00", 3);
+}
+
+void test_http_get_headers() {
+    sqlite3_stmt* stmt;
+    http_response response;
+    new_text_response(&response, "hello, world!", "Foo: Bar\r\n\r\n", 200, "HTTP/1.0 200 OK");
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(
+        sqlite3_prepare_v2(db, "select http_get_headers('http://example.com')", -1, &stmt, NULL),
+        SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 0), "Foo: Bar\r\n\r\n");
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+    ASSERT_STR_EQ(http_backend_dummy_get_last_request()->zMethod, "GET");
+    ASSERT_STR_EQ(http_backend_dummy_get_last_request()->zUrl, "http://example.com");
+}
+
+void test_http_headers() {
+    sqlite3_stmt* stmt;
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db,
+                                     "select http_headers_get(http_headers('X-Foo', 'a'), 'x-fOO'),"
+                                     " http_headers_has(http_headers('X-Foo', 'a'), 'X-Fo')",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 0), "a");
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 1), 0);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+}
+
+void test_http_headers_parse() {
+    sqlite3_stmt* stmt;
+    const char* zHeaders = "'Content-Type: text/plain\r\nSet-Cookie: a=1\r\nETag: \"x\"\r\n"
+                           "set-cookie: b=2\r\nEmpty:\r\n\r\n'";
+    char* zSql = sqlite3_mprintf("select http_headers_get(h, 'content-type'),"
+                                 " http_headers_get(h, 'SET-COOKIE'),"
+                                 " http_headers_get(h, 'etag'),"
+                                 " http_headers_get(h, 'empty'),"
+                                 " http_headers_get(h, 'missing'),"
+                                 " http_headers_has(h, 'Etag'),"
+                                 " http_headers_has(h, 'missing'),"
+                                 " typeof(h)"
+                                 " from (select http_headers_parse(%s) as h union all select %s)",
+                                 zHeaders,
+                                 zHeaders);
+    int i;
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL), SQLITE_OK);
+    for (i = 0; i < 2; ++i) {
+        ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+        ASSERT_STR_EQ(sqlite3_column_text(stmt, 0), "text/plain");
+        ASSERT_STR_EQ(sqlite3_column_text(stmt, 1), "a=1");
+        ASSERT_STR_EQ(sqlite3_column_text(stmt, 2), "\"x\"");
+        ASSERT_INT_EQ(sqlite3_column_type(stmt, 3), SQLITE_NULL);
+        ASSERT_INT_EQ(sqlite3_column_type(stmt, 4), SQLITE_NULL);
+        ASSERT_INT_EQ(sqlite3_column_int(stmt, 5), 1);
+        ASSERT_INT_EQ(sqlite3_column_int(stmt, 6), 0);
+        ASSERT_STR_EQ(sqlite3_column_text(stmt, 7), i == 0 ? "blob" : "text");
+    }
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_DONE);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+    sqlite3_free(zSql);
+
+    // Names are stored lowercase, values as they were.
+    zSql = sqlite3_mprintf("select group_concat(name || '=' || ifnull(value, 'null'), ';')"
+                           " from http_headers_each(http_headers_parse(%s))",
+                           zHeaders);
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL), SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 0),
+                  "content-type=text/plain;set-cookie=a=1;etag=\"x\";set-cookie=b=2;empty=null");
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+    sqlite3_free(zSql);
+
+    // Empty values are NULL whether the headers are text or parsed.
+    zSql = sqlite3_mprintf("select typeof(t.value), typeof(p.value),"
+                           " typeof(http_headers_get(%s, 'empty')),"
+                           " typeof(http_headers_get(http_headers_parse(%s), 'empty'))"
+                           " from http_headers_each(%s) t,"
+                           " http_headers_each(http_headers_parse(%s)) p"
+                           " where t.name = 'Empty' and p.name = 'empty'",
+                           zHeaders,
+                           zHeaders,
+                           zHeaders,
+                           zHeaders);
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL), SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 0), "null");
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 1), "null");
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 2), "null");
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 3), "null");
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_DONE);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+    sqlite3_free(zSql);
+
+    ASSERT_INT_EQ(
+        sqlite3_prepare_v2(db, "select http_headers_parse('Foo Bar\r\n\r\n')", -1, &stmt, NULL),
+        SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ERROR);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_ERROR);
+}
+
+void test_http_headers_lookup_many() {
+    sqlite3_stmt* stmt;
+    int i;
+    ASSERT_INT_EQ(
+        sqlite3_exec(db,
+                     "create table log(h text);"
+                     "insert into log values ('A: 1\r\nB: 2\r\nEmpty:\r\n\r\n');"
+                     "insert into log values ('A: 1\r\nB: 2\r\nEmpty:\r\n\r\n');"
+                     "insert into log values ('B: 3\r\nC: 4\r\n\r\n');"
+                     "insert into log values ('A: 5\r\n\r\n');",
+                     NULL,
+                     NULL,
+                     NULL),
+        SQLITE_OK);
+
+    // Every row looks up the same headers several times.
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db,
+                                     "select http_headers_get(h, 'a'), http_headers_get(h, 'b'),"
+                                     " http_headers_get(h, 'c'), http_headers_has(h, 'empty'),"
+                                     " (select group_concat(name || '=' ||"
+                                     "  ifnull(value, 'null'), ';')"
+                                     "  from http_headers_each(h))"
+                                     " from log, (select 1 union all select 2) order by log.rowid",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    for (i = 0; i < 8; ++i) {
+        ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+        if (i < 4) {
+            ASSERT_STR_EQ(sqlite3_column_text(stmt, 0), "1");
+            ASSERT_STR_EQ(sqlite3_column_text(stmt, 1), "2");
+            ASSERT_INT_EQ(sqlite3_column_type(stmt, 2), SQLITE_NULL);
+            ASSERT_INT_EQ(sqlite3_column_int(stmt, 3), 1);
+            ASSERT_STR_EQ(sqlite3_column_text(stmt, 4), "A=1;B=2;Empty=null");
+        } else if (i < 6) {
+            ASSERT_INT_EQ(sqlite3_column_type(stmt, 0), SQLITE_NULL);
+            ASSERT_STR_EQ(sqlite3_column_text(stmt, 1), "3");
+            ASSERT_STR_EQ(sqlite3_column_text(stmt, 2), "4");
+            ASSERT_INT_EQ(sqlite3_column_int(stmt, 3), 0);
+            ASSERT_STR_EQ(sqlite3_column_text(stmt, 4), "B=3;C=4");
+        } else {
+            ASSERT_STR_EQ(sqlite3_column_text(stmt, 0), "5");
+            ASSERT_INT_EQ(sqlite3_column_type(stmt, 1), SQLITE_NULL);
+            ASSERT_STR_EQ(sqlite3_column_text(stmt, 4), "A=5");
+        }
+    }
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_DONE);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+
+    // Headers given as a parameter are indexed once for the whole statement.
+    ASSERT_INT_EQ(
+        sqlite3_prepare_v2(db, "select http_headers_get(?, 'c') from log", -1, &stmt, NULL),
+        SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_bind_text(stmt, 1, "B: 3\r\nC: 4\r\n\r\n", -1, SQLITE_STATIC),
+                  SQLITE_OK);
+    for (i = 0; i < 4; ++i) {
+        ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+        ASSERT_STR_EQ(sqlite3_column_text(stmt, 0), "4");
+    }
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+
+    // Malformed headers are reported every time.
+    for (i = 0; i < 2; ++i) {
+        ASSERT_INT_EQ(
+            sqlite3_prepare_v2(db, "select http_headers_get('Bad Header', 'a')", -1, &stmt, NULL),
+            SQLITE_OK);
+        ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ERROR);
+        ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_ERROR);
+    }
+
+    ASSERT_INT_EQ(sqlite3_exec(db, "drop table log", NULL, NULL, NULL), SQLITE_OK);
+}
+
+void test_http_headers_each_name() {
+    static const struct {
+        const char* zWhere;
+        const char* zResult;
+    } aCase[] = {
+        {"name = 'set-cookie'", "2:Set-Cookie=a=1;4:set-cookie=b=2"},
+        {"name in ('VIA', 'etag', 'missing')", "3:Via=1.1 x;5:ETag=\"x\";7:via=1.1 y"},
+        {"name like 'x-%'", "6:X-Foo=1;8:x-bar=2"},
+        {"name like 'x-_ar'", "8:x-bar=2"},
+        {"name like '%g'", "5:ETag=\"x\""},
+        {"name glob 'x-b*'", "8:x-bar=2"},
+        // Repeated headers are all returned, even those that should not be.
+        {"name = 'content-type'", "1:Content-Type=text/plain;9:Content-Type=text/html"},
+        {"name = 'content-type' and value = 'text/html'", "9:Content-Type=text/html"},
+        {"name = null", NULL},
+    };
+    const char* zHeaders = "'Content-Type: text/plain\r\nSet-Cookie: a=1\r\nVia: 1.1 x\r\n"
+                           "set-cookie: b=2\r\nETag: \"x\"\r\nX-Foo: 1\r\nvia: 1.1 y\r\n"
+                           "x-bar: 2\r\nContent-Type: text/html\r\n\r\n'";
+    sqlite3_stmt* stmt;
+    char* zSql;
+    int i;
+    int j;
+
+    // Every case is also run with the name constraint hidden from the query
+    // planner by a unary +, which must not change the result.
+    for (i = 0; i < (int)(sizeof(aCase) / sizeof(aCase[0])); ++i) {
+        for (j = 0; j < 4; ++j) {
+            zSql = sqlite3_mprintf("select group_concat(rowid || ':' || name || '=' || value, ';')"
+                                   " from http_headers_each(%s%s%s) where %s%s",
+                                   j & 1 ? "" : "http_headers_parse(",
+                                   zHeaders,
+                                   j & 1 ? "" : ")",
+                                   j & 2 ? "+" : "",
+                                   aCase[i].zWhere);
+            ASSERT_INT_EQ(sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL), SQLITE_OK);
+            ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+            if (aCase[i].zResult) {
+                // Parsed headers have lowercase names.
+                char* zExpected = sqlite3_mprintf("%s", aCase[i].zResult);
+                char* z;
+                for (z = zExpected; !(j & 1) && *z; ++z) {
+                    if (*z >= 'A' && *z <= 'Z') {
+                        *z |= 0x20;
+                    }
+                }
+                ASSERT_STR_EQ(sqlite3_column_text(stmt, 0), zExpected);
+                sqlite3_free(zExpected);
+            } else {
+                ASSERT_INT_EQ(sqlite3_column_type(stmt, 0), SQLITE_NULL);
+            }
+            ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+            sqlite3_free(zSql);
+        }
+    }
+}
+
+void test_http_headers_extract() {
+    sqlite3_stmt* stmt;
+    const char* zHeaders = "'Content-Type: text/plain\r\nSet-Cookie: a=1\r\nVia: 1.1 \"x\\y\"\r\n"
+                           "set-cookie: b=2\r\nEmpty:\r\n\r\n'";
+    char* zSql = sqlite3_mprintf("select http_headers_extract(h, 'content-type', 'Set-Cookie',"
+                                 " 'via', 'empty', 'missing', null, 'SET-COOKIE'),"
+                                 " json_extract(http_headers_extract(h, 'set-cookie'),"
+                                 " '$.set-cookie[1]'),"
+                                 " json_valid(http_headers_extract(h, 'via')),"
+                                 " http_headers_extract(h)"
+                                 " from (select http_headers_parse(%s) as h union all select %s)",
+                                 zHeaders,
+                                 zHeaders);
+    int i;
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL), SQLITE_OK);
+    for (i = 0; i < 2; ++i) {
+        ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+        ASSERT_STR_EQ(sqlite3_column_text(stmt, 0),
+                      "{\"content-type\":\"text/plain\",\"Set-Cookie\":[\"a=1\",\"b=2\"],"
+                      "\"via\":\"1.1 \\\"x\\\\y\\\"\",\"empty\":\"\",\"missing\":null}");
+        ASSERT_STR_EQ(sqlite3_column_text(stmt, 1), "b=2");
+        ASSERT_INT_EQ(sqlite3_column_int(stmt, 2), 1);
+        ASSERT_STR_EQ(sqlite3_column_text(stmt, 3), "{}");
+    }
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_DONE);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+    sqlite3_free(zSql);
+
+    // The result is known to be JSON, so it is not quoted again.
+    ASSERT_INT_EQ(
+        sqlite3_prepare_v2(
+            db, "select json_object('h', http_headers_extract('A: 1\r\n', 'a'))", -1, &stmt, NULL),
+        SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 0), "{\"h\":{\"a\":\"1\"}}");
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+
+    ASSERT_INT_EQ(
+        sqlite3_prepare_v2(db, "select http_headers_extract('Bad Header', 'a')", -1, &stmt, NULL),
+        SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ERROR);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_ERROR);
+}
+
+void test_http_get_response() {
+    sqlite3_stmt* stmt;
+    http_response response;
+    new_text_response(
+        &response, "hello, world!", "Foo: Bar\r\nBaz: Qux\r\n\r\n", 200, "HTTP/1.0 200 OK");
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db,
+                                     "select http_response_status(r), "
+                                     "http_response_status_code(r), http_response_headers(r), "
+                                     "http_response_body(r), http_response_header(r, 'baz'), "
+                                     "http_response_header(r, 'missing') from "
+                                     "(select http_get_response('http://example.com') as r)",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 0), "HTTP/1.0 200 OK");
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 1), 200);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 2), "Foo: Bar\r\nBaz: Qux\r\n\r\n");
+    ASSERT_INT_EQ(sqlite3_column_type(stmt, 3), SQLITE_BLOB);
+    ASSERT_MEM_EQ(sqlite3_column_blob(stmt, 3), "hello, world!", 13);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 4), "Qux");
+    ASSERT_NULL(sqlite3_column_text(stmt, 5));
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+    ASSERT_STR_EQ(http_backend_dummy_get_last_request()->zMethod, "GET");
+
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db, "select http_response_body(x'00')", -1, &stmt, NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ERROR);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_ERROR);
+}
+
+void test_http_max_body_size() {
+    sqlite3_stmt* stmt;
+    http_response response;
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db, "select http_max_body_size(5)", -1, &stmt, NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 0), 5);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+
+    new_text_response(&response, "hello, world!", "Foo: Bar\r\n\r\n", 200, "HTTP/1.0 200 OK");
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db,
+                                     "select response_body from http_get('http://example.com')",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_TOOBIG);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_TOOBIG);
+    ASSERT_STR_EQ(sqlite3_errmsg(db), "response body exceeds the maximum size of 5 bytes");
+
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db, "select http_max_body_size(0)", -1, &stmt, NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 0), sqlite3_limit(db, SQLITE_LIMIT_LENGTH, -1));
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+}
+
+void test_http_share() {
+    sqlite3_stmt* stmt;
+    int nMaxConnections;
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db, "select http_share(1, 32)", -1, &stmt, NULL), SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 0), 1);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+    ASSERT_INT_EQ(http_backend_dummy_get_share(&nMaxConnections), 1);
+    ASSERT_INT_EQ(nMaxConnections, 32);
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db, "select http_share(0)", -1, &stmt, NULL), SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 0), 0);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+    ASSERT_INT_EQ(http_backend_dummy_get_share(&nMaxConnections), 0);
+}
+
+void test_http_backend_info() {
+    sqlite3_stmt* stmt;
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db,
+                                     "select value from http_backend_info where name = 'backend'",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 0), "dummy");
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_DONE);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+}
+
+void test_http_get_many() {
+    sqlite3_stmt* stmt;
+    http_response response;
+    new_text_response(&response, "hello, world!", "Foo: Bar\r\n\r\n", 200, "HTTP/1.0 200 OK");
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db,
+                                     "select *, request_method, request_url from "
+                                     "http_get_many(json_array(json_object('method', 'PUT', "
+                                     "'url', 'http://example.com/foo', 'body', 'hello')), 4)",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_INT_EQ(sqlite3_column_count(stmt), 7);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 0), 0);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 1), "HTTP/1.0 200 OK");
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 2), 200);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 3), "Foo: Bar\r\n\r\n");
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 4), "hello, world!");
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 5), "PUT");
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 6), "http://example.com/foo");
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_DONE);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+    ASSERT_INT_EQ(http_backend_dummy_get_last_request()->szBody, 5);
+    ASSERT_MEM_EQ(http_backend_dummy_get_last_request()->pBody, "hello", 5);
+}
+
+void test_http_get_many_error() {
+    sqlite3_stmt* stmt;
+    http_backend_dummy_set_errmsg("connection refused");
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db,
+                                     "select request_index, response_status_code, response_error "
+                                     "from http_get_many('[\"http://example.com\"]')",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 0), 0);
+    ASSERT_NULL(sqlite3_column_text(stmt, 1));
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 2), "connection refused");
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_DONE);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+}
+
+void test_http_stats() {
+    sqlite3_stmt* stmt;
+    http_response response;
+    const char* zMetrics;
+
+    new_text_response(&response, "hello", "Foo: Bar\r\n\r\n", 200, "HTTP/1.0 200 OK");
+    response.bTransfer = 1;
+    response.usTotal = 500;
+    response.szUpload = 0;
+    response.szDownload = 5;
+    response.nNewConnections = 1;
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(sqlite3_exec(db, "select * from http_get('http://stats.example/a')", 0, 0, 0),
+                  SQLITE_OK);
+    new_text_response(&response, "missing", "Foo: Bar\r\n\r\n", 404, "HTTP/1.0 404 Not Found");
+    response.bTransfer = 1;
+    response.usTotal = 3000;
+    response.szUpload = 0;
+    response.szDownload = 7;
+    response.nNewConnections = 0;
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(
+        sqlite3_exec(db, "select * from http_get('http://user@Stats.Example/b')", 0, 0, 0),
+        SQLITE_OK);
+    http_backend_dummy_set_errmsg("connection refused");
+    sqlite3_exec(db, "select * from http_get('http://stats.example/c')", 0, 0, 0);
+
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db,
+                                     "select requests, failed, status_4xx, status_5xx, "
+                                     "bytes_received, connections_new, connections_reused, "
+                                     "latency_p50_us, latency_p99_us "
+                                     "from http_stats where host = 'stats.example'",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 0), 3);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 1), 1);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 2), 1);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 3), 0);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 4), 12);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 5), 1);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 6), 1);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 7), 1024);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 8), 4096);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_DONE);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db, "select http_metrics()", -1, &stmt, NULL), SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    zMetrics = (const char*)sqlite3_column_text(stmt, 0);
+    ASSERT_INT_EQ(strstr(zMetrics, "\nhttp_requests_total{host=\"stats.example\"} 3\n") != NULL,
+                  1);
+    ASSERT_INT_EQ(
+        strstr(zMetrics,
+               "\nhttp_request_errors_total{host=\"stats.example\",class=\"4xx\"} 1\n") != NULL,
+        1);
+    ASSERT_INT_EQ(strstr(zMetrics,
+                         "\nhttp_request_duration_seconds_bucket{host=\"stats.example\","
+                         "le=\"0.001024\"} 2\n") != NULL,
+                  1);
+    ASSERT_INT_EQ(strstr(zMetrics,
+                         "\nhttp_request_duration_seconds_bucket{host=\"stats.example\","
+                         "le=\"+Inf\"} 3\n") != NULL,
+                  1);
+    ASSERT_INT_EQ(
+        strstr(zMetrics, "\nhttp_request_duration_seconds_count{host=\"stats.example\"} 3\n") !=
+            NULL,
+        1);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+
+    // Hosts are counted lowercase, and a percentile slower than the last
+    // bounded bucket is reported as +Inf.
+    new_text_response(&response, "slow", "Foo: Bar\r\n\r\n", 200, "HTTP/1.0 200 OK");
+    response.bTransfer = 1;
+    response.usTotal = http_stats_bucket_limit(HTTP_STATS_BUCKETS - 1);
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(sqlite3_exec(db, "select * from http_get('http://SLOW.stats.example/')", 0, 0, 0),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db,
+                                     "select host, latency_p50_us, typeof(latency_p50_us) "
+                                     "from http_stats where host like 'slow.%'",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 0), "slow.stats.example");
+    ASSERT_INT_EQ(sqlite3_column_double(stmt, 1) > 1e300, 1);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 2), "real");
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_DONE);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+}
+
+void test_http_trace() {
+    sqlite3_stmt* stmt;
+    http_response response;
+    const char* zGet = "select response_status_code from http_get('http://trace.example/a')";
+
+    ASSERT_INT_EQ(sqlite3_exec(db, "select http_trace_enable(1, 100)", 0, 0, 0), SQLITE_OK);
+    new_text_response(&response, "hello", "Foo: Bar\r\n\r\n", 200, "HTTP/1.0 200 OK");
+    response.bTransfer = 1;
+    response.usDns = 10;
+    response.usConnect = -1;
+    response.usTls = -1;
+    response.usFirstByte = -1;
+    response.usTotal = 500000;
+    response.szUpload = 0;
+    response.szDownload = 5;
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(sqlite3_exec(db, zGet, 0, 0, 0), SQLITE_OK);
+    http_backend_dummy_set_errmsg("connection refused");
+    sqlite3_exec(db, "select http_get_body('http://trace.example/b')", 0, 0, 0);
+    ASSERT_INT_EQ(sqlite3_exec(db, "select http_trace_enable(0)", 0, 0, 0), SQLITE_OK);
+    new_text_response(&response, "hello", "Foo: Bar\r\n\r\n", 200, "HTTP/1.0 200 OK");
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(sqlite3_exec(db, "select * from http_get('http://trace.example/c')", 0, 0, 0),
+                  SQLITE_OK);
+
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db,
+                                     "select request_method, request_url, request_sql, "
+                                     "response_status_code, response_error, transfer_dns_us, "
+                                     "transfer_connect_us, transfer_total_us, "
+                                     "transfer_bytes_received, slow "
+                                     "from http_trace() order by id",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 0), "GET");
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 1), "http://trace.example/a");
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 2), zGet);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 3), 200);
+    ASSERT_NULL(sqlite3_column_text(stmt, 4));
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 5), 10);
+    ASSERT_NULL(sqlite3_column_text(stmt, 6));
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 7), 500000);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 8), 5);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 9), 1);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 1), "http://trace.example/b");
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 2), "select http_get_body('http://trace.example/b')");
+    ASSERT_NULL(sqlite3_column_text(stmt, 3));
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 4), "connection refused");
+    ASSERT_NULL(sqlite3_column_text(stmt, 5));
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 9), 0);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_DONE);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+}
+
+void test_http_get_url_in() {
+    sqlite3_stmt* stmt;
+    http_response response;
+    new_text_response(&response, "hello, world!", "Foo: Bar\r\n\r\n", 200, "HTTP/1.0 200 OK");
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db,
+                                     "select request_url, response_status_code from http_get "
+                                     "where request_url in ('http://example.com/a', "
+                                     "'http://example.com/a') and response_status_code = 200",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 0), "http://example.com/a");
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 1), 200);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_DONE);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+    ASSERT_STR_EQ(http_backend_dummy_get_last_request()->zUrl, "http://example.com/a");
+}
+
+void test_http_enqueue() {
+    sqlite3_stmt* stmt;
+    http_response response;
+    sqlite3_int64 iId;
+    new_text_response(&response, "hello, world!", "Foo: Bar\r\n\r\n", 200, "HTTP/1.0 200 OK");
+    http_backend_dummy_set_response(&response);
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db,
+                                     "select http_enqueue('PUT', 'http://example.com/async', "
+                                     "NULL, 'hello')",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    iId = sqlite3_column_int64(stmt, 0);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db, "select http_wait(?, 5000)", -1, &stmt, NULL), SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_bind_int64(stmt, 1, iId), SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 0), 1);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db,
+                                     "select state, response_status_code, response_body, "
+                                     "request_method, request_url from http_results where id = ?",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_bind_int64(stmt, 1, iId), SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 0), "done");
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 1), 200);
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 2), "hello, world!");
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 3), "PUT");
+    ASSERT_STR_EQ(sqlite3_column_text(stmt, 4), "http://example.com/async");
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_DONE);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+    ASSERT_INT_EQ(http_backend_dummy_get_last_request()->szBody, 5);
+    ASSERT_MEM_EQ(http_backend_dummy_get_last_request()->pBody, "hello", 5);
+
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db, "delete from http_results where id = ?", -1, &stmt, NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_bind_int64(stmt, 1, iId), SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_DONE);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db, "select count(*) from http_results", -1, &stmt, NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_INT_EQ(sqlite3_column_int(stmt, 0), 0);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+}
+
 int main(int argc, char const* argv[]) {
     sqlite3_initialize();
     sqlite3_auto_extension((void (*)(void))sqlite3_http_init);
@@ -213,9 +1027,29 @@ int main(int argc, char const* argv[]) {
     test_http_get();
     test_http_get_hidden_columns();
     test_http_get_request_headers();
+    test_http_get_unused_columns();
+    test_http_get_response_meta();
+    test_http_get_transfer();
     test_http_post();
     test_http_post_hidden_columns();
     test_http_post_request_headers();
     test_http_post_request_body();
+    test_http_do_body();
+    test_http_get_headers();
+    test_http_headers();
+    test_http_headers_parse();
+    test_http_headers_lookup_many();
+    test_http_headers_each_name();
+    test_http_headers_extract();
+    test_http_get_response();
+    test_http_max_body_size();
+    test_http_share();
+    test_http_backend_info();
+    test_http_get_many();
+    test_http_get_many_error();
+    test_http_get_url_in();
+    test_http_enqueue();
+    test_http_stats();
+    test_http_trace();
     return 0;
 }
@@ -0,0 +1,288 @@
+#include "http.h"
+
+#include <sqlite3.h>
+
+#include "test.h"
+
+SQLITE_EXTENSION_INIT3
+
+void http_backend_dummy_set_response(http_response* response);
+
+int sqlite3_http_init(sqlite3*, char**, const sqlite3_api_routines*);
+
+// Allocation budgets of the hot paths, measured through a counting allocator
+// installed with SQLITE_CONFIG_MALLOC. Each test prepares a statement once,
+// warms it up and then runs it several times, checking that every run stays
+// within its budget and that the memory outstanding between runs does not
+// grow.
+//
+// The budgets include the allocations of SQLite itself while it steps the
+// statement, and of the dummy backend, which copies the method and URL of the
+// last request. The byte budgets leave some room for the rounding of the
+// underlying allocator. When a change makes a path cheaper, lower its budget
+// so that it stays that way.
+
+static sqlite3_mem_methods sDefaultMem;
+static int sAllocations;
+static int sOutstanding;
+static int sPeak;
+
+static void* count_malloc(int nBytes) {
+    void* p = sDefaultMem.xMalloc(nBytes);
+    if (p) {
+        sAllocations++;
+        sOutstanding += sDefaultMem.xSize(p);
+        if (sOutstanding > sPeak) {
+            sPeak = sOutstanding;
+        }
+    }
+    return p;
+}
+
+static void count_free(void* p) {
+    if (p) {
+        sOutstanding -= sDefaultMem.xSize(p);
+    }
+    sDefaultMem.xFree(p);
+}
+
+static void* count_realloc(void* p, int nBytes) {
+    int nOld = p ? sDefaultMem.xSize(p) : 0;
+    void* pNew = sDefaultMem.xRealloc(p, nBytes);
+    if (pNew) {
+        sAllocations++;
+        sOutstanding += sDefaultMem.xSize(pNew) - nOld;
+        if (sOutstanding > sPeak) {
+            sPeak = sOutstanding;
+        }
+    }
+    return pNew;
+}
+
+static void install_counting_allocator() {
+    sqlite3_mem_methods methods;
+    ASSERT_INT_EQ(sqlite3_config(SQLITE_CONFIG_GETMALLOC, &sDefaultMem), SQLITE_OK);
+    methods = sDefaultMem;
+    methods.xMalloc = count_malloc;
+    methods.xFree = count_free;
+    methods.xRealloc = count_realloc;
+    ASSERT_INT_EQ(sqlite3_config(SQLITE_CONFIG_MALLOC, &methods), SQLITE_OK);
+}
+
+static sqlite3* db;
+
+// Headers of the responses and of the lookups, similar to those of a CDN.
+static const char zHeaders[] =
+    "Date: Mon, 12 Oct 2026 10:00:00 GMT\r\n"
+    "Content-Type: application/json; charset=utf-8\r\n"
+    "Content-Length: 13\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: public, max-age=300\r\n"
+    "ETag: \"5f2b-1a3c\"\r\n"
+    "Server: example\r\n"
+    "Vary: Accept-Encoding\r\n"
+    "X-Cache: HIT\r\n"
+    "Set-Cookie: a=1; Path=/\r\n"
+    "Set-Cookie: b=2; Path=/\r\n"
+    "\r\n";
+
+// Number of measured runs of each statement, after as many warm-up runs.
+#define RUNS 8
+
+typedef struct alloc_usage alloc_usage;
+struct alloc_usage {
+    int nAllocations; // most allocations of a single run
+    int szPeak;       // most bytes allocated at once during a run
+};
+
+static void set_response() {
+    static http_response response;
+    memset(&response, 0, sizeof(response));
+    response.szBody = 13;
+    response.pBody = http_body_realloc(NULL, response.szBody);
+    memcpy(response.pBody, "hello, world!", response.szBody);
+    response.szBodyAlloc = response.szBody;
+    response.zHeaders = sqlite3_mprintf("%s", zHeaders);
+    response.szHeaders = sizeof(zHeaders) - 1;
+    response.iStatusCode = 200;
+    response.zStatus = sqlite3_mprintf("HTTP/1.1 200 OK");
+    http_backend_dummy_set_response(&response);
+}
+
+static void run(sqlite3_stmt* stmt) {
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    }
+    ASSERT_INT_EQ(rc, SQLITE_DONE);
+    ASSERT_INT_EQ(sqlite3_reset(stmt), SQLITE_OK);
+}
+
+// Run the statement and return the usage of its most expensive run. With
+// bRequest set, every run makes one request, whose response is allocated
+// before the run starts and freed by it.
+static alloc_usage measure(const char* zSql, const char* zBind, int bRequest) {
+    sqlite3_stmt* stmt;
+    alloc_usage usage = {0, 0};
+    int szOutstanding = -1;
+    int i;
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL), SQLITE_OK);
+    if (zBind) {
+        ASSERT_INT_EQ(sqlite3_bind_text(stmt, 1, zBind, -1, SQLITE_STATIC), SQLITE_OK);
+    }
+    for (i = 0; i < 2 * RUNS; ++i) {
+        int szBase;
+        if (i >= RUNS) {
+            // Nothing may be left behind by the previous run.
+            if (szOutstanding >= 0) {
+                ASSERT_INT_EQ(sOutstanding, szOutstanding);
+            }
+            szOutstanding = sOutstanding;
+        }
+        if (bRequest) {
+            set_response();
+        }
+        szBase = sOutstanding;
+        sAllocations = 0;
+        sPeak = sOutstanding;
+        run(stmt);
+        if (i >= RUNS) {
+            if (sAllocations > usage.nAllocations) {
+                usage.nAllocations = sAllocations;
+            }
+            if (sPeak - szBase > usage.szPeak) {
+                usage.szPeak = sPeak - szBase;
+            }
+        }
+    }
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+    return usage;
+}
+
+static void run_lookup(const char* zText) {
+    sqlite3_stmt* stmt;
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db, "select http_headers_get(?1, 'etag')", -1, &stmt, NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_bind_text(stmt, 1, zText, -1, SQLITE_STATIC), SQLITE_OK);
+    run(stmt);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+}
+
+void test_http_get_budget() {
+    alloc_usage usage =
+        measure("select response_status_code, response_body from http_get(?1)",
+                "http://budget.example/resource",
+                1);
+    ASSERT_INT_LE(usage.nAllocations, 7);
+    ASSERT_INT_LE(usage.szPeak, 576);
+}
+
+void test_http_get_headers_budget() {
+    alloc_usage usage = measure("select response_headers from http_get(?1, "
+                                "'Accept: application/json\r\nX-Request-Id: 1\r\n')",
+                                "http://budget.example/resource",
+                                1);
+    ASSERT_INT_LE(usage.nAllocations, 10);
+    ASSERT_INT_LE(usage.szPeak, 960);
+}
+
+void test_http_post_budget() {
+    alloc_usage usage =
+        measure("select response_status_code from http_post(?1, null, '{\"key\": \"value\"}')",
+                "http://budget.example/resource",
+                1);
+    ASSERT_INT_LE(usage.nAllocations, 11);
+    ASSERT_INT_LE(usage.szPeak, 608);
+}
+
+void test_http_get_body_budget() {
+    alloc_usage usage = measure("select http_get_body(?1)", "http://budget.example/resource", 1);
+    ASSERT_INT_LE(usage.nAllocations, 2);
+    ASSERT_INT_LE(usage.szPeak, 64);
+}
+
+void test_http_headers_get_budget() {
+    alloc_usage usage = measure("select http_headers_get(?1, 'etag')", zHeaders, 0);
+    ASSERT_INT_LE(usage.nAllocations, 1);
+    ASSERT_INT_LE(usage.szPeak, 64);
+}
+
+void test_http_headers_get_many_budget() {
+    alloc_usage usage = measure("select http_headers_get(?1, 'etag'), "
+                                "http_headers_get(?1, 'x-cache'), "
+                                "http_headers_get(?1, 'set-cookie'), "
+                                "http_headers_has(?1, 'vary')",
+                                zHeaders,
+                                0);
+    ASSERT_INT_LE(usage.nAllocations, 3);
+    ASSERT_INT_LE(usage.szPeak, 128);
+}
+
+void test_http_headers_each_budget() {
+    alloc_usage usage = measure("select name, value from http_headers_each(?1)", zHeaders, 0);
+    ASSERT_INT_LE(usage.nAllocations, 4);
+    ASSERT_INT_LE(usage.szPeak, 384);
+}
+
+// The index of the last headers looked up is kept on the connection, but not
+// the buffers grown for a large text once the headers are small again.
+void test_headers_index_release() {
+    sqlite3_str* pStr = sqlite3_str_new(NULL);
+    char* zLarge;
+    int szOutstanding;
+    int i;
+    run_lookup(zHeaders);
+    szOutstanding = sOutstanding;
+    for (i = 0; i < 1000; ++i) {
+        sqlite3_str_appendf(pStr, "X-Header-%d: %d\r\n", i, i);
+    }
+    sqlite3_str_appendall(pStr, "\r\n");
+    zLarge = sqlite3_str_finish(pStr);
+    run_lookup(zLarge);
+    ASSERT_INT_LE(szOutstanding + 16384, sOutstanding);
+    sqlite3_free(zLarge);
+    run_lookup(zHeaders);
+    ASSERT_INT_LE(sOutstanding, szOutstanding);
+}
+
+// Everything allocated for a connection and its requests must be freed when it
+// is closed. The request is the same as the previous one, so that neither the
+// dummy backend nor http_stats keep more than before.
+void test_connection_leak() {
+    sqlite3* db2;
+    sqlite3_stmt* stmt;
+    int szOutstanding = sOutstanding;
+    ASSERT_INT_EQ(sqlite3_open(":memory:", &db2), SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_http_init(db2, NULL, NULL), SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_prepare_v2(db2,
+                                     "select response_headers, response_body from http_get(?1)",
+                                     -1,
+                                     &stmt,
+                                     NULL),
+                  SQLITE_OK);
+    ASSERT_INT_EQ(
+        sqlite3_bind_text(stmt, 1, "http://budget.example/resource", -1, SQLITE_STATIC),
+        SQLITE_OK);
+    set_response();
+    ASSERT_INT_EQ(sqlite3_step(stmt), SQLITE_ROW);
+    ASSERT_INT_EQ(sqlite3_finalize(stmt), SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_close(db2), SQLITE_OK);
+    ASSERT_INT_EQ(sOutstanding, szOutstanding);
+}
+
+int main(int argc, char const* argv[]) {
+    install_counting_allocator();
+    ASSERT_INT_EQ(sqlite3_initialize(), SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_open(":memory:", &db), SQLITE_OK);
+    ASSERT_INT_EQ(sqlite3_http_init(db, NULL, NULL), SQLITE_OK);
+    test_http_get_budget();
+    test_http_get_headers_budget();
+    test_http_post_budget();
+    test_http_get_body_budget();
+    test_http_headers_get_budget();
+    test_http_headers_get_many_budget();
+    test_http_headers_each_budget();
+    test_headers_index_release();
+    test_connection_leak();
+    ASSERT_INT_EQ(sqlite3_close(db), SQLITE_OK);
+    return 0;
+}
@@ -1,14 +1,10 @@
+#include "http.h"
+
 #include <sqlite3.h>
 
 #include "test.h"
 
-int http_next_header(const char* headers,
-                     int size,
-                     int* pParsed,
-                     const char** ppName,
-                     int* pNameSize,
-                     const char** ppValue,
-                     int* pValueSize);
+SQLITE_EXTENSION_INIT3
 
 void single_header() {
     const char* headers = "Foo: Bar\r\n";
@@ -331,6 +327,258 @@ void folding() {
     ASSERT_INT_EQ(nParsed, strlen(headers));
 }
 
+void long_value() {
+    // Long enough to be scanned in several vector blocks.
+    const char* headers = "Set-Cookie: id=a3fWa; Expires=Thu, 21 Oct 2021 07:28:00 GMT; "
+                          "Secure; HttpOnly; Path=/docs; Domain=example.com\r\nFoo: Bar\r\n";
+    int nParsed;
+    const char* name;
+    int nameSize;
+    const char* value;
+    int valueSize;
+    int rc =
+        http_next_header(headers, strlen(headers), &nParsed, &name, &nameSize, &value, &valueSize);
+    ASSERT_INT_EQ(rc, SQLITE_ROW);
+    ASSERT_INT_EQ(nameSize, 10);
+    ASSERT_MEM_EQ(name, "Set-Cookie", 10);
+    ASSERT_INT_EQ(valueSize, 97);
+    ASSERT_MEM_EQ(value, headers + 12, 97);
+    ASSERT_INT_EQ(nParsed, 111);
+}
+
+void long_value_trailing_ws() {
+    const char* headers = "Foo: 0123456789abcdef0123456789abcdef0123456789abcdef"
+                          "                                  \t    \r\n";
+    int nParsed;
+    const char* name;
+    int nameSize;
+    const char* value;
+    int valueSize;
+    int rc =
+        http_next_header(headers, strlen(headers), &nParsed, &name, &nameSize, &value, &valueSize);
+    ASSERT_INT_EQ(rc, SQLITE_ROW);
+    ASSERT_INT_EQ(nameSize, 3);
+    ASSERT_MEM_EQ(name, "Foo", 3);
+    ASSERT_INT_EQ(valueSize, 48);
+    ASSERT_MEM_EQ(value, "0123456789abcdef0123456789abcdef0123456789abcdef", 48);
+    ASSERT_INT_EQ(nParsed, strlen(headers));
+}
+
+void long_value_non_ascii() {
+    const char* headers = "Foo: caf\xc3\xa9 \xe2\x82\xac 0123456789abcdef0123456789abcdef!\r\n";
+    int nParsed;
+    const char* name;
+    int nameSize;
+    const char* value;
+    int valueSize;
+    int rc =
+        http_next_header(headers, strlen(headers), &nParsed, &name, &nameSize, &value, &valueSize);
+    ASSERT_INT_EQ(rc, SQLITE_ROW);
+    ASSERT_INT_EQ(nameSize, 3);
+    ASSERT_MEM_EQ(name, "Foo", 3);
+    ASSERT_INT_EQ(valueSize, strlen(headers) - 7);
+    ASSERT_MEM_EQ(value, headers + 5, strlen(headers) - 7);
+    ASSERT_INT_EQ(nParsed, strlen(headers));
+}
+
+void long_value_unterminated() {
+    const char* headers = "Foo: 0123456789abcdef0123456789abcdef0123456789abcdef";
+    int nParsed;
+    const char* name;
+    int nameSize;
+    const char* value;
+    int valueSize;
+    int rc =
+        http_next_header(headers, strlen(headers), &nParsed, &name, &nameSize, &value, &valueSize);
+    ASSERT_INT_EQ(rc, SQLITE_ERROR);
+    ASSERT_INT_EQ(nParsed, strlen(headers));
+}
+
+void name_only() {
+    const char* headers = "Foo: Bar\r\n";
+    int nParsed;
+    const char* name;
+    int nameSize;
+    int rc = http_next_header(headers, strlen(headers), &nParsed, &name, &nameSize, NULL, NULL);
+    ASSERT_INT_EQ(rc, SQLITE_ROW);
+    ASSERT_INT_EQ(nameSize, 3);
+    ASSERT_MEM_EQ(name, "Foo", 3);
+    ASSERT_INT_EQ(nParsed, strlen(headers));
+}
+
+void non_ascii_name() {
+    const char* headers = "Caf\xc3\xa9: Bar\r\n";
+    int nParsed;
+    const char* name;
+    int nameSize;
+    const char* value;
+    int valueSize;
+    int rc =
+        http_next_header(headers, strlen(headers), &nParsed, &name, &nameSize, &value, &valueSize);
+    ASSERT_INT_EQ(rc, SQLITE_ERROR);
+}
+
+// Feed the headers in chunks of nChunk bytes and collect what the parser
+// returns as "name=value;" pairs, followed by the final result code.
+static void parse_in_chunks(const char* headers, int nChunk, char* zOut) {
+    http_header_parser parser;
+    int n = strlen(headers);
+    int i = 0;
+    int rc;
+    const char* name;
+    int nameSize;
+    const char* value;
+    int valueSize;
+
+    zOut[0] = '\0';
+    http_header_parser_init(&parser);
+    for (;;) {
+        rc = http_header_parser_next(&parser, &name, &nameSize, &value, &valueSize);
+        if (rc == SQLITE_ROW) {
+            sprintf(zOut + strlen(zOut), "%.*s=%.*s;", nameSize, name, valueSize, value);
+        } else if (rc == SQLITE_OK && i < n) {
+            int nFeed = n - i < nChunk ? n - i : nChunk;
+            http_header_parser_feed(&parser, headers + i, nFeed);
+            i += nFeed;
+        } else if (rc == SQLITE_OK) {
+            http_header_parser_finish(&parser);
+        } else {
+            break;
+        }
+    }
+    sprintf(zOut + strlen(zOut), "%d", rc);
+    http_header_parser_clear(&parser);
+}
+
+void parser_chunks() {
+    const char* headers = "Content-Type: text/plain\r\nX-Folded: a\r\n  b\r\nEmpty:\r\n\r\n";
+    const char* expected = "Content-Type=text/plain;X-Folded=a\r\n  b;Empty=;101";
+    char zOut[256];
+    int nChunk;
+    for (nChunk = 1; nChunk <= strlen(headers); nChunk++) {
+        parse_in_chunks(headers, nChunk, zOut);
+        ASSERT_STR_EQ(zOut, expected);
+    }
+}
+
+void parser_finish() {
+    char zOut[256];
+    int nChunk;
+    for (nChunk = 1; nChunk <= 12; nChunk++) {
+        // Without the empty line the last header is returned at the end of
+        // input, unless it is cut off.
+        parse_in_chunks("Foo: Bar\r\nBaz: 1\r\n", nChunk, zOut);
+        ASSERT_STR_EQ(zOut, "Foo=Bar;Baz=1;101");
+        parse_in_chunks("Foo: Bar\r\nBaz: 1", nChunk, zOut);
+        ASSERT_STR_EQ(zOut, "Foo=Bar;1");
+    }
+}
+
+void parser_malformed() {
+    char zOut[256];
+    int nChunk;
+    for (nChunk = 1; nChunk <= 12; nChunk++) {
+        parse_in_chunks("Foo: Bar\r\n Bad\r\nBaz Qux\r\n\r\n", nChunk, zOut);
+        ASSERT_STR_EQ(zOut, "Foo=Bar\r\n Bad;1");
+    }
+}
+
+// Parse the headers with http_next_header() and collect "name=value@offset;"
+// for each header, followed by the final result code.
+static void parse_whole(const char* headers, char* zOut) {
+    const char* p = headers;
+    int n = strlen(headers);
+    int nParsed;
+    int rc;
+    const char* name;
+    int nameSize;
+    const char* value;
+    int valueSize;
+
+    zOut[0] = '\0';
+    while ((rc = http_next_header(p, n, &nParsed, &name, &nameSize, &value, &valueSize)) ==
+           SQLITE_ROW) {
+        sprintf(zOut + strlen(zOut),
+                "%.*s=%.*s@%d;",
+                nameSize,
+                name,
+                valueSize,
+                value,
+                (int)(name - headers));
+        p += nParsed;
+        n -= nParsed;
+    }
+    sprintf(zOut + strlen(zOut), "%d", rc);
+}
+
+// The same with the parser, feeding the headers in two chunks split at iSplit.
+static void parse_split(const char* headers, int iSplit, char* zOut) {
+    http_header_parser parser;
+    int n = strlen(headers);
+    int nFed = 0;
+    int rc;
+    const char* name;
+    int nameSize;
+    const char* value;
+    int valueSize;
+
+    zOut[0] = '\0';
+    http_header_parser_init(&parser);
+    for (;;) {
+        rc = http_header_parser_next(&parser, &name, &nameSize, &value, &valueSize);
+        if (rc == SQLITE_ROW) {
+            sprintf(zOut + strlen(zOut),
+                    "%.*s=%.*s@%d;",
+                    nameSize,
+                    name,
+                    valueSize,
+                    value,
+                    parser.iHeader);
+        } else if (rc == SQLITE_OK && nFed < n) {
+            int nFeed = nFed < iSplit ? iSplit : n - nFed;
+            http_header_parser_feed(&parser, headers + nFed, nFeed);
+            nFed += nFeed;
+        } else if (rc == SQLITE_OK) {
+            http_header_parser_finish(&parser);
+        } else {
+            break;
+        }
+    }
+    sprintf(zOut + strlen(zOut), "%d", rc);
+    http_header_parser_clear(&parser);
+}
+
+// The parser must split the input exactly like http_next_header(), wherever
+// the chunks end.
+void parser_matches_next_header() {
+    static const char* const aHeaders[] = {
+        "Content-Type: text/plain\r\nX-Folded: a\r\n  b\r\nEmpty:\r\n\r\n",
+        "Bare-LF: continues\nhere\r\nNext: 1\r\n\r\n",
+        "Foo: Bar\r\n\n",
+        "\n",
+        "Foo: Bar\r\n\nBaz: 1\r\n\r\n",
+        "Bare-CR: a\rb\r\nNext: 1\r\n\r\n",
+        "Foo: Bar\r\n Bad\r\nBaz Qux\r\n\r\n",
+        "Foo: Bar\r\nBaz: 1\r\n",
+        "Foo: Bar\r\nBaz: 1",
+        "Foo: Bar\r",
+        " Leading: ws\r\n\r\n",
+        "\r\n",
+        "",
+    };
+    char zExpected[256];
+    char zOut[256];
+    int i;
+    int iSplit;
+    for (i = 0; i < (int)(sizeof(aHeaders) / sizeof(aHeaders[0])); i++) {
+        parse_whole(aHeaders[i], zExpected);
+        for (iSplit = 0; iSplit <= (int)strlen(aHeaders[i]); iSplit++) {
+            parse_split(aHeaders[i], iSplit, zOut);
+            ASSERT_STR_EQ(zOut, zExpected);
+        }
+    }
+}
+
 int main(int argc, char const* argv[]) {
     single_header();
     empty_string();
@@ -349,5 +597,15 @@ int main(int argc, char const* argv[]) {
     value_with_spaces_inside_no_leading_ws();
     trailing_ws_after_name_is_ignored();
     folding();
+    long_value();
+    long_value_trailing_ws();
+    long_value_non_ascii();
+    long_value_unterminated();
+    name_only();
+    non_ascii_name();
+    parser_chunks();
+    parser_finish();
+    parser_malformed();
+    parser_matches_next_header();
     return 0;
 }
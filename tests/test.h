@@ -25,6 +25,25 @@
         }                                                                                          \
     } while (0)
 
+#define ASSERT_INT_LE(X, Y)                                                                        \
+    do {                                                                                           \
+        int xxx = (X);                                                                             \
+        int yyy = (Y);                                                                             \
+        if (xxx > yyy) {                                                                           \
+            fprintf(stderr,                                                                        \
+                    "*** %s ***\n%s is greater than %s\nwhere\n%s is %d\nand\n%s "               \
+                    "is %d\n",                                                                     \
+                    __FUNCTION__,                                                                  \
+                    #X,                                                                            \
+                    #Y,                                                                            \
+                    #X,                                                                            \
+                    xxx,                                                                           \
+                    #Y,                                                                            \
+                    yyy);                                                                          \
+            exit(1);                                                                               \
+        }                                                                                          \
+    } while (0)
+
 #define ASSERT_STR_EQ(X, Y)                                                                        \
     do {                                                                                           \
         const char* xxx = (X);                                                                     \
@@ -56,10 +75,10 @@
                     #X,                                                                            \
                     #Y,                                                                            \
                     #X,                                                                            \
-                    SIZE,                                                                          \
+                    (int)(SIZE),                                                                   \
                     xxx,                                                                           \
                     #Y,                                                                            \
-                    SIZE,                                                                          \
+                    (int)(SIZE),                                                                   \
                     yyy);                                                                          \
             exit(1);                                                                               \
         }                                                                                          \